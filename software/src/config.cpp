@@ -27,6 +27,9 @@
 #include "tools.h"
 #include "tools/string_builder.h"
 
+uint32_t Config::unowned_update_generation = 0;
+std::vector<uint32_t> Config::dirty_owners;
+
 static ConfigRoot nullconf = Config{Config::ConfVariant{}};
 static ConfigRoot confirmconf;
 
@@ -360,6 +363,8 @@ Config::Wrap Config::add()
     children = this->asArray();
 
     children.push_back(std::move(copy));
+    // The prototype has no owner.
+    children.back().set_owner(arr.getOwner());
     this->set_updated(0xFF);
     return Wrap(&children.back());
 }
@@ -495,7 +500,7 @@ int32_t Config::asInt() const
 bool Config::asBool() const
 {
     // Asserts checked in ::get.
-    return *this->get<ConfBool>()->getVal();
+    return this->get<ConfBool>()->getVal();
 }
 
 std::vector<Config> &Config::asArray()
@@ -549,8 +554,31 @@ inline bool Config::update_value<float, Config::ConfFloat>(float value, const ch
     float old_value = conf->getVal();
     conf->setVal(value);
 
-    if (old_value != value)
+    if (old_value != value) {
         this->value.updated = 0xFF;
+        this->notify_updated();
+    }
+
+    return old_value != value;
+}
+
+// ConfBool::getVal does not return a pointer to the value
+// because the value shares its bits with the owner.
+template<>
+inline bool Config::update_value<bool, Config::ConfBool>(bool value, const char *value_type) {
+    // Asserts checked in ::is.
+    if (!this->is<ConfBool>()) {
+        String value_string(value);
+        config_abort_on_type_error("update_value", this, value_type, &value_string);
+    }
+    ConfBool *conf = get<ConfBool>();
+    bool old_value = conf->getVal();
+    conf->setVal(value);
+
+    if (old_value != value) {
+        this->value.updated = 0xFF;
+        this->notify_updated();
+    }
 
     return old_value != value;
 }
@@ -621,6 +649,14 @@ bool Config::updateUint53(uint64_t value)
     return update_value<uint64_t, ConfUint53>(value, "uint64_t");
 }
 
+bool Config::is_float_array() const
+{
+    if (!this->is<Config::ConfArray>())
+        return false;
+
+    return this->value.val.a.getSlot()->variantType == Config::type_id<Config::ConfFloat>();
+}
+
 size_t Config::fillFloatArray(float *arr, size_t elements)
 {
     // Asserts checked in ::fillArray.
@@ -681,46 +717,76 @@ size_t Config::string_length() const
     return Config::apply_visitor(string_length_visitor{}, value);
 }
 
-DynamicJsonDocument Config::to_json(const char *const *keys_to_censor, size_t keys_to_censor_len) const
+size_t Config::serialize_json(char *buf, size_t buf_size, const char *const *keys_to_censor, size_t keys_to_censor_len) const
 {
-    // Asserts checked in ::json_size.
-    DynamicJsonDocument doc(json_size(true));
+    TFJsonSerializer json{buf, buf_size};
+
+    // Asserts checked in ::apply_visitor.
+    Config::apply_visitor(::to_json{&json, nullptr, keys_to_censor, keys_to_censor_len}, value);
+
+    return json.end();
+}
+
+size_t Config::serialize_json_delta(char *buf, size_t buf_size, uint8_t api_backend_flag, const char *const *keys_to_censor, size_t keys_to_censor_len) const
+{
+    char path[CONFIG_DELTA_PATH_MAX_LENGTH];
+    path[0] = '\0';
+    bool path_overflow = false;
+
+    {
+        TFJsonSerializer json{buf, buf_size};
+        json.addArray();
+
+        ::to_json_delta{&json, keys_to_censor, keys_to_censor_len, api_backend_flag, path, 0, &path_overflow}.visit_child(*this, nullptr, 0);
 
-    JsonVariant var;
-    if (is<Config::ConfObject>()) {
-        var = doc.to<JsonObject>();
-    } else if (is<Config::ConfArray>() || is<Config::ConfUnion>()) {
-        var = doc.to<JsonArray>();
-    } else {
-        var = doc.as<JsonVariant>();
+        json.endArray();
+
+        if (!path_overflow)
+            return json.end();
     }
-    Config::apply_visitor(::to_json{var, keys_to_censor, keys_to_censor_len}, value);
-    return doc;
+
+    // At least one updated node is nested too deep to be addressed. Replace the whole config instead.
+    TFJsonSerializer json{buf, buf_size};
+    json.addArray();
+    json.addArray();
+    json.addString("");
+
+    // Asserts checked in ::apply_visitor.
+    Config::apply_visitor(::to_json{&json, nullptr, keys_to_censor, keys_to_censor_len}, value);
+
+    json.endArray();
+    json.endArray();
+
+    return json.end();
 }
 
-void Config::save_to_file(File &file)
+// Serializes into a heap buffer that is exactly as large as required.
+// The string length estimation is usually good enough, so the tree has to be walked only once.
+// If the estimation was too small (for example because strings had to be escaped), serialize a second time.
+static std::unique_ptr<char[]> serialize_json_to_buf(const Config *conf, const char *const *keys_to_censor, size_t keys_to_censor_len, size_t *out_len)
 {
-    // Asserts checked in ::to_json.
-    auto doc = this->to_json(nullptr, 0);
+    size_t buf_len = conf->string_length();
+    auto buf = heap_alloc_array<char>(buf_len + 1); // +1 for NUL-terminator
+    size_t len = conf->serialize_json(buf.get(), buf_len + 1, keys_to_censor, keys_to_censor_len);
+
+    if (len > buf_len) {
+        buf_len = len;
+        buf = heap_alloc_array<char>(buf_len + 1); // +1 for NUL-terminator
+        len = conf->serialize_json(buf.get(), buf_len + 1, keys_to_censor, keys_to_censor_len);
+    }
 
-    if (doc.overflowed()) {
-        auto capacity = doc.capacity();
-        if (capacity == 0) {
-            logger.printfln("JSON doc overflow while writing file %s! Doc capacity is zero but needed %u.", file.name(), json_size(false));
-        } else {
-            logger.printfln("JSON doc overflow while writing file %s! Doc capacity is %u. Truncated doc follows.", file.name(), capacity);
+    *out_len = len;
+    return buf;
+}
 
-            String str;
-            serializeJson(doc, str);
-            char *wbuffer = str.begin();
-            size_t len = str.length();
+void Config::save_to_file(File &file)
+{
+    size_t len;
+    auto buf = serialize_json_to_buf(this, nullptr, 0, &len);
 
-            // Overwrite zero-termination with newline. This is safe because print_plain doen't require termination and the container String is discarded afterwards.
-            wbuffer[len] = '\n';
-            logger.print_plain(wbuffer, len + 1);
-        }
+    if (file.write(reinterpret_cast<const uint8_t *>(buf.get()), len) != len) {
+        logger.printfln("Failed to write %zu bytes to file %s!", len, file.name());
     }
-    serializeJson(doc, file);
 }
 
 void Config::write_to_stream(Print &output)
@@ -730,27 +796,10 @@ void Config::write_to_stream(Print &output)
 
 void Config::write_to_stream_except(Print &output, const char *const *keys_to_censor, size_t keys_to_censor_len)
 {
-    // Asserts checked in ::to_json.
-    auto doc = this->to_json(keys_to_censor, keys_to_censor_len);
-
-    if (doc.overflowed()) {
-        auto capacity = doc.capacity();
-        if (capacity == 0) {
-            logger.printfln("JSON doc overflow while writing to stream! Doc capacity is zero but needed %u.", json_size(false));
-        } else {
-            logger.printfln("JSON doc overflow while writing to stream! Doc capacity is %u. Truncated doc follows.", capacity);
+    size_t len;
+    auto buf = serialize_json_to_buf(this, keys_to_censor, keys_to_censor_len, &len);
 
-            String str;
-            serializeJson(doc, str);
-            char *wbuffer = str.begin();
-            size_t len = str.length();
-
-            // Overwrite zero-termination with newline. This is safe because print_plain doen't require termination and the container String is discarded afterwards.
-            wbuffer[len] = '\n';
-            logger.print_plain(wbuffer, len + 1);
-        }
-    }
-    serializeJson(doc, output);
+    output.write(reinterpret_cast<const uint8_t *>(buf.get()), len);
 }
 
 String Config::to_string() const
@@ -760,63 +809,63 @@ String Config::to_string() const
 
 String Config::to_string_except(const char *const *keys_to_censor, size_t keys_to_censor_len) const
 {
-    // Asserts checked in ::to_json.
-    auto doc = this->to_json(keys_to_censor, keys_to_censor_len);
+    CoolString result;
+    size_t estimated_len = string_length();
 
-    String result;
-    serializeJson(doc, result);
-
-    // Check for overflow after serializing: Allows to print truncated doc.
-    if (doc.overflowed()) {
-        auto capacity = doc.capacity();
-        if (capacity == 0) {
-            logger.printfln("JSON doc overflow while converting to string! Doc capacity is zero but needed %u.", json_size(false));
-        } else {
-            logger.printfln("JSON doc overflow while converting to string! Doc capacity is %u. Truncated doc follows.", capacity);
+    if (!result.reserve(estimated_len)) {
+        logger.printfln("Failed to allocate %zu bytes while converting config to string!", estimated_len + 1);
+        return result;
+    }
 
-            char *wbuffer = result.begin();
-            size_t len = result.length();
+    size_t len = serialize_json(result.begin(), estimated_len + 1, keys_to_censor, keys_to_censor_len);
 
-            // Temporarily overwrite zero-termination with newline, to avoid copying the whole string to add the newline. This is safe because print_plain doesn't require termination.
-            wbuffer[len] = '\n';
-            logger.print_plain(wbuffer, len + 1);
-            wbuffer[len] = 0;
+    // The estimation was too small, for example because strings had to be escaped. Serialize a second time.
+    if (len > estimated_len) {
+        if (!result.reserve(len)) {
+            logger.printfln("Failed to allocate %zu bytes while converting config to string!", len + 1);
+            return CoolString{};
         }
+
+        len = serialize_json(result.begin(), len + 1, keys_to_censor, keys_to_censor_len);
     }
+
+    result.setLength(static_cast<int>(len));
+
     return result;
 }
 
 void Config::to_string_except(const char *const *keys_to_censor, size_t keys_to_censor_len, StringBuilder *sb) const
 {
-    // Asserts checked in ::to_json.
-    auto doc = this->to_json(keys_to_censor, keys_to_censor_len);
     char *ptr = sb->getRemainingPtr();
-    size_t written = serializeJson(doc, ptr, sb->getRemainingLength());
+    size_t remaining = sb->getRemainingLength();
+    size_t written = serialize_json(ptr, remaining + 1 /* NUL-terminator */, keys_to_censor, keys_to_censor_len);
 
-    sb->setLength(sb->getLength() + written);
+    if (written > remaining) {
+        sb->setLength(sb->getCapacity());
 
-    if (doc.overflowed()) {
-        auto capacity = doc.capacity();
-        if (capacity == 0) {
-            logger.printfln("JSON doc overflow while converting to string! Doc capacity is zero but needed %u.", json_size(false));
-        } else {
-            logger.printfln("JSON doc overflow while converting to string! Doc capacity is %u. Truncated doc follows.", capacity);
-            logger.print_plain(ptr, written);
-            logger.print_plain("\n", 1);
-        }
-    }
-
-    if (sb->getRemainingLength() == 0) {
-        logger.printfln("StringBuilder overflow while converting JSON to string! Doc size is %zu. Truncated string follows.", doc.size());
-        logger.print_plain(ptr, written);
+        logger.printfln("StringBuilder overflow while converting JSON to string! Required %zu bytes, but only %zu are left. Truncated string follows.", written, remaining);
+        logger.print_plain(ptr, remaining);
         logger.print_plain("\n", 1);
+        return;
     }
+
+    sb->setLength(sb->getLength() + written);
 }
 
-uint8_t Config::was_updated(uint8_t api_backend_flag) const
+uint8_t Config::was_updated(uint8_t api_backend_flag, uint32_t *nodes_visited) const
 {
     ASSERT_MAIN_THREAD();
-    return (value.updated & api_backend_flag) | Config::apply_visitor(is_updated{api_backend_flag}, value);
+
+    if (nodes_visited != nullptr)
+        ++*nodes_visited;
+
+    uint8_t result = value.updated & api_backend_flag;
+
+    // No need to look at the children if all requested flags are already set.
+    if (result == api_backend_flag)
+        return result;
+
+    return result | Config::apply_visitor(is_updated{api_backend_flag, nodes_visited}, value);
 }
 
 void Config::clear_updated(uint8_t api_backend_flag)
@@ -830,4 +879,33 @@ void Config::set_updated(uint8_t api_backend_flag)
 {
     ASSERT_MAIN_THREAD();
     value.updated |= api_backend_flag;
+
+    if (api_backend_flag != 0)
+        notify_updated();
+}
+
+void Config::notify_updated() const
+{
+    const uint16_t owner = Config::apply_visitor(get_owner{}, value);
+
+    if (owner == 0)
+        ++Config::unowned_update_generation;
+    else
+        Config::mark_owner_dirty(owner);
+}
+
+void Config::mark_owner_dirty(uint16_t owner)
+{
+    const size_t bit = owner - 1u;
+
+    if (bit / 32 >= dirty_owners.size())
+        dirty_owners.resize(bit / 32 + 1);
+
+    dirty_owners[bit / 32] |= 1u << (bit % 32);
+}
+
+void Config::set_owner(uint16_t owner)
+{
+    ASSERT_MAIN_THREAD();
+    Config::apply_visitor(assign_owner{owner}, value);
 }
@@ -92,6 +92,8 @@ struct Config {
         CoolString *getVal();
         const CoolString *getVal() const;
         const Slot *getSlot() const;
+        uint16_t getOwner() const;
+        void setOwner(uint16_t owner);
 
         ConfString(const char *val, uint16_t min, uint16_t max);
         ConfString(const String &val, uint16_t min, uint16_t max);
@@ -126,6 +128,9 @@ struct Config {
 
         void setVal(float f);
 
+        uint16_t getOwner() const;
+        void setOwner(uint16_t owner);
+
         ConfFloat(float val, float min, float max);
         ConfFloat(const ConfFloat &cpy);
         ~ConfFloat();
@@ -152,6 +157,8 @@ struct Config {
         int32_t *getVal();
         const int32_t *getVal() const;
         const Slot *getSlot() const;
+        uint16_t getOwner() const;
+        void setOwner(uint16_t owner);
 
         ConfInt(int32_t val, int32_t min, int32_t max);
         ConfInt(const ConfInt &cpy);
@@ -179,6 +186,8 @@ struct Config {
         uint32_t *getVal();
         const uint32_t *getVal() const;
         const Slot *getSlot() const;
+        uint16_t getOwner() const;
+        void setOwner(uint16_t owner);
 
         ConfUint(uint32_t val, uint32_t min, uint32_t max);
         ConfUint(const ConfUint &cpy);
@@ -206,6 +215,8 @@ struct Config {
         int64_t *getVal();
         const int64_t *getVal() const;
         const Slot *getSlot() const;
+        uint16_t getOwner() const;
+        void setOwner(uint16_t owner);
 
         ConfInt52(int64_t val);
         ConfInt52(const ConfInt52 &cpy);
@@ -233,6 +244,8 @@ struct Config {
         uint64_t *getVal();
         const uint64_t *getVal() const;
         const Slot *getSlot() const;
+        uint16_t getOwner() const;
+        void setOwner(uint16_t owner);
 
         ConfUint53(uint64_t val);
         ConfUint53(const ConfUint53 &cpy);
@@ -245,9 +258,15 @@ struct Config {
     };
 
     struct ConfBool {
-        bool value;
-        bool *getVal();
-        const bool *getVal() const;
+        // Bools have no slot: Bit 0 is the value, the upper 15 bits are the owner, see get_slot_owner().
+        uint16_t bits;
+
+        explicit ConfBool(bool val);
+
+        bool getVal() const;
+        void setVal(bool val);
+        uint16_t getOwner() const;
+        void setOwner(uint16_t owner);
 
         static constexpr const char *variantName = "ConfBool";
     };
@@ -270,6 +289,8 @@ struct Config {
         std::vector<Config> *getVal();
         const std::vector<Config> *getVal() const;
         const Slot *getSlot() const;
+        uint16_t getOwner() const;
+        void setOwner(uint16_t owner);
 
         ConfArray(std::vector<Config> val, const Config *prototype, uint16_t minElements, uint16_t maxElements, int8_t variantType);
         ConfArray(const ConfArray &cpy);
@@ -297,6 +318,8 @@ struct Config {
         const Config *get(const char *s, size_t s_len) const;
         const Slot *getSlot() const;
         Slot *getSlot();
+        uint16_t getOwner() const;
+        void setOwner(uint16_t owner);
 
         ConfObject(std::vector<std::pair<const char *, Config>> &&val);
         ConfObject(const ConfObject &cpy);
@@ -327,6 +350,8 @@ struct Config {
         Config *getVal();
         const Config *getVal() const;
         const Slot *getSlot() const;
+        uint16_t getOwner() const;
+        void setOwner(uint16_t owner);
 
         ConfUnion(const Config &val, uint8_t tag, uint8_t prototypes_len, const ConfUnionPrototypeInternal prototypes[]);
         ConfUnion(const ConfUnion &cpy);
@@ -496,7 +521,21 @@ struct Config {
 
     ConfVariant value;
 
-    uint8_t was_updated(uint8_t api_backend_flag) const;
+    // Dirtiness tracking for the API state update loop:
+    // Nodes of registered states carry an owner ID of their state, see set_owner().
+    // Copies, moves, assignments and new array elements pass the owner on, see conf_variant.cpp.
+    // Updating an owned node only sets the owner's bit in dirty_owners.
+    // Updating a node without owner (empty nodes, nodes not claimed by a state yet)
+    // increments unowned_update_generation, which makes the API check and re-claim all states.
+    static uint32_t unowned_update_generation;
+    static std::vector<uint32_t> dirty_owners;
+
+    static void mark_owner_dirty(uint16_t owner);
+
+    // Sets the owner of all nodes of this config. 0 means no owner.
+    void set_owner(uint16_t owner);
+
+    uint8_t was_updated(uint8_t api_backend_flag, uint32_t *nodes_visited = nullptr) const;
     void clear_updated(uint8_t api_backend_flag);
     void set_updated(uint8_t api_backend_flag);
 
@@ -783,12 +822,16 @@ private:
         T old_value = *target;
         *target = value;
 
-        if (old_value != value)
+        if (old_value != value) {
             this->value.updated = 0xFF;
+            this->notify_updated();
+        }
 
         return old_value != value;
     }
 
+    void notify_updated() const;
+
 public:
     bool clearString();
     bool updateString(const String &value);
@@ -842,9 +885,10 @@ private:
         return toWrite;
     }
 
-    DynamicJsonDocument to_json(const char *const *keys_to_censor, size_t keys_to_censor_len) const;
-
 public:
+    // True if this is an array that can only hold floats.
+    bool is_float_array() const;
+
     size_t fillFloatArray(float *arr, size_t elements);
 
     size_t fillUint8Array(uint8_t *arr, size_t elements);
@@ -859,6 +903,16 @@ public:
     size_t max_string_length() const;
     size_t string_length() const;
 
+    // Serializes directly into buf without building an intermediate JSON document.
+    // Returns the length required to serialize the whole tree (excluding the NUL-terminator),
+    // which can be larger than buf_size - 1 if buf was too small. Pass nullptr and 0 to measure only.
+    size_t serialize_json(char *buf, size_t buf_size, const char *const *keys_to_censor, size_t keys_to_censor_len) const;
+
+    // Serializes the nodes marked as updated for api_backend_flag as [["/json/pointer", value], ...].
+    // A marked node is written as a whole, so an updated root results in [["", value]].
+    // Returns the required length like serialize_json. Does not clear the updated flags.
+    size_t serialize_json_delta(char *buf, size_t buf_size, uint8_t api_backend_flag, const char *const *keys_to_censor, size_t keys_to_censor_len) const;
+
     void save_to_file(File &file);
 
     void write_to_stream(Print &output);
@@ -66,6 +66,8 @@ const std::vector<Config> *Config::ConfArray::getVal() const { return &get_slot<
 
 const Config::ConfArray::Slot *Config::ConfArray::getSlot() const { return get_slot<Config::ConfArray>(idx); }
 Config::ConfArray::Slot *Config::ConfArray::getSlot() { return get_slot<Config::ConfArray>(idx); }
+uint16_t Config::ConfArray::getOwner() const { return get_slot_owner<Config::ConfArray>(idx); }
+void Config::ConfArray::setOwner(uint16_t owner) { set_slot_owner<Config::ConfArray>(idx, owner); }
 
 Config::ConfArray::ConfArray(std::vector<Config> val, const Config *prototype, uint16_t minElements, uint16_t maxElements, int8_t variantType)
 {
@@ -19,5 +19,18 @@
 
 #include "config/private.h"
 
-bool *Config::ConfBool::getVal() { return &value; }
-const bool *Config::ConfBool::getVal() const { return &value; }
+Config::ConfBool::ConfBool(bool val) : bits(val ? 1 : 0) {}
+
+bool Config::ConfBool::getVal() const { return (bits & 1) != 0; }
+void Config::ConfBool::setVal(bool val) { bits = static_cast<uint16_t>((bits & ~1u) | (val ? 1u : 0u)); }
+
+uint16_t Config::ConfBool::getOwner() const { return bits >> 1; }
+
+void Config::ConfBool::setOwner(uint16_t owner)
+{
+    // Owners that don't fit into 15 bits are stored as unknown.
+    if (owner > (0xFFFFu >> 1))
+        owner = 0;
+
+    bits = static_cast<uint16_t>((bits & 1u) | (owner << 1));
+}
@@ -93,6 +93,9 @@ float Config::ConfFloat::getMax() const {
 const Config::ConfFloat::Slot *Config::ConfFloat::getSlot() const { return get_slot<Config::ConfFloat>(idx); }
 Config::ConfFloat::Slot *Config::ConfFloat::getSlot() { return get_slot<Config::ConfFloat>(idx); }
 
+uint16_t Config::ConfFloat::getOwner() const { return get_slot_owner<Config::ConfFloat>(idx); }
+void Config::ConfFloat::setOwner(uint16_t owner) { set_slot_owner<Config::ConfFloat>(idx, owner); }
+
 Config::ConfFloat::ConfFloat(float val, float min, float max)
 {
     if (isnan(min) || isnan(max)) {
@@ -49,6 +49,9 @@ const int32_t* Config::ConfInt::getVal() const { return &get_slot<Config::ConfIn
 const Config::ConfInt::Slot *Config::ConfInt::getSlot() const { return get_slot<Config::ConfInt>(idx); }
 Config::ConfInt::Slot *Config::ConfInt::getSlot() { return get_slot<Config::ConfInt>(idx); }
 
+uint16_t Config::ConfInt::getOwner() const { return get_slot_owner<Config::ConfInt>(idx); }
+void Config::ConfInt::setOwner(uint16_t owner) { set_slot_owner<Config::ConfInt>(idx, owner); }
+
 Config::ConfInt::ConfInt(int32_t val, int32_t min, int32_t max)
 {
     if (min > max) {
@@ -47,6 +47,9 @@ const int64_t* Config::ConfInt52::getVal() const { return &get_slot<Config::Conf
 const Config::ConfInt52::Slot *Config::ConfInt52::getSlot() const { return get_slot<Config::ConfInt52>(idx); }
 Config::ConfInt52::Slot *Config::ConfInt52::getSlot() { return get_slot<Config::ConfInt52>(idx); }
 
+uint16_t Config::ConfInt52::getOwner() const { return get_slot_owner<Config::ConfInt52>(idx); }
+void Config::ConfInt52::setOwner(uint16_t owner) { set_slot_owner<Config::ConfInt52>(idx, owner); }
+
 Config::ConfInt52::ConfInt52(int64_t val)
 {
     idx = nextSlot<Config::ConfInt52>();
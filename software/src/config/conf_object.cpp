@@ -43,18 +43,13 @@ static void abort_on_key_not_found(const char *needle)
     esp_system_abort(msg);
 }
 
-Config *Config::ConfObject::get(const char *needle, size_t needle_len)
+static size_t find_key_index(const ConfObjectSchema *schema, const char *needle, size_t needle_len)
 {
-    const auto *slot = this->getSlot();
-    const auto schema = slot->schema;
-    const auto size = schema->length;
-    const auto keys = schema->keys;
-
     if (string_is_in_rodata(needle)) {
-        for (size_t i = 0; i < size; ++i) {
-            if (keys[i].val == needle) { // Address comparison, not string comparison
-                return &slot->values[i];
-            }
+        const size_t i = schema->find_key_by_address(needle);
+
+        if (i != SIZE_MAX) {
+            return i;
         }
 #ifdef DEBUG_FS_ENABLE
         logger.printfln("Key '%s' in rodata but not in keys.", needle);
@@ -65,59 +60,50 @@ Config *Config::ConfObject::get(const char *needle, size_t needle_len)
         needle_len = strlen(needle);
     }
 
-    for (size_t i = 0; i < size; ++i) {
-        if (keys[i].length != needle_len)
-            continue;
-
-        if (memcmp(keys[i].val, needle, needle_len) == 0)
-            return &slot->values[i];
-    }
-
-    abort_on_key_not_found(needle);
+    return schema->find_key_by_value(needle, needle_len);
 }
 
-const Config *Config::ConfObject::get(const char *needle, size_t needle_len) const
+Config *Config::ConfObject::get(const char *needle, size_t needle_len)
 {
     const auto *slot = this->getSlot();
-    const auto schema = slot->schema;
-    const auto size = schema->length;
-    const auto keys = schema->keys;
+    const size_t i = find_key_index(slot->schema, needle, needle_len);
 
-    if (string_is_in_rodata(needle)) {
-        for (size_t i = 0; i < size; ++i) {
-            if (keys[i].val == needle) { // Address comparison, not string comparison
-                return &slot->values[i];
-            }
-        }
-#ifdef DEBUG_FS_ENABLE
-        logger.printfln("Key '%s' in rodata but not in keys.", needle);
-#endif
+    if (i == SIZE_MAX) {
+        abort_on_key_not_found(needle);
     }
 
-    if (!needle_len) {
-        needle_len = strlen(needle);
-    }
+    return &slot->values[i];
+}
 
-    for (size_t i = 0; i < size; ++i) {
-        if (keys[i].length != needle_len)
-            continue;
+const Config *Config::ConfObject::get(const char *needle, size_t needle_len) const
+{
+    const auto *slot = this->getSlot();
+    const size_t i = find_key_index(slot->schema, needle, needle_len);
 
-        if (memcmp(keys[i].val, needle, needle_len) == 0)
-            return &slot->values[i];
+    if (i == SIZE_MAX) {
+        abort_on_key_not_found(needle);
     }
 
-    abort_on_key_not_found(needle);
+    return &slot->values[i];
 }
 
 const Config::ConfObject::Slot *Config::ConfObject::getSlot() const { return get_slot<Config::ConfObject>(idx); }
 Config::ConfObject::Slot *Config::ConfObject::getSlot() { return get_slot<Config::ConfObject>(idx); }
+uint16_t Config::ConfObject::getOwner() const { return get_slot_owner<Config::ConfObject>(idx); }
+void Config::ConfObject::setOwner(uint16_t owner) { set_slot_owner<Config::ConfObject>(idx, owner); }
 
 Config::ConfObject::ConfObject(std::vector<std::pair<const char *, Config>> &&val)
 {
     const size_t len = val.size();
 
-    auto schema = (ConfObjectSchema *)malloc_iram_or_psram_or_dram(sizeof(ConfObjectSchema) + len * sizeof(ConfObjectSchema::Key));
+    if (len >= std::numeric_limits<uint16_t>::max())
+        esp_system_abort("ConfObject has too many keys!");
+
+    const uint32_t hash_bits = ConfObjectSchema::hash_bits_for(len);
+
+    auto schema = (ConfObjectSchema *)malloc_iram_or_psram_or_dram(ConfObjectSchema::alloc_size(len, hash_bits));
     schema->length = len;
+    schema->hash_bits = hash_bits;
 
     for (size_t i = 0; i < len; ++i) {
         const char *key = val[i].first;
@@ -134,6 +120,8 @@ Config::ConfObject::ConfObject(std::vector<std::pair<const char *, Config>> &&va
         schema->keys[i].length = strlen(key);
     }
 
+    schema->build_hash_table();
+
     idx = nextSlot<Config::ConfObject>();
     auto *slot = this->getSlot();
     slot->schema = schema;
@@ -0,0 +1,159 @@
+/* esp32-firmware
+ * Copyright (C) 2020-2024 Erik Fleckstein <erik@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Schemas with fewer keys are searched linearly, which is faster than hashing the needle.
+#define CONF_OBJECT_SCHEMA_HASH_MIN_KEYS 16
+
+// Kept free of other firmware headers so that tools/conf_object_bench can use it on the host.
+struct ConfObjectSchema {
+    struct Key {
+        size_t length;
+        const char *val;
+    };
+    size_t length;
+
+    // Number of bits of the key hash used to index the hash table that follows the keys.
+    // 0 if the schema is too small to make a hash table worthwhile.
+    // 32 bit wide because the schema might be stored in IRAM, which only allows 32 bit accesses.
+    uint32_t hash_bits;
+
+    Key keys[];
+
+    // Open addressing hash table with (1 << hash_bits) entries stored directly after keys[].
+    // Each entry is the index of a key plus one. 0 marks an empty entry.
+    // The schema might be stored in IRAM that only allows 32 bit accesses,
+    // so two 16 bit entries are packed into each 32 bit word.
+    uint16_t get_hash_entry(size_t pos) const {
+        const uint32_t *table = reinterpret_cast<const uint32_t *>(&keys[length]);
+        return static_cast<uint16_t>(table[pos / 2] >> ((pos % 2) * 16));
+    }
+
+    void set_hash_entry(size_t pos, uint16_t entry) {
+        uint32_t *table = reinterpret_cast<uint32_t *>(&keys[length]);
+        const uint32_t shift = (pos % 2) * 16;
+        table[pos / 2] = (table[pos / 2] & ~(0xFFFFu << shift)) | (static_cast<uint32_t>(entry) << shift);
+    }
+
+    static uint32_t hash_bits_for(size_t key_count) {
+        if (key_count < CONF_OBJECT_SCHEMA_HASH_MIN_KEYS)
+            return 0;
+
+        // Size the hash table to at least twice the number of keys to keep probe sequences short.
+        uint32_t hash_bits = 0;
+        while ((1u << hash_bits) < key_count * 2)
+            ++hash_bits;
+
+        return hash_bits;
+    }
+
+    static size_t hash_table_size(uint32_t hash_bits) {
+        // Round up to full 32 bit words.
+        return hash_bits == 0 ? 0 : ((1u << hash_bits) + 1) / 2 * sizeof(uint32_t);
+    }
+
+    static size_t alloc_size(size_t key_count, uint32_t hash_bits) {
+        return sizeof(ConfObjectSchema) + key_count * sizeof(Key) + hash_table_size(hash_bits);
+    }
+
+    static uint32_t hash_key(const char *key, size_t key_len) {
+        // FNV-1a
+        uint32_t hash = 2166136261u;
+
+        for (size_t i = 0; i < key_len; ++i) {
+            hash ^= static_cast<uint8_t>(key[i]);
+            hash *= 16777619u;
+        }
+
+        return hash;
+    }
+
+    // length, hash_bits and keys[] must be set.
+    void build_hash_table() {
+        if (hash_bits == 0)
+            return;
+
+        // Don't use memset: The schema could be in IRAM, which only allows 32 bit writes.
+        uint32_t *table = reinterpret_cast<uint32_t *>(&keys[length]);
+        for (size_t i = 0; i < hash_table_size(hash_bits) / sizeof(uint32_t); ++i)
+            table[i] = 0;
+
+        const size_t mask = (1u << hash_bits) - 1;
+
+        for (size_t i = 0; i < length; ++i) {
+            size_t pos = hash_key(keys[i].val, keys[i].length) & mask;
+
+            while (get_hash_entry(pos) != 0)
+                pos = (pos + 1) & mask;
+
+            set_hash_entry(pos, static_cast<uint16_t>(i + 1));
+        }
+    }
+
+    // For needles in rodata: Keys are string literals, so the same literal has the same address.
+    size_t find_key_by_address(const char *needle) const {
+        const size_t size = length;
+
+        for (size_t i = 0; i < size; ++i) {
+            if (keys[i].val == needle) { // Address comparison, not string comparison
+                return i;
+            }
+        }
+
+        return SIZE_MAX;
+    }
+
+    size_t find_key_by_value(const char *needle, size_t needle_len) const {
+        const uint32_t bits = hash_bits;
+
+        if (bits != 0) {
+            const size_t mask = (1u << bits) - 1;
+
+            // The table is at least twice as large as the number of keys, so there is always an empty entry to stop at.
+            for (size_t pos = hash_key(needle, needle_len) & mask; ; pos = (pos + 1) & mask) {
+                const uint16_t entry = get_hash_entry(pos);
+
+                if (entry == 0)
+                    return SIZE_MAX;
+
+                const Key &key = keys[entry - 1];
+
+                if (key.length == needle_len && memcmp(key.val, needle, needle_len) == 0)
+                    return entry - 1;
+            }
+        }
+
+        const size_t size = length;
+
+        for (size_t i = 0; i < size; ++i) {
+            if (keys[i].length != needle_len)
+                continue;
+
+            if (memcmp(keys[i].val, needle, needle_len) == 0)
+                return i;
+        }
+
+        return SIZE_MAX;
+    }
+};
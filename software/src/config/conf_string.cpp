@@ -44,6 +44,9 @@ const CoolString* Config::ConfString::getVal() const { return &get_slot<Config::
 const Config::ConfString::Slot* Config::ConfString::getSlot() const { return get_slot<Config::ConfString>(idx); }
 Config::ConfString::Slot* Config::ConfString::getSlot() { return get_slot<Config::ConfString>(idx); }
 
+uint16_t Config::ConfString::getOwner() const { return get_slot_owner<Config::ConfString>(idx); }
+void Config::ConfString::setOwner(uint16_t owner) { set_slot_owner<Config::ConfString>(idx, owner); }
+
 Config::ConfString::ConfString(const char *val, uint16_t minChars, uint16_t maxChars)
 {
     idx = nextSlot<Config::ConfString>();
@@ -50,6 +50,9 @@ const uint32_t* Config::ConfUint::getVal() const { return &get_slot<Config::Conf
 const Config::ConfUint::Slot *Config::ConfUint::getSlot() const { return get_slot<Config::ConfUint>(idx); }
 Config::ConfUint::Slot *Config::ConfUint::getSlot() { return get_slot<Config::ConfUint>(idx); }
 
+uint16_t Config::ConfUint::getOwner() const { return get_slot_owner<Config::ConfUint>(idx); }
+void Config::ConfUint::setOwner(uint16_t owner) { set_slot_owner<Config::ConfUint>(idx, owner); }
+
 Config::ConfUint::ConfUint(uint32_t val, uint32_t min, uint32_t max)
 {
     if (min > max) {
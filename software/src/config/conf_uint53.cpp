@@ -48,6 +48,9 @@ const uint64_t* Config::ConfUint53::getVal() const { return &get_slot<Config::Co
 const Config::ConfUint53::Slot *Config::ConfUint53::getSlot() const { return get_slot<Config::ConfUint53>(idx); }
 Config::ConfUint53::Slot *Config::ConfUint53::getSlot() { return get_slot<Config::ConfUint53>(idx); }
 
+uint16_t Config::ConfUint53::getOwner() const { return get_slot_owner<Config::ConfUint53>(idx); }
+void Config::ConfUint53::setOwner(uint16_t owner) { set_slot_owner<Config::ConfUint53>(idx, owner); }
+
 Config::ConfUint53::ConfUint53(uint64_t val)
 {
     idx = nextSlot<Config::ConfUint53>();
@@ -37,6 +37,8 @@ bool Config::ConfUnion::changeUnionVariant(uint8_t tag)
         if (slot->prototypes[i].tag == tag) {
             slot->tag = tag;
             slot->val = slot->prototypes[i].config;
+            // The prototype has no owner and the previous value might have been empty.
+            slot->val.set_owner(getOwner());
             slot->val.set_updated(0xFF);
             return true;
         }
@@ -52,6 +54,8 @@ const Config* Config::ConfUnion::getVal() const { return &get_slot<Config::ConfU
 
 const Config::ConfUnion::Slot* Config::ConfUnion::getSlot() const { return get_slot<Config::ConfUnion>(idx); }
 Config::ConfUnion::Slot* Config::ConfUnion::getSlot() { return get_slot<Config::ConfUnion>(idx); }
+uint16_t Config::ConfUnion::getOwner() const { return get_slot_owner<Config::ConfUnion>(idx); }
+void Config::ConfUnion::setOwner(uint16_t owner) { set_slot_owner<Config::ConfUnion>(idx, owner); }
 
 Config::ConfUnion::ConfUnion(const Config &val, uint8_t tag, uint8_t prototypes_len, const ConfUnionPrototypeInternal prototypes[])
 {
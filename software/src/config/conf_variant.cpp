@@ -18,6 +18,7 @@
  */
 
 #include "config/private.h"
+#include "config/visitors.h"
 
 Config::ConfVariant::Val::Val() : e(Empty{}) {}
 Config::ConfVariant::Val::~Val() {}
@@ -35,6 +36,92 @@ Config::ConfVariant::ConfVariant(ConfUint53 u) : tag(Tag::UINT64), updated(0xFF)
 
 Config::ConfVariant::ConfVariant() : tag(Tag::EMPTY), updated(0xFF), val() {}
 
+// Owner tracking, see Config::notify_updated():
+// A copy gets new slots, but keeps the owner of the copied node. Updating a copy of a state
+// only marks that state as dirty, instead of making the API re-claim all states.
+// A moved node keeps its slots and with them its owner.
+// Assigning to a node of a state hands the state's owner down to all assigned nodes.
+static uint16_t get_node_owner(const Config::ConfVariant &v)
+{
+    switch (v.tag) {
+        case Config::ConfVariant::Tag::EMPTY:
+            return 0;
+        case Config::ConfVariant::Tag::STRING:
+            return v.val.s.getOwner();
+        case Config::ConfVariant::Tag::FLOAT:
+            return v.val.f.getOwner();
+        case Config::ConfVariant::Tag::INT:
+            return v.val.i.getOwner();
+        case Config::ConfVariant::Tag::UINT:
+            return v.val.u.getOwner();
+        case Config::ConfVariant::Tag::BOOL:
+            return v.val.b.getOwner();
+        case Config::ConfVariant::Tag::ARRAY:
+            return v.val.a.getOwner();
+        case Config::ConfVariant::Tag::OBJECT:
+            return v.val.o.getOwner();
+        case Config::ConfVariant::Tag::UNION:
+            return v.val.un.getOwner();
+        case Config::ConfVariant::Tag::INT64:
+            return v.val.i64.getOwner();
+        case Config::ConfVariant::Tag::UINT64:
+            return v.val.u64.getOwner();
+    }
+    esp_system_abort("get_node_owner: ConfVariant has unknown type!");
+}
+
+// Only sets the owner of the node itself: Its children are copied with their owners.
+static void set_node_owner(Config::ConfVariant &v, uint16_t owner)
+{
+    switch (v.tag) {
+        case Config::ConfVariant::Tag::EMPTY:
+            break;
+        case Config::ConfVariant::Tag::STRING:
+            v.val.s.setOwner(owner);
+            break;
+        case Config::ConfVariant::Tag::FLOAT:
+            v.val.f.setOwner(owner);
+            break;
+        case Config::ConfVariant::Tag::INT:
+            v.val.i.setOwner(owner);
+            break;
+        case Config::ConfVariant::Tag::UINT:
+            v.val.u.setOwner(owner);
+            break;
+        case Config::ConfVariant::Tag::BOOL:
+            v.val.b.setOwner(owner);
+            break;
+        case Config::ConfVariant::Tag::ARRAY:
+            v.val.a.setOwner(owner);
+            break;
+        case Config::ConfVariant::Tag::OBJECT:
+            v.val.o.setOwner(owner);
+            break;
+        case Config::ConfVariant::Tag::UNION:
+            v.val.un.setOwner(owner);
+            break;
+        case Config::ConfVariant::Tag::INT64:
+            v.val.i64.setOwner(owner);
+            break;
+        case Config::ConfVariant::Tag::UINT64:
+            v.val.u64.setOwner(owner);
+            break;
+    }
+}
+
+// Called after a node was assigned to. owner is the owner the node had before.
+static void notify_assigned(Config::ConfVariant &v, uint16_t owner)
+{
+    // The node is not part of a state.
+    if (owner == 0)
+        return;
+
+    Config::apply_visitor(assign_owner{owner}, v);
+
+    if (v.updated != 0)
+        Config::mark_owner_dirty(owner);
+}
+
 Config::ConfVariant::ConfVariant(const ConfVariant &cpy)
 {
     switch (cpy.tag) {
@@ -74,6 +161,8 @@ Config::ConfVariant::ConfVariant(const ConfVariant &cpy)
     }
     this->tag = cpy.tag;
     this->updated = cpy.updated;
+
+    set_node_owner(*this, get_node_owner(cpy));
 }
 
 Config::ConfVariant &Config::ConfVariant::operator=(const ConfVariant &cpy)
@@ -82,6 +171,8 @@ Config::ConfVariant &Config::ConfVariant::operator=(const ConfVariant &cpy)
         return *this;
     }
 
+    const uint16_t owner = get_node_owner(*this);
+
     if (tag != Tag::EMPTY)
         destroyUnionMember();
 
@@ -123,6 +214,11 @@ Config::ConfVariant &Config::ConfVariant::operator=(const ConfVariant &cpy)
     this->tag = cpy.tag;
     this->updated = cpy.updated;
 
+    if (owner != 0)
+        notify_assigned(*this, owner);
+    else
+        set_node_owner(*this, get_node_owner(cpy));
+
     return *this;
 }
 
@@ -242,6 +338,8 @@ Config::ConfVariant::ConfVariant(ConfVariant &&cpy) {
 }
 
 Config::ConfVariant &Config::ConfVariant::operator=(ConfVariant &&cpy) {
+    const uint16_t owner = get_node_owner(*this);
+
     if (tag != Tag::EMPTY)
         destroyUnionMember();
 
@@ -283,6 +381,8 @@ Config::ConfVariant &Config::ConfVariant::operator=(ConfVariant &&cpy) {
     this->tag = cpy.tag;
     this->updated = cpy.updated;
 
+    notify_assigned(*this, owner);
+
     cpy.tag = ConfVariant::Tag::EMPTY;
 
     return *this;
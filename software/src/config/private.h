@@ -23,6 +23,7 @@
 #include <math.h>
 
 #include "config.h"
+#include "config/conf_object_schema.h"
 
 struct ConfStringSlot {
     CoolString val = "";
@@ -62,15 +63,6 @@ struct ConfArraySlot {
     bool inUse = false;
 };
 
-struct ConfObjectSchema {
-    struct Key {
-        size_t length;
-        const char *val;
-    };
-    size_t length;
-    Key keys[];
-};
-
 struct ConfObjectSlot {
     const ConfObjectSchema *schema = nullptr;
     Config *values;
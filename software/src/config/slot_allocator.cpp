@@ -86,6 +86,17 @@ size_t nextSlot()
 
                 superblock->blocks[block_i] = block;
                 RootBlock<ConfigT>::allocated_blocks++;
+
+                if (SlotConfig<ConfigT>::tracks_owner) {
+                    // Two 16 bit owners per 32 bit word: The buffer might be in IRAM.
+                    uint32_t *owner_block = static_cast<uint32_t *>(calloc_32bit_addressed(SlotConfig<ConfigT>::slots_per_block / 2, sizeof(uint32_t)));
+
+                    if (!owner_block) {
+                        esp_system_abort("Couldn't allocate slot owner buffer");
+                    }
+
+                    superblock->owner_blocks[block_i] = owner_block;
+                }
             }
 
             for (; slot_i < SlotConfig<ConfigT>::slots_per_block; slot_i++) {
@@ -93,6 +104,12 @@ size_t nextSlot()
                     size_t idx = superblock_offset * SlotConfig<ConfigT>::slots_per_superblock + block_i * SlotConfig<ConfigT>::slots_per_block + slot_i;
                     RootBlock<ConfigT>::first_free_slot = idx + 1;
 
+                    if (SlotConfig<ConfigT>::tracks_owner) {
+                        // Don't inherit the owner of the slot's previous user.
+                        uint32_t *owner_word = superblock->owner_blocks[block_i] + slot_i / 2;
+                        *owner_word &= ~(0xFFFFu << ((slot_i % 2) * 16));
+                    }
+
 #if MODULE_DEBUG_AVAILABLE()
                     RootBlock<ConfigT>::used_slots++;
 #ifdef DEBUG_FS_ENABLE
@@ -166,6 +183,60 @@ template Config::ConfUnion::Slot  *get_slot<Config::ConfUnion>(size_t idx);
 template Config::ConfUint53::Slot *get_slot<Config::ConfUint53>(size_t idx);
 template Config::ConfInt52::Slot  *get_slot<Config::ConfInt52>(size_t idx);
 
+template<typename ConfigT>
+static uint32_t *get_owner_word(size_t idx)
+{
+    Superblock<ConfigT> *superblock = RootBlock<ConfigT>::first_superblock;
+
+    size_t block_idx = idx / SlotConfig<ConfigT>::slots_per_block;
+    size_t slot_idx  = idx % SlotConfig<ConfigT>::slots_per_block;
+
+    while (block_idx >= SlotConfig<ConfigT>::blocks_per_superblock) {
+        block_idx -= SlotConfig<ConfigT>::blocks_per_superblock;
+        superblock = superblock->next_superblock;
+    }
+
+    return superblock->owner_blocks[block_idx] + slot_idx / 2;
+}
+
+template<typename ConfigT>
+uint16_t get_slot_owner(size_t idx)
+{
+    static_assert(SlotConfig<ConfigT>::tracks_owner);
+
+    return static_cast<uint16_t>(*get_owner_word<ConfigT>(idx) >> ((idx % 2) * 16));
+}
+
+template<typename ConfigT>
+void set_slot_owner(size_t idx, uint16_t owner)
+{
+    static_assert(SlotConfig<ConfigT>::tracks_owner);
+
+    uint32_t *word = get_owner_word<ConfigT>(idx);
+    const uint32_t shift = (idx % 2) * 16;
+    *word = (*word & ~(0xFFFFu << shift)) | (static_cast<uint32_t>(owner) << shift);
+}
+
+template uint16_t get_slot_owner<Config::ConfUint>(size_t idx);
+template uint16_t get_slot_owner<Config::ConfInt>(size_t idx);
+template uint16_t get_slot_owner<Config::ConfFloat>(size_t idx);
+template uint16_t get_slot_owner<Config::ConfString>(size_t idx);
+template uint16_t get_slot_owner<Config::ConfArray>(size_t idx);
+template uint16_t get_slot_owner<Config::ConfObject>(size_t idx);
+template uint16_t get_slot_owner<Config::ConfUnion>(size_t idx);
+template uint16_t get_slot_owner<Config::ConfUint53>(size_t idx);
+template uint16_t get_slot_owner<Config::ConfInt52>(size_t idx);
+
+template void set_slot_owner<Config::ConfUint>(size_t idx, uint16_t owner);
+template void set_slot_owner<Config::ConfInt>(size_t idx, uint16_t owner);
+template void set_slot_owner<Config::ConfFloat>(size_t idx, uint16_t owner);
+template void set_slot_owner<Config::ConfString>(size_t idx, uint16_t owner);
+template void set_slot_owner<Config::ConfArray>(size_t idx, uint16_t owner);
+template void set_slot_owner<Config::ConfObject>(size_t idx, uint16_t owner);
+template void set_slot_owner<Config::ConfUnion>(size_t idx, uint16_t owner);
+template void set_slot_owner<Config::ConfUint53>(size_t idx, uint16_t owner);
+template void set_slot_owner<Config::ConfInt52>(size_t idx, uint16_t owner);
+
 #ifdef DEBUG_FS_ENABLE
 template<typename ConfigT>
 static void check_slot_accounting()
@@ -32,6 +32,7 @@ template<> struct SlotConfig<Config::ConfUint> {
     static constexpr const size_t slots_per_superblock  = 2048;
     static constexpr const size_t slots_per_block       =  256;
     static constexpr const size_t blocks_per_superblock = slots_per_superblock / slots_per_block;
+    static constexpr const bool   tracks_owner          = true;
 
     static_assert(slots_per_superblock % slots_per_block == 0);
     static_assert((slots_per_block & (slots_per_block - 1)) == 0);
@@ -41,6 +42,7 @@ template<> struct SlotConfig<Config::ConfInt> {
     static constexpr const size_t slots_per_superblock  = 512;
     static constexpr const size_t slots_per_block       =  64;
     static constexpr const size_t blocks_per_superblock = slots_per_superblock / slots_per_block;
+    static constexpr const bool   tracks_owner          = true;
 
     static_assert(slots_per_superblock % slots_per_block == 0);
     static_assert((slots_per_block & (slots_per_block - 1)) == 0);
@@ -50,6 +52,7 @@ template<> struct SlotConfig<Config::ConfFloat> {
     static constexpr const size_t slots_per_superblock  = 1024;
     static constexpr const size_t slots_per_block       =  128;
     static constexpr const size_t blocks_per_superblock = slots_per_superblock / slots_per_block;
+    static constexpr const bool   tracks_owner          = true;
 
     static_assert(slots_per_superblock % slots_per_block == 0);
     static_assert((slots_per_block & (slots_per_block - 1)) == 0);
@@ -59,6 +62,7 @@ template<> struct SlotConfig<Config::ConfString> {
     static constexpr const size_t slots_per_superblock  = 512;
     static constexpr const size_t slots_per_block       =  64;
     static constexpr const size_t blocks_per_superblock = slots_per_superblock / slots_per_block;
+    static constexpr const bool   tracks_owner          = true;
 
     static_assert(slots_per_superblock % slots_per_block == 0);
     static_assert((slots_per_block & (slots_per_block - 1)) == 0);
@@ -68,6 +72,7 @@ template<> struct SlotConfig<Config::ConfArray> {
     static constexpr const size_t slots_per_superblock  = 256;
     static constexpr const size_t slots_per_block       =  32;
     static constexpr const size_t blocks_per_superblock = slots_per_superblock / slots_per_block;
+    static constexpr const bool   tracks_owner          = true;
 
     static_assert(slots_per_superblock % slots_per_block == 0);
     static_assert((slots_per_block & (slots_per_block - 1)) == 0);
@@ -77,6 +82,7 @@ template<> struct SlotConfig<Config::ConfObject> {
     static constexpr const size_t slots_per_superblock  = 2048;
     static constexpr const size_t slots_per_block       =  256;
     static constexpr const size_t blocks_per_superblock = slots_per_superblock / slots_per_block;
+    static constexpr const bool   tracks_owner          = true;
 
     static_assert(slots_per_superblock % slots_per_block == 0);
     static_assert((slots_per_block & (slots_per_block - 1)) == 0);
@@ -86,6 +92,7 @@ template<> struct SlotConfig<Config::ConfUnion> {
     static constexpr const size_t slots_per_superblock  = 128;
     static constexpr const size_t slots_per_block       =  16;
     static constexpr const size_t blocks_per_superblock = slots_per_superblock / slots_per_block;
+    static constexpr const bool   tracks_owner          = true;
 
     static_assert(slots_per_superblock % slots_per_block == 0);
     static_assert((slots_per_block & (slots_per_block - 1)) == 0);
@@ -95,6 +102,7 @@ template<> struct SlotConfig<Config::ConfUint53> {
     static constexpr const size_t slots_per_superblock  = 128;
     static constexpr const size_t slots_per_block       =  16;
     static constexpr const size_t blocks_per_superblock = slots_per_superblock / slots_per_block;
+    static constexpr const bool   tracks_owner          = true;
 
     static_assert(slots_per_superblock % slots_per_block == 0);
     static_assert((slots_per_block & (slots_per_block - 1)) == 0);
@@ -104,6 +112,7 @@ template<> struct SlotConfig<Config::ConfInt52> {
     static constexpr const size_t slots_per_superblock  = 128;
     static constexpr const size_t slots_per_block       =  16;
     static constexpr const size_t blocks_per_superblock = slots_per_superblock / slots_per_block;
+    static constexpr const bool   tracks_owner          = true;
 
     static_assert(slots_per_superblock % slots_per_block == 0);
     static_assert((slots_per_block & (slots_per_block - 1)) == 0);
@@ -112,6 +121,8 @@ template<> struct SlotConfig<Config::ConfInt52> {
 template<typename ConfigT>
 struct Superblock {
     typename ConfigT::Slot *blocks[SlotConfig<ConfigT>::blocks_per_superblock];
+    // Owners of the slots in blocks, see get_slot_owner(). Only allocated if SlotConfig<ConfigT>::tracks_owner.
+    uint32_t *owner_blocks[SlotConfig<ConfigT>::blocks_per_superblock];
     Superblock<ConfigT> *next_superblock;
 };
 
@@ -229,10 +240,40 @@ extern template Config::ConfUnion::Slot  *get_slot<Config::ConfUnion>(size_t idx
 extern template Config::ConfUint53::Slot *get_slot<Config::ConfUint53>(size_t idx);
 extern template Config::ConfInt52::Slot  *get_slot<Config::ConfInt52>(size_t idx);
 
+// The owner of a slot is the index plus one of the API state the slot's node belongs to, or 0 if unknown.
+// Config::notify_updated() uses it to mark only the owning state as dirty.
+// New slots start without owner. Bools have no slot and store their owner inline, see Config::ConfBool.
+template<typename ConfigT>
+uint16_t get_slot_owner(size_t idx);
+
+template<typename ConfigT>
+void set_slot_owner(size_t idx, uint16_t owner);
+
+extern template uint16_t get_slot_owner<Config::ConfUint>(size_t idx);
+extern template uint16_t get_slot_owner<Config::ConfInt>(size_t idx);
+extern template uint16_t get_slot_owner<Config::ConfFloat>(size_t idx);
+extern template uint16_t get_slot_owner<Config::ConfString>(size_t idx);
+extern template uint16_t get_slot_owner<Config::ConfArray>(size_t idx);
+extern template uint16_t get_slot_owner<Config::ConfObject>(size_t idx);
+extern template uint16_t get_slot_owner<Config::ConfUnion>(size_t idx);
+extern template uint16_t get_slot_owner<Config::ConfUint53>(size_t idx);
+extern template uint16_t get_slot_owner<Config::ConfInt52>(size_t idx);
+
+extern template void set_slot_owner<Config::ConfUint>(size_t idx, uint16_t owner);
+extern template void set_slot_owner<Config::ConfInt>(size_t idx, uint16_t owner);
+extern template void set_slot_owner<Config::ConfFloat>(size_t idx, uint16_t owner);
+extern template void set_slot_owner<Config::ConfString>(size_t idx, uint16_t owner);
+extern template void set_slot_owner<Config::ConfArray>(size_t idx, uint16_t owner);
+extern template void set_slot_owner<Config::ConfObject>(size_t idx, uint16_t owner);
+extern template void set_slot_owner<Config::ConfUnion>(size_t idx, uint16_t owner);
+extern template void set_slot_owner<Config::ConfUint53>(size_t idx, uint16_t owner);
+extern template void set_slot_owner<Config::ConfInt52>(size_t idx, uint16_t owner);
+
 template<typename ConfigT>
 size_t get_allocated_slot_memory()
 {
-    return RootBlock<ConfigT>::allocated_blocks * SlotConfig<ConfigT>::slots_per_block * sizeof(typename ConfigT::Slot);
+    const size_t owner_size = SlotConfig<ConfigT>::tracks_owner ? sizeof(uint16_t) : 0;
+    return RootBlock<ConfigT>::allocated_blocks * SlotConfig<ConfigT>::slots_per_block * (sizeof(typename ConfigT::Slot) + owner_size);
 }
 
 #if MODULE_DEBUG_AVAILABLE()
@@ -21,6 +21,8 @@
 
 #include "config/private.h"
 
+#include <TFJson.h>
+
 #include "header_logger.h"
 
 #include "tools.h"
@@ -163,55 +165,80 @@ struct default_validator {
 struct to_json {
     void operator()(const Config::ConfString &x)
     {
-        insertHere.set(x.getVal()->c_str());
+        if (key != nullptr)
+            json->addMemberString(key, x.getVal()->c_str());
+        else
+            json->addString(x.getVal()->c_str());
     }
     void operator()(const Config::ConfFloat &x)
     {
-        insertHere.set(x.getVal());
+        const float val = x.getVal();
+
+        // ArduinoJson serialized NaN and infinity as null. Keep doing that.
+        if (!isfinite(val)) {
+            this->add_null();
+            return;
+        }
+
+        if (key != nullptr)
+            json->addMemberNumber(key, val);
+        else
+            json->addNumber(val);
     }
     void operator()(const Config::ConfInt &x)
     {
-        insertHere.set(*x.getVal());
+        if (key != nullptr)
+            json->addMemberNumber(key, static_cast<int32_t>(*x.getVal()));
+        else
+            json->addNumber(static_cast<int32_t>(*x.getVal()));
     }
     void operator()(const Config::ConfUint &x)
     {
-        insertHere.set(*x.getVal());
+        if (key != nullptr)
+            json->addMemberNumber(key, static_cast<uint32_t>(*x.getVal()));
+        else
+            json->addNumber(static_cast<uint32_t>(*x.getVal()));
     }
     void operator()(const Config::ConfInt52 &x)
     {
-        insertHere.set(*x.getVal());
+        if (key != nullptr)
+            json->addMemberNumber(key, static_cast<int64_t>(*x.getVal()));
+        else
+            json->addNumber(static_cast<int64_t>(*x.getVal()));
     }
     void operator()(const Config::ConfUint53 &x)
     {
-        insertHere.set(*x.getVal());
+        if (key != nullptr)
+            json->addMemberNumber(key, static_cast<uint64_t>(*x.getVal()));
+        else
+            json->addNumber(static_cast<uint64_t>(*x.getVal()));
     }
     void operator()(const Config::ConfBool &x)
     {
-        insertHere.set(*x.getVal());
+        if (key != nullptr)
+            json->addMemberBoolean(key, x.getVal());
+        else
+            json->addBoolean(x.getVal());
     }
     void operator()(const Config::ConfVariant::Empty &x)
     {
-        insertHere.set(nullptr);
+        this->add_null();
     }
     void operator()(const Config::ConfArray &x)
     {
         const auto *val = x.getVal();
         const auto size = val->size();
 
-        JsonArray arr = insertHere.as<JsonArray>();
-        for (size_t i = 0; i < size; ++i) {
-            const Config *child = &(*val)[i];
-
-            if (child->is<Config::ConfObject>()) {
-                arr.createNestedObject();
-            } else if (child->is<Config::ConfArray>() || child->is<Config::ConfUnion>()) {
-                arr.createNestedArray();
-            } else {
-                arr.add(0);
-            }
+        if (key != nullptr)
+            json->addMemberArray(key);
+        else
+            json->addArray();
 
-            Config::apply_visitor(to_json{arr[i], keys_to_censor, keys_to_censor_len}, child->value);
+        for (size_t i = 0; i < size; ++i) {
+            Config::apply_visitor(to_json{json, nullptr, keys_to_censor, keys_to_censor_len}, (*val)[i].value);
         }
+
+        json->endArray();
     }
     void operator()(const Config::ConfObject &x)
     {
@@ -219,20 +246,24 @@ struct to_json {
         const auto *schema = slot->schema;
         const auto size = schema->length;
 
-        JsonObject obj = insertHere.as<JsonObject>();
+        if (key != nullptr)
+            json->addMemberObject(key);
+        else
+            json->addObject();
+
         for (size_t i = 0; i < size; ++i) {
-            const char *key = schema->keys[i].val;
+            const char *child_key = schema->keys[i].val;
             const Config &child = slot->values[i];
 
             bool censored = false;
             for (size_t ktc = 0; ktc < keys_to_censor_len; ++ktc) {
                 // We've made sure that both keys point to _rodata.
                 // Comparing the pointers should be enough, assuming that the literal strings are deduplicated perfectly.
-                if (key != keys_to_censor[ktc])
+                if (child_key != keys_to_censor[ktc])
                     continue;
 
                 if (!(child.is<Config::ConfString>() && child.asString().length() == 0)) {
-                    obj[key] = nullptr;
+                    json->addMemberNull(child_key);
                     censored = true;
                     break;
                 }
@@ -240,38 +271,160 @@ struct to_json {
             if (censored)
                 continue;
 
-            if (child.is<Config::ConfObject>()) {
-                obj.createNestedObject(key);
-            } else if (child.is<Config::ConfArray>() || child.is<Config::ConfUnion>()) {
-                obj.createNestedArray(key);
-            } else {
-                obj[key] = nullptr;
-            }
-
-            Config::apply_visitor(to_json{obj[key], keys_to_censor, keys_to_censor_len}, child.value);
+            Config::apply_visitor(to_json{json, child_key, keys_to_censor, keys_to_censor_len}, child.value);
         }
+
+        json->endObject();
     }
 
     void operator()(const Config::ConfUnion &x)
+    {
+        if (key != nullptr)
+            json->addMemberArray(key);
+        else
+            json->addArray();
+
+        json->addNumber(static_cast<uint32_t>(x.getSlot()->tag));
+        Config::apply_visitor(to_json{json, nullptr, keys_to_censor, keys_to_censor_len}, x.getVal()->value);
+
+        json->endArray();
+    }
+
+    void add_null()
+    {
+        if (key != nullptr)
+            json->addMemberNull(key);
+        else
+            json->addNull();
+    }
+
+    TFJsonSerializer *json;
+    // Key to write the value as object member. nullptr for array elements and the root.
+    const char *key;
+    const char *const *keys_to_censor;
+    size_t keys_to_censor_len;
+};
+
+#define CONFIG_DELTA_PATH_MAX_LENGTH 128
+
+// Writes a [path, value] pair for every node marked as updated for api_backend_flag.
+// Marked nodes are written as a whole, unmarked containers are searched for marked children.
+struct to_json_delta {
+    void operator()(const Config::ConfString &x) {}
+    void operator()(const Config::ConfFloat &x) {}
+    void operator()(const Config::ConfInt &x) {}
+    void operator()(const Config::ConfUint &x) {}
+    void operator()(const Config::ConfInt52 &x) {}
+    void operator()(const Config::ConfUint53 &x) {}
+    void operator()(const Config::ConfBool &x) {}
+    void operator()(const Config::ConfVariant::Empty &x) {}
+    void operator()(const Config::ConfArray &x)
     {
         const auto *val = x.getVal();
+        const auto size = val->size();
+
+        char segment[12];
+        for (size_t i = 0; i < size; ++i) {
+            int segment_len = snprintf(segment, ARRAY_SIZE(segment), "%u", i);
+            visit_child((*val)[i], segment, static_cast<size_t>(segment_len));
+        }
+    }
+    void operator()(const Config::ConfObject &x)
+    {
+        const auto *slot = x.getSlot();
+        const auto *schema = slot->schema;
+        const auto size = schema->length;
+
+        for (size_t i = 0; i < size; ++i) {
+            const char *child_key = schema->keys[i].val;
+            const Config &child = slot->values[i];
+
+            bool censored = false;
+            for (size_t ktc = 0; ktc < keys_to_censor_len; ++ktc) {
+                // Same pointer comparison as in to_json.
+                if (child_key == keys_to_censor[ktc]) {
+                    censored = true;
+                    break;
+                }
+            }
+
+            if (censored) {
+                // Write the censored value as a whole, the same way to_json does.
+                if (child.was_updated(api_backend_flag) == 0)
+                    continue;
+
+                if (!push_segment(child_key, schema->keys[i].length))
+                    return;
+
+                json->addArray();
+                json->addString(path);
+                if (child.is<Config::ConfString>() && child.asString().length() == 0)
+                    json->addString("");
+                else
+                    json->addNull();
+                json->endArray();
+
+                pop_segment(schema->keys[i].length);
+                continue;
+            }
 
-        JsonArray arr = insertHere.as<JsonArray>();
-        arr.add(x.getSlot()->tag);
-        if (val->is<Config::ConfObject>()) {
-            arr.createNestedObject();
-        } else if (val->is<Config::ConfArray>() || val->is<Config::ConfUnion>()) {
-            arr.createNestedArray();
+            visit_child(child, child_key, schema->keys[i].length);
+        }
+    }
+    void operator()(const Config::ConfUnion &x)
+    {
+        // Unions are serialized as [tag, value]. A tag change marks the value as updated.
+        visit_child(*x.getVal(), "1", 1);
+    }
+
+    void visit_child(const Config &c, const char *segment, size_t segment_len)
+    {
+        if (segment != nullptr && !push_segment(segment, segment_len))
+            return;
+
+        if ((c.value.updated & api_backend_flag) != 0) {
+            json->addArray();
+            json->addString(path);
+            Config::apply_visitor(to_json{json, nullptr, keys_to_censor, keys_to_censor_len}, c.value);
+            json->endArray();
         } else {
-            arr.add();
+            Config::apply_visitor(to_json_delta{json, keys_to_censor, keys_to_censor_len, api_backend_flag, path, path_len, path_overflow}, c.value);
         }
 
-        Config::apply_visitor(to_json{insertHere[1], keys_to_censor, keys_to_censor_len}, val->value);
+        if (segment != nullptr)
+            pop_segment(segment_len);
     }
 
-    JsonVariant insertHere;
+    bool push_segment(const char *segment, size_t segment_len)
+    {
+        // + 2 for the / and the NUL-terminator
+        if (path_len + segment_len + 2 > CONFIG_DELTA_PATH_MAX_LENGTH) {
+            *path_overflow = true;
+            return false;
+        }
+
+        path[path_len] = '/';
+        memcpy(path + path_len + 1, segment, segment_len);
+        path_len += segment_len + 1;
+        path[path_len] = '\0';
+
+        return true;
+    }
+
+    void pop_segment(size_t segment_len)
+    {
+        path_len -= segment_len + 1;
+        path[path_len] = '\0';
+    }
+
+    TFJsonSerializer *json;
     const char *const *keys_to_censor;
     size_t keys_to_censor_len;
+    uint8_t api_backend_flag;
+    // Shared buffer of CONFIG_DELTA_PATH_MAX_LENGTH bytes. Holds the JSON pointer of the visited node.
+    char *path;
+    size_t path_len;
+    bool *path_overflow;
 };
 
 static const uint8_t leading_zeros_to_char_count[33] = {10,10,10,9,9,9,8,8,8,7,7,7,7,6,6,6,5,5,5,4,4,4,4,3,3,3,2,2,2,1,1,1,1};
@@ -412,7 +565,7 @@ struct string_length_visitor {
     }
     size_t operator()(const Config::ConfBool &x)
     {
-        return (*x.getVal()) ? 4 : 5;
+        return x.getVal() ? 4 : 5;
     }
     size_t operator()(const Config::ConfVariant::Empty &x)
     {
@@ -606,8 +759,8 @@ struct from_json {
         if (!json_node.is<bool>())
             return {"JSON node was not a boolean.", false};
 
-        bool changed = x.value != json_node.as<bool>();
-        x.value = json_node.as<bool>();
+        bool changed = x.getVal() != json_node.as<bool>();
+        x.setVal(json_node.as<bool>());
         return {"", changed};
     }
     UpdateResult operator()(const Config::ConfVariant::Empty &x)
@@ -653,6 +806,9 @@ struct from_json {
 
                     // Must get val again because the push_back() consumes a slot, which might trigger a slot array move that invalidates the pointer.
                     val = x.getVal();
+
+                    // The prototype has no owner.
+                    val->back().set_owner(x.getOwner());
                 }
             }
         }
@@ -905,8 +1061,8 @@ struct from_update {
         if (update_val == nullptr)
             return {"ConfUpdate node was not a boolean.", false};
 
-        bool changed = x.value != *update_val;
-        x.value = *update_val;
+        bool changed = x.getVal() != *update_val;
+        x.setVal(*update_val);
         return {"", changed};
     }
     UpdateResult operator()(const Config::ConfVariant::Empty &x)
@@ -944,6 +1100,9 @@ struct from_update {
 
                     // Must get val again because the push_back() consumes a slot, which might trigger a slot array move that invalidates the pointer.
                     val = x.getVal();
+
+                    // The prototype has no owner.
+                    val->back().set_owner(x.getOwner());
                 }
             }
         }
@@ -1069,8 +1228,9 @@ struct is_updated {
     {
         uint8_t result = 0;
         for (const Config &c : *x.getVal()) {
-            result |= c.value.updated & api_backend_flag;
-            result |= Config::apply_visitor(is_updated{api_backend_flag}, c.value);
+            result |= visit_child(c);
+            if (result == api_backend_flag)
+                break;
         }
         return result;
     }
@@ -1081,18 +1241,33 @@ struct is_updated {
 
         uint8_t result = 0;
         for (size_t i = 0; i < size; ++i) {
-            result |= slot->values[i].value.updated & api_backend_flag;
-            result |= Config::apply_visitor(is_updated{api_backend_flag}, slot->values[i].value);
+            result |= visit_child(slot->values[i]);
+            if (result == api_backend_flag)
+                break;
         }
         return result;
     }
     uint8_t operator()(const Config::ConfUnion &x) const
     {
-        const auto &value = x.getVal()->value;
-        return (value.updated & api_backend_flag) | Config::apply_visitor(is_updated{api_backend_flag}, value);
+        return visit_child(*x.getVal());
+    }
+
+    uint8_t visit_child(const Config &c) const
+    {
+        if (nodes_visited != nullptr)
+            ++*nodes_visited;
+
+        uint8_t result = c.value.updated & api_backend_flag;
+
+        // All requested flags are set: The children can't add anything.
+        if (result == api_backend_flag)
+            return result;
+
+        return result | Config::apply_visitor(is_updated{api_backend_flag, nodes_visited}, c.value);
     }
 
     uint8_t api_backend_flag;
+    uint32_t *nodes_visited;
 };
 
 struct set_updated_false {
@@ -1146,6 +1321,113 @@ struct set_updated_false {
     uint8_t api_backend_flag;
 };
 
+// Returns the owner of the node itself, see get_slot_owner(). Empty nodes have no owner.
+struct get_owner {
+    uint16_t operator()(const Config::ConfString &x) const
+    {
+        return x.getOwner();
+    }
+    uint16_t operator()(const Config::ConfFloat &x) const
+    {
+        return x.getOwner();
+    }
+    uint16_t operator()(const Config::ConfInt &x) const
+    {
+        return x.getOwner();
+    }
+    uint16_t operator()(const Config::ConfUint &x) const
+    {
+        return x.getOwner();
+    }
+    uint16_t operator()(const Config::ConfInt52 &x) const
+    {
+        return x.getOwner();
+    }
+    uint16_t operator()(const Config::ConfUint53 &x) const
+    {
+        return x.getOwner();
+    }
+    uint16_t operator()(const Config::ConfBool &x) const
+    {
+        return x.getOwner();
+    }
+    uint16_t operator()(const Config::ConfVariant::Empty &x) const
+    {
+        return 0;
+    }
+    uint16_t operator()(const Config::ConfArray &x) const
+    {
+        return x.getOwner();
+    }
+    uint16_t operator()(const Config::ConfObject &x) const
+    {
+        return x.getOwner();
+    }
+    uint16_t operator()(const Config::ConfUnion &x) const
+    {
+        return x.getOwner();
+    }
+};
+
+struct assign_owner {
+    void operator()(Config::ConfString &x)
+    {
+        x.setOwner(owner);
+    }
+    void operator()(Config::ConfFloat &x)
+    {
+        x.setOwner(owner);
+    }
+    void operator()(Config::ConfInt &x)
+    {
+        x.setOwner(owner);
+    }
+    void operator()(Config::ConfUint &x)
+    {
+        x.setOwner(owner);
+    }
+    void operator()(Config::ConfInt52 &x)
+    {
+        x.setOwner(owner);
+    }
+    void operator()(Config::ConfUint53 &x)
+    {
+        x.setOwner(owner);
+    }
+    void operator()(Config::ConfBool &x)
+    {
+        x.setOwner(owner);
+    }
+    void operator()(const Config::ConfVariant::Empty &x)
+    {
+    }
+    void operator()(Config::ConfArray &x)
+    {
+        x.setOwner(owner);
+
+        for (Config &c : *x.getVal()) {
+            Config::apply_visitor(assign_owner{owner}, c.value);
+        }
+    }
+    void operator()(Config::ConfObject &x)
+    {
+        x.setOwner(owner);
+
+        const auto *slot = x.getSlot();
+        const auto size = slot->schema->length;
+
+        for (size_t i = 0; i < size; ++i) {
+            Config::apply_visitor(assign_owner{owner}, slot->values[i].value);
+        }
+    }
+    void operator()(Config::ConfUnion &x)
+    {
+        x.setOwner(owner);
+        Config::apply_visitor(assign_owner{owner}, x.getVal()->value);
+    }
+    uint16_t owner;
+};
+
 #ifdef DEBUG_FS_ENABLE
 struct api_info {
     void operator()(const Config::ConfString &x)
@@ -1174,7 +1456,7 @@ struct api_info {
     }
     void operator()(const Config::ConfBool &x)
     {
-        sw.printf("{\"type\":\"bool\",\"val\":%s}", x.value ? "true" : "false");
+        sw.printf("{\"type\":\"bool\",\"val\":%s}", x.getVal() ? "true" : "false");
     }
     void operator()(const Config::ConfVariant::Empty &x)
     {
@@ -35,11 +35,16 @@
 
 BootStage boot_stage = BootStage::STATIC_INITIALIZATION;
 
+// The bricklets and the modules' loop functions have to be polled,
+// so the main loop never sleeps longer than this, even if no task is due.
+// While a bricklet is sending, tick_hal keeps the main loop from sleeping at all.
+#define MAIN_LOOP_MAX_SLEEP 2_ms
+
 static IModule **loop_array = nullptr;
 static size_t loop_array_size = 0;
-static size_t loop_array_position = 0;
 
-static bool is_module_loop_overridden(const IModule *imodule) {
+template<void (IModule::*fn_ptr)()>
+static bool is_module_function_overridden(const IModule *imodule) {
 #if defined(__GNUC__)
     #pragma GCC diagnostic push
     #pragma GCC diagnostic ignored "-Wold-style-cast"
@@ -48,8 +53,7 @@ static bool is_module_loop_overridden(const IModule *imodule) {
     // GCC pointer to member function magic
     // http://www.cs.fsu.edu/~baker/ada/gnat/html/gcc_6.html#SEC151
     // https://stackoverflow.com/questions/3068144/print-address-of-virtual-member-function
-    void (IModule::*loop_ptr)() = &IModule::loop;
-    if ((void*)(imodule->*loop_ptr) != (void*)(&IModule::loop)) { // Get pointer to member function and compare with pointer to base class function.
+    if ((void*)(imodule->*fn_ptr) != (void*)(fn_ptr)) { // Get pointer to member function and compare with pointer to base class function.
         return true;
     } else {
         return false;
@@ -61,6 +65,134 @@ static bool is_module_loop_overridden(const IModule *imodule) {
 #endif
 }
 
+enum class BootPhase {
+    PreInit,
+    PreSetup,
+    Setup,
+    RegisterURLs,
+    RegisterEvents,
+    DeferredSetup,
+    _max = DeferredSetup
+};
+
+#define BOOT_PHASE_COUNT (static_cast<size_t>(BootPhase::_max) + 1)
+
+// Modules that took less than this in all boot phases together are not listed in info/boot_timings to save RAM.
+#define BOOT_TIMINGS_MODULE_MIN_US 1000
+
+// Indexed by module index * BOOT_PHASE_COUNT + phase. Freed after setup().
+static uint32_t *boot_module_timings_us = nullptr;
+static uint32_t boot_phase_timings_us[BOOT_PHASE_COUNT] = {};
+
+static micros_t boot_phase_start = 0_us;
+
+static Config boot_timings_module_prototype;
+static ConfigRoot boot_timings;
+
+static void run_boot_phase(BootPhase phase, void (IModule::*fn_ptr)()) {
+    size_t phase_idx = static_cast<size_t>(phase);
+
+    for (size_t i = 0; i < imodules_count; i++) {
+        micros_t start = now_us();
+        ((*imodules[i].imodule)->*fn_ptr)();
+
+        if (boot_module_timings_us != nullptr) {
+            boot_module_timings_us[i * BOOT_PHASE_COUNT + phase_idx] = (now_us() - start).as<uint32_t>();
+        }
+    }
+}
+
+static void finish_boot_phase(BootPhase phase) {
+    micros_t now = now_us();
+    boot_phase_timings_us[static_cast<size_t>(phase)] = (now - boot_phase_start).as<uint32_t>();
+    boot_phase_start = now;
+}
+
+static void create_boot_timings_state() {
+    boot_timings_module_prototype = Config::Object({
+        {"name", Config::Str("", 0, 32)},
+        {"timings_us", Config::Array({},
+            Config::get_prototype_uint32_0(),
+            BOOT_PHASE_COUNT, BOOT_PHASE_COUNT, Config::type_id<Config::ConfUint>()
+        )},
+    });
+
+    boot_timings = Config::Object({
+        {"timings_us", Config::Array({},
+            Config::get_prototype_uint32_0(),
+            BOOT_PHASE_COUNT, BOOT_PHASE_COUNT, Config::type_id<Config::ConfUint>()
+        )},
+        {"modules", Config::Array({},
+            &boot_timings_module_prototype,
+            0, static_cast<uint16_t>(imodules_count), Config::type_id<Config::ConfObject>()
+        )},
+    });
+}
+
+static void update_boot_timings_state() {
+    for (size_t phase_idx = 0; phase_idx < BOOT_PHASE_COUNT; phase_idx++) {
+        boot_timings.get("timings_us")->get(phase_idx)->updateUint(boot_phase_timings_us[phase_idx]);
+    }
+
+    if (boot_module_timings_us == nullptr)
+        return;
+
+    for (size_t i = 0; i < imodules_count; i++) {
+        const uint32_t *module_timings_us = boot_module_timings_us + i * BOOT_PHASE_COUNT;
+        uint32_t total_us = 0;
+
+        for (size_t phase_idx = 0; phase_idx < BOOT_PHASE_COUNT; phase_idx++) {
+            total_us += module_timings_us[phase_idx];
+        }
+
+        if (total_us < BOOT_TIMINGS_MODULE_MIN_US && !is_module_function_overridden<&IModule::deferred_setup>(*imodules[i].imodule))
+            continue;
+
+        // add() can trigger a move of ConfObjects, so get() must be called after it.
+        boot_timings.get("modules")->add();
+        Config *conf_module = static_cast<Config *>(boot_timings.get("modules")->get(boot_timings.get("modules")->count() - 1));
+
+        conf_module->get("name")->updateString(imodules[i].name);
+
+        for (size_t phase_idx = 0; phase_idx < BOOT_PHASE_COUNT; phase_idx++) {
+            conf_module->get("timings_us")->get(phase_idx)->updateUint(module_timings_us[phase_idx]);
+        }
+    }
+}
+
+// Runs the deferred setup of one module per task, starting with the module at first_idx,
+// so that the main loop keeps running in between.
+static void schedule_deferred_setup(size_t first_idx) {
+    for (size_t i = first_idx; i < imodules_count; i++) {
+        if (!is_module_function_overridden<&IModule::deferred_setup>(*imodules[i].imodule))
+            continue;
+
+        task_scheduler.scheduleOnce([i]() {
+            micros_t start = now_us();
+            (*imodules[i].imodule)->deferred_setup();
+            uint32_t runtime_us = (now_us() - start).as<uint32_t>();
+
+            const size_t phase_idx = static_cast<size_t>(BootPhase::DeferredSetup);
+
+            boot_phase_timings_us[phase_idx] += runtime_us;
+            boot_timings.get("timings_us")->get(phase_idx)->updateUint(boot_phase_timings_us[phase_idx]);
+
+            for (Config &conf_module : boot_timings.get("modules")) {
+                if (strcmp(conf_module.get("name")->asUnsafeCStr(), imodules[i].name) == 0) {
+                    conf_module.get("timings_us")->get(phase_idx)->updateUint(runtime_us);
+                    break;
+                }
+            }
+
+            schedule_deferred_setup(i + 1);
+        }, 0_ms);
+
+        return;
+    }
+
+    logger.printfln("Deferred setup done");
+}
+
 // declared and initialized by board module
 extern TF_HAL hal;
 // initialized by board module
@@ -187,6 +319,7 @@ static void register_default_urls() {
     }, true);
 
     api.addState("info/modules", &modules);
+    api.addState("info/boot_timings", &boot_timings);
 
     server.on_HTTPThread("/force_reboot", HTTP_GET, [](WebServerRequest request) {
         esp_unregister_shutdown_handler(pre_reboot);
@@ -236,9 +369,10 @@ void setup()
     // However if BUILD_MONITOR_SPEED is not the ROM bootloader's preferred speed, this call will change the speed.
     Serial.begin(BUILD_MONITOR_SPEED);
 
-    for (size_t i = 0; i < imodules_count; i++) {
-        (*imodules[i].imodule)->pre_init();
-    }
+    boot_module_timings_us = static_cast<uint32_t *>(calloc(imodules_count * BOOT_PHASE_COUNT, sizeof(uint32_t)));
+
+    boot_phase_start = now_us();
+    run_boot_phase(BootPhase::PreInit, &IModule::pre_init);
 
     if (!mount_or_format_spiffs()) {
         logger.printfln("Failed to mount SPIFFS.");
@@ -246,17 +380,19 @@ void setup()
 
     check_memory_assumptions();
 
+    finish_boot_phase(BootPhase::PreInit);
+
     boot_stage = BootStage::PRE_SETUP;
 
-    for (size_t i = 0; i < imodules_count; i++) {
-        (*imodules[i].imodule)->pre_setup();
-    }
+    create_boot_timings_state();
+
+    run_boot_phase(BootPhase::PreSetup, &IModule::pre_setup);
+
+    finish_boot_phase(BootPhase::PreSetup);
 
     boot_stage = BootStage::SETUP;
 
-    for (size_t i = 0; i < imodules_count; i++) {
-        (*imodules[i].imodule)->setup();
-    }
+    run_boot_phase(BootPhase::Setup, &IModule::setup);
 
     modules = modules_get_init_config();
 
@@ -264,34 +400,36 @@ void setup()
     config_post_setup();
     server.post_setup();
 
+    finish_boot_phase(BootPhase::Setup);
+
     boot_stage = BootStage::REGISTER_URLS;
 
     register_default_urls();
 
-    for (size_t i = 0; i < imodules_count; i++) {
-        (*imodules[i].imodule)->register_urls();
-    }
+    run_boot_phase(BootPhase::RegisterURLs, &IModule::register_urls);
+
+    finish_boot_phase(BootPhase::RegisterURLs);
 
     boot_stage = BootStage::REGISTER_EVENTS;
 
-    for (size_t i = 0; i < imodules_count; i++) {
-        (*imodules[i].imodule)->register_events();
-    }
+    run_boot_phase(BootPhase::RegisterEvents, &IModule::register_events);
+
+    finish_boot_phase(BootPhase::RegisterEvents);
 
     // Ignore non-overridden empty loop functions.
     for (size_t i = 0; i < imodules_count; i++) {
-        if (is_module_loop_overridden(*imodules[i].imodule)) {
+        if (is_module_function_overridden<&IModule::loop>(*imodules[i].imodule)) {
             loop_array_size++;
         }
     }
 
-    // Add all overridden loop functions to an array for round-robin execution.
+    // Add all overridden loop functions to an array.
     if (loop_array_size > 0) {
         loop_array = static_cast<IModule **>(malloc(sizeof(IModule *) * loop_array_size));
 
         size_t loop_array_used = 0;
         for (size_t i = 0; i < imodules_count; i++) {
-            if (is_module_loop_overridden(*imodules[i].imodule)) {
+            if (is_module_function_overridden<&IModule::loop>(*imodules[i].imodule)) {
                 loop_array[loop_array_used] = *imodules[i].imodule;
                 loop_array_used++;
             }
@@ -306,9 +444,44 @@ void setup()
         logger.printfln("Failed to register reboot handler");
     }
 
+    update_boot_timings_state();
+    free(boot_module_timings_us);
+    boot_module_timings_us = nullptr;
+
     logger.printfln("Initialization done");
 
     boot_stage = BootStage::LOOP;
+
+    schedule_deferred_setup(0);
+}
+
+// The bricklets can't signal the ESP; they are polled via SPITFP.
+// Ticks every bricklet once. Returns true if a bricklet sent a new packet or
+// still has a packet to send, i.e. if the HAL should be ticked again right away.
+static bool tick_hal() {
+    TF_HALCommon *hal_common = tf_hal_get_common(&hal);
+    uint16_t tfps_used = hal_common->tfps_used;
+    uint8_t seq_seen[TF_INVENTORY_SIZE];
+
+    for (uint16_t i = 0; i < tfps_used; ++i) {
+        seq_seen[i] = hal_common->tfps[i].spitfp->last_sequence_number_seen;
+    }
+
+    // With a timeout of 0, tf_hal_tick ticks the next bricklet in round-robin order.
+    uint16_t ticks = tfps_used > 0 ? tfps_used : 1;
+    for (uint16_t i = 0; i < ticks; ++i) {
+        tf_hal_tick(&hal, 0);
+    }
+
+    for (uint16_t i = 0; i < tfps_used; ++i) {
+        const TF_SPITFP *spitfp = hal_common->tfps[i].spitfp;
+
+        if (spitfp->last_sequence_number_seen != seq_seen[i] || spitfp->send_buf[0] != 0) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
 void loop() {
@@ -316,20 +489,24 @@ void loop() {
     watchdog.reset(watchdog_handle);
 #endif
 
-    tf_hal_tick(&hal, 0);
+    bool hal_busy = tick_hal();
     task_scheduler.custom_loop();
 
 #if MODULE_DEBUG_AVAILABLE()
     debug.custom_loop();
 #endif
 
-    // Round-robin for modules' loop functions, to prioritize HAL ticks and scheduler.
-    if (loop_array != nullptr) {
-        loop_array[loop_array_position]->loop();
+    for (size_t i = 0; i < loop_array_size; i++) {
+        loop_array[i]->loop();
+    }
 
-        loop_array_position++;
-        if (loop_array_position >= loop_array_size) {
-            loop_array_position = 0;
-        }
+    if (hal_busy) {
+        return;
     }
+
+#if MODULE_DEBUG_AVAILABLE()
+    debug.main_loop_slept(task_scheduler.waitForWork(MAIN_LOOP_MAX_SLEEP));
+#else
+    task_scheduler.waitForWork(MAIN_LOOP_MAX_SLEEP);
+#endif
 }
@@ -34,6 +34,9 @@ public:
     virtual void setup() { initialized = true; }
     virtual void register_urls() {}
     virtual void register_events() {}
+    // Non-critical setup work. Runs in the main loop after all modules are set up
+    // and the web server is reachable, one module per task.
+    virtual void deferred_setup() {}
     virtual void loop() {}
     virtual void pre_reboot() {}
 
@@ -19,6 +19,7 @@
 
 #include "api.h"
 
+#include <algorithm>
 #include <esp_task.h>
 #include <LittleFS.h>
 
@@ -93,17 +94,45 @@ void API::setup()
         bool skip_high_latency_states = state_update_counter % 4 != 0;
         ++state_update_counter;
 
+        // Take the dirty marks collected since the last run.
+        // Keep both buffers to not reallocate them in each run.
+        std::swap(dirty_owners, Config::dirty_owners);
+        std::fill(Config::dirty_owners.begin(), Config::dirty_owners.end(), 0);
+
+        const uint32_t unowned_update_generation = Config::unowned_update_generation;
         const size_t states_count = states.size();
+        uint32_t states_checked = 0;
+        uint32_t nodes_visited = 0;
 
         for (size_t state_idx = 0; state_idx < states_count; ++state_idx) {
-            const auto &reg = states[state_idx];
+            auto &reg = states[state_idx];
+
+            const size_t bit = reg.owner - 1;
+            const bool dirty = bit / 32 < dirty_owners.size() && (dirty_owners[bit / 32] & (1u << (bit % 32))) != 0;
+            const bool claim = reg.claimed_generation != unowned_update_generation;
 
-            if (skip_high_latency_states && !reg.low_latency)
+            // None of the config's nodes was updated since the last run.
+            // There is no need to walk the whole tree.
+            if (!dirty && !claim)
                 continue;
 
+            if (skip_high_latency_states && !reg.low_latency) {
+                if (dirty)
+                    Config::mark_owner_dirty(reg.owner);
+                continue;
+            }
+
+            // Nodes without owner were updated: Claim all of them.
+            if (claim) {
+                reg.config->set_owner(reg.owner);
+                reg.claimed_generation = unowned_update_generation;
+            }
+
+            ++states_checked;
+
             const size_t backend_count = this->backends.size();
 
-            uint8_t to_send = reg.config->was_updated((1 << backend_count) - 1);
+            uint8_t to_send = reg.config->was_updated((1 << backend_count) - 1, &nodes_visited);
             // If the config was not updated for any API, we don't have to serialize the payload.
             if (to_send == 0) {
                 continue;
@@ -143,7 +172,18 @@ void API::setup()
             }
 
             reg.config->clear_updated(sent);
+
+            // Backends that failed to send keep their updated flag set and must be retried in the next run.
+            if (sent != to_send)
+                Config::mark_owner_dirty(reg.owner);
         }
+
+        for (IAPIBackend *backend : this->backends) {
+            backend->flushStateUpdates();
+        }
+
+        state_update_states_checked = states_checked;
+        state_update_nodes_visited = nodes_visited;
     }, 250_ms, 250_ms);
 
     initialized = true;
@@ -165,7 +205,7 @@ void API::addCommand(const char * const path, ConfigRoot *config, const std::vec
 {
     size_t path_len = strlen(path);
 
-    if (path_len > std::numeric_limits<decltype(CommandRegistration::path_len)>::max()) {
+    if (path_len > std::numeric_limits<decltype(APIPath::path_len)>::max()) {
         logger.printfln("Command %s: path too long!", path);
         return;
     }
@@ -204,6 +244,8 @@ void API::addCommand(const char * const path, ConfigRoot *config, const std::vec
 
     auto commandIdx = commands.size() - 1;
 
+    addPath(path, path_len, APIPath::Type::Command, commandIdx);
+
     for (auto *backend : this->backends) {
         backend->addCommand(commandIdx, commands[commandIdx]);
     }
@@ -223,7 +265,7 @@ void API::addState(const char * const path, ConfigRoot *config, const std::vecto
 {
     size_t path_len = strlen(path);
 
-    if (path_len > std::numeric_limits<decltype(StateRegistration::path_len)>::max()) {
+    if (path_len > std::numeric_limits<decltype(APIPath::path_len)>::max()) {
         logger.printfln("State %s: path too long!", path);
         return;
     }
@@ -274,6 +316,20 @@ void API::addState(const char * const path, ConfigRoot *config, const std::vecto
         }
     }
 
+    auto stateIdx = states.size();
+
+    if (stateIdx >= std::numeric_limits<uint16_t>::max())
+        esp_system_abort("Too many states!");
+
+    // States of the same config share the owner ID: A config's nodes can only have one owner.
+    uint32_t owner = stateIdx + 1;
+    for (const auto &reg : states) {
+        if (reg.config == config) {
+            owner = reg.owner;
+            break;
+        }
+    }
+
     states.push_back({
         path,
         ktc,
@@ -282,10 +338,12 @@ void API::addState(const char * const path, ConfigRoot *config, const std::vecto
         path_len,
         ktc_size,
         ktc_debug_size,
-        low_latency
+        low_latency,
+        owner,
+        Config::unowned_update_generation - 1, // Never claimed yet.
     });
 
-    auto stateIdx = states.size() - 1;
+    addPath(path, path_len, APIPath::Type::State, stateIdx);
 
     for (auto *backend : this->backends) {
         backend->addState(stateIdx, states[stateIdx]);
@@ -383,7 +441,7 @@ void API::addResponse(const char * const path, ConfigRoot *config, const std::ve
 {
     size_t path_len = strlen(path);
 
-    if (path_len > std::numeric_limits<decltype(ResponseRegistration::path_len)>::max()) {
+    if (path_len > std::numeric_limits<decltype(APIPath::path_len)>::max()) {
         logger.printfln("Response %s: path too long!", path);
         return;
     }
@@ -419,6 +477,8 @@ void API::addResponse(const char * const path, ConfigRoot *config, const std::ve
     });
     auto responseIdx = responses.size() - 1;
 
+    addPath(path, path_len, APIPath::Type::Response, responseIdx);
+
     for (auto *backend : this->backends) {
         backend->addResponse(responseIdx, responses[responseIdx]);
     }
@@ -878,31 +938,13 @@ String API::callCommand(const char *path, const Config::ConfUpdate &payload)
         return "Use char *, size_t overload of callCommand in non-main thread!";
     }
 
-    CommandRegistration *reg = nullptr;
+    const APIPath *entry = findPath(path, strlen(path));
 
-    // If the called path is in rodata, try a quick address check first.
-    if (string_is_in_rodata(path)) {
-        for (CommandRegistration &chk_reg : commands) {
-            if (chk_reg.path == path) { // Address comparison
-                reg = &chk_reg;
-                break;
-            }
-        }
+    if (entry == nullptr || entry->type != APIPath::Type::Command) {
+        return StringSumHelper("Unknown command: ") + path;
     }
 
-    // If the address check didn't find a match, try string comparison instead.
-    if (!reg) {
-        for (CommandRegistration &chk_reg : commands) {
-            if (strcmp(chk_reg.path, path) == 0) {
-                reg = &chk_reg;
-                break;
-            }
-        }
-
-        if (!reg) {
-            return StringSumHelper("Unknown command: ") + path;
-        }
-    }
+    CommandRegistration *reg = &commands[entry->idx];
 
     String error = reg->config->update(&payload);
 
@@ -921,25 +963,14 @@ const Config *API::getState(const char *path, bool log_if_not_found, size_t path
         return nullptr;
     }
 
-    // If the requested path is in rodata, try a quick address check first.
-    if (string_is_in_rodata(path)) {
-        for (const auto &reg : states) {
-            if (path == reg.path) { // Address check
-                return reg.config;
-            }
-        }
-    }
-
     if (!path_len) {
         path_len = strlen(path);
     }
 
-    for (const auto &reg : states) {
-        if (path_len != reg.path_len || strcmp(path, reg.path) != 0) {
-            continue;
-        }
+    const APIPath *entry = findPath(path, path_len);
 
-        return reg.config;
+    if (entry != nullptr && entry->type == APIPath::Type::State) {
+        return states[entry->idx].config;
     }
 
     if (log_if_not_found) {
@@ -971,24 +1002,103 @@ void API::addFeature(const char *name)
 
 bool API::already_registered(const char *path, size_t path_len, const char *api_type)
 {
-    for (auto &reg : this->states) {
-        if (path_len != reg.path_len || memcmp(path, reg.path, path_len) != 0)
-            continue;
-        logger.printfln("Can't register %s %s. Already registered as state!", api_type, path);
-        return true;
+    const APIPath *entry = findPath(path, path_len);
+
+    if (entry == nullptr)
+        return false;
+
+    const char *registered_type;
+    switch (entry->type) {
+        case APIPath::Type::State:    registered_type = "state";    break;
+        case APIPath::Type::Command:  registered_type = "command";  break;
+        case APIPath::Type::Response: registered_type = "response"; break;
+        default:                      registered_type = "unknown";  break;
     }
-    for (auto &reg : this->commands) {
-        if (path_len != reg.path_len || memcmp(path, reg.path, path_len) != 0)
-            continue;
-        logger.printfln("Can't register %s %s. Already registered as command!", api_type, path);
-        return true;
+
+    logger.printfln("Can't register %s %s. Already registered as %s!", api_type, path, registered_type);
+    return true;
+}
+
+// Index of the first entry that is not less than path. Entries are ordered by length first.
+static size_t path_lower_bound(const std::vector<APIPath> &paths, const char *path, size_t path_len)
+{
+    size_t lo = 0;
+    size_t hi = paths.size();
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const APIPath &entry = paths[mid];
+
+        int cmp;
+        if (entry.path_len != path_len) {
+            cmp = entry.path_len < path_len ? -1 : 1;
+        } else {
+            cmp = memcmp(entry.path, path, path_len);
+        }
+
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
     }
-    for (auto &reg : this->responses) {
-        if (path_len != reg.path_len || memcmp(path, reg.path, path_len) != 0)
-            continue;
-        logger.printfln("Can't register %s %s. Already registered as response!", api_type, path);
-        return true;
+
+    return lo;
+}
+
+const APIPath *API::findPath(const char *path, size_t path_len) const
+{
+    size_t pos = path_lower_bound(paths, path, path_len);
+
+    if (pos >= paths.size())
+        return nullptr;
+
+    const APIPath &entry = paths[pos];
+    if (entry.path_len != path_len || memcmp(entry.path, path, path_len) != 0)
+        return nullptr;
+
+    return &entry;
+}
+
+void API::addPath(const char *path, size_t path_len, APIPath::Type type, size_t idx)
+{
+    if (idx >= APIPath::NO_UPDATE_COMMAND) {
+        esp_system_abort("Too many API registrations of one type");
     }
 
-    return false;
+    static constexpr const char update_suffix[] = "_update";
+    static constexpr size_t update_suffix_len = sizeof(update_suffix) - 1;
+
+    uint16_t update_command_idx = APIPath::NO_UPDATE_COMMAND;
+
+    if (type == APIPath::Type::State) {
+        // Usually registered after the state, but link it if it already exists.
+        String update_path = StringSumHelper(path) + update_suffix;
+        const APIPath *update_entry = findPath(update_path.c_str(), update_path.length());
+
+        if (update_entry != nullptr && update_entry->type == APIPath::Type::Command) {
+            update_command_idx = update_entry->idx;
+        }
+    } else if (type == APIPath::Type::Command && path_len > update_suffix_len && memcmp(path + path_len - update_suffix_len, update_suffix, update_suffix_len) == 0) {
+        size_t state_path_len = path_len - update_suffix_len;
+        size_t state_pos = path_lower_bound(paths, path, state_path_len);
+
+        if (state_pos < paths.size()) {
+            APIPath &state_entry = paths[state_pos];
+
+            if (state_entry.type == APIPath::Type::State && state_entry.path_len == state_path_len && memcmp(state_entry.path, path, state_path_len) == 0) {
+                state_entry.update_command_idx = static_cast<uint16_t>(idx);
+            }
+        }
+    }
+
+    size_t pos = path_lower_bound(paths, path, path_len);
+
+    paths.insert(paths.begin() + static_cast<ptrdiff_t>(pos), {
+        path,
+        static_cast<uint16_t>(path_len),
+        type,
+        static_cast<uint16_t>(idx),
+        update_command_idx,
+    });
 }
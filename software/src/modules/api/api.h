@@ -41,6 +41,11 @@ struct StateRegistration {
     const size_t keys_to_censor_len;
     const size_t keys_to_censor_in_debug_report_len;
     const uint32_t low_latency;
+
+    // Owner ID of the config's nodes, see Config::set_owner(). Shared by all states of the same config.
+    const uint32_t owner;
+    // Config::unowned_update_generation at which the config's nodes were last claimed.
+    uint32_t claimed_generation;
 };
 
 // Will be stored in IRAM -> use 32 bit integers even if a bool would be sufficient
@@ -65,6 +70,25 @@ struct ResponseRegistration {
     const size_t keys_to_censor_in_debug_report_len;
 };
 
+// Entry of the path index. Kept sorted by (path_len, path) to allow a binary search.
+struct APIPath {
+    enum class Type : uint8_t {
+        State,
+        Command,
+        Response,
+    };
+
+    static constexpr uint16_t NO_UPDATE_COMMAND = UINT16_MAX;
+
+    const char *path;
+    uint16_t path_len;
+    Type type;
+    // Index into API::states, API::commands or API::responses, depending on type.
+    uint16_t idx;
+    // States only: Index of the [path]_update command if registered, NO_UPDATE_COMMAND otherwise.
+    uint16_t update_command_idx;
+};
+
 class IAPIBackend
 {
 public:
@@ -79,6 +103,8 @@ public:
         AsString
     };
     virtual WantsStateUpdate wantsStateUpdate(size_t stateIdx);
+    // Called after each state update run. Backends that batch state updates send them here.
+    virtual void flushStateUpdates() {}
 };
 
 class API final : public IModule
@@ -108,6 +134,10 @@ public:
     const Config *getState(const char *path, bool log_if_not_found = true, size_t path_len = 0);
     const Config *getState(const String &path, bool log_if_not_found = true);
 
+    // Returns the state, command or response registered under path or nullptr.
+    // Safe to call from other tasks after the REGISTER_URLS boot stage.
+    const APIPath *findPath(const char *path, size_t path_len) const;
+
     void addFeature(const char *name);
 
     // Prefer this version of addCommand over the one below.
@@ -149,9 +179,20 @@ public:
 
     uint8_t state_update_counter = 0;
 
+    // Statistics of the last state update run. Not stored in a Config:
+    // Updating a Config from here would mark a state as dirty in each run.
+    uint32_t state_update_states_checked = 0;
+    uint32_t state_update_nodes_visited = 0;
+
 private:
     bool already_registered(const char *path, size_t path_len, const char *api_type);
 
+    // Config::dirty_owners of the current state update run.
+    std::vector<uint32_t> dirty_owners;
+    void addPath(const char *path, size_t path_len, APIPath::Type type, size_t idx);
+
+    std::vector<APIPath> paths;
+
     void executeCommand(const CommandRegistration &reg, Config::ConfUpdate payload);
 
     Config features_prototype;
@@ -66,7 +66,9 @@ static PhaseRotation convert_phase_rotation(CMPhaseRotation pr) {
 
 void ChargeManager::pre_setup()
 {
-    this->trace_buffer_index = logger.alloc_trace_buffer("charge_manager", 2 << 20);
+    this->trace_buffer_index = logger.alloc_trace_buffer("charge_manager", 1 << 20);
+    // Download with /trace_buffer/charge_manager_decisions and decode with decode_decisions.py
+    this->decision_buffer_index = logger.alloc_trace_buffer("charge_manager_decisions", 1 << 20, true);
 
     config_chargers_prototype = Config::Object({
         {"host", Config::Str("", 0, 64)},
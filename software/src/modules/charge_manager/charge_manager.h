@@ -73,6 +73,7 @@ public:
     ChargerState *get_mutable_charger_state(uint8_t idx);
 
     size_t trace_buffer_index;
+    size_t decision_buffer_index;
 
     uint8_t translate_charge_mode(ConfigChargeMode power_manager_charge_mode);
 
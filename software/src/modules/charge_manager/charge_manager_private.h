@@ -6,9 +6,13 @@
 #include "current_limits.h"
 
 #include "tools.h"
+#include "modules/cm_networking/cm_networking_defs.h"
 
 #define DISTRIBUTION_LOG_LEN 2048
 
+// sort_chargers is called 15 times per allocation.
+#define SORT_CACHE_SLOTS 16
+
 #define CHARGE_MANAGER_ERROR_CHARGER_UNREACHABLE 128
 #define CHARGE_MANAGER_ERROR_EVSE_UNREACHABLE 129
 #define CHARGE_MANAGER_ERROR_EVSE_NONREACTIVE 130
@@ -43,6 +47,31 @@ struct CurrentAllocatorConfig {
     uint16_t requested_current_threshold;
 };
 
+namespace ChargerFlag {
+    enum Type : uint8_t {
+        Off = 1,
+        WantsToCharge = 2,
+        WantsToChargeLowPriority = 4,
+        IsCharging = 8,
+        PhaseSwitchSupported = 16,
+
+        // Only used by the allocation decision record.
+        ObservePVLimit = 32,
+        EcoFast = 64
+    };
+}
+
+// The charger state fields that the allocator's inner loops read, as parallel arrays.
+// Filled from the charger states at the start of each allocation; the stages don't modify these fields.
+struct ChargerColumns {
+    int requested_current_1p[MAX_CONTROLLED_CHARGERS];
+    int requested_current_3p[MAX_CONTROLLED_CHARGERS];
+    float allocated_average_power[MAX_CONTROLLED_CHARGERS];
+    PhaseRotation phase_rotation[MAX_CONTROLLED_CHARGERS];
+    uint8_t charge_mode[MAX_CONTROLLED_CHARGERS];
+    uint8_t flags[MAX_CONTROLLED_CHARGERS];
+};
+
 // R+W _only_ by current_allocator.cpp
 struct CurrentAllocatorState {
     bool last_print_local_log_was_error = false;
@@ -54,6 +83,17 @@ struct CurrentAllocatorState {
 
     Cost control_window_min = {0, 0, 0, 0};
     Cost control_window_max = {0, 0, 0, 0};
+
+    // Result of each sort_chargers call of the last allocation, in call order.
+    struct SortOrder {
+        uint8_t count;
+        uint8_t idx[MAX_CONTROLLED_CHARGERS];
+    } sort_cache[SORT_CACHE_SLOTS] = {};
+
+    ChargerColumns columns = {};
+
+    // Sequence number of the allocation decision record.
+    uint32_t record_seq = 0;
 };
 
 namespace ChargeMode {
@@ -34,10 +34,12 @@
 
 //#include "gcc_warnings.h"
 
+// Truncates the line and stops at the terminating NUL if the distribution log is full.
 #define LOCAL_LOG_FULL(indent, fmt, ...) \
     do { \
         if(local_log) { \
-            local_log += snprintf_u(local_log, cfg->distribution_log_len - (local_log - cfg->distribution_log.get()), indent fmt "%c" __VA_OPT__(,) __VA_ARGS__, '\0'); \
+            size_t log_remaining = cfg->distribution_log_len - (local_log - cfg->distribution_log.get()); \
+            local_log += std::min(log_remaining - 1, snprintf_u(local_log, log_remaining, indent fmt "%c" __VA_OPT__(,) __VA_ARGS__, '\0')); \
         } \
     } while (0)
 
@@ -87,71 +89,182 @@ static void print_alloc(int stage, const StageContext &sc) {
     logger.printfln("%s", buf);
 }
 
-static void trace_alloc(int stage, const StageContext &sc) {
+#define record_entry(entry, len) logger.trace_plain(charge_manager.decision_buffer_index, (const char *)(entry), len)
+
+// The allocation of the previous stage, to record only the changes of each stage.
+struct RecordedAllocation {
+    int current[MAX_CONTROLLED_CHARGERS];
+    uint8_t phases[MAX_CONTROLLED_CHARGERS];
+};
+
 #if defined(BOARD_HAS_PSRAM)
-    char buf[768] = {};
-    trace("%d: raw(%d %d %d %d) min(%d %d %d %d) spread(%d %d %d %d) max_pv %d",
-           stage,
-           sc.limits->raw[0],
-           sc.limits->raw[1],
-           sc.limits->raw[2],
-           sc.limits->raw[3],
+static void record_limits(ca_record_limits *out, const CurrentLimits *limits) {
+    for (size_t i = 0; i < 4; ++i) {
+        out->raw[i] = limits->raw[i];
+        out->min[i] = limits->min[i];
+        out->spread[i] = limits->spread[i];
+    }
+    out->max_pv = limits->max_pv;
+}
 
-           sc.limits->min[0],
-           sc.limits->min[1],
-           sc.limits->min[2],
-           sc.limits->min[3],
+// Milliseconds since the timestamp or -1 if it is not set.
+static int32_t record_age(micros_t now, micros_t timestamp) {
+    if (timestamp == 0_us)
+        return -1;
 
-           sc.limits->spread[0],
-           sc.limits->spread[1],
-           sc.limits->spread[2],
-           sc.limits->spread[3],
+    return (int32_t)std::clamp((now - timestamp).to<millis_t>().as<int64_t>(), (int64_t)0, (int64_t)INT32_MAX);
+}
+#endif
 
-           sc.limits->max_pv);
+static void record_begin(const StageContext &sc, RecordedAllocation *recorded) {
+#if defined(BOARD_HAS_PSRAM)
+    auto now = now_us();
 
-    char *ptr = buf;
-    ptr += snprintf(ptr, sizeof(buf) - (ptr - buf), "%d: ", stage);
-    for(size_t i = 0; i < sc.charger_count; ++i) {
-        if (stage == 0) {
-            ptr += snprintf(ptr, sizeof(buf) - (ptr - buf), "[%2zu %dp %11s ]", i, sc.phase_allocation[i], ChargeMode::Strings[sc.charger_state[i].charge_mode]);
-        } else {
-            if (sc.phase_allocation[i] == 0 && sc.current_allocation[i] == 0)
-                ptr += snprintf(ptr, sizeof(buf) - (ptr - buf), "[        %2zu        ]", i);
-            else
-                ptr += snprintf(ptr, sizeof(buf) - (ptr - buf), "[%2zu %5d@%dp       ]", i, sc.current_allocation[i], sc.phase_allocation[i]);
-        }
+    ca_record_begin begin = {};
+    begin.header = {CA_RECORD_MAGIC, CARecordType::Begin, sizeof(begin)};
+    begin.seq = sc.ca_state->record_seq++;
+    begin.now_us = now.as<int64_t>();
+    begin.version = CA_RECORD_VERSION;
+    begin.charger_count = (uint8_t)sc.charger_count;
+    begin.global_hysteresis_elapsed = sc.ca_state->global_hysteresis_elapsed;
+    record_limits(&begin.limits, sc.limits);
+    record_entry(&begin, sizeof(begin));
+
+    for (size_t i = 0; i < sc.charger_count; ++i) {
+        const auto *state = &sc.charger_state[i];
+        const auto *alloc = &sc.charger_allocation_state[i];
+
+        ca_record_charger charger = {};
+        charger.header = {CA_RECORD_MAGIC, CARecordType::Charger, sizeof(charger)};
+        charger.idx = (uint8_t)i;
+        charger.charge_mode = state->charge_mode;
+        charger.flags = sc.columns->flags[i];
+        charger.phase_rotation = (uint8_t)state->phase_rotation;
+        charger.phases = state->phases;
+        charger.last_allocated_phases = sc.phase_allocation[i];
+        charger.charger_state = state->charger_state;
+        charger.requested_current = state->requested_current;
+        charger.supported_current = state->supported_current;
+        charger.allowed_current = state->allowed_current;
+        charger.last_allocated_current = alloc->allocated_current;
+        charger.guaranteed_pv_current = state->guaranteed_pv_current;
+        charger.allocated_average_power = state->allocated_average_power;
+        charger.last_switch_on_age = record_age(now, state->last_switch_on);
+        charger.last_phase_switch_age = record_age(now, state->last_phase_switch);
+        charger.just_plugged_in_age = record_age(now, state->just_plugged_in_timestamp);
+        charger.last_wakeup_age = record_age(now, state->last_wakeup);
+        charger.use_supported_current_age = record_age(now, state->use_supported_current);
+        record_entry(&charger, sizeof(charger));
+
+        recorded->current[i] = sc.current_allocation[i];
+        recorded->phases[i] = sc.phase_allocation[i];
+    }
+#else
+    (void)sc;
+    (void)recorded;
+#endif
+}
 
-        if (i % 8 == 7 && i != sc.charger_count - 1) {
-            trace("%s", buf);
-            ptr = buf;
-            ptr += snprintf(ptr, sizeof(buf) - (ptr - buf), "   ");
-        }
+static void record_sort(int stage, int matched, const StageContext &sc) {
+#if defined(BOARD_HAS_PSRAM)
+    ca_record_sort sort;
+    size_t len = offsetof(ca_record_sort, idx) + (((size_t)matched + 3) & ~(size_t)3);
+
+    sort.header = {CA_RECORD_MAGIC, CARecordType::Sort, (uint16_t)len};
+    sort.stage = (uint8_t)stage;
+    sort.charge_mode_filter = (uint8_t)sc.charge_mode_filter;
+    sort.charger_count = (uint8_t)sc.charger_count;
+    sort.matched = (uint8_t)matched;
+
+    for (int i = 0; i < matched; ++i)
+        sort.idx[i] = (uint8_t)sc.idx_array[i];
+
+    for (size_t i = (size_t)matched; i < len - offsetof(ca_record_sort, idx); ++i)
+        sort.idx[i] = 0;
+
+    record_entry(&sort, len);
+#else
+    (void)stage;
+    (void)matched;
+    (void)sc;
+#endif
+}
+
+static void record_stage(int stage, const StageContext &sc, RecordedAllocation *recorded) {
+#if defined(BOARD_HAS_PSRAM)
+    ca_record_stage entry;
+    size_t changes = 0;
+
+    for (size_t i = 0; i < sc.charger_count; ++i) {
+        if (sc.current_allocation[i] == recorded->current[i] && sc.phase_allocation[i] == recorded->phases[i])
+            continue;
+
+        entry.changes[changes++] = {(uint8_t)i, sc.phase_allocation[i], (uint16_t)sc.current_allocation[i]};
+        recorded->current[i] = sc.current_allocation[i];
+        recorded->phases[i] = sc.phase_allocation[i];
     }
-    trace("%s", buf);
+
+    size_t len = offsetof(ca_record_stage, changes) + changes * sizeof(ca_record_change);
+
+    entry.header = {CA_RECORD_MAGIC, CARecordType::Stage, (uint16_t)len};
+    entry.stage = (uint8_t)stage;
+    entry.charge_mode_filter = (uint8_t)sc.charge_mode_filter;
+    entry.change_count = (uint8_t)changes;
+    entry._padding = 0;
+
+    for (size_t i = 0; i < 4; ++i)
+        entry.raw[i] = sc.limits->raw[i];
+
+    record_entry(&entry, len);
+#else
+    (void)stage;
+    (void)sc;
+    (void)recorded;
 #endif
 }
 
-static void trace_sort_fn(int stage, int matched, const StageContext &sc) {
+static void record_end(int result, const StageContext &sc) {
 #if defined(BOARD_HAS_PSRAM)
-    char buf[200];
-    memset(buf, 0, sizeof(buf));
-    char *ptr = buf;
-    ptr += snprintf(ptr, ARRAY_SIZE(buf) - (ptr - buf), "%d: filtered %d to %d%s", stage, sc.charger_count, matched, matched > 0 ? ", sorted to " : ".");
-    if (matched > 0) {
-        for(int i = 0; i < matched; ++i)
-            ptr += snprintf(ptr, ARRAY_SIZE(buf) - (ptr - buf), "%d %s", sc.idx_array[i], (matched < sc.charger_count) && (i == matched - 1) ? "|..." : "");
+    ca_record_end end = {};
+    end.header = {CA_RECORD_MAGIC, CARecordType::End, sizeof(end)};
+    end.result = (uint8_t)result;
+    record_limits(&end.limits, sc.limits);
+
+    for (size_t i = 0; i < 4; ++i) {
+        end.control_window_min[i] = sc.ca_state->control_window_min[i];
+        end.control_window_max[i] = sc.ca_state->control_window_max[i];
     }
-    trace("%s", buf);
+
+    record_entry(&end, sizeof(end));
+#else
+    (void)result;
+    (void)sc;
 #endif
 }
 
-#define trace_sort(x) trace_sort_fn(x, matched, sc)
+#define trace_sort(x) record_sort(x, matched, sc)
 
 // Sorts the indices of chargers that match the filter to the front of idx_array and returns the number of matches.
-int filter_chargers_impl(filter_fn filter_, StageContext &sc) {
+// Templated over the filter so that each stage's filter is inlined into its own copy of the loop.
+template<typename Filter>
+static int filter_chargers_impl(const Filter &filter_, StageContext &sc) {
+    const auto *columns = sc.columns;
     int matches = 0;
     for(int i = 0; i < sc.charger_count; ++i) {
-        if (!filter_({sc.current_allocation[sc.idx_array[i]], sc.phase_allocation[sc.idx_array[i]], sc.cfg, &sc.charger_state[sc.idx_array[i]], sc.charge_mode_filter}))
+        int idx = sc.idx_array[i];
+        uint8_t flags = columns->flags[idx];
+
+        if (!filter_({sc.current_allocation[idx],
+                      sc.phase_allocation[idx],
+                      sc.cfg,
+                      &sc.charger_state[idx],
+                      sc.charge_mode_filter,
+                      columns->charge_mode[idx],
+                      (flags & ChargerFlag::Off) != 0,
+                      (flags & ChargerFlag::WantsToCharge) != 0,
+                      (flags & ChargerFlag::WantsToChargeLowPriority) != 0,
+                      (flags & ChargerFlag::IsCharging) != 0,
+                      (flags & ChargerFlag::PhaseSwitchSupported) != 0}))
             continue;
 
         int tmp = sc.idx_array[matches];
@@ -162,27 +275,91 @@ int filter_chargers_impl(filter_fn filter_, StageContext &sc) {
     return matches;
 }
 
+// Orders the indices of chargers by their group first and then by the stage's compare function.
+// All sort_chargers calls share this comparator, so that there is only one std::stable_sort instance.
+struct ChargerLess {
+    const int *groups;
+    compare_fn compare;
+    const StageContext *sc;
+
+    bool operator()(int left, int right) const {
+        if (groups[left] != groups[right])
+            return groups[left] < groups[right];
+
+        return compare({
+                        {sc->current_allocation[left], sc->phase_allocation[left], &sc->charger_state[left], left},
+                        {sc->current_allocation[right], sc->phase_allocation[right], &sc->charger_state[right], right},
+                       sc->limits,
+                       sc->cfg,
+                       sc->columns});
+    }
+};
+
+// The sort order of the same sort_chargers call in the last allocation can be reused if it is exactly
+// what std::stable_sort would produce for this input: A permutation of the input that is sorted and keeps
+// equivalent chargers in input order. Checking this takes at most 2 * (matched - 1) comparisons.
+static bool reuse_sort_order(const CurrentAllocatorState::SortOrder &cached, const ChargerLess &less, StageContext &sc, int matched) {
+    if (cached.count != matched)
+        return false;
+
+    int8_t input_pos[MAX_CONTROLLED_CHARGERS];
+    memset(input_pos, -1, sizeof(input_pos));
+
+    for (int i = 0; i < matched; ++i)
+        input_pos[sc.idx_array[i]] = (int8_t)i;
+
+    for (int i = 0; i < matched; ++i)
+        if (input_pos[cached.idx[i]] < 0)
+            return false;
+
+    for (int i = 1; i < matched; ++i) {
+        int left = cached.idx[i - 1];
+        int right = cached.idx[i];
+
+        if (less(right, left))
+            return false;
+
+        if (!less(left, right) && input_pos[left] > input_pos[right])
+            return false;
+    }
+
+    for (int i = 0; i < matched; ++i)
+        sc.idx_array[i] = cached.idx[i];
+
+    return true;
+}
+
+static void sort_grouped_chargers(const int *groups, compare_fn compare, StageContext &sc, int matched) {
+    ChargerLess less{groups, compare, &sc};
+
+    size_t slot = sc.sort_calls++;
+    if (slot >= SORT_CACHE_SLOTS) {
+        std::stable_sort(sc.idx_array, sc.idx_array + matched, less);
+        return;
+    }
+
+    auto &cached = sc.ca_state->sort_cache[slot];
+    if (reuse_sort_order(cached, less, sc, matched))
+        return;
+
+    std::stable_sort(sc.idx_array, sc.idx_array + matched, less);
+
+    cached.count = (uint8_t)matched;
+    for (int i = 0; i < matched; ++i)
+        cached.idx[i] = (uint8_t)sc.idx_array[i];
+}
+
 // Sorts the indices of chargers by first grouping them with the group function and then comparing in groups with the sort function.
-void sort_chargers_impl(group_fn group, compare_fn compare, StageContext &sc, int matched) {
+// Only the group function is inlined; it is called once per charger. The compare function is called through
+// a pointer by the shared comparator, so that each call site does not instantiate its own std::stable_sort.
+template<typename Group>
+static void sort_chargers_impl(const Group &group, compare_fn compare, StageContext &sc, int matched) {
     int groups[MAX_CONTROLLED_CHARGERS] = {};
 
     for(int i = 0; i < matched; ++i)
         groups[sc.idx_array[i]] = group({sc.current_allocation[sc.idx_array[i]], sc.phase_allocation[sc.idx_array[i]], &sc.charger_state[sc.idx_array[i]], sc.cfg, &sc.charger_allocation_state[sc.idx_array[i]]});
 
-    std::stable_sort(
-        sc.idx_array,
-        sc.idx_array + matched,
-        [&groups, &compare, sc] (int left, int right) {
-            if (groups[left] != groups[right])
-                return groups[left] < groups[right];
-
-            return compare({
-                            {sc.current_allocation[left], sc.phase_allocation[left], &sc.charger_state[left]},
-                            {sc.current_allocation[right], sc.phase_allocation[right], &sc.charger_state[right]},
-                           sc.limits,
-                           sc.cfg});
-        }
-    );
+    sort_grouped_chargers(groups, compare, sc, matched);
 }
 
 GridPhase get_phase(PhaseRotation rot, ChargerPhase phase) {
@@ -428,7 +605,7 @@ static bool was_just_plugged_in(const ChargerState *state) {
 // we won't toggle the contactors too fast.
 // This feature is completely deactivated if cfg->plug_in_time is set to 0.
 static void stage_2(StageContext &sc) {
-    int matched = filter_chargers(was_just_plugged_in(ctx.state) && (ctx.state->charge_mode & ctx.charge_mode_filter) != 0 && !ctx.state->off);
+    int matched = filter_chargers(was_just_plugged_in(ctx.state) && (ctx.charge_mode & ctx.charge_mode_filter) != 0 && !ctx.off);
 
     // Charger that is plugged in for the longest time first.
     sort_chargers(0,
@@ -468,6 +645,32 @@ static int get_requested_current(const ChargerState *state, const CurrentAllocat
     return reqd;
 }
 
+// Chargers are allocated either one or three phases.
+static inline int get_requested_current(const ChargerColumns *columns, int idx, uint8_t allocated_phases) {
+    return allocated_phases == 3 ? columns->requested_current_3p[idx] : columns->requested_current_1p[idx];
+}
+
+// Copies the charger state fields that the stages' filters and comparators read into the columns.
+// get_requested_current only changes when the limits are applied, so it is evaluated once per allocation.
+static void fill_charger_columns(ChargerColumns *columns, const ChargerState *charger_state, int charger_count, const CurrentAllocatorConfig *cfg) {
+    for (int i = 0; i < charger_count; ++i) {
+        const auto *state = &charger_state[i];
+
+        columns->requested_current_1p[i] = get_requested_current(state, cfg, 1);
+        columns->requested_current_3p[i] = get_requested_current(state, cfg, 3);
+        columns->allocated_average_power[i] = state->allocated_average_power;
+        columns->phase_rotation[i] = state->phase_rotation;
+        columns->charge_mode[i] = state->charge_mode;
+        columns->flags[i] = (state->off                          ? ChargerFlag::Off                      : 0)
+                          | (state->wants_to_charge              ? ChargerFlag::WantsToCharge            : 0)
+                          | (state->wants_to_charge_low_priority ? ChargerFlag::WantsToChargeLowPriority : 0)
+                          | (state->is_charging                  ? ChargerFlag::IsCharging               : 0)
+                          | (state->phase_switch_supported       ? ChargerFlag::PhaseSwitchSupported     : 0)
+                          | (state->observe_pv_limit             ? ChargerFlag::ObservePVLimit           : 0)
+                          | (state->eco_fast                     ? ChargerFlag::EcoFast                  : 0);
+    }
+}
+
 // Calculates the control window.
 // The window is the range of current that could be allocated between
 // throttling all chargers to their minimum current
@@ -496,16 +699,18 @@ static void calculate_window(bool trace_short, StageContext &sc) {
     int matched = filter_chargers(ctx.allocated_phases > 0);
     sc.idx_array = old_idx_array;
 
+    const auto *columns = sc.columns;
+
     // Calculate minimum window
     for (int i = 0; i < matched; ++i) {
         // Never remove current that was allocated in this iteration.
         if (sc.current_allocation[idx_array[i]] > 0)
             continue;
 
-        const auto *state = &sc.charger_state[idx_array[i]];
+        const auto phase_rotation = columns->phase_rotation[idx_array[i]];
         const auto alloc_phases = sc.phase_allocation[idx_array[i]];
 
-        const auto factors = get_phase_factors(alloc_phases, state->phase_rotation);
+        const auto factors = get_phase_factors(alloc_phases, phase_rotation);
 
         if (alloc_phases == 3) {
             wnd_min += min_3p * factors;
@@ -526,14 +731,14 @@ static void calculate_window(bool trace_short, StageContext &sc) {
 
     // Add maximum window of 3p chargers.
     for (int i = 0; i < matched; ++i) {
-        const auto *state = &sc.charger_state[idx_array[i]];
+        const auto phase_rotation = columns->phase_rotation[idx_array[i]];
         const auto alloc_phases = sc.phase_allocation[idx_array[i]];
 
         if (alloc_phases != 3)
             continue;
 
-        auto factors = get_phase_factors(alloc_phases, state->phase_rotation);
-        auto requested = factors * get_requested_current(state, sc.cfg, alloc_phases);
+        auto factors = get_phase_factors(alloc_phases, phase_rotation);
+        auto requested = factors * get_requested_current(columns, idx_array[i], alloc_phases);
         auto already_allocated = factors * sc.current_allocation[idx_array[i]];
 
         wnd_max += requested - already_allocated;
@@ -552,16 +757,16 @@ static void calculate_window(bool trace_short, StageContext &sc) {
 
     // Add maximum window of 1p chargers with unknown rotation.
     for (int i = 0; i < matched; ++i) {
-        const auto *state = &sc.charger_state[idx_array[i]];
+        const auto phase_rotation = columns->phase_rotation[idx_array[i]];
         const auto alloc_phases = sc.phase_allocation[idx_array[i]];
 
-        if (alloc_phases == 3 || state->phase_rotation != PhaseRotation::Unknown)
+        if (alloc_phases == 3 || phase_rotation != PhaseRotation::Unknown)
             continue;
 
-        auto factors = get_phase_factors(alloc_phases, state->phase_rotation);
+        auto factors = get_phase_factors(alloc_phases, phase_rotation);
 
         auto already_allocated = sc.current_allocation[idx_array[i]];
-        auto current = get_requested_current(state, sc.cfg, alloc_phases) - already_allocated;
+        auto current = get_requested_current(columns, idx_array[i], alloc_phases) - already_allocated;
 
         auto available_current = (sc.limits->raw - wnd_max).min_phase();
         current = std::min(available_current, current);
@@ -573,16 +778,16 @@ static void calculate_window(bool trace_short, StageContext &sc) {
 
     // Add maximum window of 1p chargers with known rotation.
     for (int i = 0; i < matched; ++i) {
-        const auto *state = &sc.charger_state[idx_array[i]];
+        const auto phase_rotation = columns->phase_rotation[idx_array[i]];
         const auto alloc_phases = sc.phase_allocation[idx_array[i]];
 
-        if (alloc_phases == 3 || state->phase_rotation == PhaseRotation::Unknown)
+        if (alloc_phases == 3 || phase_rotation == PhaseRotation::Unknown)
             continue;
 
         auto already_allocated = sc.current_allocation[idx_array[i]];
-        auto current = get_requested_current(state, sc.cfg, alloc_phases) - already_allocated;
+        auto current = get_requested_current(columns, idx_array[i], alloc_phases) - already_allocated;
 
-        const auto phase = get_phase(state->phase_rotation, ChargerPhase::P1);
+        const auto phase = get_phase(phase_rotation, ChargerPhase::P1);
         current = std::min(sc.limits->raw[phase] - wnd_max[phase], current);
 
         wnd_max[phase] += current;
@@ -914,11 +1119,11 @@ static void stage_4(StageContext &sc) {
     trace(have_active_chargers ? "4: have active chargers." : "4: don't have active chargers.");
 
     // A charger that was rotated has 0 allocated phases but is still charging.
-    int matched = filter_chargers(ctx.allocated_phases == 0 && (ctx.state->wants_to_charge || ctx.state->is_charging) && (ctx.state->charge_mode & ctx.charge_mode_filter) != 0 && !ctx.state->off);
+    int matched = filter_chargers(ctx.allocated_phases == 0 && (ctx.wants_to_charge || ctx.is_charging) && (ctx.charge_mode & ctx.charge_mode_filter) != 0 && !ctx.off);
 
     sort_chargers(
         -get_highest_charge_mode_bit(ctx.state),
-        ctx.left.state->allocated_average_power < ctx.right.state->allocated_average_power
+        ctx.columns->allocated_average_power[ctx.left.idx] < ctx.columns->allocated_average_power[ctx.right.idx]
     );
 
     trace_sort(4);
@@ -1020,11 +1225,11 @@ static void stage_5(StageContext &sc) {
 
     trace(check_pv_min ? "5: <2 active. pv reqs min" : "5: >1 active. pv reqs ena");
 
-    int matched = filter_chargers(ctx.allocated_phases == 1 && ctx.state->phase_switch_supported && deadline_elapsed(ctx.state->last_phase_switch + ctx.cfg->global_hysteresis) && (ctx.state->charge_mode & ctx.charge_mode_filter) != 0);
+    int matched = filter_chargers(ctx.allocated_phases == 1 && ctx.phase_switch_supported && deadline_elapsed(ctx.state->last_phase_switch + ctx.cfg->global_hysteresis) && (ctx.charge_mode & ctx.charge_mode_filter) != 0);
 
     sort_chargers(
         -get_highest_charge_mode_bit(ctx.state),
-        ctx.left.state->allocated_average_power < ctx.right.state->allocated_average_power
+        ctx.columns->allocated_average_power[ctx.left.idx] < ctx.columns->allocated_average_power[ctx.right.idx]
     );
 
     trace_sort(5);
@@ -1086,7 +1291,7 @@ static void stage_5(StageContext &sc) {
 
 // Stage 6: Allocate minimum current to chargers with at least one allocated phase
 static void stage_6(StageContext &sc) {
-    int matched = filter_chargers(ctx.allocated_phases > 0 && ctx.allocated_current == 0 && (ctx.state->charge_mode & ctx.charge_mode_filter) != 0);
+    int matched = filter_chargers(ctx.allocated_phases > 0 && ctx.allocated_current == 0 && (ctx.charge_mode & ctx.charge_mode_filter) != 0);
 
     // No need to sort here: We know that we have enough current to give each charger its minimum current.
     // A charger that can't be activated has 0 phases allocated.
@@ -1121,38 +1326,39 @@ static void stage_6(StageContext &sc) {
 }
 
 // The current capacity of a charger is the maximum amount of current that can be allocated to the charger additionally to the already allocated current on the allocated phases.
-static int current_capacity(const CurrentLimits *limits, const ChargerState *state, int allocated_current, uint8_t allocated_phases, const CurrentAllocatorConfig *cfg) {
-    auto requested_current = get_requested_current(state, cfg, allocated_phases);
+static int current_capacity(const CurrentLimits *limits, const ChargerColumns *columns, int idx, int allocated_current, uint8_t allocated_phases) {
+    auto requested_current = get_requested_current(columns, idx, allocated_phases);
+    auto phase_rotation = columns->phase_rotation[idx];
 
     // TODO: add margin again if exactly one charger is active and requested_current > 6000. Also add in calculate_window? -> Maybe not necessary any more?
 
     auto capacity = std::max(requested_current - allocated_current, 0);
 
-    if (allocated_phases == 3 || state->phase_rotation == PhaseRotation::Unknown) {
+    if (allocated_phases == 3 || phase_rotation == PhaseRotation::Unknown) {
         return std::min(capacity, limits->raw.min_phase());
     }
 
     for (size_t i = (size_t)ChargerPhase::P1; i < (size_t)ChargerPhase::P1 + allocated_phases; ++i) {
-        auto phase = get_phase(state->phase_rotation, (ChargerPhase)i);
+        auto phase = get_phase(phase_rotation, (ChargerPhase)i);
         capacity = std::min(capacity, limits->raw[phase]);
     }
 
     return allocated_phases * capacity;
 }
 
-static Cost get_fair_current(int matched, int start, int *idx_array, uint8_t *phase_allocation, const CurrentLimits *limits, const ChargerState *charger_state) {
+static Cost get_fair_current(int matched, int start, int *idx_array, uint8_t *phase_allocation, const CurrentLimits *limits, const ChargerColumns *columns) {
     Cost active_on_phase{0, 0, 0, 0};
     for (int i = start; i < matched; ++i) {
-        const auto *state = &charger_state[idx_array[i]];
+        auto phase_rotation = columns->phase_rotation[idx_array[i]];
         auto allocated_phases = phase_allocation[idx_array[i]];
         ++active_on_phase.pv;
-        if (allocated_phases == 3 || state->phase_rotation == PhaseRotation::Unknown) {
+        if (allocated_phases == 3 || phase_rotation == PhaseRotation::Unknown) {
             ++active_on_phase.l1;
             ++active_on_phase.l2;
             ++active_on_phase.l3;
         } else {
             for (size_t p = 1; p < 1 + allocated_phases; ++p) {
-                auto phase = get_phase(state->phase_rotation, (ChargerPhase)p);
+                auto phase = get_phase(phase_rotation, (ChargerPhase)p);
                 ++active_on_phase[phase];
             }
         }
@@ -1178,20 +1384,20 @@ static Cost get_fair_current(int matched, int start, int *idx_array, uint8_t *ph
 //   On the PV "phase" include a charger n times were n is the number of phases this charger uses.
 //   A three-phase charger will use 18 A of PV current if it is allocated 6 A to each phase.
 static void stage_7(StageContext &sc) {
-    int matched = filter_chargers(ctx.allocated_current > 0 && (ctx.state->charge_mode & ctx.charge_mode_filter) != 0);
+    int matched = filter_chargers(ctx.allocated_current > 0 && (ctx.charge_mode & ctx.charge_mode_filter) != 0);
 
     if (matched == 0)
         return;
 
     sort_chargers(
         3 - ctx.allocated_phases,
-        current_capacity(ctx.limits, ctx.left.state, ctx.left.allocated_current, ctx.left.allocated_phases, ctx.cfg) < current_capacity(ctx.limits, ctx.right.state, ctx.right.allocated_current, ctx.right.allocated_phases, ctx.cfg)
+        current_capacity(ctx.limits, ctx.columns, ctx.left.idx, ctx.left.allocated_current, ctx.left.allocated_phases) < current_capacity(ctx.limits, ctx.columns, ctx.right.idx, ctx.right.allocated_current, ctx.right.allocated_phases)
     );
 
     trace_sort(7);
 
     for (int i = 0; i < matched; ++i) {
-        Cost fair = get_fair_current(matched, i, sc.idx_array, sc.phase_allocation, sc.limits, sc.charger_state);
+        Cost fair = get_fair_current(matched, i, sc.idx_array, sc.phase_allocation, sc.limits, sc.columns);
 
         const auto *state = &sc.charger_state[sc.idx_array[i]];
 
@@ -1216,7 +1422,7 @@ static void stage_7(StageContext &sc) {
             current = std::min(current, std::max(0, enable_current - allocated_current));
         }
 
-        current = std::min(current, current_capacity(sc.limits, state, allocated_current, allocated_phases, sc.cfg));
+        current = std::min(current, current_capacity(sc.limits, sc.columns, sc.idx_array[i], allocated_current, allocated_phases));
         current += allocated_current;
 
         auto cost = get_cost(current, (ChargerPhase)allocated_phases, state->phase_rotation, allocated_current, (ChargerPhase)allocated_phases);
@@ -1246,11 +1452,11 @@ static void stage_7(StageContext &sc) {
 // - Sort by current_capacity ascending. This makes sure that one pass is enough to allocate the possible maximum.
 static void stage_8(StageContext &sc) {
     // Chargers that are currently not charging already have the enable current allocated (if available) by stage 7.
-    int matched = filter_chargers(ctx.allocated_current > 0 && ctx.state->is_charging && (ctx.state->charge_mode & ctx.charge_mode_filter) != 0);
+    int matched = filter_chargers(ctx.allocated_current > 0 && ctx.is_charging && (ctx.charge_mode & ctx.charge_mode_filter) != 0);
 
     sort_chargers(
         3 - ctx.allocated_phases,
-        current_capacity(ctx.limits, ctx.left.state, ctx.left.allocated_current, ctx.left.allocated_phases, ctx.cfg) < current_capacity(ctx.limits, ctx.right.state, ctx.right.allocated_current, ctx.right.allocated_phases, ctx.cfg)
+        current_capacity(ctx.limits, ctx.columns, ctx.left.idx, ctx.left.allocated_current, ctx.left.allocated_phases) < current_capacity(ctx.limits, ctx.columns, ctx.right.idx, ctx.right.allocated_current, ctx.right.allocated_phases)
     );
 
     trace_sort(8);
@@ -1267,7 +1473,7 @@ static void stage_8(StageContext &sc) {
                             state->observe_pv_limit
                                 ? std::max(state->guaranteed_pv_current / allocated_phases - allocated_current, sc.limits->raw.pv / allocated_phases)
                                 : 32000),
-                        current_capacity(sc.limits, state, allocated_current, allocated_phases, sc.cfg));
+                        current_capacity(sc.limits, sc.columns, sc.idx_array[i], allocated_current, allocated_phases));
 
         if (state->phase_rotation == PhaseRotation::Unknown) {
             // Phase rotation unknown. We have to assume that each phase could be used
@@ -1339,7 +1545,7 @@ static void stage_9(StageContext &sc) {
 
     trace(have_active_chargers ? "9: have active chargers." : "9: don't have active chargers.");
 
-    int matched = filter_chargers(ctx.allocated_phases == 0 && (ctx.state->wants_to_charge_low_priority || (ctx.state->wants_to_charge && ctx.state->last_wakeup != 0_us)));
+    int matched = filter_chargers(ctx.allocated_phases == 0 && (ctx.wants_to_charge_low_priority || (ctx.wants_to_charge && ctx.state->last_wakeup != 0_us)));
 
     if (matched == 0)
         return;
@@ -1559,6 +1765,8 @@ int allocate_current(
         }
     }
 
+    fill_charger_columns(&ca_state->columns, charger_state, cfg->charger_count, cfg);
+
     StageContext sc{
         idx_array,
         current_array,
@@ -1569,15 +1777,23 @@ int allocate_current(
         cfg,
         ca_state,
         charger_allocation_state,
-        0xFFFFFFFF
+        0xFFFFFFFF,
+        0,
+        &ca_state->columns
     };
 
-    trace_alloc(0, sc);
+    RecordedAllocation recorded;
+    record_begin(sc, &recorded);
+
     trace("__all__");
     stage_1(sc);
+    record_stage(1, sc, &recorded);
     stage_2(sc);
+    record_stage(2, sc, &recorded);
     stage_3(sc);
+    record_stage(3, sc, &recorded);
     stage_6(sc);
+    record_stage(6, sc, &recorded);
 
     for (ChargeMode::Type mode = ChargeMode::_max; mode >= ChargeMode::Min; mode = (ChargeMode::Type)((int)mode >> 1)) {
         sc.charge_mode_filter = mode;
@@ -1590,15 +1806,21 @@ int allocate_current(
         }
 
         stage_4(sc);
+        record_stage(4, sc, &recorded);
         stage_5(sc);
+        record_stage(5, sc, &recorded);
         stage_6(sc);
+        record_stage(6, sc, &recorded);
         stage_7(sc);
+        record_stage(7, sc, &recorded);
         stage_8(sc);
+        record_stage(8, sc, &recorded);
     }
 
     trace("__all__");
     stage_9(sc);
-    trace_alloc(9, sc);
+    record_stage(9, sc, &recorded);
+    record_end(result, sc);
     //logger.printfln("Took %u µs", end - start);
 
     auto now = now_us();
@@ -32,6 +32,8 @@ struct StageContext {
     CurrentAllocatorState *ca_state;
     const ChargerAllocationState *charger_allocation_state;
     uint32_t charge_mode_filter;
+    size_t sort_calls;
+    const ChargerColumns *columns;
 };
 
 
@@ -41,6 +43,14 @@ struct FilterContext {
     const CurrentAllocatorConfig *cfg;
     const ChargerState *state;
     uint32_t charge_mode_filter;
+
+    // Copied from the charger columns.
+    uint8_t charge_mode;
+    bool off;
+    bool wants_to_charge;
+    bool wants_to_charge_low_priority;
+    bool is_charging;
+    bool phase_switch_supported;
 };
 
 struct GroupContext {
@@ -55,6 +65,7 @@ struct CompareInfo {
     int allocated_current;
     uint8_t allocated_phases;
     const ChargerState *state;
+    int idx;
 };
 
 struct CompareContext {
@@ -62,18 +73,14 @@ struct CompareContext {
     CompareInfo right;
     CurrentLimits *limits;
     const CurrentAllocatorConfig *cfg;
+    const ChargerColumns *columns;
 };
 
-typedef bool(*filter_fn)(const FilterContext &ctx);
-
-int filter_chargers_impl(filter_fn filter, StageContext &sc);
-
-typedef int(*group_fn)(const GroupContext &ctx);
-
 typedef bool(*compare_fn)(const CompareContext &ctx);
 
-void sort_chargers_impl(group_fn group, compare_fn compare, StageContext &sc);
-
+// filter_chargers_impl and sort_chargers_impl are templates defined in current_allocator.cpp.
+// The stages pass their filters, groups and comparators as lambdas with these macros.
+// The comparator lambdas don't capture and are converted to a compare_fn.
 #define filter_chargers(x) filter_chargers_impl([](const FilterContext &ctx) { \
             return (x); \
         }, \
@@ -91,6 +98,115 @@ void sort_chargers_impl(group_fn group, compare_fn compare, StageContext &sc);
         matched); \
     } while (0)
 
+// Allocation decision record
+//
+// Every allocation writes a sequence of entries into the charge_manager_decisions trace buffer:
+// A begin entry, one charger entry per charger with the allocator's inputs, a sort entry for every
+// filter and sort (replacing the text lines of trace_sort), a stage entry after each stage with the
+// allocations it changed and an end entry before the limits are applied.
+// All fields are little-endian. The entries are aligned to 4 bytes; a ring buffer block never splits one.
+// Mirrored in decode_decisions.py. Increment CA_RECORD_VERSION when changing these structs.
+#define CA_RECORD_MAGIC 0xCA
+#define CA_RECORD_VERSION 1
+
+namespace CARecordType {
+    enum Type : uint8_t {
+        Begin = 1,
+        Charger = 2,
+        Sort = 3,
+        Stage = 4,
+        End = 5
+    };
+}
+
+struct ca_record_header {
+    uint8_t magic;
+    uint8_t type;
+    uint16_t length; // including this header
+};
+
+struct ca_record_limits {
+    int32_t raw[4];
+    int32_t min[4];
+    int32_t spread[4];
+    int32_t max_pv;
+};
+
+struct ca_record_begin {
+    ca_record_header header;
+    uint32_t seq;
+    int64_t now_us;
+    uint8_t version;
+    uint8_t charger_count;
+    uint8_t global_hysteresis_elapsed;
+    uint8_t _padding;
+    ca_record_limits limits;
+};
+static_assert(sizeof(ca_record_begin) == 72, "Unexpected ca_record_begin length");
+
+struct ca_record_charger {
+    ca_record_header header;
+    uint8_t idx;
+    uint8_t charge_mode;
+    uint8_t flags; // ChargerFlag
+    uint8_t phase_rotation;
+    uint8_t phases;
+    uint8_t last_allocated_phases;
+    uint8_t charger_state;
+    uint8_t _padding;
+    uint16_t requested_current;
+    uint16_t supported_current;
+    uint16_t allowed_current;
+    uint16_t last_allocated_current;
+    int32_t guaranteed_pv_current;
+    float allocated_average_power;
+
+    // Milliseconds since the timestamp or -1 if it is not set.
+    int32_t last_switch_on_age;
+    int32_t last_phase_switch_age;
+    int32_t just_plugged_in_age;
+    int32_t last_wakeup_age;
+    int32_t use_supported_current_age;
+};
+static_assert(sizeof(ca_record_charger) == 48, "Unexpected ca_record_charger length");
+
+struct ca_record_sort {
+    ca_record_header header;
+    uint8_t stage;
+    uint8_t charge_mode_filter;
+    uint8_t charger_count;
+    uint8_t matched;
+    // Only the first matched indices are written, padded with zeros to a multiple of 4.
+    uint8_t idx[MAX_CONTROLLED_CHARGERS];
+};
+
+struct ca_record_change {
+    uint8_t idx;
+    uint8_t phases;
+    uint16_t current;
+};
+
+struct ca_record_stage {
+    ca_record_header header;
+    uint8_t stage;
+    uint8_t charge_mode_filter;
+    uint8_t change_count;
+    uint8_t _padding;
+    int32_t raw[4]; // after the stage
+    // Only the first change_count changes are written.
+    ca_record_change changes[MAX_CONTROLLED_CHARGERS];
+};
+
+struct ca_record_end {
+    ca_record_header header;
+    uint8_t result;
+    uint8_t _padding[3];
+    ca_record_limits limits;
+    int32_t control_window_min[4];
+    int32_t control_window_max[4];
+};
+static_assert(sizeof(ca_record_end) == 92, "Unexpected ca_record_end length");
+
 GridPhase get_phase(PhaseRotation rot, ChargerPhase phase);
 
 Cost get_cost(int current_to_allocate,
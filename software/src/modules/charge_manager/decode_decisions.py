@@ -0,0 +1,453 @@
+#!/usr/bin/python3 -u
+
+# Decodes the allocation decision record of the charge manager.
+#
+# Download it with
+#     curl -o decisions.gz http://<host>/trace_buffer/charge_manager_decisions
+# (use -X PUT to also clear the record on the device) and run
+#     ./decode_decisions.py decisions.gz
+# or pass --host to download it directly.
+# --json prints one JSON object per allocation instead, for replaying the allocations.
+
+import argparse
+import gzip
+import json
+import re
+import struct
+import sys
+import urllib.request
+
+"""
+    Mirrors current_allocator_private.h. All fields are little-endian.
+
+    struct ca_record_header {
+        uint8_t magic;
+        uint8_t type;
+        uint16_t length; // including this header
+    };
+
+    struct ca_record_limits {
+        int32_t raw[4];
+        int32_t min[4];
+        int32_t spread[4];
+        int32_t max_pv;
+    };
+
+    struct ca_record_begin {
+        ca_record_header header;
+        uint32_t seq;
+        int64_t now_us;
+        uint8_t version;
+        uint8_t charger_count;
+        uint8_t global_hysteresis_elapsed;
+        uint8_t _padding;
+        ca_record_limits limits;
+    };
+
+    struct ca_record_charger {
+        ca_record_header header;
+        uint8_t idx;
+        uint8_t charge_mode;
+        uint8_t flags;
+        uint8_t phase_rotation;
+        uint8_t phases;
+        uint8_t last_allocated_phases;
+        uint8_t charger_state;
+        uint8_t _padding;
+        uint16_t requested_current;
+        uint16_t supported_current;
+        uint16_t allowed_current;
+        uint16_t last_allocated_current;
+        int32_t guaranteed_pv_current;
+        float allocated_average_power;
+        int32_t last_switch_on_age;
+        int32_t last_phase_switch_age;
+        int32_t just_plugged_in_age;
+        int32_t last_wakeup_age;
+        int32_t use_supported_current_age;
+    };
+
+    struct ca_record_sort {
+        ca_record_header header;
+        uint8_t stage;
+        uint8_t charge_mode_filter;
+        uint8_t charger_count;
+        uint8_t matched;
+        uint8_t idx[]; // padded to a multiple of 4
+    };
+
+    struct ca_record_change {
+        uint8_t idx;
+        uint8_t phases;
+        uint16_t current;
+    };
+
+    struct ca_record_stage {
+        ca_record_header header;
+        uint8_t stage;
+        uint8_t charge_mode_filter;
+        uint8_t change_count;
+        uint8_t _padding;
+        int32_t raw[4];
+        ca_record_change changes[];
+    };
+
+    struct ca_record_end {
+        ca_record_header header;
+        uint8_t result;
+        uint8_t _padding[3];
+        ca_record_limits limits;
+        int32_t control_window_min[4];
+        int32_t control_window_max[4];
+    };
+"""
+
+RECORD_MAGIC = 0xCA
+RECORD_VERSION = 1
+
+TYPE_BEGIN = 1
+TYPE_CHARGER = 2
+TYPE_SORT = 3
+TYPE_STAGE = 4
+TYPE_END = 5
+
+header_format = '<BBH'
+limits_format = '13i'
+begin_format = '<4xIqBBBx' + limits_format
+charger_format = '<4xBBBBBBBxHHHHif5i'
+sort_format = '<4xBBBB'
+stage_format = '<4xBBBx4i'
+change_format = '<BBH'
+end_format = '<4xB3x' + limits_format + '4i4i'
+
+header_len = struct.calcsize(header_format)
+begin_len = struct.calcsize(begin_format)
+charger_len = struct.calcsize(charger_format)
+sort_len = struct.calcsize(sort_format)
+stage_len = struct.calcsize(stage_format)
+change_len = struct.calcsize(change_format)
+end_len = struct.calcsize(end_format)
+
+assert begin_len == 72
+assert charger_len == 48
+assert end_len == 92
+
+INCOMPLETE_MARKER = b'\n__incomplete__\n'
+
+CHARGE_MODES = ['Off', 'PV', 'Min', 'Min+PV', 'Eco', 'Eco+PV', 'Eco+Min', 'Eco+Min+PV', 'Fast']
+
+CHARGER_FLAGS = [
+    (1, 'off'),
+    (2, 'wants_to_charge'),
+    (4, 'wants_to_charge_low_priority'),
+    (8, 'is_charging'),
+    (16, 'phase_switch_supported'),
+    (32, 'observe_pv_limit'),
+    (64, 'eco_fast'),
+]
+
+def phase_rotation(x, y, z):
+    return (x << 4) | (y << 2) | z
+
+PHASE_ROTATIONS = {
+    0: 'Unknown',
+    1: 'NotApplicable',
+    phase_rotation(1, 2, 3): 'L123',
+    phase_rotation(1, 3, 2): 'L132',
+    phase_rotation(2, 3, 1): 'L231',
+    phase_rotation(2, 1, 3): 'L213',
+    phase_rotation(3, 2, 1): 'L321',
+    phase_rotation(3, 1, 2): 'L312',
+}
+
+def unpack_limits(values):
+    return {
+        'raw': list(values[0:4]),
+        'min': list(values[4:8]),
+        'spread': list(values[8:12]),
+        'max_pv': values[12],
+    }
+
+def age(ms):
+    return None if ms < 0 else ms
+
+def parse_entry(entry_type, data):
+    if entry_type == TYPE_BEGIN:
+        seq, now_us, version, charger_count, hysteresis_elapsed, *limits = struct.unpack_from(begin_format, data)
+
+        return {
+            'seq': seq,
+            'now_us': now_us,
+            'version': version,
+            'charger_count': charger_count,
+            'global_hysteresis_elapsed': hysteresis_elapsed != 0,
+            'limits': unpack_limits(limits),
+        }
+
+    if entry_type == TYPE_CHARGER:
+        (idx, charge_mode, flags, rotation, phases, last_allocated_phases, charger_state,
+         requested_current, supported_current, allowed_current, last_allocated_current,
+         guaranteed_pv_current, allocated_average_power,
+         last_switch_on_age, last_phase_switch_age, just_plugged_in_age, last_wakeup_age, use_supported_current_age) = struct.unpack_from(charger_format, data)
+
+        return {
+            'idx': idx,
+            'charge_mode': charge_mode,
+            'flags': [name for bit, name in CHARGER_FLAGS if flags & bit],
+            'phase_rotation': PHASE_ROTATIONS.get(rotation, str(rotation)),
+            'phases': phases,
+            'last_allocated_phases': last_allocated_phases,
+            'last_allocated_current': last_allocated_current,
+            'charger_state': charger_state,
+            'requested_current': requested_current,
+            'supported_current': supported_current,
+            'allowed_current': allowed_current,
+            'guaranteed_pv_current': guaranteed_pv_current,
+            'allocated_average_power': allocated_average_power,
+            'last_switch_on_age_ms': age(last_switch_on_age),
+            'last_phase_switch_age_ms': age(last_phase_switch_age),
+            'just_plugged_in_age_ms': age(just_plugged_in_age),
+            'last_wakeup_age_ms': age(last_wakeup_age),
+            'use_supported_current_age_ms': age(use_supported_current_age),
+        }
+
+    if entry_type == TYPE_SORT:
+        stage, charge_mode_filter, charger_count, matched = struct.unpack_from(sort_format, data)
+
+        return {
+            'stage': stage,
+            'charge_mode_filter': charge_mode_filter,
+            'charger_count': charger_count,
+            'order': list(data[sort_len:sort_len + matched]),
+        }
+
+    if entry_type == TYPE_STAGE:
+        stage, charge_mode_filter, change_count, *raw = struct.unpack_from(stage_format, data)
+
+        return {
+            'stage': stage,
+            'charge_mode_filter': charge_mode_filter,
+            'raw': raw,
+            'changes': [dict(zip(('idx', 'phases', 'current'), struct.unpack_from(change_format, data, stage_len + i * change_len))) for i in range(change_count)],
+        }
+
+    if entry_type == TYPE_END:
+        values = struct.unpack_from(end_format, data)
+
+        return {
+            'result': values[0],
+            'limits': unpack_limits(values[1:14]),
+            'control_window_min': list(values[14:18]),
+            'control_window_max': list(values[18:22]),
+        }
+
+    return None
+
+# Checks the length of an entry against its type and counts, so that resynchronizing after missing data
+# doesn't take a stray magic byte for the start of an entry.
+def is_valid_entry(data, pos):
+    if pos + header_len > len(data):
+        return False
+
+    magic, entry_type, length = struct.unpack_from(header_format, data, pos)
+
+    if magic != RECORD_MAGIC or pos + length > len(data):
+        return False
+
+    if entry_type == TYPE_BEGIN:
+        return length == begin_len
+    if entry_type == TYPE_CHARGER:
+        return length == charger_len
+    if entry_type == TYPE_END:
+        return length == end_len
+    if entry_type == TYPE_SORT:
+        return length >= sort_len and length == sort_len + ((data[pos + 7] + 3) & ~3)
+    if entry_type == TYPE_STAGE:
+        return length >= stage_len and length == stage_len + data[pos + 6] * change_len
+
+    return False
+
+# Splits the download into entries. Yields None where data is missing.
+def read_entries(data):
+    match = re.match(rb'__begin_[^\n]*__\n(__dropped_(\d+)__\n)?', data)
+
+    if match is not None:
+        if match.group(2) is not None:
+            print(f'{int(match.group(2))} entries were dropped on the device', file=sys.stderr)
+
+        data = data[match.end():]
+
+    match = re.search(rb'__end_[^\n]*__\n$', data)
+
+    if match is not None:
+        data = data[:match.start()]
+
+    pos = 0
+
+    while pos < len(data):
+        if data.startswith(INCOMPLETE_MARKER, pos):
+            pos += len(INCOMPLETE_MARKER)
+            yield None
+            continue
+
+        if not is_valid_entry(data, pos):
+            # Skip to the next entry that looks valid.
+            yield None
+            pos += 1
+
+            while pos < len(data) and not is_valid_entry(data, pos) and not data.startswith(INCOMPLETE_MARKER, pos):
+                pos += 1
+
+            continue
+
+        _magic, entry_type, length = struct.unpack_from(header_format, data, pos)
+
+        yield entry_type, data[pos:pos + length]
+        pos += length
+
+# Groups the entries into allocations. Allocations with missing entries are marked incomplete.
+def read_allocations(data):
+    alloc = None
+
+    def finish(alloc):
+        if alloc is None:
+            return None
+
+        alloc['complete'] = alloc['complete'] and alloc['end'] is not None and len(alloc['chargers']) == alloc['charger_count']
+        return alloc
+
+    for entry in read_entries(data):
+        if entry is None:
+            if alloc is not None:
+                alloc['complete'] = False
+            continue
+
+        entry_type, entry_data = entry
+        parsed = parse_entry(entry_type, entry_data)
+
+        if parsed is None:
+            print(f'Unknown entry type {entry_type}', file=sys.stderr)
+            continue
+
+        if entry_type == TYPE_BEGIN:
+            result = finish(alloc)
+            if result is not None:
+                yield result
+
+            if parsed['version'] != RECORD_VERSION:
+                print(f'Record version {parsed["version"]} is not supported, expected {RECORD_VERSION}', file=sys.stderr)
+                alloc = None
+                continue
+
+            alloc = parsed
+            alloc.update({'complete': True, 'chargers': [], 'sorts': [], 'stages': [], 'end': None})
+            continue
+
+        if alloc is None:
+            continue
+
+        if entry_type == TYPE_CHARGER:
+            alloc['chargers'].append(parsed)
+        elif entry_type == TYPE_SORT:
+            alloc['sorts'].append(parsed)
+        elif entry_type == TYPE_STAGE:
+            alloc['stages'].append(parsed)
+        elif entry_type == TYPE_END:
+            alloc['end'] = parsed
+            yield finish(alloc)
+            alloc = None
+
+    result = finish(alloc)
+    if result is not None:
+        yield result
+
+def format_cost(cost):
+    return '({} {} {} {})'.format(*cost)
+
+def format_limits(limits):
+    return 'raw{} min{} spread{} max_pv {}'.format(format_cost(limits['raw']), format_cost(limits['min']), format_cost(limits['spread']), limits['max_pv'])
+
+def format_mode_filter(charge_mode_filter):
+    if charge_mode_filter == 0xFF:
+        return ''
+
+    return ' [' + ','.join(name for bit, name in ((8, 'Fast'), (4, 'Eco'), (2, 'Min'), (1, 'PV')) if charge_mode_filter & bit) + ']'
+
+def format_age(ms):
+    return '-' if ms is None else f'{ms / 1000:.1f}s'
+
+def print_allocation(alloc):
+    print(f"#{alloc['seq']} at {alloc['now_us'] / 1e6:.3f} s, {alloc['charger_count']} chargers{'' if alloc['complete'] else ', INCOMPLETE'}"
+          f"{', global hysteresis elapsed' if alloc['global_hysteresis_elapsed'] else ''}")
+    print(f"  in  {format_limits(alloc['limits'])}")
+
+    current = {}
+    phases = {}
+
+    for c in alloc['chargers']:
+        current[c['idx']] = 0
+        phases[c['idx']] = c['last_allocated_phases']
+
+        mode = CHARGE_MODES[c['charge_mode']] if c['charge_mode'] < len(CHARGE_MODES) else str(c['charge_mode'])
+        print(f"  [{c['idx']:2}] {mode:10} state {c['charger_state']} {c['phases']}p {c['phase_rotation']:7}"
+              f" req {c['requested_current']:5} sup {c['supported_current']:5} allowed {c['allowed_current']:5}"
+              f" last {c['last_allocated_current']:5}@{c['last_allocated_phases']}p gpv {c['guaranteed_pv_current']:5}"
+              f" avg_power {c['allocated_average_power']:.3f}"
+              f" ages on {format_age(c['last_switch_on_age_ms'])} phsw {format_age(c['last_phase_switch_age_ms'])}"
+              f" plug {format_age(c['just_plugged_in_age_ms'])} wake {format_age(c['last_wakeup_age_ms'])}"
+              f" sup {format_age(c['use_supported_current_age_ms'])}"
+              f" {' '.join(c['flags'])}")
+
+    sorts = list(alloc['sorts'])
+
+    for stage in alloc['stages']:
+        while len(sorts) > 0 and sorts[0]['stage'] == stage['stage'] and sorts[0]['charge_mode_filter'] == stage['charge_mode_filter']:
+            sort = sorts.pop(0)
+            order = ''.join(f' {i}' for i in sort['order'])
+            print(f"  {sort['stage']}: filtered {sort['charger_count']} to {len(sort['order'])}{', sorted to' if len(order) > 0 else '.'}{order}")
+
+        changes = ''.join(f" {c['idx']}->{c['current']}@{c['phases']}p" for c in stage['changes'])
+        print(f"  {stage['stage']}{format_mode_filter(stage['charge_mode_filter'])}: raw{format_cost(stage['raw'])}{changes}")
+
+        for c in stage['changes']:
+            current[c['idx']] = c['current']
+            phases[c['idx']] = c['phases']
+
+    end = alloc['end']
+
+    if end is not None:
+        print(f"  out {format_limits(end['limits'])} window {format_cost(end['control_window_min'])}->{format_cost(end['control_window_max'])} result {end['result']}")
+        print('  alloc ' + ' '.join(f'[{i} {current[i]}@{phases[i]}p]' for i in sorted(current)))
+
+    print()
+
+def main():
+    parser = argparse.ArgumentParser(description='Decodes the allocation decision record of the charge manager.')
+    parser.add_argument('file', nargs='?', help='download of /trace_buffer/charge_manager_decisions, gzip-compressed or not')
+    parser.add_argument('--host', help='download the record from this host instead')
+    parser.add_argument('--clear', action='store_true', help='clear the record on the host after downloading it')
+    parser.add_argument('--json', action='store_true', help='print one JSON object per allocation')
+
+    args = parser.parse_args()
+
+    if args.host is not None:
+        req = urllib.request.Request(f'http://{args.host}/trace_buffer/charge_manager_decisions', method='PUT' if args.clear else 'GET')
+        with urllib.request.urlopen(req, timeout=30) as f:
+            data = f.read()
+    elif args.file is not None:
+        with open(args.file, 'rb') as f:
+            data = f.read()
+    else:
+        parser.error('Pass a file or --host')
+
+    if data.startswith(b'\x1f\x8b'):
+        data = gzip.decompress(data)
+
+    for alloc in read_allocations(data):
+        if args.json:
+            print(json.dumps(alloc))
+        else:
+            print_allocation(alloc)
+
+if __name__ == '__main__':
+    main()
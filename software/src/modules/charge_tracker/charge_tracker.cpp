@@ -211,7 +211,7 @@ bool ChargeTracker::startCharge(uint32_t timestamp_minutes, float meter_start, u
     current_charge.get("timestamp_minutes")->updateUint(timestamp_minutes);
     current_charge.get("authorization_type")->updateUint(auth_type);
     current_charge.get("authorization_info")->value = auth_info;
-    current_charge.get("authorization_info")->value.updated = 0xFF;
+    current_charge.get("authorization_info")->set_updated(0xFF);
     return true;
 }
 
@@ -150,7 +150,14 @@ void Coredump::pre_setup()
     }
 }
 
+// Intentionally empty: The core dump is checked in deferred_setup.
+// Overridden so that initialized stays false, as it did when the check ran here.
 void Coredump::setup()
+{
+}
+
+// Checking the core dump reads the whole core dump partition. Nothing else depends on the result.
+void Coredump::deferred_setup()
 {
     const esp_err_t status = esp_core_dump_image_check();
 
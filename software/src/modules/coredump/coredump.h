@@ -36,6 +36,7 @@ public:
     void pre_init() override;
     void pre_setup() override;
     void setup() override;
+    void deferred_setup() override;
     void register_urls() override;
 
 private:
@@ -212,6 +212,31 @@ void Debug::pre_setup()
     );
 
 
+    state_task_profile_prototype = Config::Object({
+        {"file",             Config::Str("", 0, 0)},
+        {"line",             Config::Uint32(0)},
+        {"runs",             Config::Uint32(0)},
+        {"runtime_max_us",   Config::Uint32(0)},
+        {"runtime_total_us", Config::Uint53(0)},
+        {"lateness", Config::Array({},
+            Config::get_prototype_uint32_0(),
+            TASK_PROFILE_LATENESS_BUCKETS, TASK_PROFILE_LATENESS_BUCKETS, Config::type_id<Config::ConfUint>()
+        )},
+    });
+
+    state_task_profile = Config::Object({
+        {"enabled", Config::Bool(false)},
+        {"profiles", Config::Uint32(0)},
+        {"tasks", Config::Array({},
+            &state_task_profile_prototype,
+            0, DEBUG_TASK_PROFILE_STATE_COUNT, Config::type_id<Config::ConfObject>()
+        )},
+    });
+
+    task_profile_update = Config::Object({
+        {"enabled", Config::Bool(false)},
+    });
+
     task_handles.reserve(16);
     register_task(xTaskGetCurrentTaskHandle(),      getArduinoLoopTaskStackSize());
     register_task(xTaskGetIdleTaskHandleForCore(0), sizeof(StackType_t) * configMINIMAL_STACK_SIZE);
@@ -300,13 +325,18 @@ void Debug::setup()
 
         micros_t now = now_us();
         uint32_t time_since_last_update_us = (now - this->last_state_update).as<uint32_t>();
-        uint32_t integrity_check_cpu_usage = 100 * this->integrity_check_runtime_sum / time_since_last_update_us;
-        state_fast.get("cpu_usage")->updateUint(100 - integrity_check_cpu_usage);
+        uint32_t idle_cpu_usage = 100 * (this->integrity_check_runtime_sum + this->main_loop_sleep_sum) / time_since_last_update_us;
+        state_fast.get("cpu_usage")->updateUint(idle_cpu_usage < 100 ? 100 - idle_cpu_usage : 0);
         this->last_state_update = now;
 
         this->integrity_check_runs = 0;
         this->integrity_check_runtime_sum = 0;
         this->integrity_check_runtime_max = 0;
+        this->main_loop_sleep_sum = 0;
+
+        if (task_scheduler.isProfilingEnabled()) {
+            this->update_task_profile_state();
+        }
     }, 1_s, 1_s);
 
     task_scheduler.scheduleWithFixedDelay([this]() {
@@ -507,6 +537,18 @@ void Debug::register_urls()
     api.addState("debug/state_slow", &state_slow);
     api.addState("debug/state_slots", &state_slots);
     api.addState("debug/state_hwm", &state_hwm);
+    api.addState("debug/task_profile", &state_task_profile);
+
+    api.addCommand("debug/task_profile_update", &task_profile_update, {}, [this](String &/*errmsg*/) {
+        bool enabled = task_profile_update.get("enabled")->asBool();
+
+        task_scheduler.setProfilingEnabled(enabled);
+        state_task_profile.get("enabled")->updateBool(enabled);
+
+        if (enabled) {
+            this->update_task_profile_state();
+        }
+    }, false);
 
 #ifdef DEBUG_FS_ENABLE
     server.on_HTTPThread("/debug/crash", HTTP_GET, [](WebServerRequest req) {
@@ -526,6 +568,52 @@ void Debug::register_urls()
         return req.send(200, "text/plain", sw.getPtr(), static_cast<ssize_t>(sw.getLength()));
     });
 
+    server.on_HTTPThread("/debug/api_state_updates", HTTP_GET, [](WebServerRequest req) {
+        char buf[128];
+        StringWriter sw(buf, sizeof(buf));
+        task_scheduler.await([&sw]() {
+            sw.printf("states checked %lu\nnodes visited %lu\nunowned update generation %lu\n",
+                      api.state_update_states_checked, api.state_update_nodes_visited, Config::unowned_update_generation);
+        });
+        return req.send(200, "text/plain", sw.getPtr(), static_cast<ssize_t>(sw.getLength()));
+    });
+
+    server.on_HTTPThread("/debug/task_profile", HTTP_GET, [](WebServerRequest req) {
+        StringBuilder sb;
+
+        auto result = task_scheduler.await([&sb]() {
+            const std::vector<TaskProfile> &profiles = task_scheduler.getProfiles();
+
+            // One header line and one line of at most 96 characters plus the file name per profile.
+            size_t capacity = 128;
+            for (const TaskProfile &profile : profiles) {
+                capacity += 96 + strlen(profile.file);
+            }
+
+            if (!sb.setCapacity(capacity)) {
+                return;
+            }
+
+            sb.printf("    runs   total_us  max_us late<1ms/4/16/64/256/1s/4s/more task\n");
+
+            for (const TaskProfile &profile : profiles) {
+                sb.printf("%8lu %10llu %7lu", profile.runs, profile.runtime_total_us, profile.runtime_max_us);
+
+                for (size_t i = 0; i < TASK_PROFILE_LATENESS_BUCKETS; ++i) {
+                    sb.printf(i == 0 ? " %lu" : "/%lu", profile.lateness[i]);
+                }
+
+                sb.printf(" %s:%lu\n", profile.file, static_cast<unsigned long>(profile.line));
+            }
+        });
+
+        if (result != TaskScheduler::AwaitResult::Done || sb.getCapacity() == 0) {
+            return req.send(500, "text/plain", "Failed to collect task profiles");
+        }
+
+        return req.send(200, "text/plain", sb.getPtr(), static_cast<ssize_t>(sb.getLength()));
+    });
+
 #ifdef DEBUG_FS_ENABLE
     server.on_HTTPThread("/debug/rtos_tasks", HTTP_GET, [](WebServerRequest req) {
         char buf[2048]; // "This buffer is assumed to be large enough to contain the generated report. Approximately 40 bytes per task should be sufficient." - vTaskGetRunTimeStats@FreeRTOS
@@ -655,6 +743,71 @@ void Debug::custom_loop() {
     last_run = start;
 }
 
+// The main loop's sleep counts as idle time and not as loop runtime.
+void Debug::main_loop_slept(micros_t slept)
+{
+    main_loop_sleep_sum += slept.as<uint32_t>();
+    last_run = last_run + slept;
+}
+
+// Shows the profiles with the highest total runtime.
+void Debug::update_task_profile_state()
+{
+    const std::vector<TaskProfile> &profiles = task_scheduler.getProfiles();
+    const TaskProfile *top[DEBUG_TASK_PROFILE_STATE_COUNT];
+    size_t top_count = 0;
+
+    for (const TaskProfile &profile : profiles) {
+        size_t pos = top_count;
+
+        while (pos > 0 && top[pos - 1]->runtime_total_us < profile.runtime_total_us) {
+            --pos;
+        }
+
+        if (pos >= DEBUG_TASK_PROFILE_STATE_COUNT)
+            continue;
+
+        size_t last = top_count < DEBUG_TASK_PROFILE_STATE_COUNT ? top_count : DEBUG_TASK_PROFILE_STATE_COUNT - 1;
+        for (size_t i = last; i > pos; --i) {
+            top[i] = top[i - 1];
+        }
+
+        top[pos] = &profile;
+
+        if (top_count < DEBUG_TASK_PROFILE_STATE_COUNT) {
+            ++top_count;
+        }
+    }
+
+    state_task_profile.get("profiles")->updateUint(profiles.size());
+
+    Config *conf_tasks = static_cast<Config *>(state_task_profile.get("tasks"));
+
+    while (conf_tasks->count() > top_count) {
+        conf_tasks->removeLast();
+    }
+
+    while (conf_tasks->count() < top_count) {
+        conf_tasks->add();
+    }
+
+    for (size_t i = 0; i < top_count; i++) {
+        const TaskProfile *profile = top[i];
+        Config *conf = static_cast<Config *>(conf_tasks->get(i));
+
+        conf->get("file")->updateString(profile->file);
+        conf->get("line")->updateUint(profile->line);
+        conf->get("runs")->updateUint(profile->runs);
+        conf->get("runtime_max_us")->updateUint(profile->runtime_max_us);
+        conf->get("runtime_total_us")->updateUint53(profile->runtime_total_us);
+
+        Config *conf_lateness = static_cast<Config *>(conf->get("lateness"));
+        for (size_t j = 0; j < TASK_PROFILE_LATENESS_BUCKETS; j++) {
+            conf_lateness->get(j)->updateUint(profile->lateness[j]);
+        }
+    }
+}
+
 void Debug::register_task(const char *task_name, uint32_t stack_size, TaskAvailability availability)
 {
     size_t task_count = state_hwm.count();
@@ -26,6 +26,9 @@
 #include "config.h"
 #include "tools.h"
 
+// Number of task profiles with the highest total runtime in the task_profile state.
+#define DEBUG_TASK_PROFILE_STATE_COUNT 8
+
 class Debug final : public IModule
 {
 public:
@@ -44,6 +47,7 @@ public:
     void custom_loop();
 
     void task_scheduler_idle_call();
+    void main_loop_slept(micros_t slept);
     void register_task(const char *task_name, uint32_t stack_size, TaskAvailability availability = ExpectPresent);
     void register_task(TaskHandle_t handle, uint32_t stack_size);
     void deregister_task(const char *task_name);
@@ -51,16 +55,20 @@ public:
 
 private:
     void deregister_task_internal(size_t index);
+    void update_task_profile_state();
 
     ConfigRoot state_static;
     ConfigRoot state_fast;
     ConfigRoot state_slow;
     ConfigRoot state_slots;
     ConfigRoot state_hwm;
+    ConfigRoot state_task_profile;
+    ConfigRoot task_profile_update;
 
     Config state_spi_bus_prototype;
     Config state_slots_prototype;
     Config state_hwm_prototype;
+    Config state_task_profile_prototype;
 
     std::vector<TaskHandle_t> task_handles;
 
@@ -71,6 +79,7 @@ private:
     uint32_t integrity_check_runs = 0;
     uint32_t integrity_check_runtime_sum = 0;
     uint32_t integrity_check_runtime_max = 0;
+    uint32_t main_loop_sleep_sum = 0;
     bool     integrity_check_print_errors = true;
     bool     internal_heap_valid = true;
     bool     psram_heap_valid = true;
@@ -41,66 +41,65 @@ int64_t Event::registerEvent(const String &path, const std::vector<ConfPath> val
         logger.printfln("Attempted to register event for %s before the REGISTER_EVENTS BootStage!", path.c_str());
     }
 
-    auto api_states = api.states.size();
-    for (size_t i = 0; i < api_states; i++) {
-        if (path.length() != api.states[i].path_len || path != api.states[i].path) {
-            continue;
-        }
+    const APIPath *entry = api.findPath(path.c_str(), path.length());
 
-        Config *config = api.states[i].config;
-        Config *ptr = config;
+    if (entry == nullptr || entry->type != APIPath::Type::State) {
+        logger.printfln("State %s not found", path.c_str());
+        return -1;
+    }
 
-        auto conf_path = values.size() != 0 ? heap_alloc_array<ConfPath>(values.size()) : nullptr;
-        size_t conf_path_written = 0;
+    size_t stateIdx = entry->idx;
 
-        for (auto value : values) {
-            const char **obj_variant = strict_variant::get<const char *>(&value);
-            bool is_obj = obj_variant != nullptr;
-            if (is_obj) {
-                if (!string_is_in_rodata(*obj_variant))
-                    esp_system_abort("event path key not in flash! Please pass a string literal!");
-                ptr = (Config *)ptr->get(*obj_variant);
-            }
-            else
-                ptr = (Config *)ptr->get(*strict_variant::get<size_t>(&value));
+    Config *config = api.states[stateIdx].config;
+    Config *ptr = config;
 
-            if (ptr == nullptr) {
-                if (is_obj)
-                    logger.printfln("Value %s in state %s not found", *obj_variant, path.c_str());
-                else
-                    logger.printfln("Index %u in state %s not found", *strict_variant::get<size_t>(&value), path.c_str());
-                return -1;
-            }
+    auto conf_path = values.size() != 0 ? heap_alloc_array<ConfPath>(values.size()) : nullptr;
+    size_t conf_path_written = 0;
 
-            conf_path[conf_path_written] = value;
-            ++conf_path_written;
+    for (auto value : values) {
+        const char **obj_variant = strict_variant::get<const char *>(&value);
+        bool is_obj = obj_variant != nullptr;
+        if (is_obj) {
+            if (!string_is_in_rodata(*obj_variant))
+                esp_system_abort("event path key not in flash! Please pass a string literal!");
+            ptr = (Config *)ptr->get(*obj_variant);
         }
+        else
+            ptr = (Config *)ptr->get(*strict_variant::get<size_t>(&value));
 
-        int64_t eventID = ++lastEventID;
+        if (ptr == nullptr) {
+            if (is_obj)
+                logger.printfln("Value %s in state %s not found", *obj_variant, path.c_str());
+            else
+                logger.printfln("Index %u in state %s not found", *strict_variant::get<size_t>(&value), path.c_str());
+            return -1;
+        }
 
-        bool store_callback = true;
+        conf_path[conf_path_written] = value;
+        ++conf_path_written;
+    }
 
-        // If the config updated flag is currently set
-        // pushStateUpdate will call the callback soon.
-        // If not, trigger the callback to make sure
-        // it is always called at least once.
-        if (!ptr->was_updated(1 << backendIdx)) {
-            if (callback(ptr) == EventResult::Deregister) {
-                store_callback = false;
-            }
-        }
+    int64_t eventID = ++lastEventID;
+
+    bool store_callback = true;
 
-        // Store callback after possibly calling it,
-        // because the function object is forwarded to the vector and cannot be used locally afterwards.
-        if (store_callback) {
-            state_updates.push_back({eventID, i, std::move(callback), std::move(conf_path), conf_path_written});
+    // If the config updated flag is currently set
+    // pushStateUpdate will call the callback soon.
+    // If not, trigger the callback to make sure
+    // it is always called at least once.
+    if (!ptr->was_updated(1 << backendIdx)) {
+        if (callback(ptr) == EventResult::Deregister) {
+            store_callback = false;
         }
+    }
 
-        return eventID;
+    // Store callback after possibly calling it,
+    // because the function object is forwarded to the vector and cannot be used locally afterwards.
+    if (store_callback) {
+        state_updates.push_back({eventID, stateIdx, std::move(callback), std::move(conf_path), conf_path_written});
     }
 
-    logger.printfln("State %s not found", path.c_str());
-    return -1;
+    return eventID;
 }
 
 void Event::deregisterEvent(int64_t eventID)
@@ -0,0 +1,438 @@
+/* esp32-firmware
+ * Copyright (C) 2026 Erik Fleckstein <erik@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "deferred_format.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "gcc_warnings.h"
+
+// Longest conversion specification that can be formatted, including '%' and the NUL-terminator.
+#define DEFERRED_FORMAT_MAX_SPEC_LEN 24
+// Longest string argument that is stored.
+#define DEFERRED_FORMAT_MAX_STRING_LEN 255
+
+enum class ArgType : uint8_t {
+    Percent,
+    Int,
+    Long,
+    LongLong,
+    IntMax,
+    Size,
+    PtrDiff,
+    Double,
+    Pointer,
+    String,
+    Invalid,
+};
+
+struct FormatSpec {
+    const char *start; // Points to the '%'
+    size_t len;
+    ArgType type;
+    bool width_star;
+    bool precision_star;
+    int precision; // -1 if not given as a number
+};
+
+enum class LengthModifier : uint8_t {
+    None,
+    Char,
+    Short,
+    Long,
+    LongLong,
+    IntMax,
+    Size,
+    PtrDiff,
+    LongDouble,
+};
+
+static ArgType integer_type(LengthModifier length)
+{
+    switch (length) {
+        case LengthModifier::None:
+        case LengthModifier::Char:
+        case LengthModifier::Short:
+            return ArgType::Int;
+        case LengthModifier::Long:
+            return ArgType::Long;
+        case LengthModifier::LongLong:
+            return ArgType::LongLong;
+        case LengthModifier::IntMax:
+            return ArgType::IntMax;
+        case LengthModifier::Size:
+            return ArgType::Size;
+        case LengthModifier::PtrDiff:
+            return ArgType::PtrDiff;
+        case LengthModifier::LongDouble:
+        default:
+            return ArgType::Invalid;
+    }
+}
+
+// p points to the '%'. Returns the character after the conversion specification.
+static const char *parse_spec(const char *p, FormatSpec *spec)
+{
+    spec->start = p;
+    spec->width_star = false;
+    spec->precision_star = false;
+    spec->precision = -1;
+
+    ++p;
+
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'') {
+        ++p;
+    }
+
+    if (*p == '*') {
+        spec->width_star = true;
+        ++p;
+    } else {
+        while (*p >= '0' && *p <= '9') {
+            ++p;
+        }
+    }
+
+    if (*p == '.') {
+        ++p;
+
+        if (*p == '*') {
+            spec->precision_star = true;
+            ++p;
+        } else {
+            spec->precision = 0;
+
+            while (*p >= '0' && *p <= '9') {
+                spec->precision = spec->precision * 10 + (*p - '0');
+                ++p;
+            }
+        }
+    }
+
+    LengthModifier length = LengthModifier::None;
+
+    switch (*p) {
+        case 'h':
+            ++p;
+            if (*p == 'h') {
+                ++p;
+                length = LengthModifier::Char;
+            } else {
+                length = LengthModifier::Short;
+            }
+            break;
+
+        case 'l':
+            ++p;
+            if (*p == 'l') {
+                ++p;
+                length = LengthModifier::LongLong;
+            } else {
+                length = LengthModifier::Long;
+            }
+            break;
+
+        case 'q': ++p; length = LengthModifier::LongLong;   break;
+        case 'j': ++p; length = LengthModifier::IntMax;     break;
+        case 'z': ++p; length = LengthModifier::Size;       break;
+        case 't': ++p; length = LengthModifier::PtrDiff;    break;
+        case 'L': ++p; length = LengthModifier::LongDouble; break;
+
+        default:
+            break;
+    }
+
+    switch (*p) {
+        case '%':
+            spec->type = ArgType::Percent;
+            break;
+
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+            spec->type = integer_type(length);
+            break;
+
+        case 'c':
+            spec->type = length == LengthModifier::None ? ArgType::Int : ArgType::Invalid;
+            break;
+
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            spec->type = length == LengthModifier::LongDouble ? ArgType::Invalid : ArgType::Double;
+            break;
+
+        case 'p':
+            spec->type = ArgType::Pointer;
+            break;
+
+        case 's':
+            spec->type = length == LengthModifier::None ? ArgType::String : ArgType::Invalid;
+            break;
+
+        default: // Includes %n and the NUL-terminator of a truncated specification.
+            spec->type = ArgType::Invalid;
+            return p;
+    }
+
+    ++p;
+    spec->len = static_cast<size_t>(p - spec->start);
+
+    if (spec->len >= DEFERRED_FORMAT_MAX_SPEC_LEN) {
+        spec->type = ArgType::Invalid;
+    }
+
+    return p;
+}
+
+struct PackWriter {
+    uint8_t *buf;
+    size_t buf_len;
+    size_t used;
+
+    bool put(const void *src, size_t len)
+    {
+        if (buf_len - used < len)
+            return false;
+
+        memcpy(buf + used, src, len);
+        used += len;
+        return true;
+    }
+
+    template<typename T>
+    bool put_value(T value)
+    {
+        return put(&value, sizeof(value));
+    }
+};
+
+size_t deferred_format_pack(uint8_t *buf, size_t buf_len, const char *fmt, va_list args)
+{
+    PackWriter writer{buf, buf_len, 0};
+    const char *p = fmt;
+
+    // An empty result means failure. Mark messages without arguments with a single byte.
+    if (!writer.put_value<uint8_t>(0))
+        return 0;
+
+    while (*p != '\0') {
+        if (*p != '%') {
+            ++p;
+            continue;
+        }
+
+        FormatSpec spec;
+        p = parse_spec(p, &spec);
+
+        if (spec.type == ArgType::Invalid)
+            return 0;
+
+        if (spec.type == ArgType::Percent)
+            continue;
+
+        if (spec.width_star && !writer.put_value<int>(va_arg(args, int)))
+            return 0;
+
+        int precision = spec.precision;
+
+        if (spec.precision_star) {
+            precision = va_arg(args, int);
+
+            if (!writer.put_value<int>(precision))
+                return 0;
+        }
+
+        bool ok;
+
+        switch (spec.type) {
+            case ArgType::Int:      ok = writer.put_value(va_arg(args, int));        break;
+            case ArgType::Long:     ok = writer.put_value(va_arg(args, long));       break;
+            case ArgType::LongLong: ok = writer.put_value(va_arg(args, long long));  break;
+            case ArgType::IntMax:   ok = writer.put_value(va_arg(args, intmax_t));   break;
+            case ArgType::Size:     ok = writer.put_value(va_arg(args, size_t));     break;
+            case ArgType::PtrDiff:  ok = writer.put_value(va_arg(args, ptrdiff_t));  break;
+            case ArgType::Double:   ok = writer.put_value(va_arg(args, double));     break;
+            case ArgType::Pointer:  ok = writer.put_value(va_arg(args, void *));     break;
+
+            case ArgType::String: {
+                const char *s = va_arg(args, const char *);
+                if (s == nullptr) {
+                    s = "(null)";
+                }
+
+                size_t max_len = precision >= 0 ? static_cast<size_t>(precision) : DEFERRED_FORMAT_MAX_STRING_LEN;
+                if (max_len > DEFERRED_FORMAT_MAX_STRING_LEN) {
+                    max_len = DEFERRED_FORMAT_MAX_STRING_LEN;
+                }
+
+                uint8_t len = static_cast<uint8_t>(strnlen(s, max_len));
+                ok = writer.put_value(len) && writer.put(s, len);
+                break;
+            }
+
+            case ArgType::Percent:
+            case ArgType::Invalid:
+            default:
+                ok = false;
+                break;
+        }
+
+        if (!ok)
+            return 0;
+    }
+
+    return writer.used;
+}
+
+struct PackReader {
+    const uint8_t *buf;
+    size_t buf_len;
+    size_t used;
+
+    bool get(void *dst, size_t len)
+    {
+        if (buf_len - used < len)
+            return false;
+
+        memcpy(dst, buf + used, len);
+        used += len;
+        return true;
+    }
+
+    template<typename T>
+    bool get_value(T *value)
+    {
+        return get(value, sizeof(*value));
+    }
+};
+
+#if defined(__GNUC__)
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#endif
+
+template<typename T>
+static size_t format_arg(char *buf, size_t buf_len, const char *spec, const int *stars, size_t star_count, T value)
+{
+    int result;
+
+    switch (star_count) {
+        case 0:  result = snprintf(buf, buf_len, spec, value);                     break;
+        case 1:  result = snprintf(buf, buf_len, spec, stars[0], value);           break;
+        default: result = snprintf(buf, buf_len, spec, stars[0], stars[1], value); break;
+    }
+
+    if (result < 0)
+        return 0;
+
+    // Clamp to the characters that were actually written.
+    return static_cast<size_t>(result) < buf_len ? static_cast<size_t>(result) : buf_len - 1;
+}
+
+#if defined(__GNUC__)
+    #pragma GCC diagnostic pop
+#endif
+
+template<typename T>
+static size_t unpack_and_format(PackReader *reader, char *buf, size_t buf_len, const char *spec, const int *stars, size_t star_count)
+{
+    T value;
+
+    if (!reader->get_value(&value))
+        return 0;
+
+    return format_arg(buf, buf_len, spec, stars, star_count, value);
+}
+
+size_t deferred_format_unpack(char *buf, size_t buf_len, const char *fmt, const uint8_t *args, size_t args_len)
+{
+    if (buf_len == 0)
+        return 0;
+
+    PackReader reader{args, args_len, 1}; // Skip the marker byte written by deferred_format_pack.
+    size_t written = 0;
+    const char *p = fmt;
+
+    while (*p != '\0' && written < buf_len - 1) {
+        if (*p != '%') {
+            buf[written++] = *p++;
+            continue;
+        }
+
+        FormatSpec spec;
+        p = parse_spec(p, &spec);
+
+        if (spec.type == ArgType::Invalid)
+            break;
+
+        if (spec.type == ArgType::Percent) {
+            buf[written++] = '%';
+            continue;
+        }
+
+        char spec_buf[DEFERRED_FORMAT_MAX_SPEC_LEN];
+        memcpy(spec_buf, spec.start, spec.len);
+        spec_buf[spec.len] = '\0';
+
+        int stars[2];
+        size_t star_count = 0;
+
+        if (spec.width_star && !reader.get_value(&stars[star_count++]))
+            break;
+
+        if (spec.precision_star && !reader.get_value(&stars[star_count++]))
+            break;
+
+        char *out = buf + written;
+        size_t out_len = buf_len - written;
+
+        switch (spec.type) {
+            case ArgType::Int:      written += unpack_and_format<int>      (&reader, out, out_len, spec_buf, stars, star_count); break;
+            case ArgType::Long:     written += unpack_and_format<long>     (&reader, out, out_len, spec_buf, stars, star_count); break;
+            case ArgType::LongLong: written += unpack_and_format<long long>(&reader, out, out_len, spec_buf, stars, star_count); break;
+            case ArgType::IntMax:   written += unpack_and_format<intmax_t> (&reader, out, out_len, spec_buf, stars, star_count); break;
+            case ArgType::Size:     written += unpack_and_format<size_t>   (&reader, out, out_len, spec_buf, stars, star_count); break;
+            case ArgType::PtrDiff:  written += unpack_and_format<ptrdiff_t>(&reader, out, out_len, spec_buf, stars, star_count); break;
+            case ArgType::Double:   written += unpack_and_format<double>   (&reader, out, out_len, spec_buf, stars, star_count); break;
+            case ArgType::Pointer:  written += unpack_and_format<void *>   (&reader, out, out_len, spec_buf, stars, star_count); break;
+
+            case ArgType::String: {
+                uint8_t len;
+                char s[DEFERRED_FORMAT_MAX_STRING_LEN + 1];
+
+                if (!reader.get_value(&len) || !reader.get(s, len)) {
+                    buf[written] = '\0';
+                    return written;
+                }
+
+                s[len] = '\0';
+                written += format_arg<const char *>(out, out_len, spec_buf, stars, star_count, s);
+                break;
+            }
+
+            case ArgType::Percent:
+            case ArgType::Invalid:
+            default:
+                break;
+        }
+    }
+
+    buf[written] = '\0';
+    return written;
+}
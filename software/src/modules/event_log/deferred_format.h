@@ -0,0 +1,37 @@
+/* esp32-firmware
+ * Copyright (C) 2026 Erik Fleckstein <erik@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Stores printf arguments in a compact binary form, so that the message can be formatted later.
+// Strings are copied, everything else is stored with its native size.
+// The format string must stay valid until the arguments are formatted.
+
+// Returns the number of bytes written to buf or 0 if fmt contains a conversion that can't be deferred
+// (%n, wide characters and strings, long double) or if the arguments don't fit into buf.
+// args is consumed in any case.
+size_t deferred_format_pack(uint8_t *buf, size_t buf_len, const char *fmt, va_list args);
+
+// Like vsnprintf with arguments packed by deferred_format_pack.
+// Always NUL-terminates buf and returns the number of characters written, excluding the NUL-terminator.
+size_t deferred_format_unpack(char *buf, size_t buf_len, const char *fmt, const uint8_t *args, size_t args_len);
@@ -34,20 +34,121 @@
 #include <time.h>
 #include <inttypes.h>
 #include <TFJson.h>
+#include <esp_attr.h>
 #include <esp_rom_crc.h>
+#include <esp_system.h>
+#include <LittleFS.h>
 
 #include "event_log_prefix.h"
 #include "module_dependencies.h"
 #include "build.h"
 #include "options.h"
 #include "tools.h"
+#include "tools/memory.h"
+#include "tools/string_builder.h"
 #include "tools/miniz/miniz_tdef.h"
 
+#if OPTIONS_EVENT_LOG_BINARY()
+#include "deferred_format.h"
+
+#define EVENT_LOG_DRAIN_INTERVAL 100_ms
+#endif
+
+#if OPTIONS_EVENT_LOG_PERSISTENT_SEGMENTS() > 0
+// The persistent log is written when this many bytes are pending or when the interval has elapsed.
+#define EVENT_LOG_PERSIST_BATCH_SIZE 4096
+#define EVENT_LOG_PERSIST_INTERVAL 30_s
+#define EVENT_LOG_PERSIST_CHECK_INTERVAL 1_s
+
+// The newest entries of event_buf are mirrored into RTC memory, which survives a panic or watchdog reset.
+// On the next boot, the entries that were not persisted yet are appended to the crashed boot's segment.
+#define EVENT_LOG_CRASH_TAIL_SIZE 4096
+#define EVENT_LOG_CRASH_TAIL_MAGIC 0x4C545645 // "EVTL"
+
+// Positions are absolute positions in the stream of bytes pushed into event_buf, like EventLog::persist_pos.
+// Protected by event_buf_mutex.
+struct crash_tail_t {
+    uint32_t magic;
+    uint32_t build_timestamp; // Records point into the rodata of the firmware that wrote them.
+    uint32_t boot_id;
+    uint32_t start;
+    uint32_t end;
+    uint32_t persisted;
+    char buf[EVENT_LOG_CRASH_TAIL_SIZE];
+};
+
+static RTC_NOINIT_ATTR crash_tail_t crash_tail;
+
+static char crash_tail_at(uint32_t pos)
+{
+    return crash_tail.buf[pos % EVENT_LOG_CRASH_TAIL_SIZE];
+}
+
+// Returns the length of the line or record at pos. Lines are split like in EventLog::drop_entry.
+static size_t crash_tail_entry_len(uint32_t pos)
+{
+#if OPTIONS_EVENT_LOG_BINARY()
+    if (crash_tail_at(pos) == EVENT_LOG_RECORD_MARKER) {
+        char len_buf[2] = {crash_tail_at(pos + 1), crash_tail_at(pos + 2)};
+        uint16_t payload_len;
+        memcpy(&payload_len, len_buf, sizeof(payload_len));
+
+        return 3u + payload_len;
+    }
+#endif
+
+    size_t len = 0;
+
+    while (static_cast<uint32_t>(pos + len) != crash_tail.end) {
+        char c = crash_tail_at(static_cast<uint32_t>(pos + len));
+        ++len;
+
+        if (c == '\n')
+            break;
+
+#if OPTIONS_EVENT_LOG_BINARY()
+        if (static_cast<uint32_t>(pos + len) != crash_tail.end && crash_tail_at(static_cast<uint32_t>(pos + len)) == EVENT_LOG_RECORD_MARKER)
+            break;
+#endif
+    }
+
+    return len;
+}
+
+// RTC memory is uninitialized after a power cycle and holds records of a different firmware after an update.
+static bool crash_tail_valid()
+{
+    return crash_tail.magic == EVENT_LOG_CRASH_TAIL_MAGIC
+        && crash_tail.build_timestamp == build_timestamp()
+        && crash_tail.end - crash_tail.start <= EVENT_LOG_CRASH_TAIL_SIZE
+        && static_cast<int32_t>(crash_tail.end - crash_tail.persisted) >= 0;
+}
+#endif
+
 struct deflate_outbuf {
     char outbuf[1274]; // 1390 (conservative optimal WireGuard MTU) - 8 (PPPoE) - 40 (IP) - 60 (max TCP) - 8 (HTTP chunk metadata)
     char printbuf[128];
 };
 
+#if defined(BOARD_HAS_PSRAM)
+// Greedy parsing with 20 dictionary probes, like /trace_log/10020. Fast enough to keep up with slow connections.
+#define TRACE_BUFFER_TDEFL_FLAGS (TDEFL_NONDETERMINISTIC_PARSING_FLAG | TDEFL_GREEDY_PARSING_FLAG | 20)
+
+// Follows trace data that was overwritten while it was sent or that could not be read.
+static const char trace_incomplete_marker[] = "\n__incomplete__\n";
+
+static size_t print_trace_begin(char *buf, size_t buf_len, const char *name, uint32_t dropped)
+{
+    size_t written = snprintf_u(buf, buf_len, "__begin_%.100s__\n", name);
+
+    if (dropped > 0 && written < buf_len) {
+        written += snprintf_u(buf + written, buf_len - written, "__dropped_%lu__\n", dropped);
+    }
+
+    return std::min(written, buf_len - 1);
+}
+#endif
+
 static constexpr const uint8_t gzip_header[] = {
     0x1F, // ID1 (magic)
     0x8B, // ID2
@@ -65,12 +166,49 @@ void EventLog::pre_init()
 {
     event_buf.setup();
 
+#if OPTIONS_EVENT_LOG_PERSISTENT_SEGMENTS() > 0
+    // Before a software reset, everything was persisted in pre_reboot.
+    esp_reset_reason_t reset_reason = esp_reset_reason();
+    bool crashed = reset_reason == ESP_RST_PANIC || reset_reason == ESP_RST_INT_WDT || reset_reason == ESP_RST_TASK_WDT || reset_reason == ESP_RST_WDT;
+
+    if (crashed && crash_tail_valid()) {
+        uint32_t from = crash_tail.persisted;
+
+        if (static_cast<int32_t>(from - crash_tail.start) < 0) {
+            crashed_tail_lost = crash_tail.start - from;
+            from = crash_tail.start;
+        }
+
+        size_t len = crash_tail.end - from;
+
+        if (len > 0) {
+            crashed_tail = static_cast<char *>(malloc(len));
+        }
+
+        if (crashed_tail != nullptr) {
+            for (size_t i = 0; i < len; ++i) {
+                crashed_tail[i] = crash_tail_at(static_cast<uint32_t>(from + i));
+            }
+
+            crashed_tail_len = len;
+            crashed_boot_id = crash_tail.boot_id;
+        }
+    }
+
+    crash_tail.build_timestamp = build_timestamp();
+    crash_tail.boot_id = 0;
+    crash_tail.start = 0;
+    crash_tail.end = 0;
+    crash_tail.persisted = 0;
+    crash_tail.magic = EVENT_LOG_CRASH_TAIL_MAGIC;
+#endif
+
     uint32_t numeric_reset_reason;
     printfln_prefixed("", 0, "    **** " OPTIONS_MANUFACTURER_UPPER() " " OPTIONS_PRODUCT_NAME_UPPER() " V%s ****", build_version_full_str_upper());
     printfln_prefixed("", 0, "Last reset reason was: %s (%lu)", tf_reset_reason(&numeric_reset_reason), numeric_reset_reason);
 }
 
-size_t EventLog::alloc_trace_buffer(const char *name, size_t size) {
+size_t EventLog::alloc_trace_buffer(const char *name, size_t size, bool binary) {
 #if defined(BOARD_HAS_PSRAM)
     if (boot_stage > BootStage::PRE_SETUP){
         esp_system_abort("Using alloc_trace_buffer after the pre_setup is not allowed!");
@@ -85,7 +223,11 @@ size_t EventLog::alloc_trace_buffer(const char *name, size_t size) {
     }
 
     trace_buffers[trace_buffers_in_use].name = name;
-    trace_buffers[trace_buffers_in_use].buf.setup(size);
+    trace_buffers[trace_buffers_in_use].binary = binary;
+
+    if (!trace_buffers[trace_buffers_in_use].buf.setup(size)) {
+        esp_system_abort("Failed to set up trace buffer! Size must be a power of two and at least 2 KiB.");
+    }
 
     ++trace_buffers_in_use;
     trace_buffer_size_allocd += size;
@@ -101,6 +243,29 @@ void EventLog::pre_setup()
     boot_id = Config::Object({
         {"boot_id", Config::Uint32(0)}
     });
+
+#if OPTIONS_EVENT_LOG_BINARY()
+    task_scheduler.scheduleWithFixedDelay([this]() {
+        this->drain();
+    }, EVENT_LOG_DRAIN_INTERVAL, EVENT_LOG_DRAIN_INTERVAL);
+
+    // Also runs if the reboot skips the pre_reboot handlers, for example via /force_reboot.
+    if (esp_register_shutdown_handler([]() { logger.drain(); }) != ESP_OK) {
+        printfln_prefixed("event_log", 9, "Failed to register shutdown handler");
+    }
+#endif
+}
+
+void EventLog::pre_reboot()
+{
+#if OPTIONS_EVENT_LOG_BINARY()
+    drain();
+#endif
+
+#if OPTIONS_EVENT_LOG_PERSISTENT_SEGMENTS() > 0
+    persist(true);
+    persistent_log.close();
+#endif
 }
 
 #define CHUNK_SIZE 1024U
@@ -114,6 +279,46 @@ void EventLog::register_urls()
 
         request.beginChunkedResponse(200);
 
+#if OPTIONS_EVENT_LOG_BINARY()
+        auto send_chunk = [&request](const char *buf, size_t len) {
+            int result = request.sendChunk(buf, static_cast<ssize_t>(len));
+            if (result != ESP_OK) {
+                if (result != ESP_ERR_HTTPD_RESP_SEND) { // Don't log connection closed during transfer. This happens when the front-end is reloaded after a websocket reconnect.
+                    Serial.printf("/event_log sendChunk failed: %s (0x%X)\n", esp_err_to_name(result), static_cast<unsigned int>(result)); // Can't write to the event log while holding the event_buf_mutex.
+                }
+                return false;
+            }
+            return true;
+        };
+
+        char line_buf[EVENT_LOG_TIMESTAMP_LENGTH + 256];
+        static_assert(ARRAY_SIZE(line_buf) <= CHUNK_SIZE);
+        size_t chunk_used = 0;
+        size_t offset = 0;
+
+        // Records are formatted while the response is sent.
+        while (offset < used) {
+            size_t entry_len;
+            size_t line_len = format_entry(offset, line_buf, ARRAY_SIZE(line_buf), &entry_len);
+
+            offset += entry_len;
+
+            if (chunk_used + line_len > CHUNK_SIZE) {
+                if (!send_chunk(chunk_buf, chunk_used)) {
+                    return request.endChunkedResponse();
+                }
+
+                chunk_used = 0;
+            }
+
+            memcpy(chunk_buf + chunk_used, line_buf, line_len);
+            chunk_used += line_len;
+        }
+
+        if (chunk_used > 0) {
+            send_chunk(chunk_buf, chunk_used);
+        }
+#else
         for (size_t index = 0; index < used; index += CHUNK_SIZE) {
             size_t to_write = std::min(CHUNK_SIZE, used - index);
 
@@ -129,10 +334,89 @@ void EventLog::register_urls()
                 break;
             }
         }
+#endif
+
+        return request.endChunkedResponse();
+    });
+
+
+#if OPTIONS_EVENT_LOG_PERSISTENT_SEGMENTS() > 0
+    // Lists the boots in the persistent log, oldest first.
+    server.on_HTTPThread("/event_log/boots", HTTP_GET, [this](WebServerRequest request) {
+        std::vector<PersistentLog::Segment> segments = persistent_log.get_segments();
+        uint32_t current_boot_id = persistent_log.get_boot_id();
+        char buf[96];
+        StringWriter sw(buf, sizeof(buf));
+
+        request.beginChunkedResponse(200, "application/json; charset=utf-8");
+        request.sendChunk("[", 1);
+
+        for (size_t i = 0; i < segments.size();) {
+            uint32_t id = segments[i].boot_id;
+            size_t size = 0;
+
+            sw.clear();
+            sw.puts(i == 0 ? "" : ",");
+
+            // Segments of a boot are consecutive.
+            for (; i < segments.size() && segments[i].boot_id == id; ++i) {
+                size += segments[i].size;
+            }
+
+            sw.printf("{\"boot_id\":%lu,\"size\":%zu,\"current\":%s}", id, size, id == current_boot_id ? "true" : "false");
+            request.sendChunk(buf, static_cast<ssize_t>(sw.getLength()));
+        }
 
+        request.sendChunk("]", 1);
         return request.endChunkedResponse();
     });
 
+    // Returns the event log of a boot listed by /event_log/boots.
+    server.on_HTTPThread("/event_log/boots/*", HTTP_GET, [this](WebServerRequest request) {
+        const char *arg = request.uriCStr() + strlen("/event_log/boots/");
+        char *end;
+        uint32_t requested_boot_id = strtoul(arg, &end, 10);
+
+        if (end == arg || *end != '\0') {
+            return request.send(400, "text/plain", "Invalid boot ID");
+        }
+
+        std::vector<PersistentLog::Segment> segments = persistent_log.get_segments();
+        char chunk_buf[CHUNK_SIZE]; // The HTTP task's stack is large enough.
+        bool found = false;
+
+        for (const PersistentLog::Segment &segment : segments) {
+            if (segment.boot_id != requested_boot_id) {
+                continue;
+            }
+
+            // The segment might have been removed in the meantime.
+            File f = LittleFS.open(PersistentLog::segment_name(segment), "r");
+            if (!f) {
+                continue;
+            }
+
+            if (!found) {
+                request.beginChunkedResponse(200);
+                found = true;
+            }
+
+            while (f.available()) {
+                size_t read = f.read(reinterpret_cast<uint8_t *>(chunk_buf), ARRAY_SIZE(chunk_buf));
+
+                if (read == 0 || request.sendChunk(chunk_buf, static_cast<ssize_t>(read)) != ESP_OK) {
+                    return request.endChunkedResponse();
+                }
+            }
+        }
+
+        if (!found) {
+            return request.send(404, "text/plain", "Unknown boot ID");
+        }
+
+        return request.endChunkedResponse();
+    });
+#endif
 
     server.on_HTTPThread("/trace_log", HTTP_GET, [this](WebServerRequest request) {
 #if defined(BOARD_HAS_PSRAM)
@@ -140,20 +424,30 @@ void EventLog::register_urls()
 
         for (size_t i = 0; i < trace_buffers_in_use; ++i) {
             auto &trace_buffer = trace_buffers[i];
-            std::lock_guard<std::mutex> lock{trace_buffer.mutex};
 
-            char *first_chunk, *second_chunk;
-            size_t first_len, second_len;
-            trace_buffer.buf.get_chunks(&first_chunk, &first_len, &second_chunk, &second_len);
+            if (trace_buffer.binary)
+                continue;
 
             char buf[128];
-            size_t written = snprintf(buf, ARRAY_SIZE(buf), "__begin_%.100s__\n", trace_buffer.name);
+            size_t written = print_trace_begin(buf, ARRAY_SIZE(buf), trace_buffer.name, trace_buffer.buf.dropped_count());
             request.sendChunk(buf, written);
 
-            if (first_len > 0)
-                request.sendChunk(first_chunk, first_len);
-            if (second_len > 0)
-                request.sendChunk(second_chunk, second_len);
+            TraceRingbuffer::Snapshot snapshot = trace_buffer.buf.snapshot();
+
+            for (size_t block = 0; block < trace_buffer.buf.readable_blocks(); ++block) {
+                TraceRingbuffer::Chunk chunk;
+
+                if (!get_trace_block(&trace_buffer.buf, snapshot, block, &chunk)) {
+                    request.sendChunk(trace_incomplete_marker, strlen(trace_incomplete_marker));
+                    continue;
+                }
+
+                if (chunk.len > 0)
+                    request.sendChunk(chunk.data, chunk.len);
+
+                if (!trace_buffer.buf.is_unchanged(chunk))
+                    request.sendChunk(trace_incomplete_marker, strlen(trace_incomplete_marker));
+            }
 
             written = snprintf(buf, ARRAY_SIZE(buf), "__end_%.100s__\n", trace_buffer.name);
             request.sendChunk(buf, written);
@@ -186,197 +480,116 @@ void EventLog::register_urls()
 
         tdefl_flags |= dictionary_probes;
 
-        tdefl_compressor *deflator = nullptr;
-        deflate_outbuf *buf = nullptr;
-
-        defer {
-            free(deflator);
-            deflator = nullptr;
-
-            free(buf);
-            buf = nullptr;
-        };
-
-        deflator = static_cast<tdefl_compressor *>(malloc(sizeof(tdefl_compressor)));
-        if (!deflator) {
-            return request.send(500, "text/plain", "Failed to allocate compressor");
-        }
+        return send_trace_buffers_gzipped(request, tdefl_flags, 0, trace_buffers_in_use, false);
+#else
+        return request.send(200);
+#endif
+    });
 
-        buf = static_cast<decltype(buf)>(malloc(sizeof(*buf)));
-        if (!buf) {
-            return request.send(500, "text/plain", "Failed to allocate output buffer");
-        }
+#if defined(BOARD_HAS_PSRAM)
+    // Compressed download of a single trace buffer, for example /trace_buffer/charge_manager.
+    // PUT also clears the buffer: Records written while or after it is sent are kept.
+    auto trace_buffer_handler = [this](WebServerRequest request) {
+        TraceBuffer *trace_buffer = find_trace_buffer(request.uriCStr() + strlen("/trace_buffer/"));
 
-        // Initialize the low-level compressor
-        tdefl_status t_status = tdefl_init(deflator, nullptr, nullptr, tdefl_flags);
-        if (t_status != TDEFL_STATUS_OKAY) {
-            return request.send(500, "text/plain", "Failed to initialize compressor");
+        if (trace_buffer == nullptr) {
+            return request.send(404, "text/plain", "Unknown trace buffer");
         }
 
-        request.addResponseHeader("Content-Encoding", "gzip");
-        request.beginChunkedResponse(200);
-
-        // Copy gzip header to output buffer
-        static_assert(ARRAY_SIZE(buf->outbuf) >= sizeof(gzip_header));
-        memcpy(buf->outbuf, gzip_header, sizeof(gzip_header));
-
-        char *next_out = buf->outbuf + sizeof(gzip_header);
-        size_t avail_out = ARRAY_SIZE(buf->outbuf) - sizeof(gzip_header);
-
-        size_t uncompressed_len = 0;
-        uint32_t crc32 = 0;
-
-        constexpr   uint32_t HEADER_PREPARE = 0;
-        //constexpr uint32_t HEADER_SEND    = 1;
-        constexpr   uint32_t FIRST_PREPARE  = 2;
-        //constexpr uint32_t FIRST_SEND     = 3;
-        constexpr   uint32_t SECOND_PREPARE = 4;
-        //constexpr uint32_t SECOND_SEND    = 5;
-        //constexpr uint32_t FOOTER_PREPARE = 6;
-        constexpr   uint32_t FOOTER_SEND    = 7;
-
-        for (size_t i = 0; i < trace_buffers_in_use; ++i) {
-            auto &trace_buffer = trace_buffers[i];
-            std::lock_guard<std::mutex> lock{trace_buffer.mutex};
-
-            char *first_chunk, *second_chunk;
-            size_t first_len, second_len;
-            trace_buffer.buf.get_chunks(&first_chunk, &first_len, &second_chunk, &second_len);
-
-            uint32_t state = HEADER_PREPARE;
-            char *next_in;
-            size_t avail_in;
-
-            for (;;) {
-                if ((state & 1) == 0) { // One of the prepare states
-                    if (state == FIRST_PREPARE) {
-                        next_in = first_chunk;
-                        avail_in = first_len;
-                    } else if (state == SECOND_PREPARE) {
-                        next_in = second_chunk;
-                        avail_in = second_len;
-                    } else {
-                        next_in = buf->printbuf;
-
-                        const char *label = state == HEADER_PREPARE ? "begin" : "end";
-                        avail_in = snprintf_u(buf->printbuf, ARRAY_SIZE(buf->printbuf), "__%s_%.100s__\n", label, trace_buffer.name);
-                    }
-
-                    crc32 = esp_rom_crc32_le(crc32, reinterpret_cast<const uint8_t *>(next_in), avail_in);
-
-                    uncompressed_len += avail_in;
-
-                    state++; // Advance to send state
-                }
-
-                size_t in_bytes = avail_in;
-                size_t out_bytes = avail_out;
-                t_status = tdefl_compress(deflator, next_in, &in_bytes, next_out, &out_bytes, TDEFL_NO_FLUSH);
-
-                if (t_status != TDEFL_STATUS_OKAY) {
-                    printfln_prefixed("event_log", 9, "trace_log compression failed: %i", static_cast<int>(t_status));
-                    return request.endChunkedResponse();
-                }
-
-                next_in += in_bytes;
-                avail_in -= in_bytes;
-
-                next_out += out_bytes;
-                avail_out -= out_bytes;
-
-                if (avail_out == 0) {
-                    int result = request.sendChunk(buf->outbuf, ARRAY_SIZE(buf->outbuf));
+        size_t idx = static_cast<size_t>(trace_buffer - trace_buffers.data());
 
-                    if (result != ESP_OK) {
-                        printfln_prefixed("event_log", 9, "trace_log compressed chunk sending failed: %i", result);
-                        return request.endChunkedResponse();
-                    }
+        return send_trace_buffers_gzipped(request, TRACE_BUFFER_TDEFL_FLAGS, idx, 1, request.method() == HTTP_PUT);
+    };
 
-                    next_out = buf->outbuf;
-                    avail_out = ARRAY_SIZE(buf->outbuf);
-                }
+    server.on_HTTPThread("/trace_buffer/*", HTTP_GET, trace_buffer_handler);
+    server.on_HTTPThread("/trace_buffer/*", HTTP_PUT, trace_buffer_handler);
+#endif
 
-                // Insert a small delay after every compressed block so that the main task has a chance to run.
-                vTaskDelay(2);
+    api.addState("event_log/boot_id", &boot_id);
+}
 
-                if (avail_in == 0) {
-                    if (state == FOOTER_SEND) {
-                        break;
-                    } else {
-                        state++; // Advance to next prepare state
-                    }
-                }
-            }
-        }
+void EventLog::post_setup()
+{
+    // Entropy is created by the wifi modem.
+    auto id = esp_random();
+    boot_id.get("boot_id")->updateUint(id);
 
-        // Flush compression buffer
-        do {
-            size_t out_bytes = avail_out;
-            t_status = tdefl_compress(deflator, nullptr, nullptr, next_out, &out_bytes, TDEFL_FINISH);
+#if OPTIONS_EVENT_LOG_PERSISTENT_SEGMENTS() > 0
+    {
+        std::lock_guard<std::mutex> lock{event_buf_mutex};
+        crash_tail.boot_id = id;
+    }
 
-            avail_out -= out_bytes;
+    size_t max_segments = std::min(static_cast<size_t>(OPTIONS_EVENT_LOG_PERSISTENT_SEGMENTS()), LittleFS.totalBytes() / 8 / EVENT_LOG_PERSIST_SEGMENT_SIZE);
 
-            int result = request.sendChunk(buf->outbuf, static_cast<ssize_t>(ARRAY_SIZE(buf->outbuf) - avail_out));
+    bool loaded = max_segments >= 2 && persistent_log.load(max_segments);
 
-            next_out = buf->outbuf;
-            avail_out = ARRAY_SIZE(buf->outbuf);
+    // Must happen before this boot's segment is started, so that the crashed boot's segments stay consecutive.
+    if (loaded && crashed_tail != nullptr) {
+        persist_crash_tail();
+    }
 
-            if (result != ESP_OK) {
-                printfln_prefixed("event_log", 9, "trace_log final compressed chunk sending failed: %i", result);
-                return request.endChunkedResponse();
-            }
-        } while (t_status != TDEFL_STATUS_DONE);
+    free(crashed_tail);
+    crashed_tail = nullptr;
 
-        {
-            uint32_t gzip_tail[2] = {crc32, uncompressed_len};
+    if (max_segments < 2) {
+        printfln_prefixed("event_log", 9, "File system too small to keep the event log across reboots");
+    } else if (!loaded || !persistent_log.begin(id)) {
+        printfln_prefixed("event_log", 9, "Failed to set up the persistent event log");
+    } else {
+        last_persist = now_us();
 
-            int result = request.sendChunk(reinterpret_cast<const char *>(gzip_tail), sizeof(gzip_tail));
+        task_scheduler.scheduleWithFixedDelay([this]() {
+            this->persist(false);
+        }, EVENT_LOG_PERSIST_CHECK_INTERVAL, EVENT_LOG_PERSIST_CHECK_INTERVAL);
+    }
+#endif
+}
 
-            if (result != ESP_OK) {
-                printfln_prefixed("event_log", 9, "trace_log gzip tail sending failed: %i", result);
-                return request.endChunkedResponse();
-            }
-        }
+// Returns true and the wall clock time if the clock is synced, false and the uptime otherwise.
+bool EventLog::capture_timestamp(int64_t *time_us)
+{
+    struct timeval tv_now;
 
-        return request.endChunkedResponse();
-#else
-        return request.send(200);
-#endif
-    });
+    if (rtc.clock_synced(&tv_now)) {
+        *time_us = tv_now.tv_sec * 1000000 + tv_now.tv_usec;
+        return true;
+    }
 
-    api.addState("event_log/boot_id", &boot_id);
+    *time_us = now_us().as<int64_t>();
+    return false;
 }
 
-void EventLog::post_setup()
+void EventLog::format_timestamp(char buf[EVENT_LOG_TIMESTAMP_LENGTH + 1 /* \0 */])
 {
-    // Entropy is created by the wifi modem.
-    auto id = esp_random();
-    boot_id.get("boot_id")->updateUint(id);
+    int64_t time_us;
+    bool clock_synced = capture_timestamp(&time_us);
+
+    format_timestamp_at(buf, clock_synced, time_us);
 }
 
-void EventLog::format_timestamp(char buf[EVENT_LOG_TIMESTAMP_LENGTH + 1 /* \0 */])
+void EventLog::format_timestamp_at(char buf[EVENT_LOG_TIMESTAMP_LENGTH + 1 /* \0 */], bool clock_synced, int64_t time_us)
 {
-    struct timeval tv_now;
-    struct tm timeinfo;
+    if (clock_synced) {
+        struct tm timeinfo;
+        time_t secs = time_us / 1000000;
 
-    if (rtc.clock_synced(&tv_now)) {
-        localtime_r(&tv_now.tv_sec, &timeinfo);
+        localtime_r(&secs, &timeinfo);
 
         // ISO 8601 allows omitting the T between date and time. Also  ',' is the preferred decimal sign.
         size_t written = strftime(buf, EVENT_LOG_TIMESTAMP_LENGTH + 1, "%F %T", &timeinfo);
-        snprintf(buf + written, EVENT_LOG_TIMESTAMP_LENGTH + 1 - written, ",%03ld", tv_now.tv_usec / 1000);
+        snprintf(buf + written, EVENT_LOG_TIMESTAMP_LENGTH + 1 - written, ",%03ld", static_cast<long>(time_us % 1000000 / 1000));
     } else {
-        auto now = now_us();
-        auto secs = now.to<seconds_t>();
-        auto ms = (now - secs).to<millis_t>();
-        size_t to_write = snprintf_u(nullptr, 0, "%" PRIu32, secs.as<uint32_t>()) + 4; // +4 for the decimal sign and fractional part
+        uint32_t secs = static_cast<uint32_t>(time_us / 1000000);
+        uint32_t ms = static_cast<uint32_t>(time_us % 1000000 / 1000);
+        size_t to_write = snprintf_u(nullptr, 0, "%" PRIu32, secs) + 4; // +4 for the decimal sign and fractional part
         size_t start = EVENT_LOG_TIMESTAMP_LENGTH - to_write;
 
         for (size_t i = 0; i < start; ++i) {
             buf[i] = ' ';
         }
 
-        snprintf(buf + start, to_write + 1, "%" PRIu32 ",%03" PRIu32, secs.as<uint32_t>(), ms.as<uint32_t>()); // +1 for the NUL-terminator
+        snprintf(buf + start, to_write + 1, "%" PRIu32 ",%03" PRIu32, secs, ms); // +1 for the NUL-terminator
     }
 
     buf[EVENT_LOG_TIMESTAMP_LENGTH] = '\0';
@@ -393,6 +606,18 @@ size_t EventLog::vsnprintf_prefixed(char *buf, size_t buf_len, const char *prefi
     format_timestamp(buf);
     written += EVENT_LOG_TIMESTAMP_LENGTH;
 
+    written = append_prefix(buf, buf_len, written, prefix, prefix_len);
+
+    if (written < buf_len) {
+        written += vsnprintf_u(buf + written, buf_len - written, fmt, args);
+    }
+
+    return written;
+}
+
+// Appends the separators and the prefix that follow the timestamp.
+size_t EventLog::append_prefix(char *buf, size_t buf_len, size_t written, const char *prefix, size_t prefix_len)
+{
     if (written + 3 <= buf_len) {
         buf[written++] = ' ';
         buf[written++] = '|';
@@ -417,24 +642,60 @@ size_t EventLog::vsnprintf_prefixed(char *buf, size_t buf_len, const char *prefi
         }
     }
 
-    if (written < buf_len) {
-        written += vsnprintf_u(buf + written, buf_len - written, fmt, args);
-    }
-
     return written;
 }
 
+// Drops whole lines until at least count bytes are free. The event_buf_mutex must be locked.
 void EventLog::print_drop(size_t count)
 {
-    char c = '\n';
+    size_t dropped = 0;
 
-    for (size_t i = 0; i < count; ++i) {
-        event_buf.pop(&c);
+    while (event_buf.used() > 0 && dropped < count) {
+        dropped += drop_entry();
     }
 
-    while (event_buf.used() > 0 && c != '\n') {
-        event_buf.pop(&c);
+    dropped_total += static_cast<uint32_t>(dropped);
+}
+
+// Drops the oldest line or record and returns its length. The event_buf_mutex must be locked.
+size_t EventLog::drop_entry()
+{
+    char c;
+    size_t dropped = 0;
+
+#if OPTIONS_EVENT_LOG_BINARY()
+    if (event_buf.peek(&c) && c == EVENT_LOG_RECORD_MARKER) {
+        char len_buf[2];
+
+        event_buf.peek_offset(&len_buf[0], 1);
+        event_buf.peek_offset(&len_buf[1], 2);
+
+        uint16_t payload_len;
+        memcpy(&payload_len, len_buf, sizeof(payload_len));
+
+        for (size_t i = 0; i < 3u + payload_len; ++i) {
+            event_buf.pop(&c);
+        }
+
+        return 3u + payload_len;
+    }
+#endif
+
+    while (event_buf.pop(&c)) {
+        ++dropped;
+
+        if (c == '\n')
+            break;
+
+#if OPTIONS_EVENT_LOG_BINARY()
+        // A record was pushed while a line was printed in multiple parts.
+        char next;
+        if (event_buf.peek(&next) && next == EVENT_LOG_RECORD_MARKER)
+            break;
+#endif
     }
+
+    return dropped;
 }
 
 void EventLog::print_timestamp()
@@ -449,7 +710,9 @@ void EventLog::print_timestamp()
 
 size_t EventLog::print_plain(const char *buf, size_t len)
 {
+#if !OPTIONS_EVENT_LOG_BINARY()
     Serial.write(buf, len);
+#endif
 
     {
         std::lock_guard<std::mutex> lock{event_buf_mutex};
@@ -461,8 +724,29 @@ size_t EventLog::print_plain(const char *buf, size_t len)
         for (size_t i = 0; i < len; ++i) {
             event_buf.push(buf[i]);
         }
+
+#if OPTIONS_EVENT_LOG_PERSISTENT_SEGMENTS() > 0
+        crash_tail_push(buf, len);
+#endif
+
+#if OPTIONS_EVENT_LOG_BINARY()
+        // Written immediately even in binary mode, so that the last lines before a hang or panic are not lost.
+        write_serial();
+#endif
     }
 
+#if OPTIONS_EVENT_LOG_BINARY()
+    drain_while_booting();
+#else
+    publish_message(buf, len);
+#endif
+
+    return len;
+}
+
+// Sends a formatted line to the web interface.
+void EventLog::publish_message(const char *buf, size_t len)
+{
 #if MODULE_WS_AVAILABLE()
     size_t stripped_len = len;
 
@@ -493,9 +777,10 @@ size_t EventLog::print_plain(const char *buf, size_t len)
 
         ws.pushRawStateUpdate(payload, "event_log/message");
     }
+#else
+    (void)buf;
+    (void)len;
 #endif
-
-    return len;
 }
 
 size_t EventLog::vprintfln_plain(const char *fmt, va_list args)
@@ -536,6 +821,20 @@ size_t EventLog::printfln_plain(const char *fmt, ...)
 
 size_t EventLog::vprintfln_prefixed(const char *prefix, size_t prefix_len, const char *fmt, va_list args)
 {
+#if OPTIONS_EVENT_LOG_BINARY()
+    // The format string and prefix are only referenced by the record, so they must live in flash.
+    if (string_is_in_rodata(fmt) && (prefix_len == 0 || string_is_in_rodata(prefix)) && prefix_len <= UINT8_MAX) {
+        va_list args_copy;
+        va_copy(args_copy, args);
+        size_t record_len = print_record(prefix, prefix_len, fmt, args_copy);
+        va_end(args_copy);
+
+        if (record_len > 0) {
+            return record_len;
+        }
+    }
+#endif
+
     size_t written = 0;
     char buf[EVENT_LOG_TIMESTAMP_LENGTH + 256];
     size_t buf_len = ARRAY_SIZE(buf);
@@ -570,40 +869,576 @@ size_t EventLog::printfln_prefixed(const char *prefix, size_t prefix_len, const
     return written;
 }
 
-size_t EventLog::get_trace_buffer_idx(const char *name) {
-#if defined(BOARD_HAS_PSRAM)
-    for (size_t i = 0; i < trace_buffers_in_use; ++i) {
-        if (trace_buffers[i].name != name) // TODO rodata check
-            continue;
-        return i;
+#if OPTIONS_EVENT_LOG_BINARY()
+// Returns the record's length or 0 if the message can't be stored as a record.
+size_t EventLog::print_record(const char *prefix, size_t prefix_len, const char *fmt, va_list args)
+{
+    uint8_t record[EVENT_LOG_RECORD_HEADER_LENGTH + EVENT_LOG_RECORD_MAX_ARGS_LENGTH];
+    size_t args_len = deferred_format_pack(record + EVENT_LOG_RECORD_HEADER_LENGTH, EVENT_LOG_RECORD_MAX_ARGS_LENGTH, fmt, args);
+
+    if (args_len == 0) {
+        return 0;
+    }
+
+    int64_t time_us;
+    uint8_t clock_synced = capture_timestamp(&time_us) ? 1 : 0;
+    uint16_t payload_len = static_cast<uint16_t>(EVENT_LOG_RECORD_HEADER_LENGTH - 3 + args_len);
+    uint8_t prefix_len_u8 = static_cast<uint8_t>(prefix_len);
+    uint8_t *p = record;
+
+    *p++ = EVENT_LOG_RECORD_MARKER;
+    memcpy(p, &payload_len, sizeof(payload_len));
+    p += sizeof(payload_len);
+    memcpy(p, &time_us, sizeof(time_us));
+    p += sizeof(time_us);
+    *p++ = clock_synced;
+    memcpy(p, &prefix, sizeof(prefix));
+    p += sizeof(prefix);
+    *p++ = prefix_len_u8;
+    memcpy(p, &fmt, sizeof(fmt));
+
+    size_t record_len = EVENT_LOG_RECORD_HEADER_LENGTH + args_len;
+
+    {
+        std::lock_guard<std::mutex> lock{event_buf_mutex};
+
+        if (event_buf.free() < record_len) {
+            print_drop(record_len - event_buf.free());
+        }
+
+        for (size_t i = 0; i < record_len; ++i) {
+            event_buf.push(static_cast<char>(record[i]));
+        }
+
+#if OPTIONS_EVENT_LOG_PERSISTENT_SEGMENTS() > 0
+        crash_tail_push(reinterpret_cast<const char *>(record), record_len);
+#endif
+    }
+
+    drain_while_booting();
+
+    return record_len;
+}
+
+// Formats the line or record at offset into buf. Returns the formatted length and the entry's length.
+// peek(offset) returns the byte at offset of the used bytes.
+template<typename PeekFn>
+size_t EventLog::format_entry_from(const PeekFn &peek, size_t used, size_t offset, char *buf, size_t buf_len, size_t *entry_len)
+{
+    char c = peek(offset);
+
+    if (c != EVENT_LOG_RECORD_MARKER) {
+        size_t written = 0;
+
+        // A line might have been printed in multiple parts with a record in between.
+        while (offset + written < used && written < buf_len) {
+            c = peek(offset + written);
+
+            if (c == EVENT_LOG_RECORD_MARKER)
+                break;
+
+            buf[written++] = c;
+
+            if (c == '\n')
+                break;
+        }
+
+        *entry_len = written;
+        return written;
+    }
+
+    uint8_t record[EVENT_LOG_RECORD_HEADER_LENGTH + EVENT_LOG_RECORD_MAX_ARGS_LENGTH];
+    uint16_t payload_len;
+
+    if (used - offset < EVENT_LOG_RECORD_HEADER_LENGTH) {
+        *entry_len = used - offset;
+        return 0;
+    }
+
+    record[1] = static_cast<uint8_t>(peek(offset + 1));
+    record[2] = static_cast<uint8_t>(peek(offset + 2));
+    memcpy(&payload_len, &record[1], sizeof(payload_len));
+
+    size_t record_len = 3u + payload_len;
+
+    // Only records recovered after a crash can be truncated.
+    if (record_len > ARRAY_SIZE(record) || record_len > used - offset) {
+        *entry_len = used - offset;
+        return 0;
+    }
+
+    *entry_len = record_len;
+
+    for (size_t i = 3; i < record_len; ++i) {
+        record[i] = static_cast<uint8_t>(peek(offset + i));
+    }
+
+    int64_t time_us;
+    const char *prefix;
+    const char *fmt;
+    const uint8_t *p = record + 3;
+
+    memcpy(&time_us, p, sizeof(time_us));
+    p += sizeof(time_us);
+    bool clock_synced = *p++ != 0;
+    memcpy(&prefix, p, sizeof(prefix));
+    p += sizeof(prefix);
+    size_t prefix_len = *p++;
+    memcpy(&fmt, p, sizeof(fmt));
+
+    if (buf_len < EVENT_LOG_TIMESTAMP_LENGTH + 1 /* \0 */ + 1 /* \n */) {
+        return 0;
+    }
+
+    format_timestamp_at(buf, clock_synced, time_us);
+    size_t written = append_prefix(buf, buf_len - 1 /* \n */, EVENT_LOG_TIMESTAMP_LENGTH, prefix, prefix_len);
+
+    if (written < buf_len - 1) {
+        written += deferred_format_unpack(buf + written, buf_len - 1 - written, fmt, record + EVENT_LOG_RECORD_HEADER_LENGTH, record_len - EVENT_LOG_RECORD_HEADER_LENGTH);
+    }
+
+    // The IDF might log messages ending with "\r\n" via tf_event_log_[v]printfln
+    if (written >= 2 && buf[written - 2] == '\r' && buf[written - 1] == '\n') {
+        written -= 2;
+    }
+
+    buf[written++] = '\n';
+
+    return written;
+}
+
+// Formats the line or record at offset in event_buf. The event_buf_mutex must be locked.
+size_t EventLog::format_entry(size_t offset, char *buf, size_t buf_len, size_t *entry_len)
+{
+    auto peek = [this](size_t peek_offset) {
+        char c;
+        event_buf.peek_offset(&c, peek_offset);
+        return c;
+    };
+
+    return format_entry_from(peek, event_buf.used(), offset, buf, buf_len, entry_len);
+}
+
+// Writes the entries that were added since the last call to the serial console.
+// Records that were added before a line are written first, so that the serial output keeps its order.
+// The event_buf_mutex must be locked.
+void EventLog::write_serial()
+{
+    // Entries that were dropped before they were written are lost.
+    if (static_cast<int32_t>(serial_pos - dropped_total) < 0) {
+        serial_pos = dropped_total;
+    }
+
+    for (size_t offset = serial_pos - dropped_total; offset < event_buf.used(); offset = serial_pos - dropped_total) {
+        size_t entry_len;
+        size_t len = format_entry(offset, serial_buf, ARRAY_SIZE(serial_buf), &entry_len);
+        serial_pos += static_cast<uint32_t>(entry_len);
+
+        Serial.write(serial_buf, len);
+    }
+}
+
+// Writes the entries that were added since the last drain to the web interface
+// and the ones that print_plain did not write yet to the serial console.
+void EventLog::drain()
+{
+    char buf[EVENT_LOG_TIMESTAMP_LENGTH + 256];
+
+    for (;;) {
+        size_t len;
+
+        {
+            std::lock_guard<std::mutex> lock{event_buf_mutex};
+
+            // Entries that were dropped before they were drained are lost.
+            if (static_cast<int32_t>(drain_pos - dropped_total) < 0) {
+                drain_pos = dropped_total;
+            }
+
+            if (static_cast<int32_t>(serial_pos - dropped_total) < 0) {
+                serial_pos = dropped_total;
+            }
+
+            size_t offset = drain_pos - dropped_total;
+
+            if (offset >= event_buf.used()) {
+                return;
+            }
+
+            size_t entry_len;
+            len = format_entry(offset, buf, ARRAY_SIZE(buf), &entry_len);
+
+            // Written while the mutex is locked, so that a concurrent print_plain can't overtake the entry.
+            if (serial_pos == drain_pos) {
+                Serial.write(buf, len);
+                serial_pos += static_cast<uint32_t>(entry_len);
+            }
+
+            drain_pos += static_cast<uint32_t>(entry_len);
+        }
+
+        publish_message(buf, len);
+    }
+}
+
+// Messages printed during boot and reboot are written immediately, as the drain task might not run anymore.
+void EventLog::drain_while_booting()
+{
+    if (boot_stage != BootStage::LOOP && running_in_main_task()) {
+        drain();
+    }
+}
+#endif
+
+#if OPTIONS_EVENT_LOG_PERSISTENT_SEGMENTS() > 0
+// Copies the entries that were added since the last call to the persistent log.
+// Flash is only written in batches: when enough bytes are pending, the interval has elapsed or force is set.
+void EventLog::persist(bool force)
+{
+    if (!persistent_log.is_active()) {
+        return;
+    }
+
+    bool check_batch = !force;
+    uint32_t persisted = 0;
+
+    for (;;) {
+        char chunk[512];
+        size_t chunk_used = 0;
+        uint32_t lost = 0;
+
+        {
+            std::lock_guard<std::mutex> lock{event_buf_mutex};
+
+            if (check_batch) {
+                uint32_t pending = dropped_total + static_cast<uint32_t>(event_buf.used()) - persist_pos;
+
+                if (pending < EVENT_LOG_PERSIST_BATCH_SIZE && !deadline_elapsed(last_persist + EVENT_LOG_PERSIST_INTERVAL)) {
+                    return;
+                }
+
+                check_batch = false;
+            }
+
+            // Entries that were dropped before they were persisted are lost.
+            if (static_cast<int32_t>(persist_pos - dropped_total) < 0) {
+                lost = dropped_total - persist_pos;
+                persist_pos = dropped_total;
+            }
+
+            size_t offset = persist_pos - dropped_total;
+            const size_t used = event_buf.used();
+
+#if OPTIONS_EVENT_LOG_BINARY()
+            // Records are formatted; only whole lines are copied.
+            while (offset < used && ARRAY_SIZE(chunk) - chunk_used >= EVENT_LOG_TIMESTAMP_LENGTH + 256) {
+                size_t entry_len;
+                chunk_used += format_entry(offset, chunk + chunk_used, ARRAY_SIZE(chunk) - chunk_used, &entry_len);
+                offset += entry_len;
+            }
+#else
+            while (offset < used && chunk_used < ARRAY_SIZE(chunk)) {
+                event_buf.peek_offset(chunk + chunk_used, offset);
+                ++chunk_used;
+                ++offset;
+            }
+#endif
+
+            persist_pos = dropped_total + static_cast<uint32_t>(offset);
+            persisted = persist_pos;
+        }
+
+        if (lost > 0) {
+            char buf[64];
+            size_t written = snprintf_u(buf, ARRAY_SIZE(buf), "[%lu bytes of the event log were not persisted]\n", lost);
+            persistent_log.append(buf, written);
+        }
+
+        if (chunk_used == 0) {
+            break;
+        }
+
+        persistent_log.append(chunk, chunk_used);
+    }
+
+    persistent_log.flush();
+    last_persist = now_us();
+
+    // Only flushed entries are safe from a crash.
+    std::lock_guard<std::mutex> lock{event_buf_mutex};
+    crash_tail.persisted = persisted;
+}
+
+// Mirrors bytes pushed into event_buf into RTC memory. Drops whole entries when it is full.
+// The event_buf_mutex must be locked.
+void EventLog::crash_tail_push(const char *buf, size_t len)
+{
+    if (len > EVENT_LOG_CRASH_TAIL_SIZE) {
+        crash_tail.end += static_cast<uint32_t>(len);
+        crash_tail.start = crash_tail.end;
+        return;
+    }
+
+    while (crash_tail.end - crash_tail.start + len > EVENT_LOG_CRASH_TAIL_SIZE) {
+        crash_tail.start += static_cast<uint32_t>(crash_tail_entry_len(crash_tail.start));
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        crash_tail.buf[(crash_tail.end + i) % EVENT_LOG_CRASH_TAIL_SIZE] = buf[i];
+    }
+
+    // Advanced last: A crash while copying leaves out the incomplete entry.
+    crash_tail.end += static_cast<uint32_t>(len);
+}
+
+// Appends the entries that the previous boot did not persist before its panic or watchdog reset to its segments.
+void EventLog::persist_crash_tail()
+{
+    if (!persistent_log.begin(crashed_boot_id)) {
+        return;
+    }
+
+    char buf[EVENT_LOG_TIMESTAMP_LENGTH + 256];
+
+    if (crashed_tail_lost > 0) {
+        size_t written = snprintf_u(buf, ARRAY_SIZE(buf), "[%lu bytes of the event log were not persisted]\n", crashed_tail_lost);
+        persistent_log.append(buf, written);
+    }
+
+#if OPTIONS_EVENT_LOG_BINARY()
+    auto peek = [this](size_t offset) {
+        return crashed_tail[offset];
+    };
+
+    for (size_t offset = 0; offset < crashed_tail_len;) {
+        size_t entry_len;
+        size_t len = format_entry_from(peek, crashed_tail_len, offset, buf, ARRAY_SIZE(buf), &entry_len);
+
+        persistent_log.append(buf, len);
+        offset += entry_len;
     }
 #else
-    (void)name;
+    persistent_log.append(crashed_tail, crashed_tail_len);
 #endif
-    return std::numeric_limits<size_t>::max();
+
+    static const char reset_marker[] = "[Reset by a panic or watchdog]\n";
+    persistent_log.append(reset_marker, strlen(reset_marker));
+    persistent_log.flush();
+
+    printfln_prefixed("event_log", 9, "Recovered %zu bytes of the event log of boot %lu", crashed_tail_len, crashed_boot_id);
 }
+#endif
 
-void EventLog::trace_drop(size_t trace_buf_idx, size_t count)
+#if defined(BOARD_HAS_PSRAM)
+// Streams the trace buffers [first, first + count) gzip-compressed. The compressor reads the blocks in place.
+// If clear is set, the buffers only keep records written after they were sent.
+// Binary buffers are skipped unless they are requested on their own.
+WebServerRequestReturnProtect EventLog::send_trace_buffers_gzipped(WebServerRequest &request, int tdefl_flags, size_t first, size_t count, bool clear)
 {
+    tdefl_compressor *deflator = nullptr;
+    deflate_outbuf *buf = nullptr;
+
+    defer {
+        free(deflator);
+        deflator = nullptr;
+
+        free(buf);
+        buf = nullptr;
+    };
+
+    deflator = static_cast<tdefl_compressor *>(malloc(sizeof(tdefl_compressor)));
+    if (!deflator) {
+        return request.send(500, "text/plain", "Failed to allocate compressor");
+    }
+
+    buf = static_cast<decltype(buf)>(malloc(sizeof(*buf)));
+    if (!buf) {
+        return request.send(500, "text/plain", "Failed to allocate output buffer");
+    }
+
+    // Initialize the low-level compressor
+    tdefl_status t_status = tdefl_init(deflator, nullptr, nullptr, tdefl_flags);
+    if (t_status != TDEFL_STATUS_OKAY) {
+        return request.send(500, "text/plain", "Failed to initialize compressor");
+    }
+
+    request.addResponseHeader("Content-Encoding", "gzip");
+    request.beginChunkedResponse(200);
+
+    // Copy gzip header to output buffer
+    static_assert(ARRAY_SIZE(buf->outbuf) >= sizeof(gzip_header));
+    memcpy(buf->outbuf, gzip_header, sizeof(gzip_header));
+
+    char *next_out = buf->outbuf + sizeof(gzip_header);
+    size_t avail_out = ARRAY_SIZE(buf->outbuf) - sizeof(gzip_header);
+
+    size_t uncompressed_len = 0;
+    uint32_t crc32 = 0;
+
+    constexpr   uint32_t HEADER_PREPARE = 0;
+    //constexpr uint32_t HEADER_SEND    = 1;
+    constexpr   uint32_t BLOCK_PREPARE  = 2;
+    constexpr   uint32_t BLOCK_SEND     = 3;
+    constexpr   uint32_t MARKER_PREPARE = 4;
+    constexpr   uint32_t MARKER_SEND    = 5;
+    constexpr   uint32_t FOOTER_PREPARE = 6;
+    constexpr   uint32_t FOOTER_SEND    = 7;
+
+    for (size_t i = first; i < first + count; ++i) {
+        auto &trace_buffer = trace_buffers[i];
+
+        if (trace_buffer.binary && count > 1)
+            continue;
+
+        TraceRingbuffer::Snapshot snapshot = clear ? trace_buffer.buf.snapshot_and_clear() : trace_buffer.buf.snapshot();
+        size_t block = 0;
+        bool block_complete = false;
+        TraceRingbuffer::Chunk chunk;
+
+        uint32_t state = HEADER_PREPARE;
+        const char *next_in;
+        size_t avail_in;
+
+        for (;;) {
+            if ((state & 1) == 0) { // One of the prepare states
+                if (state == BLOCK_PREPARE) {
+                    block_complete = get_trace_block(&trace_buffer.buf, snapshot, block, &chunk);
+                    next_in = chunk.data;
+                    avail_in = block_complete ? chunk.len : 0;
+                } else if (state == MARKER_PREPARE) {
+                    next_in = trace_incomplete_marker;
+                    avail_in = strlen(trace_incomplete_marker);
+                } else if (state == HEADER_PREPARE) {
+                    next_in = buf->printbuf;
+                    avail_in = print_trace_begin(buf->printbuf, ARRAY_SIZE(buf->printbuf), trace_buffer.name, trace_buffer.buf.dropped_count());
+                } else {
+                    next_in = buf->printbuf;
+                    avail_in = snprintf_u(buf->printbuf, ARRAY_SIZE(buf->printbuf), "__end_%.100s__\n", trace_buffer.name);
+                }
+
+                crc32 = esp_rom_crc32_le(crc32, reinterpret_cast<const uint8_t *>(next_in), avail_in);
+
+                uncompressed_len += avail_in;
+
+                state++; // Advance to send state
+            }
+
+            size_t in_bytes = avail_in;
+            size_t out_bytes = avail_out;
+            t_status = tdefl_compress(deflator, next_in, &in_bytes, next_out, &out_bytes, TDEFL_NO_FLUSH);
+
+            if (t_status != TDEFL_STATUS_OKAY) {
+                printfln_prefixed("event_log", 9, "trace_log compression failed: %i", static_cast<int>(t_status));
+                return request.endChunkedResponse();
+            }
+
+            next_in += in_bytes;
+            avail_in -= in_bytes;
+
+            next_out += out_bytes;
+            avail_out -= out_bytes;
+
+            if (avail_out == 0) {
+                int result = request.sendChunk(buf->outbuf, ARRAY_SIZE(buf->outbuf));
+
+                if (result != ESP_OK) {
+                    printfln_prefixed("event_log", 9, "trace_log compressed chunk sending failed: %i", result);
+                    return request.endChunkedResponse();
+                }
+
+                next_out = buf->outbuf;
+                avail_out = ARRAY_SIZE(buf->outbuf);
+            }
+
+            // Insert a small delay after every compressed block so that the main task has a chance to run.
+            vTaskDelay(2);
+
+            if (avail_in == 0) {
+                if (state == FOOTER_SEND) {
+                    break;
+                } else if (state == BLOCK_SEND && (!block_complete || !trace_buffer.buf.is_unchanged(chunk))) {
+                    state = MARKER_PREPARE;
+                } else if (state == BLOCK_SEND || state == MARKER_SEND) {
+                    ++block;
+                    state = block < trace_buffer.buf.readable_blocks() ? BLOCK_PREPARE : FOOTER_PREPARE;
+                } else {
+                    state++; // Advance to next prepare state
+                }
+            }
+        }
+    }
+
+    // Flush compression buffer
+    do {
+        size_t out_bytes = avail_out;
+        t_status = tdefl_compress(deflator, nullptr, nullptr, next_out, &out_bytes, TDEFL_FINISH);
+
+        avail_out -= out_bytes;
+
+        int result = request.sendChunk(buf->outbuf, static_cast<ssize_t>(ARRAY_SIZE(buf->outbuf) - avail_out));
+
+        next_out = buf->outbuf;
+        avail_out = ARRAY_SIZE(buf->outbuf);
+
+        if (result != ESP_OK) {
+            printfln_prefixed("event_log", 9, "trace_log final compressed chunk sending failed: %i", result);
+            return request.endChunkedResponse();
+        }
+    } while (t_status != TDEFL_STATUS_DONE);
+
+    {
+        uint32_t gzip_tail[2] = {crc32, uncompressed_len};
+
+        int result = request.sendChunk(reinterpret_cast<const char *>(gzip_tail), sizeof(gzip_tail));
+
+        if (result != ESP_OK) {
+            printfln_prefixed("event_log", 9, "trace_log gzip tail sending failed: %i", result);
+            return request.endChunkedResponse();
+        }
+    }
+
+    return request.endChunkedResponse();
+}
+#endif
+
 #if defined(BOARD_HAS_PSRAM)
-    if (trace_buf_idx >= trace_buffers_in_use)
-        return;
+bool EventLog::get_trace_block(TraceRingbuffer *buf, const TraceRingbuffer::Snapshot &snapshot, size_t i, TraceRingbuffer::Chunk *chunk)
+{
+    // Producers only need a few microseconds to copy a record, unless they were preempted.
+    for (size_t tries = 0; tries < 10; ++tries) {
+        if (buf->get_block(snapshot, i, chunk))
+            return true;
 
-    char c = '\n';
+        vTaskDelay(1);
+    }
 
-    auto *trace_buffer = &this->trace_buffers[trace_buf_idx];
+    return false;
+}
+#endif
 
-    for (size_t i = 0; i < count; ++i) {
-        trace_buffer->buf.pop(&c);
+#if defined(BOARD_HAS_PSRAM)
+EventLog::TraceBuffer *EventLog::find_trace_buffer(const char *name)
+{
+    for (size_t i = 0; i < trace_buffers_in_use; ++i) {
+        if (strcmp(trace_buffers[i].name, name) == 0)
+            return &trace_buffers[i];
     }
 
-    while (trace_buffer->buf.used() > 0 && c != '\n') {
-        trace_buffer->buf.pop(&c);
+    return nullptr;
+}
+#endif
+
+size_t EventLog::get_trace_buffer_idx(const char *name) {
+#if defined(BOARD_HAS_PSRAM)
+    for (size_t i = 0; i < trace_buffers_in_use; ++i) {
+        if (trace_buffers[i].name != name) // TODO rodata check
+            continue;
+        return i;
     }
 #else
-    (void)trace_buf_idx;
-    (void)count;
+    (void)name;
 #endif
+    return std::numeric_limits<size_t>::max();
 }
 
 void EventLog::trace_timestamp(size_t trace_buf_idx)
@@ -626,16 +1461,8 @@ size_t EventLog::trace_plain(size_t trace_buf_idx, const char *buf, size_t len)
     if (trace_buf_idx >= trace_buffers_in_use)
         return 0;
 
-    auto *trace_buffer = &this->trace_buffers[trace_buf_idx];
-
-    std::lock_guard<std::mutex> lock{trace_buffer->mutex};
-    bool drop_line = trace_buffer->buf.free() < len;
-
-    trace_buffer->buf.push_n(buf, len);
-
-    if (drop_line) {
-        trace_buffer->buf.pop_until('\n');
-    }
+    if (!this->trace_buffers[trace_buf_idx].buf.push(buf, len))
+        return 0;
 
     return len;
 #else
@@ -21,16 +21,37 @@
 
 #include <stdarg.h>
 #include <mutex>
+#include <TFTools/Micros.h>
 
 #include "module.h"
 #include "config.h"
+#include "options.h"
 #include "tools/ringbuffer.h"
+#include "tools/mpsc_ringbuffer.h"
 #include "tools/malloc.h"
 
+#if OPTIONS_EVENT_LOG_PERSISTENT_SEGMENTS() > 0
+#include "persistent_log.h"
+#endif
+
 // Length of an ISO 8601 timestamp. For example "2022-02-11 12:34:56,789"
 // Also change in frontend when changing here!
 #define EVENT_LOG_TIMESTAMP_LENGTH 23
 
+#if OPTIONS_EVENT_LOG_BINARY()
+// In binary mode, messages with a format string and prefix in flash are stored as a record of the
+// format string pointer, the prefix pointer and the packed arguments. Records are formatted when
+// the event log is read and when they are drained to the serial console and the web interface.
+// Records start with this marker, which can't be part of a text line.
+#define EVENT_LOG_RECORD_MARKER '\0'
+// Marker, payload length (uint16_t), timestamp (int64_t), timestamp synced (uint8_t), prefix (pointer), prefix length (uint8_t), fmt (pointer)
+#define EVENT_LOG_RECORD_HEADER_LENGTH (1 + 2 + 8 + 1 + sizeof(const char *) + 1 + sizeof(const char *))
+#define EVENT_LOG_RECORD_MAX_ARGS_LENGTH 256
+#endif
+
+class WebServerRequest;
+struct WebServerRequestReturnProtect;
+
 class EventLog final : public IModule
 {
 public:
@@ -39,10 +60,12 @@ public:
     void pre_init() override;
     void pre_setup() override;
     void register_urls() override;
+    void pre_reboot() override;
 
     void post_setup();
 
     void format_timestamp(char buf[EVENT_LOG_TIMESTAMP_LENGTH + 1 /* \0 */]);
+    void format_timestamp_at(char buf[EVENT_LOG_TIMESTAMP_LENGTH + 1 /* \0 */], bool clock_synced, int64_t time_us);
     [[gnu::format(__printf__, 6, 0)]] size_t vsnprintf_prefixed(char *buf, size_t buf_len, const char *prefix, size_t prefix_len, const char *fmt, va_list args);
 
     void print_drop(size_t count);
@@ -55,7 +78,6 @@ public:
     [[gnu::format(__printf__, 4, 0)]] size_t vprintfln_prefixed(const char *prefix, size_t prefix_len, const char *fmt, va_list args);
     [[gnu::format(__printf__, 4, 5)]] size_t printfln_prefixed(const char *prefix, size_t prefix_len, const char *fmt, ...);
 
-    void trace_drop(size_t trace_buf_idx, size_t count);
     void trace_timestamp(size_t trace_buf_idx);
     size_t trace_plain(size_t trace_buf_idx, const char *buf, size_t len);
 
@@ -79,10 +101,55 @@ public:
     [[gnu::format(__printf__, 2, 3)]] size_t tracefln_debug(const char *fmt, ...);
 
     // Returns id of allocated buffer
-    size_t alloc_trace_buffer(const char *name, size_t size);
+    // Binary buffers are written with trace_plain and only downloaded via /trace_buffer/<name>, not included in /trace_log.
+    size_t alloc_trace_buffer(const char *name, size_t size, bool binary = false);
     size_t get_trace_buffer_idx(const char *name);
 
 private:
+    bool capture_timestamp(int64_t *time_us);
+    size_t append_prefix(char *buf, size_t buf_len, size_t written, const char *prefix, size_t prefix_len);
+    size_t drop_entry();
+    void publish_message(const char *buf, size_t len);
+
+#if OPTIONS_EVENT_LOG_BINARY()
+    size_t print_record(const char *prefix, size_t prefix_len, const char *fmt, va_list args);
+    size_t format_entry(size_t offset, char *buf, size_t buf_len, size_t *entry_len);
+    template<typename PeekFn>
+    size_t format_entry_from(const PeekFn &peek, size_t used, size_t offset, char *buf, size_t buf_len, size_t *entry_len);
+    void write_serial();
+    void drain();
+    void drain_while_booting();
+#endif
+
+#if OPTIONS_EVENT_LOG_PERSISTENT_SEGMENTS() > 0
+    void persist(bool force);
+    void crash_tail_push(const char *buf, size_t len);
+    void persist_crash_tail();
+
+    PersistentLog persistent_log;
+    micros_t last_persist = 0_us;
+
+    // Entries of the previous boot that were not persisted before a panic or watchdog reset.
+    // Copied out of RTC memory in pre_init and freed when they are persisted in post_setup.
+    char *crashed_tail = nullptr;
+    size_t crashed_tail_len = 0;
+    uint32_t crashed_tail_lost = 0;
+    uint32_t crashed_boot_id = 0;
+#endif
+
+    // Absolute positions in the stream of bytes pushed into event_buf. Protected by event_buf_mutex.
+#if OPTIONS_EVENT_LOG_BINARY()
+    uint32_t drain_pos = 0;
+    uint32_t serial_pos = 0;
+
+    // Used by write_serial. Not on the stack because print_plain is called from tasks with small stacks.
+    char serial_buf[EVENT_LOG_TIMESTAMP_LENGTH + 256];
+#endif
+#if OPTIONS_EVENT_LOG_PERSISTENT_SEGMENTS() > 0
+    uint32_t persist_pos = 0;
+#endif
+    uint32_t dropped_total = 0;
+
     std::mutex event_buf_mutex;
     TF_PackedRingbuffer<char,
                         10000,
@@ -95,17 +162,21 @@ private:
                         free_any> event_buf;
 
 
+    // Written without locking from any task, so that tracing never blocks.
+    using TraceRingbuffer = TF_MPSCRingbuffer<malloc_psram, free_any>;
+
     struct TraceBuffer {
         const char *name;
-        std::mutex mutex;
-        TF_Ringbuffer<char,
-                      malloc_psram,
-                      free_any> buf;
+        bool binary;
+        TraceRingbuffer buf;
     };
 
-    TraceBuffer *find_trace_buffer(const char *prefix);
+    TraceBuffer *find_trace_buffer(const char *name);
 
 #if defined(BOARD_HAS_PSRAM)
+    bool get_trace_block(TraceRingbuffer *buf, const TraceRingbuffer::Snapshot &snapshot, size_t i, TraceRingbuffer::Chunk *chunk);
+    WebServerRequestReturnProtect send_trace_buffers_gzipped(WebServerRequest &request, int tdefl_flags, size_t first, size_t count, bool clear);
+
     std::array<TraceBuffer, 16> trace_buffers;
     size_t trace_buffers_in_use = 0;
     size_t trace_buffer_size_allocd = 0;
@@ -0,0 +1,203 @@
+/* esp32-firmware
+ * Copyright (C) 2026 Erik Fleckstein <erik@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "persistent_log.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <LittleFS.h>
+
+#include "tools/string_builder.h"
+
+#include "gcc_warnings.h"
+
+// Parses "<seq>-<boot ID>". Returns false for unexpected names.
+static bool parse_segment_name(const char *name, PersistentLog::Segment *segment)
+{
+    char *end;
+
+    segment->seq = strtoul(name, &end, 10);
+    if (end == name || *end != '-' || segment->seq == 0)
+        return false;
+
+    const char *boot_id = end + 1;
+
+    segment->boot_id = strtoul(boot_id, &end, 10);
+    if (end == boot_id || *end != '\0')
+        return false;
+
+    return true;
+}
+
+String PersistentLog::segment_name(const Segment &segment)
+{
+    char buf[48];
+    StringWriter sw(buf, sizeof(buf));
+
+    sw.printf(EVENT_LOG_PERSIST_FOLDER "/%lu-%lu", segment.seq, segment.boot_id);
+
+    return String(buf, sw.getLength());
+}
+
+bool PersistentLog::load(size_t max_segments_)
+{
+    if (!LittleFS.mkdir(EVENT_LOG_PERSIST_FOLDER)) { // mkdir also returns true if the directory already exists and is a directory.
+        return false;
+    }
+
+    std::vector<Segment> found;
+    std::vector<String> unexpected;
+
+    {
+        File folder = LittleFS.open(EVENT_LOG_PERSIST_FOLDER);
+
+        while (File f = folder.openNextFile()) {
+            Segment segment;
+
+            if (f.isDirectory() || !parse_segment_name(f.name(), &segment)) {
+                unexpected.push_back(String(EVENT_LOG_PERSIST_FOLDER "/") + f.name());
+                continue;
+            }
+
+            segment.size = f.size();
+            found.push_back(segment);
+        }
+    }
+
+    // Left over by a different segment format or a power cycle while writing.
+    for (const String &name : unexpected) {
+        LittleFS.remove(name);
+    }
+
+    std::sort(found.begin(), found.end(), [](const Segment &a, const Segment &b) {
+        return a.seq < b.seq;
+    });
+
+    {
+        std::lock_guard<std::mutex> lock{segments_mutex};
+        segments = std::move(found);
+        next_seq = segments.empty() ? 1 : segments.back().seq + 1;
+    }
+
+    this->max_segments = max_segments_;
+
+    return true;
+}
+
+bool PersistentLog::begin(uint32_t boot_id_)
+{
+    this->boot_id = boot_id_;
+
+    Segment newest;
+    bool continue_segment;
+
+    {
+        std::lock_guard<std::mutex> lock{segments_mutex};
+        continue_segment = !segments.empty() && segments.back().boot_id == boot_id_;
+
+        if (continue_segment) {
+            newest = segments.back();
+        }
+    }
+
+    if (!continue_segment) {
+        active = open_segment();
+        return active;
+    }
+
+    if (file) {
+        file.close();
+    }
+
+    file = LittleFS.open(segment_name(newest), "a");
+    active = static_cast<bool>(file);
+    return active;
+}
+
+// Closes the current segment, removes the oldest ones and starts a new one.
+bool PersistentLog::open_segment()
+{
+    if (file) {
+        file.close();
+    }
+
+    std::lock_guard<std::mutex> lock{segments_mutex};
+
+    while (!segments.empty() && segments.size() >= max_segments) {
+        LittleFS.remove(segment_name(segments.front()));
+        segments.erase(segments.begin());
+    }
+
+    Segment segment{next_seq++, boot_id, 0};
+
+    file = LittleFS.open(segment_name(segment), "w", true);
+    if (!file) {
+        return false;
+    }
+
+    segments.push_back(segment);
+
+    return true;
+}
+
+void PersistentLog::append(const char *buf, size_t len)
+{
+    if (!active) {
+        return;
+    }
+
+    size_t used;
+
+    {
+        std::lock_guard<std::mutex> lock{segments_mutex};
+        used = segments.back().size;
+    }
+
+    if (used + len > EVENT_LOG_PERSIST_SEGMENT_SIZE && !open_segment()) {
+        active = false;
+        return;
+    }
+
+    size_t written = file.write(reinterpret_cast<const uint8_t *>(buf), len);
+
+    std::lock_guard<std::mutex> lock{segments_mutex};
+    segments.back().size += written;
+}
+
+// LittleFS caches writes; this commits them to flash.
+void PersistentLog::flush()
+{
+    if (active) {
+        file.flush();
+    }
+}
+
+void PersistentLog::close()
+{
+    if (active) {
+        file.close();
+        active = false;
+    }
+}
+
+std::vector<PersistentLog::Segment> PersistentLog::get_segments()
+{
+    std::lock_guard<std::mutex> lock{segments_mutex};
+    return segments;
+}
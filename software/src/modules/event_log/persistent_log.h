@@ -0,0 +1,88 @@
+/* esp32-firmware
+ * Copyright (C) 2026 Erik Fleckstein <erik@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <FS.h>
+#include <WString.h>
+
+#define EVENT_LOG_PERSIST_FOLDER "/event-log"
+#define EVENT_LOG_PERSIST_SEGMENT_SIZE 16384
+
+// Stores the event log of the current and previous boots in a ring of segment files on LittleFS.
+// Only the newest segment is appended to. When it is full, a new segment is started and the
+// oldest one is removed, so the writes are spread over the whole file system by LittleFS.
+// A segment only contains lines of one boot; its name is "<sequence number>-<boot ID>".
+//
+// append, flush and close must be called from the same task.
+// get_segments can be called from any task.
+class PersistentLog
+{
+public:
+    struct Segment {
+        uint32_t seq;
+        uint32_t boot_id;
+        size_t size;
+    };
+
+    PersistentLog() = default;
+    PersistentLog(const PersistentLog &other) = delete;
+    PersistentLog &operator=(const PersistentLog &other) = delete;
+
+    // Scans the stored segments. Must be called before begin.
+    bool load(size_t max_segments);
+    // Continues the newest segment if it belongs to boot_id, otherwise starts a new one.
+    // Removes segments that exceed max_segments.
+    bool begin(uint32_t boot_id);
+
+    void append(const char *buf, size_t len);
+    void flush();
+    void close();
+
+    bool is_active() const
+    {
+        return active;
+    }
+
+    uint32_t get_boot_id() const
+    {
+        return boot_id;
+    }
+
+    // Oldest first.
+    std::vector<Segment> get_segments();
+
+    static String segment_name(const Segment &segment);
+
+private:
+    bool open_segment();
+
+    std::mutex segments_mutex;
+    std::vector<Segment> segments;
+
+    File file;
+    uint32_t boot_id = 0;
+    uint32_t next_seq = 1;
+    size_t max_segments = 0;
+    bool active = false;
+};
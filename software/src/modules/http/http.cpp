@@ -100,22 +100,7 @@ bool custom_uri_match(const char *ref_uri, const char *in_uri, size_t len)
         return false;
 
     // Use + 1 to compare: in_uri starts with /; the api paths don't.
-    const size_t command_size = api.commands.size();
-    for (size_t i = 0; i < command_size; i++)
-        if (api.commands[i].path_len == len - 1 && memcmp(api.commands[i].path, in_uri + 1, len - 1) == 0)
-            return true;
-
-    const size_t state_size = api.states.size();
-    for (size_t i = 0; i < state_size; i++)
-        if (api.states[i].path_len == len - 1 && memcmp(api.states[i].path, in_uri + 1, len - 1) == 0)
-            return true;
-
-    const size_t response_size = api.responses.size();
-    for (size_t i = 0; i < response_size; i++)
-        if (api.responses[i].path_len == len - 1 && memcmp(api.responses[i].path, in_uri + 1, len - 1) == 0)
-            return true;
-
-    return false;
+    return api.findPath(in_uri + 1, len - 1) != nullptr;
 }
 
 #if MODULE_AUTOMATION_AVAILABLE()
@@ -242,11 +227,11 @@ WebServerRequestReturnProtect Http::run_response(WebServerRequest req, ResponseR
 // Use + 1 to compare: req.uriCStr() starts with /; the api paths don't.
 WebServerRequestReturnProtect Http::api_handler_get(WebServerRequest req)
 {
-    size_t req_uri_len = strlen(req.uriCStr() + 1);
+    const char *req_uri = req.uriCStr() + 1;
+    const APIPath *entry = api.findPath(req_uri, strlen(req_uri));
 
-    for (size_t i = 0; i < api.states.size(); i++) {
-        if (api.states[i].path_len != req_uri_len || memcmp(api.states[i].path, req.uriCStr() + 1, req_uri_len) != 0)
-            continue;
+    if (entry != nullptr && entry->type == APIPath::Type::State) {
+        size_t i = entry->idx;
 
         String response;
         auto result = task_scheduler.await([&response, i]() {
@@ -258,9 +243,8 @@ WebServerRequestReturnProtect Http::api_handler_get(WebServerRequest req)
         return req.send(200, "application/json; charset=utf-8", response.c_str(), response.length());
     }
 
-    for (size_t i = 0; i < api.commands.size(); i++)
-        if (api.commands[i].path_len == req_uri_len && memcmp(api.commands[i].path, req.uriCStr() + 1, req_uri_len) == 0 && api.commands[i].config->is_null())
-            return run_command(req, i);
+    if (entry != nullptr && entry->type == APIPath::Type::Command && api.commands[entry->idx].config->is_null())
+        return run_command(req, entry->idx);
 
     // If we reach this point, the url matcher found an API with the req.uri() as path, but we did not.
     // This was probably a raw command or a command that requires a payload. Return 405 - Method not allowed
@@ -269,32 +253,23 @@ WebServerRequestReturnProtect Http::api_handler_get(WebServerRequest req)
 
 WebServerRequestReturnProtect Http::api_handler_put(WebServerRequest req)
 {
-    size_t req_uri_len = strlen(req.uriCStr() + 1);
-
-    for (size_t i = 0; i < api.commands.size(); i++)
-        if (api.commands[i].path_len == req_uri_len && memcmp(api.commands[i].path, req.uriCStr() + 1, req_uri_len) == 0)
-            return run_command(req, i);
-
-    for (size_t i = 0; i < api.responses.size(); i++)
-        if (api.responses[i].path_len == req_uri_len && memcmp(api.responses[i].path, req.uriCStr() + 1, req_uri_len) == 0)
-            return run_response(req, api.responses[i]);
-
-    if (req.uri().endsWith("_update")) {
-        return req.send(405, "text/plain", "Request method for this URI is not handled by server");
-    }
-
-    for (size_t i = 0; i < api.states.size(); i++) {
-        if (api.states[i].path_len != req_uri_len || memcmp(api.states[i].path, req.uriCStr() + 1, req_uri_len) != 0)
-            continue;
-
-        String uri_update = req.uri() + "_update";
-        for (size_t a = 0; a < api.commands.size(); a++)
-            if (api.commands[a].path_len == uri_update.length() - 1 && memcmp(api.commands[a].path, uri_update.c_str() + 1, uri_update.length() - 1) == 0)
-                return run_command(req, a);
-
-        // If we've found the api state that matches req.uriCStr() but did not find a corresponding command with _update,
-        // break here because there can't be two states with the same path. We don't have to check the rest.
-        break;
+    const char *req_uri = req.uriCStr() + 1;
+    const APIPath *entry = api.findPath(req_uri, strlen(req_uri));
+
+    if (entry != nullptr) {
+        switch (entry->type) {
+            case APIPath::Type::Command:
+                return run_command(req, entry->idx);
+
+            case APIPath::Type::Response:
+                return run_response(req, api.responses[entry->idx]);
+
+            case APIPath::Type::State:
+                // Writing to a state is an alias of its _update command, if there is one.
+                if (entry->update_command_idx != APIPath::NO_UPDATE_COMMAND)
+                    return run_command(req, entry->update_command_idx);
+                break;
+        }
     }
 
     // If we reach this point, the url matcher found an API with the req.uri() as path, but we did not.
@@ -22,6 +22,10 @@ def main(filepath):
         iso_data = data.split('__begin_iso15118_ll__\n')[1].split('__end_iso15118_ll__')[0]
         qca_list = []
         for line in iso_data.splitlines():
+            # Skip markers for dropped records and incomplete trace blocks.
+            if len(line) == 0 or line.startswith('__'):
+                continue
+
             t, qca = line.split(' ')
             qca_list.extend([int(qca[i:i+2], 16) for i in range(0, len(qca), 2)])
 
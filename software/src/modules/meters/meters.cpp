@@ -766,9 +766,9 @@ MeterValueAvailability Meters::get_value_ids_extended(uint32_t slot, MeterValueI
     return MeterValueAvailability::Fresh;
 }
 
-static float get_extended_value(const Config *values, const Meters::extra_value_id *extra_value)
+static float get_extended_value(const float *values, const Meters::extra_value_id *extra_value)
 {
-    const float base_value = values->get(extra_value->source_index)->asFloat();
+    const float base_value = values[extra_value->source_index];
 
     if (extra_value->direction == Meters::ExtraValueDirection::Positive) {
         return base_value > 0 ? base_value : 0;
@@ -784,8 +784,9 @@ MeterValueAvailability Meters::get_values(uint32_t slot, const Config **values,
         return MeterValueAvailability::Unavailable;
     }
 
-    const MeterSlot &meter_slot = meter_slots[slot];
+    MeterSlot &meter_slot = meter_slots[slot];
 
+    sync_values_config(meter_slot);
     *values = &meter_slot.values;
 
     if (!this->meter_is_fresh(slot, max_age)) {
@@ -795,6 +796,27 @@ MeterValueAvailability Meters::get_values(uint32_t slot, const Config **values,
     }
 }
 
+// The returned array is valid until the next update of the slot's values.
+MeterValueAvailability Meters::get_values(uint32_t slot, const float **values, size_t *value_count, micros_t max_age)
+{
+    if (slot >= OPTIONS_METERS_MAX_SLOTS()) {
+        *values = nullptr;
+        *value_count = 0;
+        return MeterValueAvailability::Unavailable;
+    }
+
+    const MeterSlot &meter_slot = meter_slots[slot];
+
+    *values = meter_slot.value_store;
+    *value_count = meter_slot.value_count;
+
+    if (!this->meter_is_fresh(slot, max_age)) {
+        return MeterValueAvailability::Stale;
+    } else {
+        return MeterValueAvailability::Fresh;
+    }
+}
+
 MeterValueAvailability Meters::get_values_with_cache(uint32_t slot, float *values, const uint32_t *index_cache, size_t value_count, micros_t max_age)
 {
     if (slot >= OPTIONS_METERS_MAX_SLOTS()) {
@@ -802,7 +824,7 @@ MeterValueAvailability Meters::get_values_with_cache(uint32_t slot, float *value
     }
 
     const MeterSlot &meter_slot = meter_slots[slot];
-    const uint32_t meter_value_count = static_cast<uint32_t>(meter_slot.values.count());
+    const uint32_t meter_value_count = static_cast<uint32_t>(meter_slot.value_count);
 
     for (size_t i = 0; i < value_count; i++) {
         uint32_t index = index_cache[i];
@@ -810,12 +832,12 @@ MeterValueAvailability Meters::get_values_with_cache(uint32_t slot, float *value
         if (index == UINT32_MAX) {
             values[i] = NAN;
         } else if (index < meter_value_count) {
-            values[i] = meter_slot.values.get(index)->asFloat();
+            values[i] = meter_slot.value_store[index];
         } else {
             uint32_t extra_value_index = index - meter_value_count;
 
             if (extra_value_index < meter_slot.extra_value_id_count) {
-                values[i] = get_extended_value(&meter_slot.values, &(meter_slot.extra_value_ids[extra_value_index]));
+                values[i] = get_extended_value(meter_slot.value_store, &(meter_slot.extra_value_ids[extra_value_index]));
             } else {
                 logger.printfln_meter("Attempted to get index %lu via cache but have only %lu values and %u extra values", index, meter_value_count, meter_slot.extra_value_id_count);
                 values[i] = NAN;
@@ -839,15 +861,15 @@ MeterValueAvailability Meters::get_value_by_index(uint32_t slot, uint32_t index,
     }
 
     const MeterSlot &meter_slot = meter_slots[slot];
-    const uint32_t value_count = static_cast<uint32_t>(meter_slot.values.count());
+    const uint32_t value_count = static_cast<uint32_t>(meter_slot.value_count);
 
     if (index < value_count) {
-        *value_out = meter_slot.values.get(index)->asFloat();
+        *value_out = meter_slot.value_store[index];
     } else {
         uint32_t extra_value_index = index - value_count;
 
         if (extra_value_index < meter_slot.extra_value_id_count) {
-            *value_out = get_extended_value(&meter_slot.values, &(meter_slot.extra_value_ids[extra_value_index]));
+            *value_out = get_extended_value(meter_slot.value_store, &(meter_slot.extra_value_ids[extra_value_index]));
         } else {
             logger.printfln_meter("Attempted to get index %lu but have only %lu values and %u extra values", index, value_count, meter_slot.extra_value_id_count);
             *value_out = NAN;
@@ -895,7 +917,7 @@ MeterValueAvailability Meters::get_single_value(uint32_t slot, uint32_t kind, fl
         }
     }
 
-    *value_out = meter_slot.values.get(cached_index)->asFloat();
+    *value_out = meter_slot.value_store[cached_index];
 
     if (!this->meter_is_fresh(slot, max_age)) {
         return MeterValueAvailability::Stale;
@@ -931,7 +953,7 @@ MeterValueAvailability Meters::get_currents(uint32_t slot, float currents[INDEX_
     }
 
     const MeterSlot &meter_slot = meter_slots[slot];
-    const ConfigRoot &values = meter_slot.values;
+    const float *values = meter_slot.value_store;
 
     uint32_t currents_available = 0;
     for (uint32_t i = 0; i < INDEX_CACHE_CURRENT_COUNT; i++) {
@@ -941,7 +963,7 @@ MeterValueAvailability Meters::get_currents(uint32_t slot, float currents[INDEX_
             currents[i] = NAN;
         } else {
             currents_available++;
-            currents[i] = values.get(cached_index)->asFloat();
+            currents[i] = values[cached_index];
         }
     }
 
@@ -961,9 +983,23 @@ MeterValueAvailability Meters::get_currents(uint32_t slot, float currents[INDEX_
     }
 }
 
+// Returns true if the value changed from a value that was not NaN.
+static inline bool store_value(float *value_store, uint32_t *changed_bitmap, size_t index, float new_value)
+{
+    const float old_value = value_store[index];
+    value_store[index] = new_value;
+
+    // Think about NaN and signed zeros before changing this! This has to match Config::updateFloat.
+    if (old_value == new_value)
+        return false;
+
+    changed_bitmap[index / 32] |= 1u << (index % 32);
+
+    return !isnan(old_value);
+}
+
 void Meters::apply_filters(MeterSlot &meter_slot, size_t base_value_count, const float *base_values)
 {
-    Config &values = meter_slot.values;
     float extra_values[OPTIONS_METERS_MAX_VALUES_PER_METER()];
     size_t filter_count = 0;
     uint32_t value_combiner_filter_bitmask = meter_slot.value_combiner_filters_bitmask;
@@ -982,15 +1018,37 @@ void Meters::apply_filters(MeterSlot &meter_slot, size_t base_value_count, const
         filter_count++;
     } while (value_combiner_filter_bitmask);
 
-    size_t extra_value_count = values.count() - base_value_count;
+    size_t extra_value_count = meter_slot.value_count - base_value_count;
     for (size_t i = 0; i < extra_value_count; i++) {
         float value = extra_values[i];
         if (!isnan(value)) {
-            values.get(base_value_count + i)->updateFloat(value);
+            store_value(meter_slot.value_store, meter_slot.values_changed_bitmap, base_value_count + i, value);
         }
     }
 }
 
+// Copies the values that changed since the last call into the API view.
+void Meters::sync_values_config(MeterSlot &meter_slot)
+{
+    Config &values = meter_slot.values;
+    uint32_t *changed_bitmap = meter_slot.values_changed_bitmap;
+
+    for (size_t word = 0; word < METERS_VALUE_BITMAP_WORDS; word++) {
+        uint32_t changed = changed_bitmap[word];
+        if (changed == 0)
+            continue;
+
+        changed_bitmap[word] = 0;
+        meter_slot.values_notify_bitmap[word] |= changed;
+
+        do {
+            size_t index = word * 32 + static_cast<size_t>(__builtin_ctz(changed));
+            values.get(index)->updateFloat(meter_slot.value_store[index]);
+            changed &= changed - 1;
+        } while (changed);
+    }
+}
+
 void Meters::update_value(uint32_t slot, uint32_t index, float new_value)
 {
     if (isnan(new_value))
@@ -1007,32 +1065,22 @@ void Meters::update_value(uint32_t slot, uint32_t index, float new_value)
     }
 
     MeterSlot &meter_slot = meter_slots[slot];
-    Config &values = meter_slot.values;
 
-    if (index >= values.count()) {
-        logger.printfln_meter("Tried to update value %lu that is known to not exist (index >= %zu)", index, values.count());
+    if (index >= meter_slot.value_count) {
+        logger.printfln_meter("Tried to update value %lu that is known to not exist (index >= %zu)", index, meter_slot.value_count);
         return;
     }
 
-    Config *conf_val = static_cast<Config *>(values.get(index));
     micros_t t_now = now_us();
 
-    // Think about ordering and short-circuting issues before changing this!
-    float old_value = conf_val->asFloat();
-    if (conf_val->updateFloat(new_value) && !isnan(old_value))
+    if (store_value(meter_slot.value_store, meter_slot.values_changed_bitmap, index, new_value))
         meter_slot.values_last_changed_at = t_now;
 
     meter_slot.values_last_updated_at = t_now;
 
     if (meter_slot.value_combiner_filters_bitmask) {
-        float base_values[OPTIONS_METERS_MAX_VALUES_PER_METER()];
-        size_t base_value_count = meter_slot.base_value_count;
-
-        for (size_t i = 0; i < base_value_count; i++) {
-            base_values[i] = values.get(i)->asFloat();
-        }
-
-        apply_filters(meter_slot, base_value_count, base_values);
+        // Filters only write behind the base values, so they can read the base values in place.
+        apply_filters(meter_slot, meter_slot.base_value_count, meter_slot.value_store);
     }
 }
 
@@ -1045,7 +1093,8 @@ void Meters::update_all_values(uint32_t slot, const float new_values[])
 
     MeterSlot &meter_slot = meter_slots[slot];
 
-    Config &values = meter_slot.values;
+    float *value_store = meter_slot.value_store;
+    uint32_t *changed_bitmap = meter_slot.values_changed_bitmap;
     size_t base_value_count = meter_slot.base_value_count;
     bool updated_any_value = false;
     bool changed_any_value = false;
@@ -1053,11 +1102,7 @@ void Meters::update_all_values(uint32_t slot, const float new_values[])
     for (size_t i = 0; i < base_value_count; i++) {
         float new_value = new_values[i];
         if (!isnan(new_value)) {
-            Config *conf_val = static_cast<Config *>(values.get(i));
-
-            // Think about ordering and short-circuting issues before changing this!
-            float old_value = conf_val->asFloat();
-            if (conf_val->updateFloat(new_value) && !isnan(old_value))
+            if (store_value(value_store, changed_bitmap, i, new_value))
                 changed_any_value = true;
 
             updated_any_value = true;
@@ -1111,6 +1156,9 @@ void Meters::finish_update(uint32_t slot)
     MeterSlot &meter_slot = meter_slots[slot];
     float power;
 
+    sync_values_config(meter_slot);
+    notify_value_subscribers(slot, meter_slot);
+
     if (get_power(slot, &power) == MeterValueAvailability::Fresh) {
         meter_slot.power_history.add_sample(power);
     }
@@ -1214,6 +1262,21 @@ void Meters::declare_value_ids(uint32_t slot, const MeterValueID new_value_ids[]
         //logger.printfln_meter("Applying filter %s", filter->name);
     }
 
+    float *value_store = static_cast<float *>(malloc(sizeof(float) * total_value_id_count));
+    if (value_store == nullptr) {
+        logger.printfln_meter("Failed to allocate memory for %lu values", total_value_id_count);
+        meter_slot.base_value_count = 0;
+        meter_slot.value_combiner_filters_bitmask = 0;
+        return;
+    }
+
+    for (uint32_t i = 0; i < total_value_id_count; i++) {
+        value_store[i] = NAN;
+    }
+
+    meter_slot.value_store = value_store;
+    meter_slot.value_count = total_value_id_count;
+
     size_t filter_count = all_filter_data.size();
     value_combiner_filter_data *filter_data_compact = static_cast<value_combiner_filter_data *>(malloc(sizeof(value_combiner_filter_data) * filter_count));
     for (size_t i = 0; i < filter_count; i++) {
@@ -1253,6 +1316,12 @@ void Meters::declare_value_ids(uint32_t slot, const MeterValueID new_value_ids[]
 
     meter_slot.values_declared = true;
 
+    for (ValueSubscription &subscription : value_subscriptions) {
+        if (subscription.slot == slot) {
+            resolve_value_subscription(subscription);
+        }
+    }
+
     const char *plural_s = total_value_id_count == 1 ? "" : "s";
     if (total_value_id_count == value_id_count) {
         logger.printfln_meter("Meter declared %lu value%s", total_value_id_count, plural_s);
@@ -1317,6 +1386,100 @@ void Meters::fill_index_cache(uint32_t slot, size_t find_value_count, const Mete
     }
 }
 
+bool Meters::subscribe_values(uint32_t slot, const MeterValueID value_ids[], size_t value_id_count, ValuesCallback &&callback)
+{
+    if (slot >= OPTIONS_METERS_MAX_SLOTS()) {
+        logger.printfln_meter("Tried to subscribe to values of non-existent slot");
+        return false;
+    }
+
+    if (value_id_count == 0 || value_id_count > METERS_MAX_SUBSCRIBED_VALUES) {
+        logger.printfln_meter("Cannot subscribe to %zu values, must be 1 to %i", value_id_count, METERS_MAX_SUBSCRIBED_VALUES);
+        return false;
+    }
+
+    value_subscriptions.emplace_back();
+    ValueSubscription &subscription = value_subscriptions.back();
+
+    subscription.callback    = std::move(callback);
+    subscription.slot        = slot;
+    subscription.value_count = value_id_count;
+    memcpy(subscription.value_ids, value_ids, sizeof(MeterValueID) * value_id_count);
+    init_uint32_array(subscription.index_cache, METERS_MAX_SUBSCRIBED_VALUES, UINT32_MAX);
+    memset(subscription.value_store_mask, 0, sizeof(subscription.value_store_mask));
+
+    if (meter_slots[slot].values_declared) {
+        resolve_value_subscription(subscription);
+    }
+
+    return true;
+}
+
+void Meters::resolve_value_subscription(ValueSubscription &subscription)
+{
+    const uint32_t slot = subscription.slot;
+    const MeterSlot &meter_slot = meter_slots[slot];
+
+    // Generates the extra value IDs if necessary.
+    size_t value_ids_length;
+    get_value_ids_extended(slot, nullptr, &value_ids_length);
+
+    fill_index_cache(slot, subscription.value_count, subscription.value_ids, subscription.index_cache);
+
+    // Extra values are calculated when they're read, so a subscriber depends on their source values.
+    for (size_t i = 0; i < subscription.value_count; i++) {
+        uint32_t index = subscription.index_cache[i];
+
+        if (index == UINT32_MAX)
+            continue;
+
+        if (index >= meter_slot.value_count) {
+            index = meter_slot.extra_value_ids[index - meter_slot.value_count].source_index;
+        }
+
+        subscription.value_store_mask[index / 32] |= 1u << (index % 32);
+    }
+}
+
+void Meters::notify_value_subscribers(uint32_t slot, MeterSlot &meter_slot)
+{
+    uint32_t changed[METERS_VALUE_BITMAP_WORDS];
+    bool changed_any = false;
+
+    for (size_t word = 0; word < METERS_VALUE_BITMAP_WORDS; word++) {
+        changed[word] = meter_slot.values_notify_bitmap[word];
+        meter_slot.values_notify_bitmap[word] = 0;
+
+        if (changed[word] != 0)
+            changed_any = true;
+    }
+
+    if (!changed_any)
+        return;
+
+    for (const ValueSubscription &subscription : value_subscriptions) {
+        if (subscription.slot != slot)
+            continue;
+
+        bool relevant = false;
+
+        for (size_t word = 0; word < METERS_VALUE_BITMAP_WORDS; word++) {
+            if ((changed[word] & subscription.value_store_mask[word]) != 0) {
+                relevant = true;
+                break;
+            }
+        }
+
+        if (!relevant)
+            continue;
+
+        float values[METERS_MAX_SUBSCRIBED_VALUES];
+        get_values_with_cache(slot, values, subscription.index_cache, subscription.value_count);
+
+        subscription.callback(values);
+    }
+}
+
 static const char *meters_path_postfixes[] = {"", "config", "state", "value_ids", "values", "errors", "reset", "last_reset"};
 static_assert(ARRAY_SIZE(meters_path_postfixes) == static_cast<uint32_t>(Meters::PathType::_max) + 1, "Path postfix length mismatch");
 
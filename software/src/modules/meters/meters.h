@@ -19,7 +19,9 @@
 
 #pragma once
 
+#include <functional>
 #include <stdint.h>
+#include <vector>
 
 #include "module.h"
 #include "config.h"
@@ -33,6 +35,9 @@
 #include "tools.h"
 
 #define METERS_MAX_FILTER_VALUES 7
+#define METERS_MAX_SUBSCRIBED_VALUES 8
+
+#define METERS_VALUE_BITMAP_WORDS ((OPTIONS_METERS_MAX_VALUES_PER_METER() + 31) / 32)
 
 #define INDEX_CACHE_POWER          0
 #define INDEX_CACHE_ENERGY_IMPORT  1
@@ -102,6 +107,7 @@ public:
     MeterValueAvailability get_value_ids(uint32_t slot, const Config **value_ids);
     MeterValueAvailability get_value_ids_extended(uint32_t slot, MeterValueID *value_ids_out, size_t *value_ids_length);
     MeterValueAvailability get_values(uint32_t slot, const Config **values, micros_t max_age = 0_us);
+    MeterValueAvailability get_values(uint32_t slot, const float **values, size_t *value_count, micros_t max_age = 0_us);
     MeterValueAvailability get_values_with_cache(uint32_t slot, float *values, const uint32_t *index_cache, size_t value_count, micros_t max_age = 0_us);
     MeterValueAvailability get_value_by_index(uint32_t slot, uint32_t index, float *value, micros_t max_age = 0_us);
     MeterValueAvailability get_power(uint32_t slot, float *power_w, micros_t max_age = 0_us);
@@ -120,6 +126,13 @@ public:
 
     void fill_index_cache(uint32_t slot, size_t value_count, const MeterValueID value_ids[], uint32_t index_cache[]);
 
+    // Called with the subscribed values in the order of their value IDs. Values the meter doesn't provide are NaN.
+    using ValuesCallback = std::function<void(const float values[])>;
+
+    // The callback is called from finish_update() if at least one of the subscribed values changed.
+    // Subscribe in setup() or later, but not from a callback.
+    bool subscribe_values(uint32_t slot, const MeterValueID value_ids[], size_t value_id_count, ValuesCallback &&callback);
+
     String get_path(uint32_t slot, PathType path_type);
 
 private:
@@ -127,8 +140,17 @@ private:
     {
     public:
         ConfigRoot value_ids;
+        // API view of value_store. Only updated by sync_values_config().
         ConfigRoot values;
 
+        // Base values followed by the values calculated by the filters.
+        float   *value_store;
+        size_t   value_count;
+        // Values that changed since the last sync_values_config().
+        uint32_t values_changed_bitmap[METERS_VALUE_BITMAP_WORDS];
+        // Values that changed since the subscribers were last notified.
+        uint32_t values_notify_bitmap[METERS_VALUE_BITMAP_WORDS];
+
         micros_t values_last_updated_at;
         micros_t values_last_changed_at;
         bool     values_declared;
@@ -154,11 +176,24 @@ private:
         ValueHistory power_history;
     };
 
+    struct ValueSubscription {
+        ValuesCallback callback;
+        uint32_t slot;
+        size_t value_count;
+        MeterValueID value_ids[METERS_MAX_SUBSCRIBED_VALUES];
+        uint32_t index_cache[METERS_MAX_SUBSCRIBED_VALUES];
+        // Values in the slot's value_store that the subscribed values depend on.
+        uint32_t value_store_mask[METERS_VALUE_BITMAP_WORDS];
+    };
+
     IMeterGenerator *get_generator_for_class(MeterClassID meter_class);
     IMeter *new_meter_of_class(MeterClassID meter_class, uint32_t slot, Config *state, Config *errors);
 
     MeterValueAvailability get_single_value(uint32_t slot, uint32_t kind, float *value, micros_t max_age_us);
     void apply_filters(MeterSlot &meter_slot, size_t base_value_count, const float *base_values);
+    void sync_values_config(MeterSlot &meter_slot);
+    void resolve_value_subscription(ValueSubscription &subscription);
+    void notify_value_subscribers(uint32_t slot, MeterSlot &meter_slot);
 
     float live_samples_per_second();
 
@@ -166,6 +201,8 @@ private:
 
     bool meters_feature_declared = false;
 
+    std::vector<ValueSubscription> value_subscriptions;
+
     std::vector<std::tuple<MeterClassID, IMeterGenerator *>> generators;
 
     size_t history_chars_per_value;
@@ -30,6 +30,52 @@
 #pragma GCC diagnostic ignored "-Wuseless-cast"
 #endif
 
+struct EnvelopeTierSpec {
+    const char *name;
+    uint32_t interval_s;
+    size_t size;
+};
+
+// Each interval must be a multiple of the previous one.
+static const EnvelopeTierSpec envelope_tier_specs[VALUE_HISTORY_ENVELOPE_TIER_COUNT] = {
+    {"1s",  1,       VALUE_HISTORY_ENVELOPE_1S_SIZE},
+    {"1m",  60,      VALUE_HISTORY_ENVELOPE_1M_SIZE},
+    {"15m", 15 * 60, VALUE_HISTORY_ENVELOPE_15M_SIZE},
+    {"1h",  60 * 60, VALUE_HISTORY_ENVELOPE_1H_SIZE},
+};
+
+#if VALUE_HISTORY_ENVELOPE_ENABLED
+// Returns the index of the enabled tier requested by .../history_envelope/<name> or VALUE_HISTORY_ENVELOPE_TIER_COUNT.
+static size_t find_envelope_tier(WebServerRequest &request)
+{
+    const char *name = strrchr(request.uriCStr(), '/') + 1;
+
+    for (size_t i = 0; i < VALUE_HISTORY_ENVELOPE_TIER_COUNT; ++i) {
+        if (envelope_tier_specs[i].size > 0 && strcmp(envelope_tier_specs[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    return VALUE_HISTORY_ENVELOPE_TIER_COUNT;
+}
+#endif
+
+void ValueHistory::EnvelopeAccumulator::clear()
+{
+    sum = 0;
+    count = 0;
+    min = INT32_MAX;
+    max = INT32_MIN;
+}
+
+void ValueHistory::EnvelopeAccumulator::add(int64_t sample_sum, uint32_t sample_count, int32_t sample_min, int32_t sample_max)
+{
+    sum += sample_sum;
+    count += sample_count;
+    min = std::min(min, sample_min);
+    max = std::max(max, sample_max);
+}
+
 void ValueHistory::setup()
 {
     history.setup();
@@ -37,6 +83,24 @@ void ValueHistory::setup()
     history.clear();
     live.clear();
 
+    for (size_t i = 0; i < VALUE_HISTORY_ENVELOPE_TIER_COUNT; ++i) {
+        EnvelopeTier &tier = envelope_tiers[i];
+        size_t size = envelope_tier_specs[i].size;
+
+        tier.acc.clear();
+
+        if (size == 0) {
+            continue;
+        }
+
+        tier.avg.setup(size);
+        tier.min.setup(size);
+        tier.max.setup(size);
+        tier.avg.clear();
+        tier.min.clear();
+        tier.max.clear();
+    }
+
     for (size_t i = 0; i < history.size(); ++i) {
         //float f = 5000.0 * sin(PI/120.0 * i) + 5000.0;
         // Use negative state to mark that these are pre-filled.
@@ -81,6 +145,19 @@ void ValueHistory::register_urls(String base_url)
 
         return request.send(200, "application/json; charset=utf-8", sb.getPtr(), static_cast<ssize_t>(sb.getLength()));
     });
+
+#if VALUE_HISTORY_ENVELOPE_ENABLED
+    // One handler serves all tiers: URI handlers are limited.
+    server.on(("/" + base_url + "history_envelope/*").c_str(), HTTP_GET, [this](WebServerRequest request) {
+        size_t tier_index = find_envelope_tier(request);
+
+        if (tier_index >= VALUE_HISTORY_ENVELOPE_TIER_COUNT) {
+            return request.send(404, "text/plain", "Unknown envelope tier");
+        }
+
+        return send_envelope_tier(request, tier_index);
+    });
+#endif
 }
 
 void ValueHistory::register_urls_empty(String base_url)
@@ -96,6 +173,21 @@ void ValueHistory::register_urls_empty(String base_url)
     server.on(("/" + base_url + "live").c_str(), HTTP_GET, [this, empty_live, empty_live_len](WebServerRequest request) {
         return request.send(200, "application/json; charset=utf-8", empty_live, empty_live_len);
     });
+
+#if VALUE_HISTORY_ENVELOPE_ENABLED
+    server.on(("/" + base_url + "history_envelope/*").c_str(), HTTP_GET, [](WebServerRequest request) {
+        size_t tier_index = find_envelope_tier(request);
+
+        if (tier_index >= VALUE_HISTORY_ENVELOPE_TIER_COUNT) {
+            return request.send(404, "text/plain", "Unknown envelope tier");
+        }
+
+        char buf[80];
+        size_t len = snprintf_u(buf, sizeof(buf), "{\"offset\":0,\"interval\":%lu,\"avg\":[],\"min\":[],\"max\":[]}", envelope_tier_specs[tier_index].interval_s);
+
+        return request.send(200, "application/json; charset=utf-8", buf, static_cast<ssize_t>(len));
+    });
+#endif
 }
 
 void ValueHistory::add_sample(float sample)
@@ -106,6 +198,71 @@ void ValueHistory::add_sample(float sample)
 
     ++sample_count;
     sample_sum += sample;
+
+    // Use the raw samples for the envelope. The live history's averages would hide short spikes.
+    int32_t value = clamp(static_cast<int32_t>(VALUE_HISTORY_VALUE_MIN),
+                          static_cast<int32_t>(roundf(sample)),
+                          static_cast<int32_t>(VALUE_HISTORY_VALUE_MAX));
+
+    envelope_tiers[0].acc.add(value, 1, value, value);
+}
+
+void ValueHistory::update_envelope_tiers(micros_t now)
+{
+    if (!VALUE_HISTORY_ENVELOPE_ENABLED) {
+        return;
+    }
+
+    for (size_t i = 0; i < VALUE_HISTORY_ENVELOPE_TIER_COUNT; ++i) {
+        EnvelopeTier &tier = envelope_tiers[i];
+        uint32_t bucket = (now / seconds_t{envelope_tier_specs[i].interval_s}).as<uint32_t>();
+
+        if (tier.current_bucket == UINT32_MAX) {
+            tier.current_bucket = bucket;
+            continue;
+        }
+
+        // The bucket boundaries of a tier are also boundaries of all lower tiers.
+        if (bucket == tier.current_bucket) {
+            break;
+        }
+
+        const EnvelopeAccumulator &acc = tier.acc;
+        // Disabled tiers only pass their buckets on to the next tier.
+        bool enabled = envelope_tier_specs[i].size > 0;
+
+        if (acc.count == 0) {
+            if (enabled) {
+                tier.avg.push(INT32_MIN);
+                tier.min.push(INT32_MIN);
+                tier.max.push(INT32_MIN);
+            }
+        } else {
+            if (enabled) {
+                tier.avg.push(static_cast<int32_t>(acc.sum / static_cast<int64_t>(acc.count)));
+                tier.min.push(acc.min);
+                tier.max.push(acc.max);
+            }
+
+            if (i + 1 < VALUE_HISTORY_ENVELOPE_TIER_COUNT) {
+                envelope_tiers[i + 1].acc.add(acc.sum, acc.count, acc.min, acc.max);
+            }
+        }
+
+        tier.acc.clear();
+
+        // Buckets that passed without a tick, for example because the task was blocked, stay empty.
+        uint32_t skipped = enabled ? std::min(bucket - tier.current_bucket - 1, static_cast<uint32_t>(tier.avg.size())) : 0;
+
+        for (uint32_t s = 0; s < skipped; ++s) {
+            tier.avg.push(INT32_MIN);
+            tier.min.push(INT32_MIN);
+            tier.max.push(INT32_MIN);
+        }
+
+        tier.current_bucket = bucket;
+        tier.last_update = now;
+    }
 }
 
 void ValueHistory::tick(micros_t now, bool update_history, int32_t *live_sample, int32_t *history_sample)
@@ -131,6 +288,8 @@ void ValueHistory::tick(micros_t now, bool update_history, int32_t *live_sample,
         --last_live_val_valid;
     }
 
+    update_envelope_tiers(now);
+
     live.push(live_val);
     *live_sample = live_val;
     live_last_update = now;
@@ -236,6 +395,67 @@ void ValueHistory::format_history_samples(StringBuilder *sb)
     }
 }
 
+// Streams the buckets as separate arrays, oldest first, to keep the response buffer small.
+WebServerRequestReturnProtect ValueHistory::send_envelope_tier(WebServerRequest &request, size_t tier_index)
+{
+    EnvelopeTier &tier = envelope_tiers[tier_index];
+    StringBuilder sb;
+
+    if (!sb.setCapacity(512)) {
+        return request.send(500, "text/plain", "Failed to allocate buffer");
+    }
+
+    request.beginChunkedResponse(200, "application/json; charset=utf-8");
+
+    sb.printf("{\"offset\":%lu,\"interval\":%lu", (now_us() - tier.last_update).to<millis_t>().as<uint32_t>(), envelope_tier_specs[tier_index].interval_s);
+
+    const struct {
+        const char *name;
+        EnvelopeRingbuffer *buckets;
+    } columns[] = {
+        {"avg", &tier.avg},
+        {"min", &tier.min},
+        {"max", &tier.max},
+    };
+
+    // Leaves room for a column header or a value with its separator.
+    auto flush_if_full = [&request, &sb](size_t needed) {
+        if (sb.getRemainingLength() <= needed) {
+            request.sendChunk(sb.getPtr(), static_cast<ssize_t>(sb.getLength()));
+            sb.clear();
+        }
+    };
+
+    for (const auto &column : columns) {
+        flush_if_full(16);
+        sb.printf(",\"%s\":[", column.name);
+
+        size_t used = column.buckets->used();
+        int32_t val;
+
+        for (size_t i = 0; i < used && column.buckets->peek_offset(&val, i); ++i) {
+            flush_if_full(chars_per_value);
+
+            const char *separator = i == 0 ? "" : ",";
+
+            if (val == INT32_MIN) {
+                sb.printf("%snull", separator);
+            } else {
+                sb.printf("%s%d", separator, static_cast<int>(val));
+            }
+        }
+
+        flush_if_full(2);
+        sb.puts("]");
+    }
+
+    flush_if_full(2);
+    sb.puts("}");
+    request.sendChunk(sb.getPtr(), static_cast<ssize_t>(sb.getLength()));
+
+    return request.endChunkedResponse();
+}
+
 float ValueHistory::samples_per_second()
 {
     float samples_per_second = 0;
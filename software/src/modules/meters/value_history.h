@@ -50,7 +50,21 @@
 static_assert(INT32_MIN < VALUE_HISTORY_VALUE_MIN);
 static_assert(INT32_MAX >= VALUE_HISTORY_VALUE_MAX);
 
+// The envelope history keeps the average, minimum and maximum of all samples per bucket
+// in tiers of increasing bucket intervals. Each closed bucket is also added to the next tier.
+#define VALUE_HISTORY_ENVELOPE_TIER_COUNT 4
+
+// Number of buckets per tier plus one; must be powers of two. 0 disables a tier.
+#define VALUE_HISTORY_ENVELOPE_1S_SIZE  OPTIONS_METERS_HISTORY_ENVELOPE_1S_SIZE()
+#define VALUE_HISTORY_ENVELOPE_1M_SIZE  OPTIONS_METERS_HISTORY_ENVELOPE_1M_SIZE()
+#define VALUE_HISTORY_ENVELOPE_15M_SIZE OPTIONS_METERS_HISTORY_ENVELOPE_15M_SIZE()
+#define VALUE_HISTORY_ENVELOPE_1H_SIZE  OPTIONS_METERS_HISTORY_ENVELOPE_1H_SIZE()
+
+#define VALUE_HISTORY_ENVELOPE_ENABLED (VALUE_HISTORY_ENVELOPE_1S_SIZE > 0 || VALUE_HISTORY_ENVELOPE_1M_SIZE > 0 || VALUE_HISTORY_ENVELOPE_15M_SIZE > 0 || VALUE_HISTORY_ENVELOPE_1H_SIZE > 0)
+
 class StringBuilder;
+class WebServerRequest;
+struct WebServerRequestReturnProtect;
 
 class ValueHistory
 {
@@ -70,6 +84,39 @@ public:
     void format_history_samples(StringBuilder *sb);
     float samples_per_second();
 
+    struct EnvelopeAccumulator {
+        int64_t sum;
+        uint32_t count;
+        int32_t min;
+        int32_t max;
+
+        void clear();
+        void add(int64_t sample_sum, uint32_t sample_count, int32_t sample_min, int32_t sample_max);
+    };
+
+    using EnvelopeRingbuffer = TF_Ringbuffer<int32_t,
+#if defined(BOARD_HAS_PSRAM)
+                                             malloc_psram,
+#else
+                                             malloc_32bit_addressed,
+#endif
+                                             free_any>;
+
+    struct EnvelopeTier {
+        // Written in lockstep. INT32_MIN marks buckets without samples.
+        EnvelopeRingbuffer avg;
+        EnvelopeRingbuffer min;
+        EnvelopeRingbuffer max;
+        EnvelopeAccumulator acc;
+        uint32_t current_bucket = UINT32_MAX;
+        micros_t last_update = 0_us;
+    };
+
+    void update_envelope_tiers(micros_t now);
+    WebServerRequestReturnProtect send_envelope_tier(WebServerRequest &request, size_t tier_index);
+
+    EnvelopeTier envelope_tiers[VALUE_HISTORY_ENVELOPE_TIER_COUNT];
+
     int64_t sum_this_interval = 0;
     int all_samples_this_interval = 0;
     int valid_samples_this_interval = 0;
@@ -289,13 +289,15 @@ void MeterMeta::on_values_change_double()
 
 void MeterMeta::on_values_change_task_double()
 {
-    const Config *values_a;
-    const Config *values_b;
+    const float *values_a;
+    const float *values_b;
+    size_t value_count_a;
+    size_t value_count_b;
 
-    MeterValueAvailability availability_a = meters.get_values(source_meter_a, &values_a); // micros_t{2100 * 1000} 2.1s
-    MeterValueAvailability availability_b = meters.get_values(source_meter_b, &values_b); // micros_t{2100 * 1000} 2.1s
+    MeterValueAvailability availability_a = meters.get_values(source_meter_a, &values_a, &value_count_a); // micros_t{2100 * 1000} 2.1s
+    MeterValueAvailability availability_b = meters.get_values(source_meter_b, &values_b, &value_count_b); // micros_t{2100 * 1000} 2.1s
 
-    if (values_a->count() <= 0 || values_b->count() <= 0) {
+    if (value_count_a == 0 || value_count_b == 0) {
         return;
     }
 
@@ -312,8 +314,8 @@ void MeterMeta::on_values_change_task_double()
     float values[OPTIONS_METERS_MAX_VALUES_PER_METER()];
 
     for (size_t i = 0; i < value_count; i++) {
-        float value_a = values_a->get((*value_indices)[i][0])->asFloat();
-        float value_b = values_b->get((*value_indices)[i][1])->asFloat();
+        float value_a = values_a[(*value_indices)[i][0]];
+        float value_b = values_b[(*value_indices)[i][1]];
         float value;
 
         if (mode == ConfigMode::Sum) {
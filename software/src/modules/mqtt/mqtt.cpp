@@ -421,9 +421,10 @@ void Mqtt::onMqttMessage(char *topic, size_t topic_len, char *data, size_t data_
     topic += global_topic_prefix.length() + 1;
     topic_len -= global_topic_prefix.length() + 1;
 
-    for (auto &reg : api.commands) {
-        if (topic_len != reg.path_len || memcmp(topic, reg.path, topic_len) != 0)
-            continue;
+    const APIPath *entry = api.findPath(topic, topic_len);
+
+    if (entry != nullptr && entry->type == APIPath::Type::Command) {
+        auto &reg = api.commands[entry->idx];
 
         if (retain && reg.is_action) {
             logger.printfln("Topic %s is an action. Ignoring retained message (data_len=%u).", reg.path, data_len);
@@ -446,11 +447,8 @@ void Mqtt::onMqttMessage(char *topic, size_t topic_len, char *data, size_t data_
     }
 
     // Don't print error message on state topics, this could be one of our own messages.
-    for (auto &reg : api.states) {
-        if (topic_len != reg.path_len || memcmp(topic, reg.path, topic_len) != 0)
-            continue;
+    if (entry != nullptr && entry->type == APIPath::Type::State)
         return;
-    }
 
     // Don't print error message if this packet was received because it was retained (as opposed to a newly published message)
     // The spec says:
@@ -35,6 +35,9 @@
 
 #define METER_SLOT_BATTERY_NO_BATTERY (255)
 
+// Power values of a meter that did not update for this long are not used.
+#define PM_METER_MAX_AGE 10_s
+
 void PowerManager::pre_setup()
 {
     // States
@@ -435,6 +438,7 @@ void PowerManager::setup()
         current_meter_available = true;
     }
 
+    subscribe_meter_values();
 #endif
     if (excess_charging_enabled && !power_meter_available) {
         set_config_error(PM_CONFIG_ERROR_FLAGS_EXCESS_NO_METER_MASK);
@@ -753,16 +757,21 @@ static int32_t update_mavg_filter(int32_t filter_input, PowerManager::mavg_filte
     return filter->filtered_val;
 }
 
+// Meter values are pushed by the meters module when they change, see subscribe_meter_values().
 void PowerManager::update_data()
 {
 #if MODULE_METERS_AVAILABLE()
-    if (meters.get_power(meter_slot_power, &power_at_meter_raw_w) != MeterValueAvailability::Fresh) {
+    // Subscriptions only notify about changes, so a meter that stopped updating has to be detected here.
+    if (meter_slot_power < OPTIONS_METERS_MAX_SLOTS() && meters.meter_is_fresh(meter_slot_power, PM_METER_MAX_AGE)) {
+        power_at_meter_raw_w = power_at_meter_subscribed_w;
+    } else {
         power_at_meter_raw_w = NAN;
     }
-    if (have_battery) {
-        if (meters.get_power(meter_slot_battery_power, &power_at_battery_raw_w) != MeterValueAvailability::Fresh) {
-            power_at_battery_raw_w = NAN;
-        }
+
+    if (have_battery && meters.meter_is_fresh(meter_slot_battery_power, PM_METER_MAX_AGE)) {
+        power_at_battery_raw_w = power_at_battery_subscribed_w;
+    } else {
+        power_at_battery_raw_w = NAN;
     }
 #endif
 
@@ -779,37 +788,64 @@ void PowerManager::update_data()
     }
 
     if (!isnan(power_at_battery_raw_w)) {
-        if (battery_inverted) {
-            power_at_battery_raw_w *= -1;
-        }
         low_level_state.get("power_at_battery")->updateFloat(power_at_battery_raw_w);
     }
+}
 
-    float meter_currents[INDEX_CACHE_CURRENT_COUNT];
 #if MODULE_METERS_AVAILABLE()
-    MeterValueAvailability ret = meters.get_currents(meter_slot_currents, meter_currents);
-    if (ret != MeterValueAvailability::Fresh)
-#else
-    // Unconditionally execute block
-#endif
-    { // Don't place bracket in sections removed by precompiler to make VSCode happy
-        for (size_t i = 0; i < INDEX_CACHE_CURRENT_COUNT; i++) {
-            meter_currents[i] = NAN;
+static float first_valid_value(const float values[], size_t value_count)
+{
+    for (size_t i = 0; i < value_count; i++) {
+        if (!isnan(values[i])) {
+            return values[i];
         }
     }
 
-    for (size_t i = 0; i < INDEX_CACHE_CURRENT_COUNT; i++) {
-        float meter_current_a = meter_currents[i];
-        if (!isnan(meter_current_a)) {
-            // TODO Store in low_level_state
+    return NAN;
+}
+
+void PowerManager::subscribe_meter_values()
+{
+    // Same order of precedence as Meters::get_power().
+    static const MeterValueID power_value_ids[] = {
+        MeterValueID::PowerActiveLSumImExDiff,
+        MeterValueID::PowerDCImExDiff,
+        MeterValueID::PowerDCChaDisDiff,
+        MeterValueID::PowerPVSumImExDiff,
+    };
 
-            if (dynamic_load_enabled) {
-                int32_t raw_current_ma = static_cast<int32_t>(meter_current_a * 1000);
-                currents_at_meter_raw_ma[i] = raw_current_ma;
+    static const MeterValueID current_value_ids[INDEX_CACHE_CURRENT_COUNT] = {
+        MeterValueID::CurrentL1ImExDiff,
+        MeterValueID::CurrentL2ImExDiff,
+        MeterValueID::CurrentL3ImExDiff,
+    };
+
+    if (meter_slot_power < OPTIONS_METERS_MAX_SLOTS()) {
+        meters.subscribe_values(meter_slot_power, power_value_ids, ARRAY_SIZE(power_value_ids), [this](const float values[]) {
+            this->power_at_meter_subscribed_w = first_valid_value(values, ARRAY_SIZE(power_value_ids));
+        });
+    }
+
+    if (have_battery) {
+        meters.subscribe_values(meter_slot_battery_power, power_value_ids, ARRAY_SIZE(power_value_ids), [this](const float values[]) {
+            float power_w = first_valid_value(values, ARRAY_SIZE(power_value_ids));
+            this->power_at_battery_subscribed_w = this->battery_inverted ? -power_w : power_w;
+        });
+    }
+
+    if (dynamic_load_enabled && meter_slot_currents < OPTIONS_METERS_MAX_SLOTS()) {
+        meters.subscribe_values(meter_slot_currents, current_value_ids, ARRAY_SIZE(current_value_ids), [this](const float values[]) {
+            for (size_t i = 0; i < INDEX_CACHE_CURRENT_COUNT; i++) {
+                float meter_current_a = values[i];
+                if (!isnan(meter_current_a)) {
+                    // TODO Store in low_level_state
+                    this->currents_at_meter_raw_ma[i] = static_cast<int32_t>(meter_current_a * 1000);
+                }
             }
-        }
+        });
     }
 }
+#endif
 
 void PowerManager::update_energy()
 {
@@ -134,6 +134,9 @@ private:
 
     void zero_limits();
     void update_data();
+#if MODULE_METERS_AVAILABLE()
+    void subscribe_meter_values();
+#endif
     void update_energy();
     void update_phase_switcher();
     void set_max_current_limit(int32_t limit_ma);
@@ -173,6 +176,9 @@ private:
 
     float    power_at_meter_raw_w = NAN;
     float    power_at_battery_raw_w = NAN;
+    // Last values pushed by the meter subscriptions. Only copied to the raw values while the meter is fresh.
+    float    power_at_meter_subscribed_w = NAN;
+    float    power_at_battery_subscribed_w = NAN;
     int32_t  current_pv_floating_min_ma = INT32_MAX;
     minmax_filter current_pv_minmax_ma;
     minmax_filter current_pv_long_min_ma;
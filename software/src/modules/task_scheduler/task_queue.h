@@ -0,0 +1,236 @@
+/* esp32-firmware
+ * Copyright (C) 2026 Erik Fleckstein <erik@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Pooled task storage with a min-heap of the queued tasks, ordered by next_deadline.
+// Tasks are allocated in chunks that are never freed, so task pointers stay valid until the task is released.
+//
+// The low TASK_QUEUE_SLOT_BITS of a task ID are the task's slot, which makes finding a task by its ID O(1).
+// The remaining bits are a sequence number that keeps IDs unique when a slot is reused
+// and orders tasks with the same deadline by their allocation.
+// The highest bit of an ID is never set by the queue; callers can use it as a flag.
+//
+// T needs the members uint64_t task_id, next_deadline (ordered with <) and uint32_t heap_pos.
+// Not thread safe.
+#define TASK_QUEUE_SLOT_BITS 16
+#define TASK_QUEUE_CHUNK_SIZE 16
+
+template<typename T>
+class TaskQueue
+{
+public:
+    static constexpr uint32_t NOT_QUEUED = UINT32_MAX;
+
+    TaskQueue() = default;
+    TaskQueue(const TaskQueue &other) = delete;
+    TaskQueue &operator=(const TaskQueue &other) = delete;
+
+    ~TaskQueue()
+    {
+        for (T *chunk : chunks) {
+            delete[] chunk;
+        }
+    }
+
+    // Returns an unqueued task with a new ID or nullptr if all slots are in use. id_flags are ORed into the ID.
+    T *alloc(uint64_t id_flags = 0)
+    {
+        uint32_t slot;
+
+        if (!free_slots.empty()) {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        } else {
+            slot = static_cast<uint32_t>(chunks.size() * TASK_QUEUE_CHUNK_SIZE);
+
+            if (slot >= (1u << TASK_QUEUE_SLOT_BITS))
+                return nullptr;
+
+            chunks.push_back(new T[TASK_QUEUE_CHUNK_SIZE]);
+
+            free_slots.reserve(free_slots.size() + TASK_QUEUE_CHUNK_SIZE - 1);
+            for (uint32_t i = TASK_QUEUE_CHUNK_SIZE - 1; i > 0; --i) {
+                free_slots.push_back(slot + i);
+            }
+        }
+
+        T *task = at(slot);
+        task->task_id = (++last_sequence << TASK_QUEUE_SLOT_BITS) | slot | id_flags;
+        task->heap_pos = NOT_QUEUED;
+
+        return task;
+    }
+
+    // The task must not be queued.
+    void release(T *task)
+    {
+        free_slots.push_back(slot_of(task->task_id));
+        task->task_id = 0;
+    }
+
+    // Returns the allocated task with this ID, queued or not, or nullptr.
+    T *find(uint64_t task_id)
+    {
+        if (task_id == 0)
+            return nullptr;
+
+        uint32_t slot = slot_of(task_id);
+
+        if (slot >= chunks.size() * TASK_QUEUE_CHUNK_SIZE)
+            return nullptr;
+
+        T *task = at(slot);
+
+        return task->task_id == task_id ? task : nullptr;
+    }
+
+    static bool is_queued(const T *task)
+    {
+        return task->heap_pos != NOT_QUEUED;
+    }
+
+    bool empty() const
+    {
+        return heap.empty();
+    }
+
+    size_t size() const
+    {
+        return heap.size();
+    }
+
+    T *top() const
+    {
+        return heap.front();
+    }
+
+    void push(T *task)
+    {
+        task->heap_pos = static_cast<uint32_t>(heap.size());
+        heap.push_back(task);
+        sift_up(task->heap_pos);
+    }
+
+    T *pop()
+    {
+        T *task = heap.front();
+        remove(task);
+        return task;
+    }
+
+    // The task must be queued.
+    void remove(T *task)
+    {
+        uint32_t pos = task->heap_pos;
+        T *last = heap.back();
+
+        heap.pop_back();
+        task->heap_pos = NOT_QUEUED;
+
+        if (last == task)
+            return;
+
+        heap[pos] = last;
+        last->heap_pos = pos;
+
+        if (pos > 0 && before(last, heap[(pos - 1) / 2])) {
+            sift_up(pos);
+        } else {
+            sift_down(pos);
+        }
+    }
+
+private:
+    static uint32_t slot_of(uint64_t task_id)
+    {
+        return static_cast<uint32_t>(task_id & ((1ull << TASK_QUEUE_SLOT_BITS) - 1));
+    }
+
+    T *at(uint32_t slot) const
+    {
+        return &chunks[slot / TASK_QUEUE_CHUNK_SIZE][slot % TASK_QUEUE_CHUNK_SIZE];
+    }
+
+    // Tasks with the same deadline run in the order they were allocated.
+    static bool before(const T *a, const T *b)
+    {
+        if (a->next_deadline < b->next_deadline)
+            return true;
+
+        if (b->next_deadline < a->next_deadline)
+            return false;
+
+        return (a->task_id & ~(1ull << 63)) < (b->task_id & ~(1ull << 63));
+    }
+
+    void sift_up(uint32_t pos)
+    {
+        T *task = heap[pos];
+
+        while (pos > 0) {
+            uint32_t parent = (pos - 1) / 2;
+
+            if (!before(task, heap[parent]))
+                break;
+
+            heap[pos] = heap[parent];
+            heap[pos]->heap_pos = pos;
+            pos = parent;
+        }
+
+        heap[pos] = task;
+        task->heap_pos = pos;
+    }
+
+    void sift_down(uint32_t pos)
+    {
+        T *task = heap[pos];
+        uint32_t count = static_cast<uint32_t>(heap.size());
+
+        for (;;) {
+            uint32_t child = 2 * pos + 1;
+
+            if (child >= count)
+                break;
+
+            if (child + 1 < count && before(heap[child + 1], heap[child]))
+                ++child;
+
+            if (!before(heap[child], task))
+                break;
+
+            heap[pos] = heap[child];
+            heap[pos]->heap_pos = pos;
+            pos = child;
+        }
+
+        heap[pos] = task;
+        task->heap_pos = pos;
+    }
+
+    std::vector<T *> chunks;
+    std::vector<uint32_t> free_slots;
+    std::vector<T *> heap;
+    uint64_t last_sequence = 0;
+};
@@ -22,94 +22,96 @@
 #include "event_log_prefix.h"
 #include "module_dependencies.h"
 
-static uint64_t last_task_id = 0;
-
-Task::Task(std::function<void(void)> &&fn, uint64_t task_id, micros_t first_run_delay, micros_t delay, const char *file, uint_least32_t line, bool once) :
-        fn(std::move(fn)),
-        task_id(task_id),
-        next_deadline(now_us() + first_run_delay),
-        delay(delay),
-        awaited_by(nullptr),
-        file(file),
-        line(line),
-        once(once),
-        cancelled(false) {
+void Task::init(std::function<void(void)> &&fn, micros_t first_run_delay, micros_t delay, const char *file, uint_least32_t line, bool once)
+{
+    this->fn = std::move(fn);
+    this->next_deadline = now_us() + first_run_delay;
+    this->delay = delay;
+    this->awaited_by = nullptr;
+    this->file = file;
+    this->line = line;
+    this->once = once;
+    this->cancelled = false;
 }
 
-WallClockTask::WallClockTask(std::unique_ptr<Task> &&runner_task, uint64_t task_id, minutes_t interval_minutes, bool run_on_first_sync) :
-        runner_task(std::move(runner_task)),
+WallClockTask::WallClockTask(Task *runner_task, uint64_t task_id, minutes_t interval_minutes, bool run_on_first_sync) :
+        runner_task(runner_task),
         task_id(task_id),
         interval_minutes(interval_minutes),
         run_on_first_sync(run_on_first_sync) {
 
 }
 
-/*
-A Compare type providing a strict weak ordering.
-
-Note that the Compare parameter is defined such that it returns true
-if its first argument comes before its second argument in a weak ordering.
-But because the priority queue outputs largest elements first,
-the elements that "come before" are actually output last.
-That is, the front of the queue contains the "last" element
-according to the weak ordering imposed by Compare.
-(https://en.cppreference.com/w/cpp/container/priority_queue)
-*/
-bool compare(const std::unique_ptr<Task> &a, const std::unique_ptr<Task> &b)
+void TaskScheduler::pre_reboot()
 {
-    return a->next_deadline >= b->next_deadline;
+    rebooting = true;
 }
 
-// https://stackoverflow.com/a/36711682
-bool TaskQueue::removeByTaskID(uint64_t task_id)
-{
-    // The queue is locked if this function is called.
+COREDUMP_RTC_DATA_ATTR const char *task_fn_file;
+COREDUMP_RTC_DATA_ATTR uint_least32_t task_fn_line;
 
-    if (task_id == 0)
-        return false;
+void TaskScheduler::pre_init()
+{
+    wake_semaphore = xSemaphoreCreateBinaryStatic(&wake_semaphore_buf);
+}
 
-    auto it = std::find_if(this->c.begin(), this->c.end(), [task_id](const std::unique_ptr<Task> &t){return t->task_id == task_id;});
+void TaskScheduler::custom_loop()
+{
+    // Only run tasks that were due when the loop started.
+    // A task that reschedules itself without delay would otherwise never let the loop finish.
+    micros_t loop_start = now_us();
 
-    if (it == this->c.end()) {
-        // not found
-        return false;
+    if (!this->runDueTask(loop_start)) {
+#if MODULE_DEBUG_AVAILABLE()
+        debug.task_scheduler_idle_call();
+#endif
+        return;
     }
 
-    if (it == this->c.begin()) {
-        this->pop();
-        return true;
+    while (this->runDueTask(loop_start)) {
     }
-
-    // remove element and re-heap
-    this->c.erase(it);
-    std::make_heap(this->c.begin(), this->c.end(), this->comp);
-    return true;
 }
 
-Task *TaskQueue::findByTaskID(uint64_t task_id)
+micros_t TaskScheduler::waitForWork(micros_t max_sleep)
 {
-    if (task_id == 0)
-        return nullptr;
+    micros_t sleep = max_sleep;
 
-    auto it = std::find_if(this->c.begin(), this->c.end(), [task_id](const std::unique_ptr<Task> &t){return t->task_id == task_id;});
+    {
+        std::lock_guard<std::mutex> lock{this->task_mutex};
+        if (!tasks.empty()) {
+            micros_t until_deadline = tasks.top()->next_deadline - now_us();
 
-    if (it == this->c.end()) {
-        // not found
-        return nullptr;
+            if (until_deadline < sleep)
+                sleep = until_deadline;
+        }
     }
 
-    return it->get();
+    int64_t sleep_us = sleep.as<int64_t>();
+
+    if (sleep_us <= 0)
+        return 0_us;
+
+    // Rounded down: Waking up early only costs one more loop iteration.
+    TickType_t ticks = pdMS_TO_TICKS(static_cast<uint32_t>(sleep_us / 1000));
+
+    if (ticks == 0)
+        return 0_us;
+
+    micros_t start = now_us();
+    xSemaphoreTake(wake_semaphore, ticks);
+    return now_us() - start;
 }
 
-void TaskScheduler::pre_reboot()
+// Must be called with the task_mutex locked.
+void TaskScheduler::wakeMainLoop()
 {
-    rebooting = true;
+    if (wake_semaphore != nullptr && !running_in_main_task()) {
+        xSemaphoreGive(wake_semaphore);
+    }
 }
 
-COREDUMP_RTC_DATA_ATTR const char *task_fn_file;
-COREDUMP_RTC_DATA_ATTR uint_least32_t task_fn_line;
-
-void TaskScheduler::custom_loop()
+// Returns false if no task was due at now.
+bool TaskScheduler::runDueTask(micros_t now)
 {
     // We can't use defer to clean up currentTask on function level,
     // because we have to make sure currentTask is only written
@@ -117,26 +119,21 @@ void TaskScheduler::custom_loop()
 
     {
         std::lock_guard<std::mutex> lock{this->task_mutex};
-        if (!tasks.empty() && deadline_elapsed(tasks.top()->next_deadline)) {
-            this->currentTask = tasks.top_and_pop();
+        if (tasks.empty() || now < tasks.top()->next_deadline)
+            return false;
 
-            if (this->currentTask->cancelled) {
-                if (this->currentTask->awaited_by != nullptr) {
-                    xTaskNotifyGive(this->currentTask->awaited_by);
-                    this->currentTask->awaited_by = nullptr;
-                }
+        this->currentTask = tasks.pop();
 
-                this->currentTask = nullptr;
-                return;
+        if (this->currentTask->cancelled) {
+            if (this->currentTask->awaited_by != nullptr) {
+                xTaskNotifyGive(this->currentTask->awaited_by);
+                this->currentTask->awaited_by = nullptr;
             }
-        }
-    }
 
-    if (!this->currentTask) {
-#if MODULE_DEBUG_AVAILABLE()
-        debug.task_scheduler_idle_call();
-#endif
-        return;
+            this->releaseTask(this->currentTask);
+            this->currentTask = nullptr;
+            return true;
+        }
     }
 
     task_fn_file = this->currentTask->file;
@@ -148,6 +145,10 @@ void TaskScheduler::custom_loop()
         // but also allows other threads to schedule tasks while one is executed.
         if (!this->currentTask->fn) {
             logger.printfln("Invalid task");
+        } else if (this->profiling_enabled) {
+            micros_t start = now_us();
+            this->currentTask->fn();
+            this->profileTask(this->currentTask, start, now_us());
         } else {
             this->currentTask->fn();
         }
@@ -163,43 +164,143 @@ void TaskScheduler::custom_loop()
         }
 
         if (this->currentTask->once) {
-            if (!IS_WALL_CLOCK_TASK_ID(this->currentTask->task_id))
-                return;
-
-            for (auto &wall_clock_task : this->wall_clock_tasks) {
-                if (wall_clock_task.task_id != this->currentTask->task_id)
-                    continue;
-                wall_clock_task.runner_task = std::move(this->currentTask);
-                return;
+            if (IS_WALL_CLOCK_TASK_ID(this->currentTask->task_id)) {
+                for (auto &wall_clock_task : this->wall_clock_tasks) {
+                    // The runner task stays allocated until the WallClockTask is cancelled.
+                    if (wall_clock_task.task_id == this->currentTask->task_id)
+                        return true;
+                }
             }
-            return;
+
+            this->releaseTask(this->currentTask);
+            return true;
         }
 
         // Check whether a repeated task was cancelled while it was being executed.
         if (this->currentTask->cancelled) {
-            return;
+            this->releaseTask(this->currentTask);
+            return true;
         }
 
         this->currentTask->next_deadline = now_us() + this->currentTask->delay;
 
-        tasks.push(std::move(this->currentTask));
+        tasks.push(this->currentTask);
     }
+
+    return true;
+}
+
+#define TASK_PROFILE_INDEX_SIZE (TASK_PROFILE_MAX_COUNT * 2)
+#define TASK_PROFILE_INDEX_EMPTY UINT16_MAX
+
+void TaskScheduler::setProfilingEnabled(bool enabled)
+{
+    if (enabled && !profiling_enabled) {
+        profiles.clear();
+        profiles.reserve(TASK_PROFILE_MAX_COUNT);
+        profile_index.assign(TASK_PROFILE_INDEX_SIZE, TASK_PROFILE_INDEX_EMPTY);
+    }
+
+    profiling_enabled = enabled;
+}
+
+void TaskScheduler::profileTask(const Task *task, micros_t start, micros_t end)
+{
+    size_t slot = ((reinterpret_cast<uintptr_t>(task->file) >> 2) ^ (task->line * 2654435761u)) % TASK_PROFILE_INDEX_SIZE;
+    TaskProfile *profile = nullptr;
+
+    for (size_t probes = 0; probes < TASK_PROFILE_INDEX_SIZE; ++probes) {
+        uint16_t idx = profile_index[slot];
+
+        if (idx == TASK_PROFILE_INDEX_EMPTY) {
+            if (profiles.size() >= TASK_PROFILE_MAX_COUNT)
+                return;
+
+            profile_index[slot] = static_cast<uint16_t>(profiles.size());
+            profile = &profiles.emplace_back();
+            profile->file = task->file;
+            profile->line = task->line;
+            break;
+        }
+
+        if (profiles[idx].file == task->file && profiles[idx].line == task->line) {
+            profile = &profiles[idx];
+            break;
+        }
+
+        slot = (slot + 1) % TASK_PROFILE_INDEX_SIZE;
+    }
+
+    if (profile == nullptr)
+        return;
+
+    uint32_t runtime_us = (end - start).as<uint32_t>();
+
+    ++profile->runs;
+    profile->runtime_total_us += runtime_us;
+    if (runtime_us > profile->runtime_max_us)
+        profile->runtime_max_us = runtime_us;
+
+    int64_t late_us = (start - task->next_deadline).as<int64_t>();
+    int64_t bucket_limit_us = 1000;
+    size_t bucket = 0;
+
+    while (bucket < TASK_PROFILE_LATENESS_BUCKETS - 1 && late_us >= bucket_limit_us) {
+        ++bucket;
+        bucket_limit_us *= 4;
+    }
+
+    ++profile->lateness[bucket];
+}
+
+// The task_mutex must be locked.
+void TaskScheduler::releaseTask(Task *task)
+{
+    // Free the captures now instead of when the slot is reused.
+    task->fn = nullptr;
+    tasks.release(task);
+}
+
+// The task_mutex must be locked.
+Task *TaskScheduler::findActiveTask(uint64_t task_id)
+{
+    Task *task = tasks.find(task_id);
+
+    if (task == nullptr || (!TaskQueue<Task>::is_queued(task) && task != this->currentTask))
+        return nullptr;
+
+    return task;
+}
+
+uint64_t TaskScheduler::scheduleTask(std::function<void(void)> &&fn, uint64_t id_flags, micros_t first_run_delay, micros_t delay, const std::source_location &src_location, bool once, bool enqueue)
+{
+    // The task_mutex is locked by the caller.
+    Task *task = tasks.alloc(id_flags);
+    if (task == nullptr) {
+        logger.printfln("Too many tasks. Can't schedule task from %s:%lu", src_location.file_name(), static_cast<unsigned long>(src_location.line()));
+        return 0;
+    }
+
+    task->init(std::move(fn), first_run_delay, delay, src_location.file_name(), src_location.line(), once);
+
+    if (enqueue) {
+        tasks.push(task);
+        this->wakeMainLoop();
+    }
+
+    return task->task_id;
 }
 
 uint64_t TaskScheduler::scheduleOnce(std::function<void(void)> &&fn, millis_t delay_ms, const std::source_location &src_location)
 {
     std::lock_guard<std::mutex> lock{this->task_mutex};
-    uint64_t task_id = ++last_task_id;
-    tasks.emplace(new Task(std::move(fn), task_id, delay_ms, 0_us, src_location.file_name(), src_location.line(), true));
-    return task_id;
+    return scheduleTask(std::move(fn), 0, delay_ms, 0_us, src_location, true, true);
 }
 
 uint64_t TaskScheduler::scheduleWithFixedDelay(std::function<void(void)> &&fn, millis_t first_delay_ms, millis_t delay_ms, const std::source_location &src_location)
 {
     std::lock_guard<std::mutex> lock{this->task_mutex};
-    uint64_t task_id = ++last_task_id;
-    tasks.emplace(new Task(std::move(fn), task_id, first_delay_ms, delay_ms, src_location.file_name(), src_location.line(), false));
-    return task_id;
+    return scheduleTask(std::move(fn), 0, first_delay_ms, delay_ms, src_location, false, true);
 }
 
 uint64_t TaskScheduler::scheduleWhenClockSynced(std::function<void(void)> &&fn, const std::source_location &src_location)
@@ -229,10 +330,11 @@ uint64_t TaskScheduler::scheduleWallClock(std::function<void(void)> &&fn, minute
     uint64_t task_id;
     {
         std::lock_guard<std::mutex> lock{this->task_mutex};
-        task_id = ++last_task_id | (1ull << 63ull);
-        auto runner_task = std::unique_ptr<Task>(new Task(std::move(fn), task_id, 0_us, execution_delay_ms, src_location.file_name(), src_location.line(), true));
+        task_id = scheduleTask(std::move(fn), 1ull << 63ull, 0_us, execution_delay_ms, src_location, true, false);
+        if (task_id == 0)
+            return 0;
 
-        wall_clock_tasks.emplace_back(std::move(runner_task), task_id, interval_minutes, run_on_first_sync);
+        wall_clock_tasks.emplace_back(tasks.find(task_id), task_id, interval_minutes, run_on_first_sync);
     }
 
     if (!wall_clock_worker_started) {
@@ -250,25 +352,36 @@ TaskScheduler::CancelResult TaskScheduler::cancel(uint64_t task_id)
 
     std::lock_guard<std::mutex> lock{this->task_mutex};
     if (IS_WALL_CLOCK_TASK_ID(task_id)) {
-        size_t i = 0;
-        bool task_scheduled = false;
-        for (; i < wall_clock_tasks.size(); ++i) {
+        for (size_t i = 0; i < wall_clock_tasks.size(); ++i) {
             if (wall_clock_tasks[i].task_id != task_id)
                 continue;
-            task_scheduled = !(bool)(wall_clock_tasks[i].runner_task);
+
+            Task *runner_task = wall_clock_tasks[i].runner_task;
+            wall_clock_tasks.erase(wall_clock_tasks.begin() + i);
+
+            // Not scheduled: Only the WallClockTask held the runner task.
+            if (!TaskQueue<Task>::is_queued(runner_task) && runner_task != this->currentTask) {
+                this->releaseTask(runner_task);
+                return TaskScheduler::CancelResult::Cancelled;
+            }
+
             break;
         }
-        wall_clock_tasks.erase(wall_clock_tasks.begin() + i);
-        if (!task_scheduled)
-            return TaskScheduler::CancelResult::Cancelled;
     }
 
-    if (this->currentTask && this->currentTask->task_id == task_id) {
+    Task *task = this->findActiveTask(task_id);
+
+    if (task == nullptr)
+        return TaskScheduler::CancelResult::NotFound;
+
+    if (task == this->currentTask) {
         this->currentTask->cancelled = true;
         return TaskScheduler::CancelResult::WillBeCancelled;
     }
-    else
-        return tasks.removeByTaskID(task_id) ? TaskScheduler::CancelResult::Cancelled : TaskScheduler::CancelResult::NotFound;
+
+    tasks.remove(task);
+    this->releaseTask(task);
+    return TaskScheduler::CancelResult::Cancelled;
 }
 
 uint64_t TaskScheduler::currentTaskId()
@@ -315,12 +428,7 @@ TaskScheduler::AwaitResult TaskScheduler::await(uint64_t task_id, millis_t milli
         // - is currently running, i.e. not in the queue but in this->currentTask
         // - or was already executed, canceled or not yet created,
         //   i.e. not in the queue and not in this->currentTask
-        Task *task = nullptr;
-
-        if (this->currentTask != nullptr && this->currentTask->task_id == task_id)
-            task = this->currentTask.get();
-        else
-            task = tasks.findByTaskID(task_id);
+        Task *task = this->findActiveTask(task_id);
 
         if (task == nullptr)
             return TaskScheduler::AwaitResult::Done;
@@ -384,14 +492,14 @@ void TaskScheduler::wall_clock_worker() {
         if (last_minute != -1 && (minutes_since_midnight % task.interval_minutes) != 0_min)
             continue;
 
-        if(!task.runner_task) {
-            logger.printfln("Attempted to schedule WallClockTask execution but runner_task is invalid. Is this task still enqueued?");
+        if (TaskQueue<Task>::is_queued(task.runner_task) || task.runner_task == this->currentTask) {
+            logger.printfln("Attempted to schedule WallClockTask execution but runner_task is still enqueued or running.");
             logger.printfln("    task_id=%llu interval_minutes=%lu run_on_first_sync=%d", task.task_id, task.interval_minutes.as<uint32_t>(), task.run_on_first_sync);
             continue;
         }
 
         task.runner_task->next_deadline = now + task.runner_task->delay;
-        tasks.emplace(std::move(task.runner_task));
+        tasks.push(task.runner_task);
     }
 
     last_minute = time_struct.tm_min;
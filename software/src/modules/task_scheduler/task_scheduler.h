@@ -20,36 +20,56 @@
 #pragma once
 
 #include <vector>
-#include <queue>
 #include <functional>
 #include <mutex>
 #include <source_location>
 #include <time.h>
 #include <iostream>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 #include "module.h"
 #include "tools.h"
+#include "task_queue.h"
 
+// Tasks live in the pool of the TaskQueue. A task is only destroyed when its slot is reused.
 struct Task {
+    // Lambdas that capture at most a pointer are stored inside the std::function without a heap allocation.
     std::function<void(void)> fn;
-    uint64_t task_id;
+    uint64_t task_id = 0;
     micros_t next_deadline;
     micros_t delay;
     TaskHandle_t awaited_by;
     const char *file;
     uint_least32_t line;
+    // Maintained by the TaskQueue.
+    uint32_t heap_pos;
     bool once;
     bool cancelled;
 
-    Task(std::function<void(void)> &&fn, uint64_t task_id, micros_t first_run_delay, micros_t delay, const char *file, uint_least32_t line, bool once);
+    void init(std::function<void(void)> &&fn, micros_t first_run_delay, micros_t delay, const char *file, uint_least32_t line, bool once);
 };
 
 #define IS_WALL_CLOCK_TASK_ID(task_id) (task_id & (1ull << 63))
 
+#define TASK_PROFILE_MAX_COUNT 256
+#define TASK_PROFILE_LATENESS_BUCKETS 8
+
+// Runtime of all tasks scheduled from one source location.
+struct TaskProfile {
+    const char *file;
+    uint_least32_t line;
+    uint32_t runs;
+    uint32_t runtime_max_us;
+    uint64_t runtime_total_us;
+    // Bucket i counts runs that started less than 4^i ms after their deadline. The last bucket counts all later runs.
+    uint32_t lateness[TASK_PROFILE_LATENESS_BUCKETS];
+};
+
 struct WallClockTask {
-    // Is moved into the task queue to execute the WallClockTask.
-    std::unique_ptr<Task> runner_task;
-    // This is the runner_task's ID; duplicated to match currentTask against the WallClockTask IDs when moving the task back.
+    // Stays allocated while the WallClockTask exists. Is pushed into the task queue to execute the WallClockTask.
+    Task *runner_task;
+    // This is the runner_task's ID; duplicated to match currentTask against the WallClockTask IDs.
     // All WallClockTask IDs have the highest bit set.
     uint64_t task_id;
 
@@ -59,36 +79,22 @@ struct WallClockTask {
     // Additionally run this task when the system clock is synced for the first time.
     bool run_on_first_sync;
 
-    WallClockTask(std::unique_ptr<Task> &&runner_task, uint64_t task_id, minutes_t interval_minutes, bool run_on_first_sync);
-};
-
-bool compare(const std::unique_ptr<Task> &a, const std::unique_ptr<Task> &b);
-
-class TaskQueue : public std::priority_queue<std::unique_ptr<Task>, std::vector<std::unique_ptr<Task>>, decltype(&compare)>
-{
-    using std::priority_queue<std::unique_ptr<Task>, std::vector<std::unique_ptr<Task>>, decltype(&compare)>::priority_queue;
-
-public:
-    bool removeByTaskID(uint64_t task_id);
-    Task *findByTaskID(uint64_t task_id);
-
-    std::unique_ptr<Task> top_and_pop()
-    {
-        std::pop_heap(c.begin(), c.end(), comp);
-        std::unique_ptr<Task> value = std::move(c.back());
-        c.pop_back();
-        return value;
-    }
+    WallClockTask(Task *runner_task, uint64_t task_id, minutes_t interval_minutes, bool run_on_first_sync);
 };
 
 class TaskScheduler final : public IModule
 {
 public:
-    TaskScheduler() : tasks(&compare) {}
+    TaskScheduler() {}
 
+    void pre_init() override;
     void pre_reboot() override;
 
+    // Runs all tasks that are due.
     void custom_loop();
+    // Blocks the main thread until the next task is due, another thread schedules a task or max_sleep elapsed.
+    // Returns the time spent blocking.
+    micros_t waitForWork(micros_t max_sleep);
     uint64_t currentTaskId();
 
     enum class CancelResult {
@@ -132,18 +138,41 @@ public:
 
     AwaitResult await(std::function<void(void)> &&fn, millis_t millis_to_wait = 10_s, const std::source_location &src_location = std::source_location::current());
 
+    // Task profiling. Only call these in the main thread.
+    // Enabling the profiler discards the previous profiles. Disabling it keeps them.
+    void setProfilingEnabled(bool enabled);
+    bool isProfilingEnabled() const {return profiling_enabled;}
+    const std::vector<TaskProfile> &getProfiles() const {return profiles;}
+
 private:
     AwaitResult await(uint64_t task_id, millis_t millis_to_wait = 10_s);
 
+    uint64_t scheduleTask(std::function<void(void)> &&fn, uint64_t id_flags, micros_t first_run_delay, micros_t delay, const std::source_location &src_location, bool once, bool enqueue);
+    void releaseTask(Task *task);
+    // Returns the queued or running task with this ID or nullptr.
+    Task *findActiveTask(uint64_t task_id);
+    bool runDueTask(micros_t now);
+    void wakeMainLoop();
+
     std::mutex task_mutex;
-    TaskQueue tasks;
-    std::unique_ptr<Task> currentTask = nullptr;
+    TaskQueue<Task> tasks;
+    Task *currentTask = nullptr;
+
+    StaticSemaphore_t wake_semaphore_buf;
+    SemaphoreHandle_t wake_semaphore = nullptr;
 
     std::vector<WallClockTask> wall_clock_tasks;
     bool wall_clock_worker_started = false;
 
     bool rebooting = false;
 
+    void profileTask(const Task *task, micros_t start, micros_t end);
+
+    bool profiling_enabled = false;
+    std::vector<TaskProfile> profiles;
+    // Open addressing hash table of indices into profiles, keyed by file and line.
+    std::vector<uint16_t> profile_index;
+
     void wall_clock_worker();
     void run_wall_clock_task(uint64_t task_id);
 };
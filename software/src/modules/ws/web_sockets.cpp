@@ -33,88 +33,259 @@ static constexpr micros_t WORKER_WATCHDOG_TIMEOUT = 5_min;
 static int watchdog_handle = -1;
 #endif
 
-void clear_ws_work_item(ws_work_item *wi)
+bool WebSockets::haveWork(int *fd, ws_queued_item *item)
 {
-    free(wi->payload);
-    wi->payload = nullptr;
+    std::lock_guard<std::recursive_mutex> lock{work_queue_mutex};
+
+    // Round-robin over the clients, so that one client with a long queue does not delay the others.
+    for (size_t i = 0; i < MAX_WEB_SOCKET_CLIENTS; ++i) {
+        WebSocketsClientQueue *queue = &client_queues[(next_client_queue + i) % MAX_WEB_SOCKET_CLIENTS];
+
+        if (queue->count == 0)
+            continue;
+
+        *fd = queue->fd;
+        *item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % MAX_WEB_SOCKET_WORK_ITEMS_IN_QUEUE;
+        --queue->count;
+
+        next_client_queue = (next_client_queue + i + 1) % MAX_WEB_SOCKET_CLIENTS;
+        return true;
+    }
+
+    return false;
 }
 
-bool WebSockets::haveWork(ws_work_item *item)
+bool WebSockets::haveQueuedWork()
 {
     std::lock_guard<std::recursive_mutex> lock{work_queue_mutex};
 
-    if (work_queue.empty())
-        return false;
+    for (const WebSocketsClientQueue &queue : client_queues) {
+        if (queue.count != 0 || queue.resync_pending)
+            return true;
+    }
 
-    *item = work_queue.front();
-    work_queue.pop_front();
-    return true;
+    return false;
 }
 
-void WebSockets::cleanUpQueue()
+void WebSockets::releasePayload(ws_payload *payload)
 {
     std::lock_guard<std::recursive_mutex> lock{work_queue_mutex};
-    while (!work_queue.empty()) {
-        ws_work_item *wi = &work_queue.front();
-        for (int i = 0; i < MAX_WEB_SOCKET_CLIENTS; ++i) {
-            if (wi->fds[i] != -1) {
-                return;
+
+    if (--payload->refs != 0)
+        return;
+
+    switch (payload->storage) {
+        case ws_payload::Storage::Owned:
+            free(payload->data);
+            delete payload;
+            break;
+
+        case ws_payload::Storage::Inline:
+            free(payload);
+            break;
+
+        case ws_payload::Storage::Pooled:
+            payload_pool[payload_pool_free++] = payload;
+            break;
+    }
+}
+
+ws_payload *WebSockets::allocPayload(size_t capacity)
+{
+    // Binary frames store floats directly after the struct.
+    static_assert(sizeof(ws_payload) % alignof(float) == 0);
+
+    if (capacity < WEBSOCKET_PAYLOAD_POOL_BUFFER_SIZE) {
+        std::lock_guard<std::recursive_mutex> lock{work_queue_mutex};
+        ws_payload *payload = nullptr;
+
+        if (payload_pool_free > 0) {
+            payload = payload_pool[--payload_pool_free];
+        } else if (payload_pool_allocated < WEBSOCKET_PAYLOAD_POOL_SIZE) {
+            payload = static_cast<ws_payload *>(malloc(sizeof(ws_payload) + WEBSOCKET_PAYLOAD_POOL_BUFFER_SIZE));
+            if (payload != nullptr) {
+                ++payload_pool_allocated;
             }
         }
-        clear_ws_work_item(wi);
-        // Every fd was -1.
-        work_queue.pop_front();
+
+        if (payload != nullptr) {
+            *payload = {reinterpret_cast<char *>(payload + 1), 0, HTTPD_WS_TYPE_TEXT, 1, ws_payload::Storage::Pooled};
+            return payload;
+        }
+    }
+
+    // Pool exhausted or payload too large.
+    ws_payload *payload = static_cast<ws_payload *>(malloc(sizeof(ws_payload) + capacity + 1));
+    if (payload == nullptr) {
+        return nullptr;
     }
+
+    *payload = {reinterpret_cast<char *>(payload + 1), 0, HTTPD_WS_TYPE_TEXT, 1, ws_payload::Storage::Inline};
+    return payload;
 }
 
-bool WebSockets::queueFull()
+void WebSockets::clearClientQueue(WebSocketsClientQueue *queue)
 {
     std::lock_guard<std::recursive_mutex> lock{work_queue_mutex};
-    if (work_queue.size() < MAX_WEB_SOCKET_WORK_ITEMS_IN_QUEUE) {
-        return false;
+
+    for (size_t i = 0; i < queue->count; ++i) {
+        releasePayload(queue->items[(queue->head + i) % MAX_WEB_SOCKET_WORK_ITEMS_IN_QUEUE].payload);
     }
 
-    cleanUpQueue();
+    queue->head = 0;
+    queue->count = 0;
+}
 
-    if (work_queue.size() >= MAX_WEB_SOCKET_WORK_ITEMS_IN_QUEUE) {
-        return true;
+// Takes ownership of payload. Returns false only if the payload could not be enqueued because of an allocation failure.
+bool WebSockets::enqueue(const int fds[MAX_WEB_SOCKET_CLIENTS], char *payload, size_t payload_len, httpd_ws_type_t ws_type, int32_t coalesce_key)
+{
+    ws_payload *shared = new(std::nothrow) ws_payload{payload, payload_len, ws_type, 1, ws_payload::Storage::Owned};
+    if (shared == nullptr) {
+        free(payload);
+        return false;
     }
-    // Print only to the console because printing to the event log
-    // would generate more websocket messages to fill up the queue.
-    printf("web_sockets: Work queue was full but %u items were cleaned.\n", MAX_WEB_SOCKET_WORK_ITEMS_IN_QUEUE - work_queue.size());
 
-    return false;
+    enqueuePayload(fds, shared, coalesce_key);
+    return true;
 }
 
-static bool send_ws_work_item(WebSockets *ws, ws_work_item wi)
+// Takes the caller's reference to shared.
+void WebSockets::enqueuePayload(const int fds[MAX_WEB_SOCKET_CLIENTS], ws_payload *shared, int32_t coalesce_key, ws_payload_merge_fn merge)
 {
-    httpd_ws_frame_t ws_pkt;
-    memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
+    std::lock_guard<std::recursive_mutex> lock{work_queue_mutex};
 
-    ws_pkt.payload = (uint8_t *)wi.payload;
-    ws_pkt.len = wi.payload_len;
-    ws_pkt.type = wi.payload_len == 0 ? HTTPD_WS_TYPE_PING : wi.ws_type;
+    // Clients that have the same payload queued share the merged payload.
+    const ws_payload *merged_from[MAX_WEB_SOCKET_CLIENTS];
+    ws_payload *merged[MAX_WEB_SOCKET_CLIENTS];
+    size_t merged_count = 0;
 
-    bool result = true;
+    for (size_t i = 0; i < MAX_WEB_SOCKET_CLIENTS; ++i) {
+        if (fds[i] == -1)
+            continue;
 
-    struct httpd_data *hd = (struct httpd_data *)ws->httpd;
+        // Look up by fd: The keep alive slot could have been reused since fds was copied.
+        WebSocketsClientQueue *queue = nullptr;
+        for (WebSocketsClientQueue &q : client_queues) {
+            if (q.fd == fds[i]) {
+                queue = &q;
+                break;
+            }
+        }
 
-    for (int i = 0; i < MAX_WEB_SOCKET_CLIENTS; ++i) {
-        if (wi.fds[i] == -1) {
+        // Closed or waiting for the full state anyway.
+        if (queue == nullptr || queue->resync_pending)
             continue;
+
+        bool coalesced = false;
+
+        if (coalesce_key != WEBSOCKET_COALESCE_KEY_NONE) {
+            for (size_t j = 0; j < queue->count; ++j) {
+                ws_queued_item &queued = queue->items[(queue->head + j) % MAX_WEB_SOCKET_WORK_ITEMS_IN_QUEUE];
+
+                if (queued.coalesce_key != coalesce_key)
+                    continue;
+
+                ws_payload *replacement = shared;
+
+                if (merge != nullptr) {
+                    replacement = nullptr;
+
+                    for (size_t k = 0; k < merged_count; ++k) {
+                        if (merged_from[k] == queued.payload) {
+                            replacement = merged[k];
+                            break;
+                        }
+                    }
+
+                    if (replacement == nullptr) {
+                        replacement = merge(this, queued.payload, shared);
+
+                        if (replacement == nullptr)
+                            break;
+
+                        merged_from[merged_count] = queued.payload;
+                        merged[merged_count] = replacement;
+                        ++merged_count;
+                    }
+                }
+
+                // Replace in place: The newer or merged payload supersedes the queued one.
+                releasePayload(queued.payload);
+                queued.payload = replacement;
+                ++replacement->refs;
+                coalesced = true;
+                break;
+            }
         }
 
-        if (httpd_ws_get_fd_info(hd, wi.fds[i]) != HTTPD_WS_CLIENT_WEBSOCKET) {
+        if (coalesced)
             continue;
-        }
 
-        if (httpd_ws_send_frame_async(hd, wi.fds[i], &ws_pkt) != ESP_OK) {
-            ws->keepAliveCloseDead(wi.fds[i]);
-            result = false;
+        if (queue->count >= MAX_WEB_SOCKET_WORK_ITEMS_IN_QUEUE) {
+            // This client does not keep up. Drop only its queue and send it the full state when the worker runs next.
+            queue->dropped += queue->count + 1;
+            clearClientQueue(queue);
+            queue->resync_pending = true;
+            continue;
         }
+
+        queue->items[(queue->head + queue->count) % MAX_WEB_SOCKET_WORK_ITEMS_IN_QUEUE] = {shared, coalesce_key};
+        ++queue->count;
+        ++shared->refs;
     }
 
-    return result;
+    // Drop the references held while enqueueing. This frees the payloads if no queue took them.
+    for (size_t k = 0; k < merged_count; ++k) {
+        releasePayload(merged[k]);
+    }
+
+    releasePayload(shared);
+}
+
+static bool send_ws_frame(WebSockets *ws, int fd, char *payload, size_t payload_len, httpd_ws_type_t ws_type)
+{
+    httpd_ws_frame_t ws_pkt;
+    memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
+
+    ws_pkt.payload = (uint8_t *)payload;
+    ws_pkt.len = payload_len;
+    ws_pkt.type = payload_len == 0 ? HTTPD_WS_TYPE_PING : ws_type;
+
+    struct httpd_data *hd = (struct httpd_data *)ws->httpd;
+
+    if (httpd_ws_get_fd_info(hd, fd) != HTTPD_WS_CLIENT_WEBSOCKET) {
+        return true;
+    }
+
+    if (httpd_ws_send_frame_async(hd, fd, &ws_pkt) != ESP_OK) {
+        ws->keepAliveCloseDead(fd);
+        return false;
+    }
+
+    return true;
+}
+
+// Sends the full state to clients whose queue overflowed. Runs in the HTTP thread.
+void WebSockets::resyncClients()
+{
+    for (size_t i = 0; i < MAX_WEB_SOCKET_CLIENTS; ++i) {
+        int fd;
+        {
+            std::lock_guard<std::recursive_mutex> lock{work_queue_mutex};
+            WebSocketsClientQueue *queue = &client_queues[i];
+
+            if (!queue->resync_pending)
+                continue;
+
+            queue->resync_pending = false;
+            fd = queue->fd;
+        }
+
+        if (fd != -1 && on_client_connect_fn) {
+            on_client_connect_fn(WebSocketsClient{fd, this});
+        }
+    }
 }
 
 static void work(void *arg)
@@ -122,12 +293,15 @@ static void work(void *arg)
     WebSockets *ws = (WebSockets *)arg;
     ws->worker_active = WEBSOCKET_WORKER_RUNNING;
 
-    ws_work_item wi;
-    while (ws->haveWork(&wi)) {
-        send_ws_work_item(ws, wi);
-        clear_ws_work_item(&wi);
+    int fd;
+    ws_queued_item item;
+    while (ws->haveWork(&fd, &item)) {
+        send_ws_frame(ws, fd, item.payload->data, item.payload->len, item.payload->ws_type);
+        ws->releasePayload(item.payload);
     }
 
+    ws->resyncClients();
+
     ws->worker_active = WEBSOCKET_WORKER_DONE;
 #if MODULE_WATCHDOG_AVAILABLE()
     watchdog.reset(watchdog_handle);
@@ -154,8 +328,30 @@ static esp_err_t ws_handler(httpd_req_t *req)
                 ws->closeLRUClient();
             }
 
+            uint8_t features = 0;
+
+            if (ws->supported_subprotocol != nullptr) {
+                char protocols[64];
+                if (httpd_req_get_hdr_value_str(req, "Sec-WebSocket-Protocol", protocols, sizeof(protocols)) == ESP_OK) {
+                    size_t supported_len = strlen(ws->supported_subprotocol);
+
+                    // The header is a comma separated list of protocols.
+                    for (char *p = protocols; *p != '\0'; ) {
+                        p += strspn(p, " ,");
+                        size_t token_len = strcspn(p, " ,");
+
+                        if (token_len == supported_len && memcmp(p, ws->supported_subprotocol, token_len) == 0) {
+                            features |= WEBSOCKET_FEATURE_SUBPROTOCOL;
+                            break;
+                        }
+
+                        p += token_len;
+                    }
+                }
+            }
+
             struct httpd_data *hd = (struct httpd_data *)ws->httpd;
-            esp_err_t ret = httpd_ws_respond_server_handshake(&hd->hd_req, nullptr);
+            esp_err_t ret = httpd_ws_respond_server_handshake(&hd->hd_req, ws->supported_subprotocol);
             if (ret != ESP_OK) {
                 return ret;
             }
@@ -167,6 +363,14 @@ static esp_err_t ws_handler(httpd_req_t *req)
 
             int sock = httpd_req_to_sockfd(req);
 
+            char query[16];
+            char value[4];
+            if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK
+             && httpd_query_key_value(query, "delta", value, sizeof(value)) == ESP_OK
+             && strcmp(value, "1") == 0) {
+                features |= WEBSOCKET_FEATURE_DELTA_UPDATES;
+            }
+
             if (ws->on_client_connect_fn) {
                 // call the client connect callback before adding the client to
                 // the keep alive list to ensure that the full state is send by the
@@ -175,7 +379,7 @@ static esp_err_t ws_handler(httpd_req_t *req)
                 ws->on_client_connect_fn(WebSocketsClient{sock, ws});
             }
 
-            ws->keepAliveAdd(sock);
+            ws->keepAliveAdd(sock, features);
         } else {
             request.send(200);
         }
@@ -219,6 +423,17 @@ static esp_err_t ws_handler(httpd_req_t *req)
         // If it was a PONG, update the keep-alive
         WebSockets *ws = (WebSockets *)req->user_ctx;
         ws->receivedPong(httpd_req_to_sockfd(req));
+    } else if (ws_pkt.type == HTTPD_WS_TYPE_TEXT && ws_pkt.len == 6 && memcmp(ws_pkt.payload, "resync", 6) == 0) {
+        // A delta updates client lost track of a state. Send a full snapshot again.
+        // Queued messages would be applied on top of the snapshot and are older than it.
+        WebSockets *ws = (WebSockets *)req->user_ctx;
+        int sock = httpd_req_to_sockfd(req);
+
+        ws->workQueueRemove(sock);
+
+        if (ws->on_client_connect_fn) {
+            ws->on_client_connect_fn(WebSocketsClient{sock, ws});
+        }
     } else if (ws_pkt.type == HTTPD_WS_TYPE_TEXT) {
         // If it was a TEXT message, print it
         logger.printfln("Ignoring received packet with message: \"%s\" (web sockets are unidirectional for now)", ws_pkt.payload);
@@ -237,25 +452,44 @@ static esp_err_t ws_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
-void WebSockets::keepAliveAdd(int fd)
+void WebSockets::keepAliveAdd(int fd, uint8_t features)
 {
-    std::lock_guard<std::recursive_mutex> lock{keep_alive_mutex};
-    for (int i = 0; i < MAX_WEB_SOCKET_CLIENTS; ++i) {
-        if (keep_alive_fds[i] == fd) {
-            // fd is already in the keep alive array. Only update last_pong to prevent instantly closing the new connection.
-            // This can happen if web sockets are opened and closed rapidly (so that LWIP "reuses" the fd) and we miss a close frame.
+    int slot = -1;
+
+    {
+        std::lock_guard<std::recursive_mutex> lock{keep_alive_mutex};
+        for (int i = 0; i < MAX_WEB_SOCKET_CLIENTS; ++i) {
+            if (keep_alive_fds[i] == fd) {
+                // fd is already in the keep alive array. Only update last_pong to prevent instantly closing the new connection.
+                // This can happen if web sockets are opened and closed rapidly (so that LWIP "reuses" the fd) and we miss a close frame.
+                keep_alive_last_pong[i] = now_us();
+                keep_alive_features[i] = features;
+                slot = i;
+                break;
+            }
+        }
+
+        for (int i = 0; slot == -1 && i < MAX_WEB_SOCKET_CLIENTS; ++i) {
+            if (keep_alive_fds[i] != -1)
+                continue;
+            keep_alive_fds[i] = fd;
             keep_alive_last_pong[i] = now_us();
-            return;
+            keep_alive_features[i] = features;
+            slot = i;
         }
     }
 
-    for (int i = 0; i < MAX_WEB_SOCKET_CLIENTS; ++i) {
-        if (keep_alive_fds[i] != -1)
-            continue;
-        keep_alive_fds[i] = fd;
-        keep_alive_last_pong[i] = now_us();
+    if (slot == -1)
         return;
-    }
+
+    // A new connection starts with an empty queue, even if the fd was reused.
+    std::lock_guard<std::recursive_mutex> lock{work_queue_mutex};
+    WebSocketsClientQueue *queue = &client_queues[slot];
+
+    clearClientQueue(queue);
+    queue->fd = fd;
+    queue->dropped = 0;
+    queue->resync_pending = false;
 }
 
 void WebSockets::keepAliveRemove(int fd)
@@ -267,16 +501,30 @@ void WebSockets::keepAliveRemove(int fd)
                 continue;
             keep_alive_fds[i] = -1;
             keep_alive_last_pong[i] = 0_us;
+            keep_alive_features[i] = 0;
             break;
         }
     }
 
     {
         std::lock_guard<std::recursive_mutex> lock{work_queue_mutex};
-        for (int i = 0; i < work_queue.size(); ++i)
-            for (int j = 0; j < MAX_WEB_SOCKET_CLIENTS; ++j)
-                if (work_queue[i].fds[j] == fd)
-                    work_queue[i].fds[j] = -1;
+        for (WebSocketsClientQueue &queue : client_queues) {
+            if (queue.fd != fd)
+                continue;
+            clearClientQueue(&queue);
+            queue.fd = -1;
+            queue.resync_pending = false;
+        }
+    }
+}
+
+// Drops everything queued for fd.
+void WebSockets::workQueueRemove(int fd)
+{
+    std::lock_guard<std::recursive_mutex> lock{work_queue_mutex};
+    for (WebSocketsClientQueue &queue : client_queues) {
+        if (queue.fd == fd)
+            clearClientQueue(&queue);
     }
 }
 
@@ -330,13 +578,7 @@ void WebSockets::pingActiveClients()
         memcpy(fds, keep_alive_fds, sizeof(fds));
     }
 
-    std::lock_guard<std::recursive_mutex> lock{work_queue_mutex};
-    if (queueFull()) {
-        return;
-    }
-
-    work_queue.push_back({{}, nullptr, 0, HTTPD_WS_TYPE_PING});
-    memcpy(work_queue.back().fds, fds, sizeof(fds));
+    enqueue(fds, nullptr, 0, HTTPD_WS_TYPE_PING, WEBSOCKET_COALESCE_KEY_PING);
 }
 
 void WebSockets::checkActiveClients()
@@ -391,9 +633,7 @@ void WebSockets::receivedPong(int fd)
 
 bool WebSocketsClient::sendOwnedNoFreeBlocking_HTTPThread(char *payload, size_t payload_len, httpd_ws_type_t ws_type)
 {
-    ws_work_item wi{{this->fd, -1, -1, -1, -1}, payload, payload_len, ws_type};
-    bool result = send_ws_work_item(ws, wi);
-    return result;
+    return send_ws_frame(ws, this->fd, payload, payload_len, ws_type);
 }
 
 void WebSocketsClient::close_HTTPThread()
@@ -407,20 +647,17 @@ bool WebSockets::sendToClient(const char *payload, size_t payload_len, int fd, h
     if (httpd_ws_get_fd_info(httpd, fd) != HTTPD_WS_CLIENT_WEBSOCKET)
         return true;
 
-    char *payload_copy = (char *)malloc(payload_len * sizeof(char));
+    ws_payload *payload_copy = allocPayload(payload_len);
     if (payload_copy == nullptr) {
         return false;
     }
 
-    memcpy(payload_copy, payload, payload_len);
+    memcpy(payload_copy->data, payload, payload_len);
+    payload_copy->len = payload_len;
+    payload_copy->ws_type = ws_type;
 
-    std::lock_guard<std::recursive_mutex> lock{work_queue_mutex};
-    if (queueFull()) {
-        free(payload_copy);
-        return false;
-    }
-
-    work_queue.push_back({{fd, -1, -1, -1, -1}, payload_copy, payload_len, ws_type});
+    const int fds[MAX_WEB_SOCKET_CLIENTS] = {fd, -1, -1, -1, -1};
+    enqueuePayload(fds, payload_copy, WEBSOCKET_COALESCE_KEY_NONE);
     return true;
 }
 
@@ -431,26 +668,34 @@ bool WebSockets::sendToClientOwned(char *payload, size_t payload_len, int fd, ht
         return true;
     }
 
-    std::lock_guard<std::recursive_mutex> lock{work_queue_mutex};
-    if (queueFull()) {
-        free(payload);
-        return false;
-    }
-
-    work_queue.push_back({{fd, -1, -1, -1, -1}, payload, payload_len, ws_type});
-    return true;
+    const int fds[MAX_WEB_SOCKET_CLIENTS] = {fd, -1, -1, -1, -1};
+    return enqueue(fds, payload, payload_len, ws_type, WEBSOCKET_COALESCE_KEY_NONE);
 }
 
-bool WebSockets::haveActiveClient()
+bool WebSockets::haveActiveClient(uint8_t feature_mask, uint8_t feature_value)
 {
     std::lock_guard<std::recursive_mutex> lock{keep_alive_mutex};
     for (int i = 0; i < MAX_WEB_SOCKET_CLIENTS; ++i) {
-        if (keep_alive_fds[i] != -1)
+        if (keep_alive_fds[i] != -1 && (keep_alive_features[i] & feature_mask) == feature_value)
             return true;
     }
     return false;
 }
 
+uint8_t WebSockets::activeFeatureSets()
+{
+    static_assert((WEBSOCKET_FEATURE_DELTA_UPDATES | WEBSOCKET_FEATURE_SUBPROTOCOL) < 8);
+
+    uint8_t result = 0;
+
+    std::lock_guard<std::recursive_mutex> lock{keep_alive_mutex};
+    for (int i = 0; i < MAX_WEB_SOCKET_CLIENTS; ++i) {
+        if (keep_alive_fds[i] != -1)
+            result |= 1 << keep_alive_features[i];
+    }
+    return result;
+}
+
 bool WebSockets::haveFreeSlot()
 {
     std::lock_guard<std::recursive_mutex> lock{keep_alive_mutex};
@@ -461,9 +706,9 @@ bool WebSockets::haveFreeSlot()
     return false;
 }
 
-bool WebSockets::sendToAllOwned(char *payload, size_t payload_len, httpd_ws_type_t ws_type)
+bool WebSockets::sendToAllOwned(char *payload, size_t payload_len, httpd_ws_type_t ws_type, uint8_t feature_mask, uint8_t feature_value, int32_t coalesce_key)
 {
-    if (!this->haveActiveClient()) {
+    if (!this->haveActiveClient(feature_mask, feature_value)) {
         free(payload);
         return true;
     }
@@ -472,46 +717,49 @@ bool WebSockets::sendToAllOwned(char *payload, size_t payload_len, httpd_ws_type
     int fds[MAX_WEB_SOCKET_CLIENTS];
     {
         std::lock_guard<std::recursive_mutex> lock{keep_alive_mutex};
-        memcpy(fds, keep_alive_fds, sizeof(fds));
+        for (int i = 0; i < MAX_WEB_SOCKET_CLIENTS; ++i) {
+            fds[i] = (keep_alive_features[i] & feature_mask) == feature_value ? keep_alive_fds[i] : -1;
+        }
     }
 
-    std::lock_guard<std::recursive_mutex> lock{work_queue_mutex};
-    if (queueFull()) {
-        free(payload);
-        return false;
-    }
-    work_queue.push_back({{}, payload, payload_len, ws_type});
-    memcpy(work_queue.back().fds, fds, sizeof(fds));
-    return true;
+    return enqueue(fds, payload, payload_len, ws_type, coalesce_key);
 }
 
-bool WebSockets::sendToAll(const char *payload, size_t payload_len, httpd_ws_type_t ws_type)
+bool WebSockets::sendToAllPayload(ws_payload *payload, uint8_t feature_mask, uint8_t feature_value, int32_t coalesce_key, ws_payload_merge_fn merge)
 {
-    if (!this->haveActiveClient())
+    if (!this->haveActiveClient(feature_mask, feature_value)) {
+        releasePayload(payload);
         return true;
-
-    char *payload_copy = (char *)malloc(payload_len * sizeof(char));
-    if (payload_copy == nullptr) {
-        return false;
     }
-    memcpy(payload_copy, payload, payload_len);
 
     // Copy over to not hold both mutexes at the same time.
     int fds[MAX_WEB_SOCKET_CLIENTS];
     {
         std::lock_guard<std::recursive_mutex> lock{keep_alive_mutex};
-        memcpy(fds, keep_alive_fds, sizeof(fds));
+        for (int i = 0; i < MAX_WEB_SOCKET_CLIENTS; ++i) {
+            fds[i] = (keep_alive_features[i] & feature_mask) == feature_value ? keep_alive_fds[i] : -1;
+        }
     }
 
-    std::lock_guard<std::recursive_mutex> lock{work_queue_mutex};
-    if (queueFull()) {
-        free(payload_copy);
+    enqueuePayload(fds, payload, coalesce_key, merge);
+    return true;
+}
+
+bool WebSockets::sendToAll(const char *payload, size_t payload_len, httpd_ws_type_t ws_type)
+{
+    if (!this->haveActiveClient())
+        return true;
+
+    ws_payload *payload_copy = allocPayload(payload_len);
+    if (payload_copy == nullptr) {
         return false;
     }
 
-    work_queue.push_back({{}, payload_copy, payload_len, ws_type});
-    memcpy(work_queue.back().fds, fds, sizeof(fds));
-    return true;
+    memcpy(payload_copy->data, payload, payload_len);
+    payload_copy->len = payload_len;
+    payload_copy->ws_type = ws_type;
+
+    return sendToAllPayload(payload_copy);
 }
 
 void WebSockets::triggerHttpThread()
@@ -539,8 +787,7 @@ void WebSockets::triggerHttpThread()
     if (!deadline_elapsed(last_worker_run + WORKER_WATCHDOG_TIMEOUT / 8_us))
 #endif
     {
-        std::lock_guard<std::recursive_mutex> lock{work_queue_mutex};
-        if (work_queue.empty()) {
+        if (!haveQueuedWork()) {
             return;
         }
     }
@@ -568,19 +815,26 @@ void WebSockets::pre_setup() {
         {"keep_alive_peers", Config::Array({}, new Config{Config::Str("", 0, INET6_ADDRSTRLEN)}, MAX_WEB_SOCKET_CLIENTS, MAX_WEB_SOCKET_CLIENTS, Config::type_id<Config::ConfString>())},
         {"worker_active", Config::Uint8(WEBSOCKET_WORKER_DONE)},
         {"last_worker_run", Config::Uint32(0)},
-        {"queue_len", Config::Uint32(0)}
+        {"queue_len", Config::Uint32(0)},
+        {"queue_depths", Config::Array({}, Config::get_prototype_uint32_0(), MAX_WEB_SOCKET_CLIENTS, MAX_WEB_SOCKET_CLIENTS, Config::type_id<Config::ConfUint>())},
+        {"queue_drops", Config::Array({}, Config::get_prototype_uint32_0(), MAX_WEB_SOCKET_CLIENTS, MAX_WEB_SOCKET_CLIENTS, Config::type_id<Config::ConfUint>())}
     });
 
     Config *state_keep_alive_fds = static_cast<Config *>(state.get("keep_alive_fds"));
     Config *state_keep_alive_pongs = static_cast<Config *>(state.get("keep_alive_pongs"));
     Config *state_keep_alive_peers = static_cast<Config *>(state.get("keep_alive_peers"));
+    Config *state_queue_depths = static_cast<Config *>(state.get("queue_depths"));
+    Config *state_queue_drops = static_cast<Config *>(state.get("queue_drops"));
 
     for (int i = 0; i < MAX_WEB_SOCKET_CLIENTS; ++i) {
         state_keep_alive_fds->add()->updateInt(-1); // Override default from shared prototype.
         state_keep_alive_pongs->add();
         state_keep_alive_peers->add();
+        state_queue_depths->add();
+        state_queue_drops->add();
         keep_alive_fds[i] = -1;
         keep_alive_last_pong[i] = 0;
+        keep_alive_features[i] = 0;
     }
 }
 
@@ -591,7 +845,17 @@ void WebSockets::updateDebugState()
 
         state.get("worker_active"  )->updateUint(worker_active);
         state.get("last_worker_run")->updateUint(last_worker_run.to<millis_t>().as<uint32_t>());
-        state.get("queue_len"      )->updateUint(work_queue.size());
+        Config *state_queue_depths = static_cast<Config *>(state.get("queue_depths"));
+        Config *state_queue_drops  = static_cast<Config *>(state.get("queue_drops"));
+
+        size_t queue_len = 0;
+        for (size_t i = 0; i < MAX_WEB_SOCKET_CLIENTS; ++i) {
+            queue_len += client_queues[i].count;
+            state_queue_depths->get(i)->updateUint(client_queues[i].count);
+            state_queue_drops->get(i)->updateUint(client_queues[i].dropped);
+        }
+
+        state.get("queue_len"      )->updateUint(queue_len);
     }
 
     {
@@ -642,6 +906,7 @@ void WebSockets::start(const char *uri, const char *state_path, httpd_handle_t h
     }
 
     this->httpd = httpd;
+    this->supported_subprotocol = supported_subprotocol;
 
     httpd_uri_t ws = {};
     ws.uri = uri;
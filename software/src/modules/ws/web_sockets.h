@@ -22,14 +22,32 @@
 #include <functional>
 #include <atomic>
 #include <mutex>
-#include <deque>
 #include <esp_http_server.h>
 
 #include "config.h"
 
 #define MAX_WEB_SOCKET_CLIENTS 5
+// Per client. If a client's queue overflows, the queue is dropped and the client receives the full state again.
 #define MAX_WEB_SOCKET_WORK_ITEMS_IN_QUEUE 32
 
+// Payloads up to this size (including the NUL-terminator) are taken from a pool
+// that grows on demand up to WEBSOCKET_PAYLOAD_POOL_SIZE buffers, which are never freed.
+#define WEBSOCKET_PAYLOAD_POOL_BUFFER_SIZE 512
+#define WEBSOCKET_PAYLOAD_POOL_SIZE 16
+
+// Queued items with the same coalesce key replace each other, except for WEBSOCKET_COALESCE_KEY_NONE.
+// If a merge function is passed, they are merged instead.
+// Non-negative keys are API state indices.
+#define WEBSOCKET_COALESCE_KEY_NONE (-1)
+#define WEBSOCKET_COALESCE_KEY_PING (-2)
+#define WEBSOCKET_COALESCE_KEY_STATE_BATCH (-3)
+
+// Client features, negotiated when the connection is opened.
+// The client requested delta state updates by connecting with ?delta=1
+#define WEBSOCKET_FEATURE_DELTA_UPDATES (1 << 0)
+// The client negotiated the subprotocol passed to start().
+#define WEBSOCKET_FEATURE_SUBPROTOCOL (1 << 1)
+
 class WebSockets;
 
 struct WebSocketsClient {
@@ -40,14 +58,43 @@ struct WebSocketsClient {
     void close_HTTPThread();
 };
 
-struct ws_work_item {
-    int fds[MAX_WEB_SOCKET_CLIENTS];
-    char *payload;
-    size_t payload_len;
+// Payload shared by all client queues it was enqueued into.
+struct ws_payload {
+    enum class Storage : uint8_t {
+        // data was passed in by the caller and is freed separately.
+        Owned,
+        // data follows the struct in the same allocation.
+        Inline,
+        // Like Inline, but returned to the pool when released.
+        Pooled,
+    };
+
+    char *data;
+    size_t len;
     httpd_ws_type_t ws_type;
+    // Protected by work_queue_mutex.
+    uint8_t refs;
+    Storage storage;
 };
 
-void clear_ws_work_item(ws_work_item *wi);
+// Merges a queued payload with a newer one that has the same coalesce key. Called with the work_queue_mutex locked.
+// Returns a payload with one reference or nullptr to queue the newer payload separately.
+typedef ws_payload *(*ws_payload_merge_fn)(WebSockets *ws, const ws_payload *queued, const ws_payload *newer);
+
+struct ws_queued_item {
+    ws_payload *payload;
+    int32_t coalesce_key;
+};
+
+// Send queue of one keep alive slot. Protected by work_queue_mutex.
+struct WebSocketsClientQueue {
+    int fd = -1;
+    ws_queued_item items[MAX_WEB_SOCKET_WORK_ITEMS_IN_QUEUE];
+    size_t head = 0;
+    size_t count = 0;
+    uint32_t dropped = 0;
+    bool resync_pending = false;
+};
 
 #define WEBSOCKET_WORKER_ENQUEUED 0
 #define WEBSOCKET_WORKER_RUNNING 1
@@ -65,26 +112,40 @@ public:
     bool sendToClient(const char *payload, size_t payload_len, int sock, httpd_ws_type_t ws_type = HTTPD_WS_TYPE_TEXT);
     bool sendToClientOwned(char *payload, size_t payload_len, int sock, httpd_ws_type_t ws_type = HTTPD_WS_TYPE_TEXT);
     bool sendToAll(const char *payload, size_t payload_len, httpd_ws_type_t ws_type = HTTPD_WS_TYPE_TEXT);
-    bool sendToAllOwned(char *payload, size_t payload_len, httpd_ws_type_t ws_type = HTTPD_WS_TYPE_TEXT);
+    // Only sends to clients with (features & feature_mask) == feature_value.
+    bool sendToAllOwned(char *payload, size_t payload_len, httpd_ws_type_t ws_type = HTTPD_WS_TYPE_TEXT, uint8_t feature_mask = 0, uint8_t feature_value = 0, int32_t coalesce_key = WEBSOCKET_COALESCE_KEY_NONE);
+    // Takes the caller's reference to payload.
+    bool sendToAllPayload(ws_payload *payload, uint8_t feature_mask = 0, uint8_t feature_value = 0, int32_t coalesce_key = WEBSOCKET_COALESCE_KEY_NONE, ws_payload_merge_fn merge = nullptr);
+
+    // Returns a payload with one reference and room for capacity bytes plus a NUL-terminator or nullptr.
+    // Set len and ws_type before sending it.
+    ws_payload *allocPayload(size_t capacity);
 
     bool haveFreeSlot();
-    bool haveActiveClient();
+    bool haveActiveClient(uint8_t feature_mask = 0, uint8_t feature_value = 0);
+    // Returns a mask with bit (1 << features) set for every combination of features that an active client has.
+    uint8_t activeFeatureSets();
     void pingActiveClients();
     void checkActiveClients();
     void closeLRUClient();
     void receivedPong(int fd);
 
-    void cleanUpQueue();
-    bool queueFull();
+    bool enqueue(const int fds[MAX_WEB_SOCKET_CLIENTS], char *payload, size_t payload_len, httpd_ws_type_t ws_type, int32_t coalesce_key);
+    void enqueuePayload(const int fds[MAX_WEB_SOCKET_CLIENTS], ws_payload *payload, int32_t coalesce_key, ws_payload_merge_fn merge = nullptr);
+    void releasePayload(ws_payload *payload);
+    void clearClientQueue(WebSocketsClientQueue *queue);
+    void resyncClients();
 
     void onConnect_HTTPThread(std::function<void(WebSocketsClient)> &&fn);
     void onBinaryDataReceived_HTTPThread(std::function<void(const int fd, httpd_ws_frame_t *ws_pkt)> &&fn);
 
     void triggerHttpThread();
-    bool haveWork(ws_work_item *item);
+    bool haveWork(int *fd, ws_queued_item *item);
+    bool haveQueuedWork();
 
-    void keepAliveAdd(int fd);
+    void keepAliveAdd(int fd, uint8_t features);
     void keepAliveRemove(int fd);
+    void workQueueRemove(int fd);
     void keepAliveCloseDead(int fd);
 
     void updateDebugState();
@@ -95,9 +156,17 @@ public:
     std::recursive_mutex keep_alive_mutex;
     int keep_alive_fds[MAX_WEB_SOCKET_CLIENTS];
     micros_t keep_alive_last_pong[MAX_WEB_SOCKET_CLIENTS];
+    uint8_t keep_alive_features[MAX_WEB_SOCKET_CLIENTS];
 
     std::recursive_mutex work_queue_mutex;
-    std::deque<ws_work_item> work_queue;
+    // Indexed like keep_alive_fds.
+    WebSocketsClientQueue client_queues[MAX_WEB_SOCKET_CLIENTS];
+    size_t next_client_queue = 0;
+
+    // Protected by work_queue_mutex.
+    ws_payload *payload_pool[WEBSOCKET_PAYLOAD_POOL_SIZE];
+    size_t payload_pool_free = 0;
+    size_t payload_pool_allocated = 0;
 
     std::atomic<uint8_t> worker_active;
     micros_t last_worker_run = 0_us;
@@ -111,4 +180,5 @@ public:
     ConfigRoot state;
 
     const char *handler_uri;
+    const char *supported_subprotocol = nullptr;
 };
@@ -19,6 +19,7 @@
 
 #include "ws.h"
 
+#include <algorithm>
 #include <esp_http_server.h>
 
 #include "event_log_prefix.h"
@@ -33,9 +34,30 @@ static size_t prefix_len = strlen(prefix);
 static size_t infix_len = strlen(infix);
 static size_t suffix_len = strlen(suffix);
 
+static const char *delta_infix = "\",\"patch\":";
+static size_t delta_infix_len = strlen(delta_infix);
+
+// Initial guess for the size of a state's JSON. Retried with the exact size if it was too small.
+static constexpr size_t STATE_GUESS_LEN = 256;
+
+// Batches that would grow larger when merged are queued separately.
+// A client that keeps falling behind then overflows its queue and is resynced.
+static constexpr size_t MERGED_BATCH_MAX_LEN = 16384;
+
+// Clients that negotiate this subprotocol receive float array states as binary frames.
+static const char *binary_subprotocol = "tf-binary-v1";
+
+// Binary state update frame:
+// uint8_t type
+// uint8_t path_len
+// char    path[path_len]
+// zero padding to align the values to four bytes
+// values, little endian
+#define BINARY_FRAME_TYPE_FLOAT_ARRAY 1
+
 void WS::pre_setup()
 {
-    api.registerBackend(this);
+    backend_flag = static_cast<uint8_t>(1 << api.registerBackend(this));
     web_sockets.pre_setup();
 }
 
@@ -120,7 +142,7 @@ void WS::register_urls()
         }
     });
 
-    web_sockets.start("/ws", "/info/ws", server.httpd);
+    web_sockets.start("/ws", "/info/ws", server.httpd, binary_subprotocol);
 
     task_scheduler.scheduleWithFixedDelay([this](){
         char *payload;
@@ -142,29 +164,324 @@ void WS::addResponse(size_t responseIdx, const ResponseRegistration &reg)
 {
 }
 
+// Makes room for len more bytes in batch. Starts with a pool buffer and moves to a larger buffer if necessary.
+bool WS::batchReserve(Batch *batch, size_t len)
+{
+    size_t used = batch->payload == nullptr ? 0 : batch->payload->len;
+
+    if (batch->payload != nullptr && batch->capacity - used >= len) {
+        return true;
+    }
+
+    size_t new_capacity = std::max(used + len, std::max(batch->capacity * 2, static_cast<size_t>(WEBSOCKET_PAYLOAD_POOL_BUFFER_SIZE - 1)));
+    ws_payload *payload = web_sockets.allocPayload(new_capacity);
+    if (payload == nullptr) {
+        return false;
+    }
+
+    if (batch->payload != nullptr) {
+        memcpy(payload->data, batch->payload->data, used);
+        web_sockets.releasePayload(batch->payload);
+    }
+
+    payload->len = used;
+    batch->payload = payload;
+    batch->capacity = new_capacity;
+
+    return true;
+}
+
+// Appends {"topic":"<path>"<infix><body>}\n to batch.
+// serialize(buf, buf_size) writes the body and returns its required length like Config::serialize_json.
+// The first attempt uses all free space of the batch. A body that did not fit is written again after growing the batch.
+template<typename F>
+bool WS::batchStateMessage(Batch *batch, const String &path, const char *msg_infix, size_t msg_infix_len, F &&serialize)
+{
+    size_t framing_len = prefix_len + path.length() + msg_infix_len + suffix_len;
+    size_t body_len = STATE_GUESS_LEN;
+
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (!batchReserve(batch, framing_len + body_len)) {
+            return false;
+        }
+
+        ws_payload *payload = batch->payload;
+        size_t free_len = batch->capacity - payload->len;
+        body_len = free_len - framing_len;
+
+        // The payload has room for a NUL-terminator after capacity bytes.
+        StringWriter sw{payload->data + payload->len, free_len + 1};
+        sw.puts(prefix, prefix_len);
+        sw.puts(path.c_str(), path.length());
+        sw.puts(msg_infix, msg_infix_len);
+
+        size_t required = serialize(sw.getRemainingPtr(), body_len + 1);
+
+        if (required <= body_len) {
+            sw.setLength(sw.getLength() + required);
+            sw.puts(suffix, suffix_len);
+
+            payload->len += sw.getLength();
+            return true;
+        }
+
+        body_len = required;
+    }
+
+    return false;
+}
+
+// Appends a message that was already written to another batch.
+bool WS::batchCopy(Batch *batch, const BatchedMessage &msg)
+{
+    if (!batchReserve(batch, msg.len)) {
+        return false;
+    }
+
+    memcpy(batch->payload->data + batch->payload->len, msg.batch->payload->data + msg.offset, msg.len);
+    batch->payload->len += msg.len;
+
+    return true;
+}
+
+// Adds the state to the batch of every client class. The batches are sent by flushStateUpdates.
 // returns true on success
 bool WS::pushStateUpdate(size_t stateIdx, const String &payload, const String &path)
 {
-    if (!web_sockets.haveActiveClient()) {
+    uint8_t active = web_sockets.activeFeatureSets();
+    if (active == 0) {
         return true;
     }
 
-    StringBuilder sb;
-    size_t payload_len = payload.length();
+    const auto &reg = api.states[stateIdx];
+    uint8_t json_mask = jsonFeatureMask(stateIdx);
+    bool send_binary = false;
+
+    // Every message is serialized only once. Further client classes copy it from the first batch.
+    BatchedMessage full_msg;
+    BatchedMessage delta_msg;
+
+    for (uint8_t cls = 0; cls < CLIENT_CLASS_COUNT; ++cls) {
+        if ((active & (1 << cls)) == 0)
+            continue;
+
+        if ((cls & json_mask & WEBSOCKET_FEATURE_SUBPROTOCOL) != 0) {
+            send_binary = true;
+            continue;
+        }
+
+        Batch *batch = &batches[cls];
+        bool delta = (cls & WEBSOCKET_FEATURE_DELTA_UPDATES) != 0;
+        BatchedMessage *msg = delta ? &delta_msg : &full_msg;
+
+        if (msg->batch != nullptr) {
+            if (!batchCopy(batch, *msg)) {
+                return false;
+            }
+
+            continue;
+        }
+
+        size_t offset = batch->payload == nullptr ? 0 : batch->payload->len;
+        bool ok;
+
+        if (delta) {
+            // Only the nodes that were updated since the last successful push to this backend.
+            ok = batchStateMessage(batch, path, delta_infix, delta_infix_len, [this, &reg](char *buf, size_t buf_size) {
+                return reg.config->serialize_json_delta(buf, buf_size, backend_flag, reg.keys_to_censor, reg.keys_to_censor_len);
+            });
+        } else if (payload.length() != 0) {
+            // The payload is only serialized if another backend wanted it as string. Copy it instead of serializing twice.
+            size_t payload_len = payload.length();
+
+            ok = batchStateMessage(batch, path, infix, infix_len, [&payload, payload_len](char *buf, size_t buf_size) {
+                if (payload_len < buf_size)
+                    memcpy(buf, payload.c_str(), payload_len);
+
+                return payload_len;
+            });
+        } else {
+            ok = batchStateMessage(batch, path, infix, infix_len, [&reg](char *buf, size_t buf_size) {
+                return reg.config->serialize_json(buf, buf_size, reg.keys_to_censor, reg.keys_to_censor_len);
+            });
+        }
+
+        if (!ok) {
+            return false;
+        }
+
+        *msg = {batch, offset, batch->payload->len - offset};
+    }
+
+    if (send_binary) {
+        return pushStateBinary(stateIdx, path);
+    }
 
-    if (!pushStateUpdateBegin(&sb, stateIdx, payload_len, path.c_str(), path.length())) {
+    return true;
+}
+
+// Returns the topic of a batched message or 0 if the line is not a state message.
+static size_t message_topic(const char *line, size_t line_len, const char **topic)
+{
+    if (line_len < prefix_len || memcmp(line, prefix, prefix_len) != 0)
+        return 0;
+
+    const char *start = line + prefix_len;
+    const char *quote = static_cast<const char *>(memchr(start, '"', line_len - prefix_len));
+
+    if (quote == nullptr)
+        return 0;
+
+    *topic = start;
+    return static_cast<size_t>(quote - start);
+}
+
+// Calls fn(line, line_len) for every newline-delimited message of a batch.
+template<typename F>
+static void for_each_message(const ws_payload *batch, F &&fn)
+{
+    const char *end = batch->data + batch->len;
+
+    for (const char *line = batch->data; line < end;) {
+        const char *newline = static_cast<const char *>(memchr(line, '\n', static_cast<size_t>(end - line)));
+        size_t line_len = newline == nullptr ? static_cast<size_t>(end - line) : static_cast<size_t>(newline + 1 - line);
+
+        fn(line, line_len);
+        line += line_len;
+    }
+}
+
+// Merges a batch that is still queued for a client with the next one.
+// Full state messages of the queued batch are left out if the newer batch contains the same state.
+// Patches can't replace each other, so delta batches are concatenated.
+static ws_payload *merge_batches(WebSockets *web_sockets, const ws_payload *queued, const ws_payload *newer, bool drop_replaced)
+{
+    if (queued->len + newer->len > MERGED_BATCH_MAX_LEN)
+        return nullptr;
+
+    ws_payload *merged = web_sockets->allocPayload(queued->len + newer->len);
+    if (merged == nullptr)
+        return nullptr;
+
+    std::vector<std::pair<const char *, size_t>> newer_topics;
+
+    if (drop_replaced) {
+        for_each_message(newer, [&newer_topics](const char *line, size_t line_len) {
+            const char *topic;
+            size_t topic_len = message_topic(line, line_len, &topic);
+
+            if (topic_len > 0)
+                newer_topics.emplace_back(topic, topic_len);
+        });
+    }
+
+    size_t len = 0;
+
+    for_each_message(queued, [merged, &len, &newer_topics](const char *line, size_t line_len) {
+        const char *topic;
+        size_t topic_len = message_topic(line, line_len, &topic);
+
+        for (const auto &newer_topic : newer_topics) {
+            if (topic_len > 0 && newer_topic.second == topic_len && memcmp(newer_topic.first, topic, topic_len) == 0)
+                return;
+        }
+
+        memcpy(merged->data + len, line, line_len);
+        len += line_len;
+    });
+
+    memcpy(merged->data + len, newer->data, newer->len);
+    merged->len = len + newer->len;
+    merged->ws_type = newer->ws_type;
+
+    return merged;
+}
+
+static ws_payload *merge_full_batches(WebSockets *web_sockets, const ws_payload *queued, const ws_payload *newer)
+{
+    return merge_batches(web_sockets, queued, newer, true);
+}
+
+static ws_payload *merge_delta_batches(WebSockets *web_sockets, const ws_payload *queued, const ws_payload *newer)
+{
+    return merge_batches(web_sockets, queued, newer, false);
+}
+
+// Sends one newline-delimited frame per client class.
+// A client that still has the previous batch of its class queued gets both merged into one frame.
+void WS::flushStateUpdates()
+{
+    for (uint8_t cls = 0; cls < CLIENT_CLASS_COUNT; ++cls) {
+        Batch *batch = &batches[cls];
+
+        if (batch->payload == nullptr)
+            continue;
+
+        ws_payload_merge_fn merge = (cls & WEBSOCKET_FEATURE_DELTA_UPDATES) != 0 ? merge_delta_batches : merge_full_batches;
+
+        web_sockets.sendToAllPayload(batch->payload, CLIENT_CLASS_MASK, cls, WEBSOCKET_COALESCE_KEY_STATE_BATCH, merge);
+        *batch = Batch{};
+    }
+}
+
+// Binary clients receive float arrays as binary frames and all other states as JSON.
+// Returns the feature mask that selects JSON clients with the value 0 (full) or WEBSOCKET_FEATURE_DELTA_UPDATES.
+uint8_t WS::jsonFeatureMask(size_t stateIdx)
+{
+    const auto &reg = api.states[stateIdx];
+
+    if (reg.path_len <= UINT8_MAX && reg.config->is_float_array())
+        return WEBSOCKET_FEATURE_DELTA_UPDATES | WEBSOCKET_FEATURE_SUBPROTOCOL;
+
+    return WEBSOCKET_FEATURE_DELTA_UPDATES;
+}
+
+// returns true on success
+bool WS::pushStateBinary(size_t stateIdx, const String &path)
+{
+    Config *config = api.states[stateIdx].config;
+    size_t path_len = path.length();
+    size_t header_len = (2 + path_len + 3) & ~static_cast<size_t>(3);
+    size_t value_count = config->count();
+    size_t len = header_len + value_count * sizeof(float);
+
+    ws_payload *msg = web_sockets.allocPayload(len);
+    if (msg == nullptr) {
         return false;
     }
 
-    sb.puts(payload.c_str(), payload_len);
+    // Payload buffers are aligned, so the values are aligned too.
+    uint8_t *buf = reinterpret_cast<uint8_t *>(msg->data);
+    buf[0] = BINARY_FRAME_TYPE_FLOAT_ARRAY;
+    buf[1] = static_cast<uint8_t>(path_len);
+    memcpy(buf + 2, path.c_str(), path_len);
+    memset(buf + 2 + path_len, 0, header_len - 2 - path_len);
+
+    config->fillFloatArray(reinterpret_cast<float *>(buf + header_len), value_count);
+
+    msg->len = len;
+    msg->ws_type = HTTPD_WS_TYPE_BINARY;
 
-    return pushStateUpdateEnd(&sb);
+    return web_sockets.sendToAllPayload(msg, WEBSOCKET_FEATURE_SUBPROTOCOL, WEBSOCKET_FEATURE_SUBPROTOCOL, static_cast<int32_t>(stateIdx));
 }
 
 // returns true on success
 bool WS::pushRawStateUpdate(const String &payload, const String &path)
 {
-    return pushStateUpdate(0, payload, path);
+    if (!web_sockets.haveActiveClient()) {
+        return true;
+    }
+
+    StringBuilder sb;
+    size_t payload_len = payload.length();
+
+    if (!pushRawStateUpdateBegin(&sb, payload_len, path.c_str(), path.length())) {
+        return false;
+    }
+
+    sb.puts(payload.c_str(), payload_len);
+
+    return pushRawStateUpdateEnd(&sb);
 }
 
 // returns true if it is okay to call pushStateUpdateEnd
@@ -214,8 +531,9 @@ bool WS::pushRawStateUpdateEnd(StringBuilder *sb)
 
 IAPIBackend::WantsStateUpdate WS::wantsStateUpdate(size_t stateIdx)
 {
+    // Serialized directly into a payload buffer by pushStateUpdate.
     return web_sockets.haveActiveClient() ?
-           IAPIBackend::WantsStateUpdate::AsString :
+           IAPIBackend::WantsStateUpdate::AsConfig :
            IAPIBackend::WantsStateUpdate::No;
 }
 
@@ -42,6 +42,7 @@ public:
     void addResponse(size_t responseIdx, const ResponseRegistration &reg) override;
     bool pushStateUpdate(size_t stateIdx, const String &payload, const String &path) override;
     bool pushRawStateUpdate(const String &payload, const String &path) override;
+    void flushStateUpdates() override;
     WantsStateUpdate wantsStateUpdate(size_t stateIdx) override;
 
     bool pushStateUpdateBegin(StringBuilder *sb, size_t stateIdx, size_t payload_len, const char *path, ssize_t path_len = -1);
@@ -52,4 +53,34 @@ public:
     bool haveActiveClient();
 
     WebSockets web_sockets;
+
+private:
+    // Clients are grouped by their combination of these features.
+    static constexpr uint8_t CLIENT_CLASS_MASK = WEBSOCKET_FEATURE_DELTA_UPDATES | WEBSOCKET_FEATURE_SUBPROTOCOL;
+    static constexpr size_t CLIENT_CLASS_COUNT = CLIENT_CLASS_MASK + 1;
+
+    // Newline-delimited state messages of one state update run.
+    struct Batch {
+        ws_payload *payload = nullptr;
+        size_t capacity = 0; // excluding NUL-terminator
+    };
+
+    struct BatchedMessage {
+        const Batch *batch = nullptr;
+        size_t offset = 0;
+        size_t len = 0;
+    };
+
+    uint8_t jsonFeatureMask(size_t stateIdx);
+    bool pushStateBinary(size_t stateIdx, const String &path);
+
+    bool batchReserve(Batch *batch, size_t len);
+    template<typename F>
+    bool batchStateMessage(Batch *batch, const String &path, const char *msg_infix, size_t msg_infix_len, F &&serialize);
+    bool batchCopy(Batch *batch, const BatchedMessage &msg);
+
+    // Only used by the API state update task.
+    Batch batches[CLIENT_CLASS_COUNT];
+
+    uint8_t backend_flag = 0;
 };
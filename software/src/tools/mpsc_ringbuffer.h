@@ -0,0 +1,284 @@
+/* esp32-firmware
+ * Copyright (C) 2026 Erik Fleckstein <erik@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Lock-free multi-producer ring buffer for records of bytes, for example log lines.
+//
+// The buffer is split into blocks and a record never spans two blocks. Producers reserve space
+// in the current block with a CAS, copy their record and commit it. If a record doesn't fit,
+// the block is sealed and the next block, which holds the oldest records, is reset and becomes
+// the current block. Every step of advancing to the next block can be completed by any producer,
+// so a preempted producer never stalls the others. A record is dropped instead if it is larger
+// than a block or if a record in the next block is still being copied.
+//
+// Readers access blocks in place. The oldest block can be reset by a producer at any time, so
+// readers skip it and check with is_unchanged() whether a block was reused while reading it.
+// snapshot_and_clear() seals the current block: Records in it and in older blocks are only
+// visible in the returned snapshot, records pushed later are kept for the next reader.
+//
+// The block states are tagged with the absolute number of the block (modulo 2^11), which keeps
+// a producer that was preempted while the ring wrapped around from reserving space in a reused block.
+template <void*(*malloc_fn)(size_t), void(*free_fn)(void*)>
+class TF_MPSCRingbuffer {
+public:
+    static constexpr size_t MAX_BLOCKS = 16;
+    static constexpr size_t MIN_BLOCK_SIZE = 1024;
+
+    struct Chunk {
+        const char *data;
+        size_t len;
+        uint32_t block;
+    };
+
+    struct Snapshot {
+        uint32_t newest;
+        uint32_t first; // Blocks before this one were cleared.
+    };
+
+    TF_MPSCRingbuffer() = default;
+    TF_MPSCRingbuffer(const TF_MPSCRingbuffer &other) = delete;
+    TF_MPSCRingbuffer &operator=(const TF_MPSCRingbuffer &other) = delete;
+
+    ~TF_MPSCRingbuffer()
+    {
+        if (buffer != nullptr)
+            free_fn(buffer);
+    }
+
+    // size must be a power of two and at least 2 * MIN_BLOCK_SIZE.
+    // Returns false if size is invalid or the allocation failed.
+    bool setup(size_t size)
+    {
+        if ((size & (size - 1)) != 0 || size < 2 * MIN_BLOCK_SIZE)
+            return false;
+
+        block_count = size / MIN_BLOCK_SIZE;
+        if (block_count > MAX_BLOCKS)
+            block_count = MAX_BLOCKS;
+
+        block_size = size / block_count;
+        if (block_size > OFFSET_MASK)
+            return false;
+
+        buffer = static_cast<char *>(malloc_fn(size));
+        if (buffer == nullptr)
+            return false;
+
+        // Block 0 is the current block. All others are empty and sealed, as if they were filled in the previous lap.
+        for (size_t i = 0; i < block_count; ++i) {
+            uint32_t block = static_cast<uint32_t>(i) - (i == 0 ? 0 : static_cast<uint32_t>(block_count));
+
+            blocks[i].committed.store(tag(block), std::memory_order_relaxed);
+            blocks[i].state.store(i == 0 ? tag(block) : (tag(block) | SEALED), std::memory_order_relaxed);
+        }
+
+        first_block.store(0, std::memory_order_relaxed);
+        current.store(0, std::memory_order_release);
+
+        return true;
+    }
+
+    // Returns false if the record was dropped.
+    bool push(const char *data, size_t len)
+    {
+        if (len == 0)
+            return true;
+
+        if (len > block_size) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        for (;;) {
+            uint32_t block = current.load(std::memory_order_acquire);
+            Block &b = blocks[index_of(block)];
+            uint32_t state = b.state.load(std::memory_order_acquire);
+
+            // The block was already reset for a later lap.
+            if ((state & TAG_MASK) != tag(block))
+                continue;
+
+            if ((state & SEALED) == 0) {
+                uint32_t offset = state & OFFSET_MASK;
+
+                if (offset + len <= block_size) {
+                    if (!b.state.compare_exchange_weak(state, state + static_cast<uint32_t>(len), std::memory_order_acquire))
+                        continue;
+
+                    memcpy(block_data(block) + offset, data, len);
+                    b.committed.fetch_add(static_cast<uint32_t>(len), std::memory_order_release);
+                    return true;
+                }
+
+                if (!b.state.compare_exchange_weak(state, state | SEALED, std::memory_order_acq_rel))
+                    continue;
+            }
+
+            if (!advance(block)) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+    }
+
+    // Pass the snapshot to get_block to read a consistent sequence of blocks.
+    Snapshot snapshot() const
+    {
+        uint32_t first = first_block.load(std::memory_order_acquire);
+        return {current.load(std::memory_order_acquire), first};
+    }
+
+    // Like snapshot, but later snapshots won't include the records in the returned one.
+    // Returns a snapshot without blocks if the ring can't advance because a record is still being copied.
+    Snapshot snapshot_and_clear()
+    {
+        uint32_t first = first_block.load(std::memory_order_acquire);
+
+        for (;;) {
+            uint32_t block = current.load(std::memory_order_acquire);
+            Block &b = blocks[index_of(block)];
+            uint32_t state = b.state.load(std::memory_order_acquire);
+
+            if ((state & TAG_MASK) != tag(block))
+                continue;
+
+            if ((state & SEALED) == 0 && !b.state.compare_exchange_weak(state, state | SEALED, std::memory_order_acq_rel))
+                continue;
+
+            if (!advance(block))
+                return {block, block + 1};
+
+            first_block.store(block + 1, std::memory_order_release);
+            return {block, first};
+        }
+    }
+
+    // Number of blocks a reader can access. Excludes the oldest block.
+    size_t readable_blocks() const
+    {
+        return block_count - 1;
+    }
+
+    // Returns the committed records of the i-th readable block of the snapshot, oldest first.
+    // Returns false if a record in the block is still being copied; try again later in that case.
+    // Blocks that were already reused, cleared or never written return an empty chunk.
+    bool get_block(const Snapshot &snap, size_t i, Chunk *chunk) const
+    {
+        uint32_t block = snap.newest - static_cast<uint32_t>(readable_blocks() - 1 - i);
+        const Block &b = blocks[index_of(block)];
+
+        // Read committed before state: If both match, all records reserved before the state was read are committed.
+        uint32_t committed = b.committed.load(std::memory_order_acquire);
+        uint32_t state = b.state.load(std::memory_order_acquire);
+
+        chunk->data = block_data(block);
+        chunk->len = 0;
+        chunk->block = block;
+
+        if ((state & TAG_MASK) != tag(block) || (committed & TAG_MASK) != tag(block) || static_cast<int32_t>(block - snap.first) < 0)
+            return true;
+
+        if ((committed & OFFSET_MASK) != (state & OFFSET_MASK))
+            return false;
+
+        chunk->len = state & OFFSET_MASK;
+        return true;
+    }
+
+    // Returns false if the chunk's block was reset since get_block returned it.
+    bool is_unchanged(const Chunk &chunk) const
+    {
+        return (blocks[index_of(chunk.block)].state.load(std::memory_order_acquire) & TAG_MASK) == tag(chunk.block);
+    }
+
+    uint32_t dropped_count() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr uint32_t OFFSET_BITS = 20;
+    static constexpr uint32_t OFFSET_MASK = (1u << OFFSET_BITS) - 1;
+    static constexpr uint32_t SEALED      = 1u << OFFSET_BITS;
+    static constexpr uint32_t TAG_SHIFT   = OFFSET_BITS + 1;
+    static constexpr uint32_t TAG_MASK    = ~((1u << TAG_SHIFT) - 1);
+
+    struct Block {
+        // Tag, sealed flag and the number of bytes reserved.
+        std::atomic<uint32_t> state;
+        // Tag and the number of bytes committed.
+        std::atomic<uint32_t> committed;
+    };
+
+    static uint32_t tag(uint32_t block)
+    {
+        return block << TAG_SHIFT;
+    }
+
+    size_t index_of(uint32_t block) const
+    {
+        return block & (block_count - 1);
+    }
+
+    char *block_data(uint32_t block) const
+    {
+        return buffer + index_of(block) * block_size;
+    }
+
+    // Resets the block after the given one and makes it the current block.
+    // Any step can be done by another producer first; the CASes then fail, which is fine.
+    bool advance(uint32_t block)
+    {
+        uint32_t next = block + 1;
+        uint32_t old_tag = tag(next - static_cast<uint32_t>(block_count));
+        Block &b = blocks[index_of(next)];
+
+        uint32_t committed = b.committed.load(std::memory_order_acquire);
+        uint32_t state = b.state.load(std::memory_order_acquire);
+
+        if ((committed & TAG_MASK) == old_tag) {
+            // A producer is still copying a record into the block.
+            if ((committed & OFFSET_MASK) != (state & OFFSET_MASK))
+                return false;
+
+            b.committed.compare_exchange_strong(committed, tag(next), std::memory_order_acq_rel);
+        }
+
+        if ((state & TAG_MASK) == old_tag)
+            b.state.compare_exchange_strong(state, tag(next), std::memory_order_acq_rel);
+
+        current.compare_exchange_strong(block, next, std::memory_order_acq_rel);
+
+        return true;
+    }
+
+    Block blocks[MAX_BLOCKS];
+    std::atomic<uint32_t> current{0};
+    std::atomic<uint32_t> first_block{0};
+    std::atomic<uint32_t> dropped{0};
+    size_t block_count = 0;
+    size_t block_size = 0;
+    char *buffer = nullptr;
+};
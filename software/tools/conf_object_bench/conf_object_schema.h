@@ -0,0 +1 @@
+../../src/config/conf_object_schema.h
\ No newline at end of file
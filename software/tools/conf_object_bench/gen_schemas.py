@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+# Collects the keys of every Config::Object({...}) in the firmware modules
+# and writes them to schemas.h for the benchmark in main.cpp.
+
+import pathlib
+import re
+import sys
+
+MODULES = (pathlib.Path(__file__).resolve().parent / '../../src/modules').resolve()
+
+OBJECT_START = re.compile(r'Config::Object\(\{')
+KEY = re.compile(r'\{\s*"((?:[^"\\]|\\.)*)"\s*,')
+
+
+# Returns the keys of the object whose initializer list starts at pos.
+# Only the direct children are collected, nested objects are found by their own Config::Object.
+def object_keys(src, pos):
+    keys = []
+    depth = 1
+
+    while pos < len(src) and depth > 0:
+        if src.startswith('//', pos):
+            pos = src.find('\n', pos)
+            continue
+
+        if src.startswith('/*', pos):
+            pos = src.find('*/', pos) + 2
+            continue
+
+        c = src[pos]
+
+        if c == '"':
+            pos += 1
+            while src[pos] != '"':
+                pos += 2 if src[pos] == '\\' else 1
+            pos += 1
+            continue
+
+        if c in '({[':
+            if depth == 1 and c == '{':
+                m = KEY.match(src, pos)
+                if m is not None:
+                    keys.append(m.group(1))
+            depth += 1
+        elif c in ')}]':
+            depth -= 1
+
+        pos += 1
+
+    return keys
+
+
+def main():
+    schemas = []
+
+    for path in sorted(MODULES.rglob('*.cpp')):
+        src = path.read_text(encoding='utf-8', errors='replace')
+
+        for m in OBJECT_START.finditer(src):
+            keys = object_keys(src, m.end())
+
+            # Objects built from a variable list of entries have no literal keys.
+            if len(keys) == 0:
+                continue
+
+            if len(set(keys)) != len(keys):
+                print(f'{path}: duplicate keys in object at offset {m.start()}', file=sys.stderr)
+                continue
+
+            line = src.count('\n', 0, m.start()) + 1
+            schemas.append((f'{path.relative_to(MODULES)}:{line}', keys))
+
+    out = ['// Generated by gen_schemas.py from src/modules. Do not edit.', '']
+
+    for i, (_source, keys) in enumerate(schemas):
+        quoted = ', '.join('"' + key + '"' for key in keys)
+        out.append(f'static const char *const schema_{i}_keys[] = {{{quoted}}};')
+
+    out += ['', 'static const BenchSchema bench_schemas[] = {']
+
+    for i, (source, keys) in enumerate(schemas):
+        out.append(f'    {{"{source}", schema_{i}_keys, {len(keys)}}},')
+
+    out += ['};', '']
+
+    with open(pathlib.Path(__file__).resolve().parent / 'schemas.h', 'w', encoding='utf-8') as f:
+        f.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()
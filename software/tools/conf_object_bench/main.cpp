@@ -0,0 +1,207 @@
+// Host microbenchmark for the ConfObject key lookup.
+// Uses the keys of every Config::Object in src/modules, collected into schemas.h by gen_schemas.py.
+// For each schema, it looks up
+//  - the key pointers themselves, like string literals in the firmware that are in rodata,
+//  - copies of the keys, like keys parsed from JSON, and
+//  - keys that are not in the schema.
+// Copies and missing keys are looked up both through a hash table and with the linear scan.
+// The hash table is built for every schema here, also for those with fewer than
+// CONF_OBJECT_SCHEMA_HASH_MIN_KEYS keys that are scanned linearly in the firmware,
+// to check that threshold against the real key sets. All lookups must agree.
+
+#include "conf_object_schema.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+struct BenchSchema {
+    const char *source;
+    const char *const *keys;
+    size_t length;
+};
+
+#include "schemas.h"
+
+static constexpr size_t LOOKUPS = 4000000;
+
+static volatile size_t sink;
+
+struct Schema {
+    ConfObjectSchema *schema;
+    std::vector<std::string> storage;
+
+    Schema(const std::vector<std::string> &keys, bool hashed)
+    {
+        const size_t len = keys.size();
+        uint32_t hash_bits = 0;
+
+        // Same table size as hash_bits_for, but without the minimum key count.
+        if (hashed) {
+            while ((1u << hash_bits) < len * 2)
+                ++hash_bits;
+        }
+
+        storage = keys;
+        schema = static_cast<ConfObjectSchema *>(malloc(ConfObjectSchema::alloc_size(len, hash_bits)));
+        schema->length = len;
+        schema->hash_bits = hash_bits;
+
+        for (size_t i = 0; i < len; ++i) {
+            schema->keys[i].val = storage[i].c_str();
+            schema->keys[i].length = storage[i].size();
+        }
+
+        schema->build_hash_table();
+    }
+
+    ~Schema()
+    {
+        free(schema);
+    }
+
+    Schema(const Schema &) = delete;
+    Schema &operator=(const Schema &) = delete;
+};
+
+struct Needle {
+    const Schema *hashed;
+    const Schema *linear;
+    size_t key;
+    std::string copy;
+    std::string missing;
+};
+
+template<typename Lookup>
+static double run(const std::vector<Needle> &needles, Lookup &&lookup)
+{
+    size_t acc = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        acc += lookup(needles[i % needles.size()]);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    sink = acc;
+
+    return std::chrono::duration<double, std::nano>(end - start).count() / LOOKUPS;
+}
+
+// Lookups cycle through all keys of all schemas in the row, so that each key is looked up equally often.
+static void bench(const char *name, const std::vector<Needle> &needles, size_t schema_count)
+{
+    if (needles.empty()) {
+        return;
+    }
+
+    const double address = run(needles, [](const Needle &n) { return n.hashed->schema->find_key_by_address(n.hashed->storage[n.key].c_str()); });
+    const double hash    = run(needles, [](const Needle &n) { return n.hashed->schema->find_key_by_value(n.copy.c_str(), n.copy.size()); });
+    const double scan    = run(needles, [](const Needle &n) { return n.linear->schema->find_key_by_value(n.copy.c_str(), n.copy.size()); });
+    const double miss_h  = run(needles, [](const Needle &n) { return n.hashed->schema->find_key_by_value(n.missing.c_str(), n.missing.size()); });
+    const double miss_l  = run(needles, [](const Needle &n) { return n.linear->schema->find_key_by_value(n.missing.c_str(), n.missing.size()); });
+
+    printf("%-40s %7zu %5zu | %9.1f | %9.1f %9.1f | %9.1f %9.1f\n", name, schema_count, needles.size(), address, hash, scan, miss_h, miss_l);
+}
+
+int main()
+{
+    struct Bucket {
+        const char *name;
+        size_t min_keys;
+        size_t max_keys;
+    };
+
+    static const Bucket buckets[] = {
+        {"1-3 keys", 1, 3},
+        {"4-7 keys", 4, 7},
+        {"8-15 keys", 8, CONF_OBJECT_SCHEMA_HASH_MIN_KEYS - 1},
+        {"16+ keys (hashed in the firmware)", CONF_OBJECT_SCHEMA_HASH_MIN_KEYS, SIZE_MAX},
+        {"all", 1, SIZE_MAX},
+    };
+
+    const size_t schema_count = sizeof(bench_schemas) / sizeof(bench_schemas[0]);
+    std::vector<Schema *> hashed;
+    std::vector<Schema *> linear;
+    bool ok = true;
+
+    for (const BenchSchema &bench_schema : bench_schemas) {
+        const std::vector<std::string> keys{bench_schema.keys, bench_schema.keys + bench_schema.length};
+
+        hashed.push_back(new Schema{keys, true});
+        linear.push_back(new Schema{keys, false});
+    }
+
+    auto needles_of = [&](size_t s) {
+        std::vector<Needle> needles;
+
+        for (size_t i = 0; i < bench_schemas[s].length; ++i) {
+            const std::string key = bench_schemas[s].keys[i];
+            needles.push_back({hashed[s], linear[s], i, key, key + "_x"});
+        }
+
+        return needles;
+    };
+
+    for (size_t s = 0; s < schema_count; ++s) {
+        for (const Needle &n : needles_of(s)) {
+            const size_t by_address = n.hashed->schema->find_key_by_address(n.hashed->storage[n.key].c_str());
+            const size_t by_hash = n.hashed->schema->find_key_by_value(n.copy.c_str(), n.copy.size());
+            const size_t by_scan = n.linear->schema->find_key_by_value(n.copy.c_str(), n.copy.size());
+
+            if (by_address != n.key || by_hash != n.key || by_scan != n.key) {
+                fprintf(stderr, "%s: lookup of %s returned %zu (address) %zu (hash) %zu (linear), expected %zu\n", bench_schemas[s].source, n.copy.c_str(), by_address, by_hash, by_scan, n.key);
+                ok = false;
+            }
+
+            if (n.hashed->schema->find_key_by_value(n.missing.c_str(), n.missing.size()) != SIZE_MAX
+             || n.linear->schema->find_key_by_value(n.missing.c_str(), n.missing.size()) != SIZE_MAX
+             || n.hashed->schema->find_key_by_address(n.copy.c_str()) != SIZE_MAX) {
+                fprintf(stderr, "%s: found missing key %s\n", bench_schemas[s].source, n.missing.c_str());
+                ok = false;
+            }
+        }
+    }
+
+    printf("%-40s %7s %5s | %9s | %9s %9s | %9s %9s  [ns/lookup]\n", "", "schemas", "keys", "address", "hash", "linear", "miss hash", "miss lin");
+
+    for (const Bucket &bucket : buckets) {
+        std::vector<Needle> needles;
+        size_t count = 0;
+
+        for (size_t s = 0; s < schema_count; ++s) {
+            if (bench_schemas[s].length < bucket.min_keys || bench_schemas[s].length > bucket.max_keys)
+                continue;
+
+            std::vector<Needle> schema_needles = needles_of(s);
+            needles.insert(needles.end(), schema_needles.begin(), schema_needles.end());
+            ++count;
+        }
+
+        bench(bucket.name, needles, count);
+    }
+
+    printf("\n");
+
+    // The schemas that are large enough to be hashed in the firmware, one by one.
+    for (size_t s = 0; s < schema_count; ++s) {
+        if (bench_schemas[s].length >= CONF_OBJECT_SCHEMA_HASH_MIN_KEYS) {
+            bench(bench_schemas[s].source, needles_of(s), 1);
+        }
+    }
+
+    for (size_t s = 0; s < schema_count; ++s) {
+        delete hashed[s];
+        delete linear[s];
+    }
+
+    if (!ok) {
+        printf("FAILED\n");
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
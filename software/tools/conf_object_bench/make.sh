@@ -0,0 +1,2 @@
+#!/bin/sh
+python3 gen_schemas.py && clang++ -std=c++20 -O2 -- *.cpp
@@ -0,0 +1 @@
+../../src/modules/charge_manager/charge_manager_private.h
\ No newline at end of file
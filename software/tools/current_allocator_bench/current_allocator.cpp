@@ -0,0 +1 @@
+../../src/modules/charge_manager/current_allocator.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../src/modules/charge_manager/current_allocator.h
\ No newline at end of file
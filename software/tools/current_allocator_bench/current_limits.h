@@ -0,0 +1 @@
+../../src/modules/charge_manager/current_limits.h
\ No newline at end of file
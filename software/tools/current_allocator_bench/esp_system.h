@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+[[noreturn]] inline void esp_system_abort(const char *details)
+{
+    fprintf(stderr, "%s\n", details);
+    abort();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// 1 to 9 are the allocator stages.
+#define STAGE_SETUP 0
+#define STAGE_APPLY 10
+#define STAGE_COUNT 11
+
+// Host replacement for the event log.
+//
+// allocate_current has no timing hooks, but its trace lines mark where the stages begin:
+// "__all__" before stages 1 and 9, "__only ..." before stage 4, "Calc Wnd" at the start of stage 3,
+// lines starting with "<stage>:" within each stage. So do the entries of the allocation decision record:
+// sort and stage entries carry their stage, the end entry is written before applying the limits.
+// The time between two trace lines or entries is attributed to the stage of the earlier one.
+// Time spent in this class is not attributed to any stage.
+class EventLog
+{
+public:
+    [[gnu::format(__printf__, 2, 3)]] void printfln(const char *fmt, ...);
+
+    void trace_timestamp(size_t trace_buf_idx);
+    [[gnu::format(__printf__, 3, 4)]] size_t tracefln_plain(size_t trace_buf_idx, const char *fmt, ...);
+    size_t trace_plain(size_t trace_buf_idx, const char *buf, size_t len);
+
+    void begin_call();
+    void end_call();
+
+    // Of the last allocate_current call.
+    int64_t stage_ns[STAGE_COUNT];
+
+    // Print log and trace lines instead of dropping them.
+    bool verbose = false;
+
+    // Write the allocation decision record here if set.
+    FILE *record_file = nullptr;
+
+private:
+    int stage = STAGE_SETUP;
+    int64_t stage_start_ns = 0;
+};
+
+extern EventLog logger;
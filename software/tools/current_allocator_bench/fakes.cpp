@@ -0,0 +1,161 @@
+#include "event_log_prefix.h"
+#include "module_dependencies.h"
+#include "tools.h"
+#include "current_allocator_private.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+EventLog logger;
+ChargeManager charge_manager;
+Rtc rtc;
+
+micros_t sim_now = 0_us;
+
+static int64_t host_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Returns the stage number if the line starts with "<digit>:".
+static int parse_stage_prefix(const char *line)
+{
+    if (line[0] < '0' || line[0] > '9' || line[1] != ':')
+        return -1;
+
+    return line[0] - '0';
+}
+
+void EventLog::printfln(const char *fmt, ...)
+{
+    if (!verbose)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    putchar('\n');
+}
+
+void EventLog::trace_timestamp(size_t trace_buf_idx)
+{
+    (void)trace_buf_idx;
+}
+
+size_t EventLog::tracefln_plain(size_t trace_buf_idx, const char *fmt, ...)
+{
+    (void)trace_buf_idx;
+
+    int64_t now = host_ns();
+    stage_ns[stage] += now - stage_start_ns;
+
+    va_list args;
+    va_start(args, fmt);
+
+    if (stage != STAGE_APPLY) {
+        int prefix = parse_stage_prefix(fmt);
+
+        if (strcmp(fmt, "__all__") == 0) {
+            stage = stage == STAGE_SETUP ? 1 : 9;
+        } else if (strncmp(fmt, "__only", 6) == 0) {
+            stage = 4;
+        } else if (strcmp(fmt, "     Calc Wnd") == 0) {
+            stage = 3;
+        } else if (prefix > 0) {
+            stage = prefix;
+        } else if (strcmp(fmt, "%s") == 0) {
+            // The per-charger lines of stages 4 and 5.
+            va_list copy;
+            va_copy(copy, args);
+            prefix = parse_stage_prefix(va_arg(copy, const char *));
+            va_end(copy);
+
+            if (prefix > 0)
+                stage = prefix;
+        }
+    }
+
+    size_t written = 0;
+
+    if (verbose) {
+        int result = vprintf(fmt, args);
+        putchar('\n');
+        written = result < 0 ? 0 : static_cast<size_t>(result);
+    }
+
+    va_end(args);
+
+    stage_start_ns = host_ns();
+    return written;
+}
+
+size_t EventLog::trace_plain(size_t trace_buf_idx, const char *buf, size_t len)
+{
+    (void)trace_buf_idx;
+
+    stage_ns[stage] += host_ns() - stage_start_ns;
+
+    const auto *header = reinterpret_cast<const ca_record_header *>(buf);
+
+    if (header->type == CARecordType::Sort) {
+        stage = reinterpret_cast<const ca_record_sort *>(buf)->stage;
+    } else if (header->type == CARecordType::Stage) {
+        stage = reinterpret_cast<const ca_record_stage *>(buf)->stage;
+    } else if (header->type == CARecordType::End) {
+        stage = STAGE_APPLY;
+    }
+
+    if (record_file != nullptr)
+        fwrite(buf, 1, len, record_file);
+
+    stage_start_ns = host_ns();
+    return len;
+}
+
+void EventLog::begin_call()
+{
+    memset(stage_ns, 0, sizeof(stage_ns));
+    stage = STAGE_SETUP;
+    stage_start_ns = host_ns();
+}
+
+void EventLog::end_call()
+{
+    stage_ns[stage] += host_ns() - stage_start_ns;
+}
+
+bool Rtc::clock_synced(struct timeval *out_tv_now)
+{
+    out_tv_now->tv_sec = static_cast<time_t>(sim_now.t / 1000000);
+    out_tv_now->tv_usec = static_cast<suseconds_t>(sim_now.t % 1000000);
+    return true;
+}
+
+micros_t now_us()
+{
+    return sim_now;
+}
+
+bool deadline_elapsed(micros_t deadline_us)
+{
+    return deadline_us < now_us();
+}
+
+size_t snprintf_u(char *buf, size_t len, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int res = vsnprintf(buf, len, format, args);
+    va_end(args);
+
+    return res < 0 ? 0 : static_cast<size_t>(res);
+}
+
+time_t get_localtime_midnight_in_utc(time_t timestamp)
+{
+    return timestamp - timestamp % (24 * 60 * 60);
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+// The firmware's warning pragmas are tuned for the xtensa toolchain and trip over host compilers.
@@ -0,0 +1,495 @@
+// Host benchmark for the current allocator of the charge manager.
+// Compiles modules/charge_manager/current_allocator.cpp unmodified and drives allocate_current()
+// with scripted fleets of chargers. Every step, each charger reports its state through
+// update_from_client_packet() as a cm_state packet would, then the allocator runs once.
+// The simulated time advances by one allocation interval per step, so hysteresis, rotation
+// and wake-up timers behave as on the device.
+//
+// Reports per-call latency, per-stage time (see event_log_prefix.h) and allocation outcomes.
+// Built with BOARD_HAS_PSRAM like the 64 charger builds, so the stages' trace formatting
+// and the allocation decision record are included.
+//
+// Usage: ./a.out [-v] [-r record file] [scenario [charger count [steps]]]
+// -r writes the allocation decision record as /trace_buffer/charge_manager_decisions would send it
+// (uncompressed) for modules/charge_manager/decode_decisions.py.
+
+#include "current_allocator.h"
+#include "event_log_prefix.h"
+#include "modules/cm_networking/cm_networking_defs.h"
+#include "tools.h"
+
+#include <algorithm>
+#include <math.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+extern micros_t sim_now;
+
+static constexpr int STEPS_DEFAULT = 360;
+static constexpr int GUARANTEED_PV_CURRENT = 1400 * 1000 / 230;
+
+struct Vehicle {
+    bool present;
+    bool full;
+    uint8_t phases;
+    uint8_t charge_mode;
+    uint16_t max_current;
+    float energy_needed_kwh;
+    float energy_charged_kwh;
+    int leave_step;
+};
+
+struct Charger {
+    Vehicle vehicle;
+    bool phase_switch_supported;
+    uint8_t phases_connected;
+    uint8_t last_iec_state;
+    micros_t last_state_change;
+    float energy_abs_kwh;
+    float power_w;
+    char name[32];
+    char host[32];
+};
+
+struct Site {
+    int grid_limit_ma;
+    int pv_peak_ma;
+    int pv_ma;
+};
+
+struct Scenario {
+    const char *name;
+    // Probability per step and free charger that a vehicle arrives.
+    float arrival_probability;
+    // Steps a vehicle stays.
+    int stay_min;
+    int stay_max;
+    // Mix of charge modes, vehicle and charger types. Fractions of the fleet.
+    float fast_share;
+    float pv_share;
+    float min_pv_share;
+    float one_phase_vehicle_share;
+    float phase_switch_share;
+    int grid_limit_per_charger_ma;
+    int pv_peak_per_charger_ma;
+    bool all_present_at_start;
+};
+
+static const Scenario scenarios[] = {
+    // name     arrival stay       fast  pv    min+pv 1p    p-sw  grid/charger pv/charger start
+    {"idle",    0.0f,   0,    0,   0.0f, 0.0f, 0.0f,  0.0f, 0.0f, 4000,        0,           false},
+    {"fast",    0.0f,   0,    0,   1.0f, 0.0f, 0.0f,  0.0f, 0.0f, 4000,        0,           true},
+    {"mixed",   0.02f,  60,   300, 0.3f, 0.3f, 0.2f,  0.25f, 0.5f, 5000,       6000,        true},
+    {"churn",   0.2f,   3,    20,  0.4f, 0.2f, 0.2f,  0.25f, 0.5f, 5000,       6000,        false},
+};
+
+static uint32_t rng_state;
+
+static uint32_t rng()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static float rng_float()
+{
+    return static_cast<float>(rng() & 0xFFFFFF) / static_cast<float>(0x1000000);
+}
+
+static int rng_range(int min, int max)
+{
+    return min + static_cast<int>(rng() % static_cast<uint32_t>(max - min + 1));
+}
+
+static void arrive(const Scenario &s, Charger *c, int step)
+{
+    Vehicle &v = c->vehicle;
+
+    v.present = true;
+    v.full = false;
+    v.phases = rng_float() < s.one_phase_vehicle_share ? 1 : 3;
+    v.max_current = rng_float() < 0.5f ? 16000 : 32000;
+    v.energy_needed_kwh = 5.0f + 35.0f * rng_float();
+    v.energy_charged_kwh = 0;
+    v.leave_step = s.stay_max == 0 ? INT32_MAX : step + rng_range(s.stay_min, s.stay_max);
+
+    float mode = rng_float();
+    if (mode < s.fast_share)
+        v.charge_mode = ChargeMode::Fast;
+    else if (mode < s.fast_share + s.pv_share)
+        v.charge_mode = ChargeMode::PV;
+    else if (mode < s.fast_share + s.pv_share + s.min_pv_share)
+        v.charge_mode = ChargeMode::Min | ChargeMode::PV;
+    else
+        v.charge_mode = ChargeMode::Min;
+}
+
+// Copy of ChargeManager::update_charger_state_from_mode without the eco module.
+static void update_charger_state_from_mode(ChargerState *state)
+{
+    auto mode = state->charge_mode;
+
+    state->off = true;
+    state->observe_pv_limit = false;
+    state->eco_fast = false;
+    state->guaranteed_pv_current = 0;
+
+    for (uint8_t m = ChargeMode::_max; m >= ChargeMode::_min; m = static_cast<uint8_t>(m >> 1)) {
+        switch (static_cast<ChargeMode::Type>(mode & m)) {
+            case ChargeMode::Fast:
+                state->off = false;
+                state->observe_pv_limit = false;
+                return;
+
+            case ChargeMode::Eco:
+                continue;
+
+            case ChargeMode::Min:
+                state->off = false;
+                state->guaranteed_pv_current = GUARANTEED_PV_CURRENT;
+                state->observe_pv_limit = true;
+                continue;
+
+            case ChargeMode::PV:
+                state->off = false;
+                state->observe_pv_limit = true;
+                return;
+        }
+    }
+}
+
+// Builds the state packet the charger would send after applying its last allocation.
+static void build_packet(Charger *c, const ChargerAllocationState &alloc, uint32_t uptime, cm_state_v1 *v1, cm_state_v2 *v2, cm_state_v3 *v3)
+{
+    const Vehicle &v = c->vehicle;
+    bool allocated = alloc.allocated_current > 0 && alloc.allocated_phases > 0;
+
+    if (c->phase_switch_supported && alloc.allocated_phases > 0)
+        c->phases_connected = static_cast<uint8_t>(alloc.allocated_phases);
+
+    uint8_t charger_state;
+    if (!v.present)
+        charger_state = 0;
+    else if (!allocated)
+        charger_state = 1;
+    else if (v.full)
+        charger_state = 2;
+    else
+        charger_state = 3;
+
+    if (charger_state != c->last_iec_state) {
+        c->last_iec_state = charger_state;
+        c->last_state_change = sim_now;
+    }
+
+    memset(v1, 0, sizeof(*v1));
+
+    v1->feature_flags = CM_FEATURE_FLAGS_METER_MASK | CM_FEATURE_FLAGS_CP_DISCONNECT_MASK | CM_FEATURE_FLAGS_EVSE_MASK
+                      | (c->phase_switch_supported ? CM_FEATURE_FLAGS_PHASE_SWITCH_MASK : 0);
+    v1->esp32_uid = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(c));
+    v1->evse_uptime = uptime;
+    v1->car_stopped_charging = v.present && v.full ? 1 : 0;
+    v1->allowed_charging_current = alloc.allocated_current;
+    v1->supported_current = 32000;
+    v1->iec61851_state = charger_state == 3 ? 2 : (charger_state == 0 ? 0 : 1);
+    v1->charger_state = charger_state;
+    v1->state_flags = CM_STATE_FLAGS_MANAGED_MASK;
+
+    float power = 0;
+
+    if (charger_state == 3) {
+        int phases = std::min<int>(v.phases, c->phases_connected);
+        float current = static_cast<float>(std::min(alloc.allocated_current, v.max_current)) / 1000.0f;
+
+        for (int p = 0; p < phases; ++p) {
+            v1->line_currents[p] = current;
+        }
+
+        power = current * 230.0f * static_cast<float>(phases);
+    }
+
+    for (int p = 0; p < 3; ++p) {
+        v1->line_voltages[p] = 230.0f;
+        v1->line_power_factors[p] = 1.0f;
+    }
+
+    c->power_w = power;
+    v1->power_total = power;
+    v1->energy_abs = c->energy_abs_kwh;
+
+    v2->time_since_state_change = static_cast<uint32_t>((sim_now - c->last_state_change).t / 1000);
+
+    v3->phases = static_cast<uint8_t>(c->phases_connected | (c->phase_switch_supported ? CM_STATE_V3_CAN_PHASE_SWITCH_MASK : 0));
+}
+
+static void update_vehicle(const Scenario &s, Charger *c, int step, float interval_h)
+{
+    Vehicle &v = c->vehicle;
+
+    if (v.present) {
+        float kwh = c->power_w * interval_h / 1000.0f;
+
+        v.energy_charged_kwh += kwh;
+        c->energy_abs_kwh += kwh;
+
+        if (v.energy_charged_kwh >= v.energy_needed_kwh)
+            v.full = true;
+
+        if (step >= v.leave_step)
+            v.present = false;
+    } else if (rng_float() < s.arrival_probability) {
+        arrive(s, c, step);
+    }
+}
+
+struct Stats {
+    std::vector<int64_t> call_ns;
+    int64_t stage_ns[STAGE_COUNT] = {};
+    int results[4] = {};
+    int64_t active_chargers = 0;
+    int64_t waiting_chargers = 0;
+    int64_t allocated_ma[4] = {};
+    int64_t changes = 0;
+    int64_t phase_over_limit = 0;
+};
+
+static bool run(const Scenario &s, size_t charger_count, int steps)
+{
+    rng_state = 0x9E3779B9u ^ static_cast<uint32_t>(charger_count * 7919);
+    sim_now = 24_h;
+
+    CurrentAllocatorConfig cfg;
+    cfg.allocation_interval = 10_s;
+    cfg.global_hysteresis = 210_s;
+    cfg.wakeup_time = 210_s;
+    cfg.plug_in_time = 210_s;
+    cfg.rotation_interval = 15_m;
+    cfg.minimum_current_3p = 6000;
+    cfg.minimum_current_1p = 6000;
+    cfg.enable_current_factor = 1.5f;
+    // The distribution log is only allocated if the charge manager is configured to be verbose.
+    if (logger.verbose) {
+        cfg.distribution_log = std::unique_ptr<char[]>(new char[DISTRIBUTION_LOG_LEN]);
+        cfg.distribution_log_len = DISTRIBUTION_LOG_LEN;
+    } else {
+        cfg.distribution_log = nullptr;
+        cfg.distribution_log_len = 0;
+    }
+    cfg.charger_count = charger_count;
+    cfg.requested_current_margin = 3000;
+    cfg.requested_current_threshold = 60;
+
+    CurrentAllocatorState ca_state;
+    std::vector<ChargerState> charger_state(charger_count);
+    std::vector<ChargerAllocationState> alloc_state(charger_count);
+    std::vector<Charger> chargers(charger_count);
+    std::vector<const char *> hosts(charger_count);
+
+    static const PhaseRotation rotations[] = {PhaseRotation::Unknown, PhaseRotation::L123, PhaseRotation::L231, PhaseRotation::L312};
+
+    for (size_t i = 0; i < charger_count; ++i) {
+        Charger &c = chargers[i];
+
+        snprintf(c.name, sizeof(c.name), "Charger %zu", i);
+        snprintf(c.host, sizeof(c.host), "10.0.0.%zu", i + 10);
+        hosts[i] = c.host;
+
+        c.phase_switch_supported = rng_float() < s.phase_switch_share;
+        c.phases_connected = 3;
+        charger_state[i].phase_rotation = rotations[i % ARRAY_SIZE(rotations)];
+        // Start with the previous allocation acknowledged.
+        charger_state[i].last_update = sim_now;
+
+        if (s.all_present_at_start)
+            arrive(s, &c, 0);
+    }
+
+    Site site;
+    site.grid_limit_ma = s.grid_limit_per_charger_ma * static_cast<int>(charger_count);
+    site.pv_peak_ma = s.pv_peak_per_charger_ma * static_cast<int>(charger_count);
+
+    auto get_charger_name = [&chargers](uint8_t idx) { return static_cast<const char *>(chargers[idx].name); };
+    auto notify_charger_unresponsive = [](uint8_t idx) { (void)idx; };
+
+    float interval_h = cfg.allocation_interval.as<float>() / 3600e6f;
+    Stats stats;
+
+    for (int step = 0; step < steps; ++step) {
+        for (size_t i = 0; i < charger_count; ++i) {
+            update_vehicle(s, &chargers[i], step, interval_h);
+        }
+
+        // Chargers send their state about once per second and receive the current allocation in reply.
+        // Two rounds per allocation are enough to report vehicle changes and then the applied allocation.
+        for (uint32_t round = 0; round < 2; ++round) {
+            for (size_t i = 0; i < charger_count; ++i) {
+                cm_state_v1 v1;
+                cm_state_v2 v2;
+                cm_state_v3 v3;
+
+                build_packet(&chargers[i], alloc_state[i], static_cast<uint32_t>(step) * 2 + round + 1, &v1, &v2, &v3);
+                update_from_client_packet(static_cast<uint8_t>(i), &v1, &v2, &v3, &cfg, charger_state.data(), alloc_state.data(), hosts.data(), get_charger_name);
+            }
+        }
+
+        for (size_t i = 0; i < charger_count; ++i) {
+            charger_state[i].charge_mode = chargers[i].vehicle.charge_mode;
+            update_charger_state_from_mode(&charger_state[i]);
+        }
+
+        // PV follows one sine half-wave over the run.
+        site.pv_ma = static_cast<int>(static_cast<float>(site.pv_peak_ma) * sinf(static_cast<float>(M_PI) * static_cast<float>(step) / static_cast<float>(steps)));
+
+        CurrentLimits limits;
+        limits.raw = Cost{site.pv_ma, site.grid_limit_ma, site.grid_limit_ma, site.grid_limit_ma};
+        limits.min = limits.raw;
+        limits.spread = limits.raw;
+        limits.max_pv = site.pv_ma;
+
+        CurrentLimits limits_post_allocation = limits;
+        std::vector<ChargerAllocationState> prev_alloc = alloc_state;
+        uint32_t allocated_current = 0;
+
+        logger.begin_call();
+        int result = allocate_current(&cfg,
+                                      &limits_post_allocation,
+                                      false,
+                                      charger_state.data(),
+                                      hosts.data(),
+                                      get_charger_name,
+                                      notify_charger_unresponsive,
+                                      &ca_state,
+                                      alloc_state.data(),
+                                      &allocated_current);
+        logger.end_call();
+
+        int64_t call_ns = 0;
+        for (size_t i = 0; i < STAGE_COUNT; ++i) {
+            stats.stage_ns[i] += logger.stage_ns[i];
+            call_ns += logger.stage_ns[i];
+        }
+        stats.call_ns.push_back(call_ns);
+        stats.results[std::clamp(result, 0, 3)]++;
+
+        for (size_t p = 0; p < 4; ++p) {
+            stats.allocated_ma[p] += limits.raw[p] - limits_post_allocation.raw[p];
+            if (p > 0 && limits_post_allocation.raw[p] < 0)
+                stats.phase_over_limit++;
+        }
+
+        for (size_t i = 0; i < charger_count; ++i) {
+            const auto &a = alloc_state[i];
+
+            if (a.allocated_phases > 0)
+                stats.active_chargers++;
+            else if (charger_state[i].wants_to_charge)
+                stats.waiting_chargers++;
+
+            if (a.allocated_current != prev_alloc[i].allocated_current || a.allocated_phases != prev_alloc[i].allocated_phases)
+                stats.changes++;
+        }
+
+        sim_now += cfg.allocation_interval;
+    }
+
+    std::vector<int64_t> sorted = stats.call_ns;
+    std::sort(sorted.begin(), sorted.end());
+
+    int64_t total_ns = 0;
+    for (int64_t ns : sorted) {
+        total_ns += ns;
+    }
+
+    double calls = static_cast<double>(steps);
+
+    printf("%-6s %3zu | %7.1f %7.1f %7.1f %7.1f |",
+           s.name,
+           charger_count,
+           static_cast<double>(total_ns) / calls / 1000.0,
+           static_cast<double>(sorted[sorted.size() / 2]) / 1000.0,
+           static_cast<double>(sorted[sorted.size() * 99 / 100]) / 1000.0,
+           static_cast<double>(sorted.back()) / 1000.0);
+
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        printf(" %6.1f", static_cast<double>(stats.stage_ns[i]) / calls / 1000.0);
+    }
+
+    printf(" | %5.1f %5.1f %6.1f %6.1f %6.1f %6.1f %5.2f %4d %4lld\n",
+           static_cast<double>(stats.active_chargers) / calls,
+           static_cast<double>(stats.waiting_chargers) / calls,
+           static_cast<double>(stats.allocated_ma[0]) / calls / 1000.0,
+           static_cast<double>(stats.allocated_ma[1]) / calls / 1000.0,
+           static_cast<double>(stats.allocated_ma[2]) / calls / 1000.0,
+           static_cast<double>(stats.allocated_ma[3]) / calls / 1000.0,
+           static_cast<double>(stats.changes) / calls,
+           stats.results[2],
+           static_cast<long long>(stats.phase_over_limit));
+
+    return stats.phase_over_limit == 0;
+}
+
+int main(int argc, char **argv)
+{
+    int arg = 1;
+
+    if (arg < argc && strcmp(argv[arg], "-v") == 0) {
+        logger.verbose = true;
+        ++arg;
+    }
+
+    if (arg + 1 < argc && strcmp(argv[arg], "-r") == 0) {
+        logger.record_file = fopen(argv[arg + 1], "wb");
+
+        if (logger.record_file == nullptr) {
+            perror(argv[arg + 1]);
+            return 1;
+        }
+
+        fputs("__begin_charge_manager_decisions__\n", logger.record_file);
+        arg += 2;
+    }
+
+    const char *scenario_filter = arg < argc ? argv[arg++] : nullptr;
+    size_t count_filter = arg < argc ? strtoul(argv[arg++], nullptr, 10) : 0;
+    int steps = arg < argc ? atoi(argv[arg++]) : STEPS_DEFAULT;
+
+    if (count_filter > MAX_CONTROLLED_CHARGERS || steps <= 0) {
+        fprintf(stderr, "At most %d chargers and at least one step are supported\n", MAX_CONTROLLED_CHARGERS);
+        return 1;
+    }
+
+    std::vector<size_t> counts = {1, 8, 16, 32, 60, MAX_CONTROLLED_CHARGERS};
+
+    if (count_filter != 0)
+        counts = {count_filter};
+
+    printf("                 latency [us]                |"
+           " stage [us per call]                                                                  |"
+           " chargers     allocated [A]               chg/  err over\n");
+    printf("scen.    n |    mean     p50     p99     max |"
+           "  setup      1      2      3      4      5      6      7      8      9  apply |"
+           " activ wait     sum     L1     L2     L3  call   (2) lim.\n");
+
+    bool ok = true;
+
+    for (const Scenario &s : scenarios) {
+        if (scenario_filter != nullptr && strcmp(scenario_filter, s.name) != 0)
+            continue;
+
+        for (size_t count : counts) {
+            ok &= run(s, count, steps);
+        }
+    }
+
+    if (logger.record_file != nullptr) {
+        fputs("__end_charge_manager_decisions__\n", logger.record_file);
+        fclose(logger.record_file);
+    }
+
+    return ok ? 0 : 1;
+}
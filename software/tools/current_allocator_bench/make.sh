@@ -0,0 +1,2 @@
+#!/bin/sh
+clang++ -std=c++20 -O2 -DBOARD_HAS_PSRAM -I. -- *.cpp tools/*.cpp
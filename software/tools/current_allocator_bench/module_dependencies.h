@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+#include <sys/time.h>
+
+#define MODULE_ENERGY_MANAGER_AVAILABLE() 0
+#define MODULE_EM_V1_AVAILABLE() 0
+#define MODULE_POWER_MANAGER_AVAILABLE() 0
+#define MODULE_EVSE_COMMON_AVAILABLE() 0
+#define MODULE_AUTOMATION_AVAILABLE() 0
+#define MODULE_FIRMWARE_UPDATE_AVAILABLE() 0
+#define MODULE_ECO_AVAILABLE() 0
+
+struct ChargeManager {
+    size_t trace_buffer_index = 0;
+    size_t decision_buffer_index = 1;
+};
+
+// The wall clock follows the simulated time, starting at midnight UTC.
+struct Rtc {
+    bool clock_synced(struct timeval *out_tv_now);
+};
+
+extern ChargeManager charge_manager;
+extern Rtc rtc;
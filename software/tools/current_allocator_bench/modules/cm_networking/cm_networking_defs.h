@@ -0,0 +1 @@
+../../../../src/modules/cm_networking/cm_networking_defs.h
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <type_traits>
+
+// Host replacement for the parts of tools.h and TFTools/Micros.h that the current allocator uses.
+// now_us() returns the simulated time of the benchmark, not the host clock.
+
+template <int64_t US_PER_TICK>
+class Duration
+{
+public:
+    static constexpr int64_t us_per_tick = US_PER_TICK;
+
+    constexpr Duration() : t(0) {}
+    constexpr Duration(int64_t t_) : t(t_) {}
+
+    // Coarser durations convert implicitly, as seconds_t to micros_t does on the device.
+    template <int64_t OTHER, typename = typename std::enable_if<(OTHER > US_PER_TICK) && (OTHER % US_PER_TICK == 0)>::type>
+    constexpr Duration(Duration<OTHER> other) : t(other.t * (OTHER / US_PER_TICK)) {}
+
+    template <typename T>
+    constexpr T as() const { return static_cast<T>(t); }
+
+    template <typename D>
+    constexpr D to() const { return D{t * US_PER_TICK / D::us_per_tick}; }
+
+    constexpr explicit operator int64_t() const { return t; }
+
+    constexpr Duration operator-() const { return Duration{-t}; }
+    Duration &operator+=(Duration other) { t += other.t; return *this; }
+    Duration &operator-=(Duration other) { t -= other.t; return *this; }
+
+    friend constexpr Duration operator+(Duration a, Duration b) { return Duration{a.t + b.t}; }
+    friend constexpr Duration operator-(Duration a, Duration b) { return Duration{a.t - b.t}; }
+    friend constexpr Duration operator*(Duration a, Duration b) { return Duration{a.t * b.t}; }
+    friend constexpr Duration operator%(Duration a, Duration b) { return Duration{a.t % b.t}; }
+    friend constexpr Duration operator/(Duration a, int64_t b) { return Duration{a.t / b}; }
+    friend constexpr bool operator==(Duration a, Duration b) { return a.t == b.t; }
+    friend constexpr bool operator!=(Duration a, Duration b) { return a.t != b.t; }
+    friend constexpr bool operator< (Duration a, Duration b) { return a.t <  b.t; }
+    friend constexpr bool operator<=(Duration a, Duration b) { return a.t <= b.t; }
+    friend constexpr bool operator> (Duration a, Duration b) { return a.t >  b.t; }
+    friend constexpr bool operator>=(Duration a, Duration b) { return a.t >= b.t; }
+
+    int64_t t;
+};
+
+using micros_t  = Duration<1>;
+using millis_t  = Duration<1000>;
+using seconds_t = Duration<1000 * 1000>;
+
+constexpr micros_t  operator""_us(unsigned long long int i) { return micros_t{static_cast<int64_t>(i)}; }
+constexpr millis_t  operator""_ms(unsigned long long int i) { return millis_t{static_cast<int64_t>(i)}; }
+constexpr seconds_t operator""_s (unsigned long long int i) { return seconds_t{static_cast<int64_t>(i)}; }
+constexpr seconds_t operator""_m (unsigned long long int i) { return seconds_t{static_cast<int64_t>(i) * 60}; }
+constexpr seconds_t operator""_h (unsigned long long int i) { return seconds_t{static_cast<int64_t>(i) * 60 * 60}; }
+
+micros_t now_us();
+bool deadline_elapsed(micros_t deadline_us);
+
+// Unchecked snprintf that returns size_t
+[[gnu::format(__printf__, 3, 4)]]
+size_t snprintf_u(char *buf, size_t len, const char *format, ...);
+
+time_t get_localtime_midnight_in_utc(time_t timestamp);
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
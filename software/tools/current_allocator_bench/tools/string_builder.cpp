@@ -0,0 +1 @@
+../../../src/tools/string_builder.cpp
\ No newline at end of file
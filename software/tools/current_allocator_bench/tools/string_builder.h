@@ -0,0 +1 @@
+../../../src/tools/string_builder.h
\ No newline at end of file
@@ -0,0 +1,231 @@
+// Host stress test for the TF_MPSCRingbuffer used by the trace buffers.
+// Several producer threads push records of varying length while a reader thread
+// snapshots the buffer. Every record the reader sees must be complete and each
+// producer's records must appear in the order they were pushed. Every 16th snapshot
+// also clears the buffer; later snapshots must not contain the cleared records again.
+
+#include "mpsc_ringbuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static constexpr size_t PRODUCERS = 8;
+static constexpr uint32_t RECORDS_PER_PRODUCER = 200000;
+
+static void *malloc_host(size_t size)
+{
+    return malloc(size);
+}
+
+static void free_host(void *ptr)
+{
+    free(ptr);
+}
+
+using Ringbuffer = TF_MPSCRingbuffer<malloc_host, free_host>;
+
+static uint32_t checksum(const char *data, size_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619u;
+    }
+
+    return hash;
+}
+
+// "p<producer> s<seq> <payload> c<checksum of everything before ' c'>\n"
+static size_t format_record(char *buf, size_t buf_len, uint32_t producer, uint32_t seq)
+{
+    int written = snprintf(buf, buf_len, "p%u s%u ", producer, seq);
+    size_t len = static_cast<size_t>(written);
+    size_t payload_len = (seq * 7 + producer * 13) % 300;
+
+    for (size_t i = 0; i < payload_len; ++i) {
+        buf[len++] = static_cast<char>('a' + (seq + i) % 26);
+    }
+
+    uint32_t sum = checksum(buf, len);
+    written = snprintf(buf + len, buf_len - len, " c%08x\n", sum);
+
+    return len + static_cast<size_t>(written);
+}
+
+struct Stats {
+    uint64_t snapshots = 0;
+    uint64_t records = 0;
+    uint64_t overwritten_blocks = 0;
+    uint64_t busy_retries = 0;
+    uint64_t clears = 0;
+    uint64_t errors = 0;
+    std::vector<int64_t> cleared_seq = std::vector<int64_t>(PRODUCERS, -1);
+};
+
+static bool check_record(const std::string &line, uint32_t *producer, uint32_t *seq)
+{
+    size_t sum_pos = line.rfind(" c");
+
+    if (sum_pos == std::string::npos || line.size() != sum_pos + 10)
+        return false;
+
+    if (sscanf(line.c_str(), "p%u s%u ", producer, seq) != 2 || *producer >= PRODUCERS)
+        return false;
+
+    char expected[16];
+    snprintf(expected, sizeof(expected), " c%08x", checksum(line.data(), sum_pos));
+
+    if (line.compare(sum_pos, std::string::npos, expected) != 0)
+        return false;
+
+    char buf[512];
+    size_t len = format_record(buf, sizeof(buf), *producer, *seq);
+
+    return line.size() + 1 == len && line.compare(0, std::string::npos, buf, len - 1) == 0;
+}
+
+static void read_snapshot(Ringbuffer &rb, Stats *stats, bool clear)
+{
+    std::vector<int64_t> last_seq(PRODUCERS, -1);
+    Ringbuffer::Snapshot snapshot = clear ? rb.snapshot_and_clear() : rb.snapshot();
+
+    for (size_t i = 0; i < rb.readable_blocks(); ++i) {
+        Ringbuffer::Chunk chunk;
+
+        while (!rb.get_block(snapshot, i, &chunk)) {
+            ++stats->busy_retries;
+            std::this_thread::yield();
+        }
+
+        std::string data{chunk.data, chunk.len};
+
+        if (!rb.is_unchanged(chunk)) {
+            ++stats->overwritten_blocks;
+            continue;
+        }
+
+        size_t start = 0;
+
+        while (start < data.size()) {
+            size_t end = data.find('\n', start);
+
+            if (end == std::string::npos) {
+                fprintf(stderr, "Block %u ends with an incomplete record\n", chunk.block);
+                ++stats->errors;
+                break;
+            }
+
+            std::string line = data.substr(start, end - start);
+            uint32_t producer, seq;
+
+            if (!check_record(line, &producer, &seq)) {
+                fprintf(stderr, "Torn record in block %u: '%s'\n", chunk.block, line.c_str());
+                ++stats->errors;
+            } else if (static_cast<int64_t>(seq) <= last_seq[producer]) {
+                fprintf(stderr, "Record p%u s%u out of order\n", producer, seq);
+                ++stats->errors;
+            } else if (static_cast<int64_t>(seq) <= stats->cleared_seq[producer]) {
+                fprintf(stderr, "Record p%u s%u was already cleared\n", producer, seq);
+                ++stats->errors;
+            } else {
+                last_seq[producer] = seq;
+                ++stats->records;
+            }
+
+            start = end + 1;
+        }
+    }
+
+    if (clear) {
+        for (size_t p = 0; p < PRODUCERS; ++p) {
+            stats->cleared_seq[p] = std::max(stats->cleared_seq[p], last_seq[p]);
+        }
+
+        ++stats->clears;
+    }
+
+    ++stats->snapshots;
+}
+
+static bool run(size_t size)
+{
+    Ringbuffer rb;
+
+    if (!rb.setup(size)) {
+        fprintf(stderr, "Setup with size %zu failed\n", size);
+        return false;
+    }
+
+    std::atomic<size_t> producers_running{PRODUCERS};
+    std::atomic<uint64_t> pushed{0};
+    std::vector<std::thread> producers;
+    Stats stats;
+
+    std::thread reader{[&rb, &producers_running, &stats]() {
+        while (producers_running.load() > 0) {
+            read_snapshot(rb, &stats, stats.snapshots % 16 == 15);
+        }
+    }};
+
+    for (uint32_t p = 0; p < PRODUCERS; ++p) {
+        producers.emplace_back([&rb, &producers_running, &pushed, p]() {
+            char buf[512];
+            uint64_t ok = 0;
+
+            for (uint32_t seq = 0; seq < RECORDS_PER_PRODUCER; ++seq) {
+                size_t len = format_record(buf, sizeof(buf), p, seq);
+                ok += rb.push(buf, len);
+
+                if (seq % 64 == 0)
+                    std::this_thread::yield();
+            }
+
+            pushed += ok;
+            --producers_running;
+        });
+    }
+
+    for (std::thread &t : producers) {
+        t.join();
+    }
+
+    reader.join();
+
+    // Nothing is written anymore: The final snapshot must be complete.
+    Stats final_stats;
+    final_stats.cleared_seq = stats.cleared_seq;
+    read_snapshot(rb, &final_stats, false);
+
+    uint64_t total = static_cast<uint64_t>(PRODUCERS) * RECORDS_PER_PRODUCER;
+    bool ok = stats.errors == 0 && final_stats.errors == 0 && final_stats.overwritten_blocks == 0 && pushed + rb.dropped_count() == total;
+
+    printf("%8zu bytes: %9llu pushed %7u dropped %6llu snapshots %10llu records read %5llu overwritten blocks %7llu busy retries %5llu clears %4llu errors -> %s\n",
+           size,
+           static_cast<unsigned long long>(pushed.load()),
+           rb.dropped_count(),
+           static_cast<unsigned long long>(stats.snapshots),
+           static_cast<unsigned long long>(stats.records + final_stats.records),
+           static_cast<unsigned long long>(stats.overwritten_blocks),
+           static_cast<unsigned long long>(stats.busy_retries),
+           static_cast<unsigned long long>(stats.clears),
+           static_cast<unsigned long long>(stats.errors + final_stats.errors),
+           ok ? "OK" : "FAILED");
+
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+
+    ok &= run(8192);
+    ok &= run(1 << 16);
+    ok &= run(1 << 20);
+
+    return ok ? 0 : 1;
+}
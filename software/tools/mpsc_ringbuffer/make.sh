@@ -0,0 +1,2 @@
+#!/bin/sh
+clang++ -std=c++20 -O2 -pthread -- *.cpp
@@ -0,0 +1 @@
+../../src/tools/mpsc_ringbuffer.h
\ No newline at end of file
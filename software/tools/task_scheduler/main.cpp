@@ -0,0 +1,221 @@
+// Host benchmark for the TaskQueue used by the TaskScheduler.
+// Compares it against the previous std::priority_queue based queue with a workload
+// similar to the energy manager's: a few hundred periodic tasks plus one-shot tasks
+// of which some are cancelled before they run.
+
+#include "task_queue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+static constexpr size_t PERIODIC_TASKS = 300;
+static constexpr size_t ONCE_TASKS_PER_RUN = 4;
+static constexpr int64_t SIMULATED_US = 10ll * 60 * 1000 * 1000;
+
+struct Task {
+    std::function<void(void)> fn;
+    uint64_t task_id = 0;
+    int64_t next_deadline;
+    int64_t delay;
+    uint32_t heap_pos;
+    bool once;
+};
+
+// The previous implementation: Heap allocated tasks in a priority queue, linear cancel.
+static bool compare(const std::unique_ptr<Task> &a, const std::unique_ptr<Task> &b)
+{
+    return a->next_deadline >= b->next_deadline;
+}
+
+class LegacyQueue : public std::priority_queue<std::unique_ptr<Task>, std::vector<std::unique_ptr<Task>>, decltype(&compare)>
+{
+public:
+    LegacyQueue() : priority_queue(&compare) {}
+
+    bool removeByTaskID(uint64_t task_id)
+    {
+        auto it = std::find_if(this->c.begin(), this->c.end(), [task_id](const std::unique_ptr<Task> &t){return t->task_id == task_id;});
+
+        if (it == this->c.end())
+            return false;
+
+        this->c.erase(it);
+        std::make_heap(this->c.begin(), this->c.end(), this->comp);
+        return true;
+    }
+
+    std::unique_ptr<Task> top_and_pop()
+    {
+        std::pop_heap(c.begin(), c.end(), comp);
+        std::unique_ptr<Task> value = std::move(c.back());
+        c.pop_back();
+        return value;
+    }
+};
+
+struct Stats {
+    uint64_t runs = 0;
+    uint64_t cancels = 0;
+    uint64_t checksum = 0;
+};
+
+static std::vector<int64_t> periodic_delays()
+{
+    std::mt19937 rng{1234};
+    std::uniform_int_distribution<int> dist{0, 5};
+    const int64_t delays[] = {100'000, 250'000, 500'000, 1'000'000, 5'000'000, 60'000'000};
+
+    std::vector<int64_t> result;
+    for (size_t i = 0; i < PERIODIC_TASKS; ++i) {
+        result.push_back(delays[dist(rng)]);
+    }
+
+    return result;
+}
+
+static Stats run_legacy(const std::vector<int64_t> &delays)
+{
+    LegacyQueue tasks;
+    Stats stats;
+    uint64_t last_task_id = 0;
+    std::vector<uint64_t> to_cancel;
+
+    for (int64_t delay : delays) {
+        auto task = std::make_unique<Task>();
+        task->fn = [&stats, delay]() {stats.checksum += delay;};
+        task->task_id = ++last_task_id;
+        task->next_deadline = delay;
+        task->delay = delay;
+        task->once = false;
+        tasks.push(std::move(task));
+    }
+
+    while (!tasks.empty() && tasks.top()->next_deadline < SIMULATED_US) {
+        std::unique_ptr<Task> task = tasks.top_and_pop();
+        int64_t now = task->next_deadline;
+
+        task->fn();
+        ++stats.runs;
+
+        if (!task->once) {
+            // Like an await() with timeout: Schedule one-shot tasks, cancel every other one.
+            for (size_t i = 0; i < ONCE_TASKS_PER_RUN; ++i) {
+                auto once = std::make_unique<Task>();
+                once->fn = [&stats]() {stats.checksum += 1;};
+                once->task_id = ++last_task_id;
+                once->next_deadline = now + 1000 * static_cast<int64_t>(i + 1);
+                once->delay = 0;
+                once->once = true;
+
+                if (i % 2 == 0)
+                    to_cancel.push_back(once->task_id);
+
+                tasks.push(std::move(once));
+            }
+
+            for (uint64_t task_id : to_cancel) {
+                stats.cancels += tasks.removeByTaskID(task_id);
+            }
+            to_cancel.clear();
+
+            task->next_deadline = now + task->delay;
+            tasks.push(std::move(task));
+        }
+    }
+
+    return stats;
+}
+
+static Stats run_pooled(const std::vector<int64_t> &delays)
+{
+    TaskQueue<Task> tasks;
+    Stats stats;
+    std::vector<uint64_t> to_cancel;
+
+    for (int64_t delay : delays) {
+        Task *task = tasks.alloc();
+        task->fn = [&stats, delay]() {stats.checksum += delay;};
+        task->next_deadline = delay;
+        task->delay = delay;
+        task->once = false;
+        tasks.push(task);
+    }
+
+    while (!tasks.empty() && tasks.top()->next_deadline < SIMULATED_US) {
+        Task *task = tasks.pop();
+        int64_t now = task->next_deadline;
+
+        task->fn();
+        ++stats.runs;
+
+        if (task->once) {
+            task->fn = nullptr;
+            tasks.release(task);
+            continue;
+        }
+
+        for (size_t i = 0; i < ONCE_TASKS_PER_RUN; ++i) {
+            Task *once = tasks.alloc();
+            once->fn = [&stats]() {stats.checksum += 1;};
+            once->next_deadline = now + 1000 * static_cast<int64_t>(i + 1);
+            once->delay = 0;
+            once->once = true;
+
+            if (i % 2 == 0)
+                to_cancel.push_back(once->task_id);
+
+            tasks.push(once);
+        }
+
+        for (uint64_t task_id : to_cancel) {
+            Task *cancelled = tasks.find(task_id);
+            if (cancelled == nullptr || !TaskQueue<Task>::is_queued(cancelled))
+                continue;
+
+            tasks.remove(cancelled);
+            cancelled->fn = nullptr;
+            tasks.release(cancelled);
+            ++stats.cancels;
+        }
+        to_cancel.clear();
+
+        task->next_deadline = now + task->delay;
+        tasks.push(task);
+    }
+
+    return stats;
+}
+
+template<typename F>
+static void bench(const char *name, F &&fn, const std::vector<int64_t> &delays)
+{
+    auto start = std::chrono::steady_clock::now();
+    Stats stats = fn(delays);
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+
+    printf("%-8s %9llu runs %9llu cancels %8.1f ms %7.1f ns/run (checksum %llu)\n",
+           name,
+           static_cast<unsigned long long>(stats.runs),
+           static_cast<unsigned long long>(stats.cancels),
+           ns / 1e6,
+           ns / static_cast<double>(stats.runs),
+           static_cast<unsigned long long>(stats.checksum));
+}
+
+int main()
+{
+    std::vector<int64_t> delays = periodic_delays();
+
+    bench("legacy", run_legacy, delays);
+    bench("pooled", run_pooled, delays);
+
+    return 0;
+}
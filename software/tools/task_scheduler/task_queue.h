@@ -0,0 +1 @@
+../../src/modules/task_scheduler/task_queue.h
\ No newline at end of file
@@ -14,6 +14,9 @@ import threading
 import time
 
 app = Flask(__name__)
+# Accept the binary subprotocol requested by the web interface. Browsers refuse the connection otherwise.
+# Only text frames are forwarded, which the web interface handles as well.
+app.config['SOCK_SERVER_OPTIONS'] = {'subprotocols': ['tf-binary-v1']}
 sock = Sock(app)
 host = None
 
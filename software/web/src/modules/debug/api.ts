@@ -65,3 +65,22 @@ interface task_hwm {
 }
 
 export type state_hwm = task_hwm[];
+
+interface task_profile_entry {
+    file: string;
+    line: number;
+    runs: number;
+    runtime_max_us: number;
+    runtime_total_us: number;
+    lateness: number[];
+}
+
+export interface task_profile {
+    enabled: boolean;
+    profiles: number;
+    tasks: task_profile_entry[];
+}
+
+export interface task_profile_update {
+    enabled: boolean;
+}
@@ -72,6 +72,38 @@ export function update<T extends keyof ConfigMap>(topic: T, payload: ConfigMap[T
         update_cache_item(api_cache[topic], payload);
 }
 
+// Applies [json_pointer, value] pairs sent by a WebSocket with delta updates enabled.
+// Returns false if a pointer does not match the cached state. A full snapshot is required in that case.
+export function update_partial(topic: string, patch: [string, any][]): boolean {
+    for (let [pointer, value] of patch) {
+        if (pointer == "") {
+            update(topic as keyof ConfigMap, value);
+            continue;
+        }
+
+        let parent: any = api_cache[topic as keyof ConfigMap];
+        let keys = pointer.split("/").slice(1);
+        let last_key = keys.pop();
+
+        for (let key of keys) {
+            if (is_primitive(parent) || !(key in parent))
+                return false;
+
+            parent = parent[key];
+        }
+
+        if (is_primitive(parent) || !(last_key in parent))
+            return false;
+
+        if (is_primitive(parent[last_key]) || is_primitive(value))
+            parent[last_key] = value;
+        else
+            update_cache_item(parent[last_key], value);
+    }
+
+    return true;
+}
+
 export function get<T extends keyof ConfigMap>(topic: T) : Readonly<ConfigMap[T]> {
     // This should be unnecessary, but putting a tuple in a DeepSignal seems to drop
     // the tuple's type information. Typescript then thinks the tuple is an array.
@@ -299,6 +299,36 @@ function iFrameSocketInit(first: boolean, keep_as_first: boolean, continuation:
 
 // Copy of keep_as_first parameter of setupEventSource
 let k_a_f: boolean;
+
+// Set after requesting the full state until it is received.
+let awaiting_resync = false;
+
+// Negotiated with the firmware to receive float arrays (for example meter values) as binary frames.
+const WS_BINARY_SUBPROTOCOL = "tf-binary-v1";
+const WS_BINARY_FRAME_TYPE_FLOAT_ARRAY = 1;
+
+function wsOnBinaryMessage(data: ArrayBuffer) {
+    let bytes = new Uint8Array(data);
+
+    if (bytes.length < 2 || bytes[0] != WS_BINARY_FRAME_TYPE_FLOAT_ARRAY) {
+        console.log("Received malformed binary event", bytes);
+        return;
+    }
+
+    let path_len = bytes[1];
+    let topic = new TextDecoder().decode(bytes.subarray(2, 2 + path_len));
+    // Values are aligned to four bytes.
+    let values_offset = (2 + path_len + 3) & ~3;
+    // JSON updates send NaN as null.
+    let values = Array.from(new Float32Array(data, values_offset), (v) => isNaN(v) ? null : v);
+
+    batch(() => {
+        API.update(topic as any, values as any);
+
+        if (allow_render.peek())
+            API.trigger_unchecked(topic, eventTarget);
+    });
+}
 const wsOnMessageCallback = (e: MessageEvent) => {
     if(!k_a_f)
         remove_alert("event_connection_lost");
@@ -309,21 +339,44 @@ const wsOnMessageCallback = (e: MessageEvent) => {
     }
     wsReconnectTimeout = window.setTimeout(wsReconnectCallback, RECONNECT_TIME);
 
+    if (e.data instanceof ArrayBuffer) {
+        wsOnBinaryMessage(e.data);
+        return;
+    }
+
     let topics: any[] = [];
+    let need_resync = false;
 
     let end_marker_found = (e.data as string).includes("\n\n");
     let messages = (e.data as string).trim();
 
+    // The full state ends with the end marker.
+    if (end_marker_found)
+        awaiting_resync = false;
+
     batch(() => {
         for (let item of messages.split("\n")) {
             let obj = JSON.parse(item);
-            if (!("topic" in obj) || !("payload" in obj)) {
+            if (!("topic" in obj) || (!("payload" in obj) && !("patch" in obj))) {
                 console.log("Received malformed event", obj);
                 return;
             }
 
+            if ("patch" in obj) {
+                // Patches sent before the full state can't be applied to the cached state.
+                if (awaiting_resync)
+                    continue;
+
+                if (!API.update_partial(obj["topic"], obj["patch"])) {
+                    console.log("Delta update for " + obj["topic"] + " does not match cached state. Requesting full state.");
+                    need_resync = true;
+                    continue;
+                }
+            } else {
+                API.update(obj["topic"], obj["payload"]);
+            }
+
             topics.push(obj["topic"]);
-            API.update(obj["topic"], obj["payload"]);
         }
 
         if (allow_render.peek()) {
@@ -337,6 +390,12 @@ const wsOnMessageCallback = (e: MessageEvent) => {
             allow_render.value = true;
         }
     });
+
+    // The firmware answers with the full state. Request it once, even if multiple patches did not match.
+    if (need_resync && ws != null) {
+        ws.send("resync");
+        awaiting_resync = true;
+    }
 };
 
 export function setupEventSource(first: boolean, keep_as_first: boolean, continuation: (ws: WebSocket, eventTarget: API.APIEventTarget) => void, isIframe?: boolean) {
@@ -362,7 +421,10 @@ export function setupEventSource(first: boolean, keep_as_first: boolean, continu
         ws.close();
         ws = null;
     }
-    ws = new WebSocket((location.protocol == 'https:' ? 'wss://' : 'ws://') + location.host + '/ws');
+    // A new connection starts with the full state.
+    awaiting_resync = false;
+    ws = new WebSocket((location.protocol == 'https:' ? 'wss://' : 'ws://') + location.host + '/ws?delta=1', WS_BINARY_SUBPROTOCOL);
+    ws.binaryType = "arraybuffer";
 
     if (wsReconnectTimeout != null) {
         clearTimeout(wsReconnectTimeout);